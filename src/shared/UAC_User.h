@@ -44,6 +44,9 @@ Environment:
 #define UAC_DEFAULT_OUT_HUB_OFFSET               0
 #define UAC_DEFAULT_DROPOUT_DETECTION            1
 #define UAC_DEFAULT_BUFFER_THREAD_PRIORITY       30
+#define UAC_DEFAULT_SAMPLE_RATE_WINDOW_MS        1000
+#define UAC_MIN_SAMPLE_RATE_WINDOW_MS            8
+#define UAC_MAX_SAMPLE_RATE_WINDOW_MS            1000
 
 #if defined(_M_ARM64EC) || defined(_M_ARM64)
 #define UAC_DEFAULT_CLASSIC_FRAMES_PER_IRP      4
@@ -93,6 +96,7 @@ enum class DeviceStatuses
     ClockSourceChanged = 1 << 2, //  UAC_DEVICE_STATUS_CLOCK_SOURCE_CHANGED 0x00000004
     OverloadDetected = 1 << 3,   //  UAC_DEVICE_STATUS_OVERLOAD_DETECTED    0x00000008
     LatencyChanged = 1 << 4,     //  UAC_DEVICE_STATUS_LATENCY_CHANGED      0x00000010
+    OverloadPredicted = 1 << 5,  //  UAC_DEVICE_STATUS_OVERLOAD_PREDICTED   0x00000020
 };
 
 constexpr int toInt(DeviceStatuses Status)
@@ -118,7 +122,9 @@ enum class KsPropertyUACLowLatencyAudio
     StopAsioStream,
     SetAsioBuffer,
     UnsetAsioBuffer,
-    ReleaseAsioOwnership
+    ReleaseAsioOwnership,
+    GetStatistics,
+    GetEventTrace
 };
 
 constexpr int toInt(KsPropertyUACLowLatencyAudio Property)
@@ -274,7 +280,7 @@ typedef struct UAC_SET_FLAGS_CONTEXT_
     ULONG BufferThreadPriority;
     ULONG ClassicFramesPerIrp2;
     ULONG SuggestedBufferPeriod;
-    ULONG Reserved2;
+    ULONG SampleRateWindowMs; // 0 for UAC_DEFAULT_SAMPLE_RATE_WINDOW_MS
 } UAC_SET_FLAGS_CONTEXT, *PUAC_SET_FLAGS_CONTEXT;
 
 typedef struct UAC_ASIO_PLAY_BUFFER_HEADER_
@@ -329,6 +335,124 @@ typedef struct UAC_ASIO_REC_BUFFER_HEADER_
     __declspec(align(4)) LONG      AsioProcessStart;
     __declspec(align(4)) LONG      AsioProcessComplete;
     LONG                           Reserved;
+    __declspec(align(8)) ULONGLONG InputMeasuredSampleRate;  // Sample rate measured over the sliding window, Q16.16 Hz, 0 if not measured yet
+    __declspec(align(8)) ULONGLONG OutputMeasuredSampleRate; // Sample rate measured over the sliding window, Q16.16 Hz, 0 if not measured yet
+    __declspec(align(4)) ULONG     InputOffsetFrame;         // Input buffer operation offset chosen by the auto tuner, in packets, 0 if not tuned
+    __declspec(align(4)) ULONG     OutputOffsetFrame;        // Output buffer operation offset chosen by the auto tuner, in packets, 0 if not tuned
 } UAC_ASIO_REC_BUFFER_HEADER, *PUAC_ASIO_REC_BUFFER_HEADER;
 
+// Log-linear latency histogram, values in microseconds.
+// Values below 2^UAC_LATENCY_HISTOGRAM_SUB_BUCKET_BITS have a bucket each. Above that,
+// each power of two is divided into 2^UAC_LATENCY_HISTOGRAM_SUB_BUCKET_BITS buckets, so
+// the relative error of a bucket is below 25%. The last bucket also counts larger values.
+#define UAC_LATENCY_HISTOGRAM_SUB_BUCKET_BITS 2
+#define UAC_LATENCY_HISTOGRAM_BUCKETS         80
+
+enum class UACLatencyHistogram : ULONG
+{
+    WakeupInterval = 0, // Time between two wakeups of the mixing engine thread
+    DpcToThread,        // Time from the last isochronous completion to the wakeup
+    ClientProcessing,   // Time from the ASIO notification to OutputReady
+    AsioNotifyPeriod,   // Time between two ASIO notifications
+    CaptureProcessing,  // Time spent on the input packets in one wakeup
+    RenderProcessing,   // Time spent on the output packets in one wakeup, on the render thread if it is split
+    Count
+};
+
+constexpr ULONG toULong(UACLatencyHistogram histogram)
+{
+    return static_cast<ULONG>(histogram);
+}
+
+typedef struct UAC_LATENCY_HISTOGRAM_
+{
+    ULONGLONG Count;
+    ULONGLONG SumUs;
+    ULONG     MaxUs;
+    ULONG     Reserved;
+    ULONG     Buckets[UAC_LATENCY_HISTOGRAM_BUCKETS];
+} UAC_LATENCY_HISTOGRAM, *PUAC_LATENCY_HISTOGRAM;
+
+// State of the overload predictor of one signal, values in microseconds.
+// The prediction is the larger of TailUs and AverageUs + 3 * DeviationUs. Warning is set
+// while the prediction is above 85% of BudgetUs, and cleared below 70%.
+enum class UACOverloadSignal : ULONG
+{
+    ClientProcessing = 0, // Time from the ASIO notification to OutputReady, budget is the dropout threshold
+    DpcLateness,          // Time from the last isochronous completion to the wakeup, budget is the dropout threshold
+    Count
+};
+
+constexpr ULONG toULong(UACOverloadSignal signal)
+{
+    return static_cast<ULONG>(signal);
+}
+
+typedef struct UAC_OVERLOAD_PREDICTION_
+{
+    ULONGLONG Samples;
+    ULONGLONG Warnings;    // Number of times Warning was set
+    LONG      AverageUs;   // Exponentially weighted moving average
+    LONG      DeviationUs; // Exponentially weighted mean absolute deviation
+    LONG      TailUs;      // Estimated 98th percentile
+    LONG      BudgetUs;    // Dropout threshold of the last sample
+    ULONG     Warning;
+    ULONG     Reserved;
+} UAC_OVERLOAD_PREDICTION, *PUAC_OVERLOAD_PREDICTION;
+
+typedef struct UAC_STATISTICS_
+{
+    ULONG                   Length; // sizeof(UAC_STATISTICS)
+    ULONG                   SubBucketBits;
+    ULONG                   Buckets;
+    ULONG                   Histograms;
+    UAC_LATENCY_HISTOGRAM   Histogram[toULong(UACLatencyHistogram::Count)];
+    UAC_OVERLOAD_PREDICTION Prediction[toULong(UACOverloadSignal::Count)];
+} UAC_STATISTICS, *PUAC_STATISTICS;
+
+// Binary event trace of the stream hot paths.
+// Timestamp is the raw performance counter, converted to time with Frequency.
+// Payload meaning depends on EventId and is listed next to each id.
+#define UAC_EVENT_TRACE_RECORDS 1024
+
+enum class UACEventId : USHORT
+{
+    None = 0,           // the record was overwritten while it was read
+    MixingEngineWakeUp, // wakeup reason, process io, stream status
+    OutUrbInitialized,  // start frame, transfer bytes, number of packets, read position (samples, low 32 bits)
+    OutCompensated,     // start frame, packet, samples, +1 or -1
+    OutCompensateTotal, // compensated samples
+    OutTransferLimited, // required samples, limit samples
+    OutAbnormalPacket,  // start frame, packet, samples
+    OutPacketDropped,   // start frame, packet, transfer bytes, limit bytes
+    OutSyncStarted,     // start frame
+    FeedbackLockDelay,  // start frame, packet, feedback value
+    RtPacketCopy,       // device index, RtPacket index, offset in RtPacket, frames
+    RtPacketNext,       // device index, RtPacket index
+};
+
+constexpr USHORT toUShort(UACEventId eventId)
+{
+    return static_cast<USHORT>(eventId);
+}
+
+typedef struct UAC_EVENT_RECORD_
+{
+    ULONGLONG Timestamp;
+    ULONG     Sequence; // low 32 bits of the record number + 1, 0 while the record is written
+    USHORT    EventId;
+    USHORT    Processor;
+    LONG      Payload[4];
+} UAC_EVENT_RECORD, *PUAC_EVENT_RECORD;
+
+typedef struct UAC_EVENT_TRACE_
+{
+    ULONG            Length;      // sizeof(UAC_EVENT_TRACE)
+    ULONG            Records;     // number of valid entries in Record
+    ULONGLONG        Frequency;   // performance counter frequency
+    ULONGLONG        FirstRecord; // record number of Record[0]
+    ULONGLONG        Lost;        // records overwritten before they were read, since the previous call
+    UAC_EVENT_RECORD Record[UAC_EVENT_TRACE_RECORDS];
+} UAC_EVENT_TRACE, *PUAC_EVENT_TRACE;
+
 #endif
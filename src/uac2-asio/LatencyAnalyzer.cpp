@@ -0,0 +1,323 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    LatencyAnalyzer.cpp
+
+Abstract:
+
+    This file implements a class that measures the round trip latency of a
+    loopback connection with a maximum length sequence.
+
+Environment:
+
+    ASIO Driver
+
+--*/
+
+#include "LatencyAnalyzer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+const double c_pi = 3.14159265358979323846;
+
+// The interpolated peak is searched in steps of 1 / (2 * c_fractionSteps) sample.
+const int c_fractionSteps = 64;
+const int c_interpolationTaps = 16;
+
+// Taps of a maximal length Fibonacci LFSR for each supported order.
+struct MLS_TAPS
+{
+    uint32_t Order;
+    uint32_t Taps[4];
+};
+
+const MLS_TAPS c_mlsTaps[] = {
+    {10, {10, 7, 0, 0}},
+    {11, {11, 9, 0, 0}},
+    {12, {12, 11, 10, 4}},
+    {13, {13, 12, 11, 8}},
+    {14, {14, 13, 12, 2}},
+    {15, {15, 14, 0, 0}},
+    {16, {16, 14, 13, 11}},
+    {17, {17, 14, 0, 0}},
+    {18, {18, 11, 0, 0}},
+};
+} // namespace
+
+void LatencyAnalyzer::Start(
+    uint32_t mlsOrder,
+    uint32_t settleSamples,
+    uint32_t maxDelaySamples,
+    float    amplitude
+)
+{
+    m_state = State::Idle;
+    GenerateMls(mlsOrder, amplitude, m_stimulus);
+    m_response.assign(m_stimulus.size() + maxDelaySamples, 0.0f);
+    m_position = 0;
+    m_settleSamples = settleSamples;
+    m_maxDelaySamples = maxDelaySamples;
+    if (!m_stimulus.empty())
+    {
+        m_state = State::Running;
+    }
+}
+
+void LatencyAnalyzer::Reset()
+{
+    m_state = State::Idle;
+}
+
+LatencyAnalyzer::State LatencyAnalyzer::GetState() const
+{
+    return m_state;
+}
+
+void LatencyAnalyzer::ProcessBlock(
+    const float * input,
+    float *       output,
+    uint32_t      frames
+)
+{
+    if (m_state != State::Running)
+    {
+        return;
+    }
+
+    for (uint32_t frame = 0; frame < frames; ++frame, ++m_position)
+    {
+        float stimulus = 0.0f;
+        if (m_position >= m_settleSamples)
+        {
+            uint64_t offset = m_position - m_settleSamples;
+            if (offset < m_stimulus.size())
+            {
+                stimulus = m_stimulus[(size_t)offset];
+            }
+            if (offset < m_response.size())
+            {
+                m_response[(size_t)offset] = input[frame];
+            }
+        }
+        output[frame] = stimulus;
+    }
+
+    if (m_position >= (uint64_t)m_settleSamples + m_response.size())
+    {
+        m_state = State::Completed;
+    }
+}
+
+bool LatencyAnalyzer::Analyze(
+    double & delaySamples,
+    double & peakToNoise
+) const
+{
+    if (m_state != State::Completed)
+    {
+        return false;
+    }
+
+    return CrossCorrelate(m_stimulus, m_response, delaySamples, peakToNoise) && (peakToNoise >= c_minPeakToNoise);
+}
+
+void LatencyAnalyzer::GenerateMls(
+    uint32_t             order,
+    float                amplitude,
+    std::vector<float> & sequence
+)
+{
+    sequence.clear();
+
+    const MLS_TAPS * taps = nullptr;
+    for (const MLS_TAPS & entry : c_mlsTaps)
+    {
+        if (entry.Order == order)
+        {
+            taps = &entry;
+            break;
+        }
+    }
+    if (taps == nullptr)
+    {
+        return;
+    }
+
+    const uint32_t length = (1U << order) - 1;
+    uint32_t       lfsr = 1;
+
+    sequence.reserve(length);
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        sequence.push_back((lfsr & 1) ? amplitude : -amplitude);
+
+        uint32_t bit = 0;
+        for (uint32_t tap : taps->Taps)
+        {
+            if (tap != 0)
+            {
+                bit ^= (lfsr >> (order - tap)) & 1;
+            }
+        }
+        lfsr = (lfsr >> 1) | (bit << (order - 1));
+    }
+}
+
+bool LatencyAnalyzer::CrossCorrelate(
+    const std::vector<float> & stimulus,
+    const std::vector<float> & response,
+    double &                   delaySamples,
+    double &                   peakToNoise
+)
+{
+    delaySamples = 0.0;
+    peakToNoise = 0.0;
+
+    if (stimulus.empty() || response.size() < stimulus.size())
+    {
+        return false;
+    }
+
+    // Zero padding to the sum of the lengths makes the circular correlation linear.
+    size_t fftLength = 1;
+    while (fftLength < stimulus.size() + response.size())
+    {
+        fftLength <<= 1;
+    }
+
+    std::vector<std::complex<double>> stimulusSpectrum(fftLength);
+    std::vector<std::complex<double>> responseSpectrum(fftLength);
+    std::copy(stimulus.begin(), stimulus.end(), stimulusSpectrum.begin());
+    std::copy(response.begin(), response.end(), responseSpectrum.begin());
+
+    Fft(stimulusSpectrum, false);
+    Fft(responseSpectrum, false);
+    for (size_t i = 0; i < fftLength; ++i)
+    {
+        responseSpectrum[i] *= std::conj(stimulusSpectrum[i]);
+    }
+    Fft(responseSpectrum, true);
+
+    // correlation[lag] = sum(response[n + lag] * stimulus[n])
+    const size_t lags = response.size() - stimulus.size() + 1;
+    size_t       peakLag = 0;
+    double       peak = 0.0;
+    double       energy = 0.0;
+    for (size_t lag = 0; lag < lags; ++lag)
+    {
+        double value = std::abs(responseSpectrum[lag].real());
+        energy += value * value;
+        if (value > peak)
+        {
+            peak = value;
+            peakLag = lag;
+        }
+    }
+    if (peak <= 0.0)
+    {
+        return false;
+    }
+
+    // The noise floor excludes the peak and its neighbors.
+    double peakEnergy = 0.0;
+    size_t peakWidth = 0;
+    for (size_t lag = (peakLag > 2 ? peakLag - 2 : 0); lag <= std::min(peakLag + 2, lags - 1); ++lag)
+    {
+        double value = responseSpectrum[lag].real();
+        peakEnergy += value * value;
+        ++peakWidth;
+    }
+    double noiseRms = (lags > peakWidth) ? std::sqrt(std::max(energy - peakEnergy, 0.0) / (double)(lags - peakWidth)) : 0.0;
+    peakToNoise = (noiseRms > 0.0) ? (peak / noiseRms) : peak;
+
+    // The correlation of a band limited loopback is a sampled sinc, so the peak is searched
+    // between the neighbors of peakLag on a grid interpolated with a windowed sinc.
+    const double sign = (responseSpectrum[peakLag].real() < 0.0) ? -1.0 : 1.0;
+    double       offset = 0.0;
+    double       finePeak = peak;
+    for (int step = -c_fractionSteps; step <= c_fractionSteps; ++step)
+    {
+        double fraction = (double)step / (double)(2 * c_fractionSteps);
+        double value = 0.0;
+        for (int tap = -c_interpolationTaps; tap <= c_interpolationTaps; ++tap)
+        {
+            int64_t lag = (int64_t)peakLag + tap;
+            if ((lag < 0) || (lag >= (int64_t)lags))
+            {
+                continue;
+            }
+            double x = fraction - (double)tap;
+            double sinc = (x == 0.0) ? 1.0 : std::sin(c_pi * x) / (c_pi * x);
+            double window = 0.5 + 0.5 * std::cos(c_pi * x / (double)(c_interpolationTaps + 1));
+            value += responseSpectrum[(size_t)lag].real() * sinc * window;
+        }
+        value *= sign;
+        if (value > finePeak)
+        {
+            finePeak = value;
+            offset = fraction;
+        }
+    }
+    delaySamples = (double)peakLag + offset;
+
+    return true;
+}
+
+void LatencyAnalyzer::Fft(
+    std::vector<std::complex<double>> & data,
+    bool                                inverse
+)
+{
+    const size_t length = data.size();
+
+    for (size_t i = 1, j = 0; i < length; ++i)
+    {
+        size_t bit = length >> 1;
+        for (; (j & bit) != 0; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(data[i], data[j]);
+        }
+    }
+
+    for (size_t span = 2; span <= length; span <<= 1)
+    {
+        double               angle = (inverse ? 2.0 : -2.0) * c_pi / (double)span;
+        std::complex<double> step(std::cos(angle), std::sin(angle));
+        for (size_t start = 0; start < length; start += span)
+        {
+            std::complex<double> twiddle(1.0, 0.0);
+            for (size_t k = 0; k < span / 2; ++k)
+            {
+                std::complex<double> even = data[start + k];
+                std::complex<double> odd = data[start + k + span / 2] * twiddle;
+                data[start + k] = even + odd;
+                data[start + k + span / 2] = even - odd;
+                twiddle *= step;
+            }
+        }
+    }
+
+    if (inverse)
+    {
+        for (std::complex<double> & value : data)
+        {
+            value /= (double)length;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    LatencyAnalyzer.h
+
+Abstract:
+
+    This file defines a class that measures the round trip latency of a
+    loopback connection with a maximum length sequence.
+
+Environment:
+
+    ASIO Driver
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+//
+// The analyzer is fed one ASIO buffer at a time, in float samples. After
+// settleSamples, it writes the maximum length sequence to the output and
+// records the input until the sequence and maxDelaySamples have been
+// captured. The round trip is the lag of the peak of the cross-correlation
+// between the sequence and the recording, computed with an FFT and refined
+// to a fraction of a sample by windowed sinc interpolation around the
+// peak.
+// ProcessBlock() runs on the worker thread, Analyze() on another thread once
+// GetState() returns Completed. It uses only the C++ standard library, so
+// that it can be built and checked on any platform (host/CMakeLists.txt).
+//
+class LatencyAnalyzer
+{
+  public:
+    enum class State
+    {
+        Idle,
+        Running,
+        Completed
+    };
+
+    void Start(
+        uint32_t mlsOrder,
+        uint32_t settleSamples,
+        uint32_t maxDelaySamples,
+        float    amplitude
+    );
+
+    void Reset();
+
+    State GetState() const;
+
+    void ProcessBlock(
+        const float * input,
+        float *       output,
+        uint32_t      frames
+    );
+
+    bool Analyze(
+        double & delaySamples,
+        double & peakToNoise
+    ) const;
+
+    static void GenerateMls(
+        uint32_t             order,
+        float                amplitude,
+        std::vector<float> & sequence
+    );
+
+    static bool CrossCorrelate(
+        const std::vector<float> & stimulus,
+        const std::vector<float> & response,
+        double &                   delaySamples,
+        double &                   peakToNoise
+    );
+
+  private:
+    static void Fft(
+        std::vector<std::complex<double>> & data,
+        bool                                inverse
+    );
+
+    static constexpr double c_minPeakToNoise = 8.0;
+
+    std::atomic<State> m_state{State::Idle};
+    std::vector<float> m_stimulus;
+    std::vector<float> m_response;
+    uint64_t           m_position{0};
+    uint32_t           m_settleSamples{0};
+    uint32_t           m_maxDelaySamples{0};
+};
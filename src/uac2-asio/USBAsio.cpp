@@ -74,8 +74,12 @@ static const TCHAR * c_OutputHubOffsetName = _T("OutHubOffset");
 static const TCHAR * c_InputBufferOperationOffsetName = _T("InBufferOperationOffset");
 static const TCHAR * c_InputHubOffsetName = _T("InHubOffset");
 static const TCHAR * c_BufferThreadPriorityName = _T("BufferThreadPriority");
+static const TCHAR * c_SampleRateWindowName = _T("SampleRateWindow");
 static const TCHAR * c_DropoutDetectionName = _T("DropoutDetection");
 static const TCHAR * c_OutBulkOperationOffset = _T("OutBulkOperationOffset");
+static const TCHAR * c_LoopbackInputChannelName = _T("LoopbackInputChannel");
+static const TCHAR * c_LoopbackOutputChannelName = _T("LoopbackOutputChannel");
+static const TCHAR * c_MeasuredLatencyKeyName = _T("Software\\Microsoft\\Windows USB ASIO\\MeasuredLatency");
 static const TCHAR * c_ServiceName = _T("USBAudio2-ACX");
 static const TCHAR * c_ReferenceName = _T("RenderDevice0");
 
@@ -103,6 +107,108 @@ static void getNanoSeconds(ASIOTimeStamp * timeStamp)
     timeStamp->lo = (unsigned long)(nanoSeconds - (timeStamp->hi * c_TwoRaisedTo32));
 }
 
+// Latency measurement: order of the maximum length sequence and its level (-12 dBFS).
+static const ULONG c_LatencyMeasurementMlsOrder = 15;
+static const float c_LatencyMeasurementAmplitude = 0.25f;
+
+static ULONG getBytesPerSample(UACSampleType sampleType)
+{
+    switch (sampleType)
+    {
+    case UACSampleType::UACSTInt16LSB:
+        return 2;
+    case UACSampleType::UACSTInt24LSB:
+        return 3;
+    case UACSampleType::UACSTInt32LSB16:
+    case UACSampleType::UACSTInt32LSB20:
+    case UACSampleType::UACSTInt32LSB24:
+    case UACSampleType::UACSTInt32LSB:
+    case UACSampleType::UACSTFloat32LSB:
+        return 4;
+    default:
+        return 2;
+    }
+}
+
+// Full scale of the integer sample types, 0 for float.
+static double getFullScale(UACSampleType sampleType)
+{
+    switch (sampleType)
+    {
+    case UACSampleType::UACSTInt16LSB:
+    case UACSampleType::UACSTInt32LSB16:
+        return 32768.0;
+    case UACSampleType::UACSTInt32LSB20:
+        return 524288.0;
+    case UACSampleType::UACSTInt24LSB:
+    case UACSampleType::UACSTInt32LSB24:
+        return 8388608.0;
+    case UACSampleType::UACSTInt32LSB:
+        return 2147483648.0;
+    default:
+        return 0.0;
+    }
+}
+
+static void convertToFloat(const UCHAR * buffer, UACSampleType sampleType, float * samples, ULONG frames)
+{
+    const double fullScale = getFullScale(sampleType);
+
+    for (ULONG frame = 0; frame < frames; ++frame)
+    {
+        switch (getBytesPerSample(sampleType))
+        {
+        case 2:
+            samples[frame] = (float)(((const SHORT *)buffer)[frame] / fullScale);
+            break;
+        case 3: {
+            const UCHAR * sample = buffer + frame * 3;
+            LONG          value = (LONG)(((ULONG)sample[0] << 8) | ((ULONG)sample[1] << 16) | ((ULONG)sample[2] << 24)) >> 8;
+            samples[frame] = (float)(value / fullScale);
+            break;
+        }
+        default:
+            samples[frame] = (fullScale == 0.0) ? ((const float *)buffer)[frame] : (float)(((const LONG *)buffer)[frame] / fullScale);
+            break;
+        }
+    }
+}
+
+static void convertFromFloat(const float * samples, UACSampleType sampleType, UCHAR * buffer, ULONG frames)
+{
+    const double fullScale = getFullScale(sampleType);
+
+    for (ULONG frame = 0; frame < frames; ++frame)
+    {
+        double value = (samples[frame] > 1.0f) ? 1.0 : ((samples[frame] < -1.0f) ? -1.0 : samples[frame]);
+        double scaled = (value * fullScale >= fullScale) ? (fullScale - 1.0) : (value * fullScale);
+        switch (getBytesPerSample(sampleType))
+        {
+        case 2:
+            ((SHORT *)buffer)[frame] = (SHORT)scaled;
+            break;
+        case 3: {
+            LONG    integer = (LONG)scaled;
+            UCHAR * sample = buffer + frame * 3;
+            sample[0] = (UCHAR)(integer & 0xff);
+            sample[1] = (UCHAR)((integer >> 8) & 0xff);
+            sample[2] = (UCHAR)((integer >> 16) & 0xff);
+            break;
+        }
+        default:
+            if (fullScale == 0.0)
+            {
+                ((float *)buffer)[frame] = (float)value;
+            }
+            else
+            {
+                ((LONG *)buffer)[frame] = (LONG)scaled;
+            }
+            break;
+        }
+    }
+}
+
 CUnknown * CreateInstance(LPUNKNOWN, HRESULT *)
 {
     return (CUnknown *)nullptr;
@@ -413,6 +519,8 @@ ASIOError CUSBAsio::start()
 
         m_isStarted = true;
 
+        StartLatencyMeasurement();
+
         ThreadStart(); // activate 'hardware'
 
         return ASE_OK;
@@ -436,6 +544,11 @@ ASIOError CUSBAsio::stop()
     m_isStarted = false;
     ThreadStop(); // de-activate 'hardware'
     StopAsioStream(m_usbDeviceHandle);
+    if (m_latencyAnalyzer.GetState() == LatencyAnalyzer::State::Running)
+    {
+        info_print_(_T("latency measurement cancelled.\n"));
+        m_latencyAnalyzer.Reset();
+    }
 
     return ASE_OK;
 }
@@ -487,8 +600,15 @@ ASIOError CUSBAsio::getLatencies(long * inputLatency, long * outputLatency)
         info_print_(_T("Obtained latency offset in-%d out-%d\n"), m_audioProperty.InputLatencyOffset, m_audioProperty.OutputLatencyOffset);
     }
 
-    *inputLatency = m_blockFrames + m_audioProperty.InputLatencyOffset;
-    *outputLatency = m_blockFrames + m_audioProperty.OutputLatencyOffset;
+    // The loopback measurement only gives the round trip, so its correction is split between the directions.
+    LONG correction = 0;
+    if (LoadLatencyCorrection((ULONG)m_sampleRate, m_blockFrames, correction))
+    {
+        info_print_(_T("measured round trip correction %d samples.\n"), correction);
+    }
+
+    *inputLatency = m_blockFrames + m_audioProperty.InputLatencyOffset + correction / 2;
+    *outputLatency = m_blockFrames + m_audioProperty.OutputLatencyOffset + (correction - correction / 2);
 
     // >>comment-002<<
     return ASE_OK;
@@ -1001,26 +1121,7 @@ ASIOError CUSBAsio::createBuffers(ASIOBufferInfo * bufferInfos, long numChannels
                 SetEvent(m_asioResetEvent);
             }
 
-            ULONG bytesPerSample = 0;
-            switch (m_audioProperty.SampleType)
-            {
-            case UACSampleType::UACSTInt16LSB:
-                bytesPerSample = 2;
-                break;
-            case UACSampleType::UACSTInt24LSB:
-                bytesPerSample = 3;
-                break;
-            case UACSampleType::UACSTInt32LSB16:
-            case UACSampleType::UACSTInt32LSB20:
-            case UACSampleType::UACSTInt32LSB24:
-            case UACSampleType::UACSTInt32LSB:
-            case UACSampleType::UACSTFloat32LSB:
-                bytesPerSample = 4;
-                break;
-            default:
-                bytesPerSample = 2;
-                break;
-            }
+            ULONG bytesPerSample = getBytesPerSample(m_audioProperty.SampleType);
             ULONG bufferSizeBytes = m_blockFrames;
             bufferSizeBytes *= bytesPerSample;
 
@@ -1055,6 +1156,9 @@ ASIOError CUSBAsio::createBuffers(ASIOBufferInfo * bufferInfos, long numChannels
                 m_activeInputs = 0;
                 m_activeOutputs = 0;
                 info = bufferInfos;
+                // The host reads and writes the driver buffers in place. They are locked by the driver
+                // in SetAsioBuffer, and the driver converts between them and the isochronous buffers
+                // directly, so each sample is copied only once.
                 for (i = 0; i < numChannels; i++, info++)
                 {
                     if (info->isInput)
@@ -1119,7 +1223,10 @@ ASIOError CUSBAsio::createBuffers(ASIOBufferInfo * bufferInfos, long numChannels
                 playHdr->OutputReadyEvent = m_outputReadyEvent;
                 playHdr->DeviceReadyEvent = m_deviceReadyEvent;
 #endif
-                playHdr->Training = 0;
+                {
+                    LONG correction = 0;
+                    playHdr->Training = (m_loopbackInputChannel != 0 && m_loopbackOutputChannel != 0 && !LoadLatencyCorrection((ULONG)m_sampleRate, m_blockFrames, correction)) ? 1 : 0;
+                }
                 result = SetAsioBuffer(m_usbDeviceHandle, m_driverPlayBufferWithKsProperty, sizeof(KSPROPERTY) + playSize, (UCHAR *)m_driverRecBuffer, recSize);
 
                 if (!result)
@@ -1383,6 +1490,10 @@ void CUSBAsio::BufferSwitch()
         {
             m_callbacks->bufferSwitch(m_toggle, ASIOTrue);
         }
+        if (m_latencyAnalyzer.GetState() == LatencyAnalyzer::State::Running)
+        {
+            ProcessLatencyMeasurement(m_toggle);
+        }
         m_toggle = m_toggle ? 0 : 1;
     }
 }
@@ -1508,6 +1619,132 @@ bool CUSBAsio::MeasureLatency()
     }
 }
 
+bool CUSBAsio::StartLatencyMeasurement()
+{
+    LONG correction = 0;
+
+    // The measurement runs once for each sample rate and buffer size, when a loopback is configured.
+    if (m_loopbackInputChannel == 0 || m_loopbackInputChannel > m_inAvailableChannels ||
+        m_loopbackOutputChannel == 0 || m_loopbackOutputChannel > m_outAvailableChannels ||
+        (m_audioProperty.CurrentSampleFormat != UACSampleFormat::UAC_SAMPLE_FORMAT_PCM && m_audioProperty.CurrentSampleFormat != UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT) ||
+        LoadLatencyCorrection((ULONG)m_sampleRate, m_blockFrames, correction))
+    {
+        return false;
+    }
+
+    auto lockClient = m_clientInfoCS.lock();
+
+    m_loopbackInput.assign(m_blockFrames, 0.0f);
+    m_loopbackOutput.assign(m_blockFrames, 0.0f);
+    // Wait 0.5 seconds for the stream to settle, and look for the loopback up to 4 buffers and 100 ms later.
+    m_latencyAnalyzer.Start(c_LatencyMeasurementMlsOrder, (ULONG)m_sampleRate / 2, 4 * m_blockFrames + (ULONG)m_sampleRate / 10, c_LatencyMeasurementAmplitude);
+    info_print_(_T("latency measurement started, loopback out %u -> in %u, sample rate %lf, buffer %d.\n"), m_loopbackOutputChannel, m_loopbackInputChannel, m_sampleRate, m_blockFrames);
+
+    return true;
+}
+
+_Use_decl_annotations_
+void CUSBAsio::ProcessLatencyMeasurement(long index)
+{
+    ULONG bufferSizeBytes = m_blockFrames * getBytesPerSample(m_audioProperty.SampleType);
+
+    if (m_driverRecBuffer == nullptr || m_driverPlayBuffer == nullptr || m_loopbackInput.size() < (size_t)m_blockFrames || m_loopbackOutput.size() < (size_t)m_blockFrames)
+    {
+        return;
+    }
+
+    // The loopback channels replace whatever the client has written to them.
+    const UCHAR * input = (const UCHAR *)m_driverRecBuffer + sizeof(UAC_ASIO_REC_BUFFER_HEADER) + bufferSizeBytes * (2 * (m_loopbackInputChannel - 1) + index);
+    UCHAR *       output = m_driverPlayBuffer + sizeof(UAC_ASIO_PLAY_BUFFER_HEADER) + bufferSizeBytes * (2 * (m_loopbackOutputChannel - 1) + index);
+
+    convertToFloat(input, m_audioProperty.SampleType, m_loopbackInput.data(), m_blockFrames);
+    m_latencyAnalyzer.ProcessBlock(m_loopbackInput.data(), m_loopbackOutput.data(), m_blockFrames);
+    convertFromFloat(m_loopbackOutput.data(), m_audioProperty.SampleType, output, m_blockFrames);
+
+    if (m_latencyAnalyzer.GetState() == LatencyAnalyzer::State::Completed)
+    {
+        // The correlation takes a few tens of milliseconds, so it runs on the reset thread.
+        m_isRequireLatencyAnalysis = true;
+        SetEvent(m_asioResetEvent);
+    }
+}
+
+void CUSBAsio::CompleteLatencyMeasurement()
+{
+    double delaySamples = 0.0;
+    double peakToNoise = 0.0;
+
+    auto lockClient = m_clientInfoCS.lock();
+
+    bool measured = m_latencyAnalyzer.Analyze(delaySamples, peakToNoise);
+    m_latencyAnalyzer.Reset();
+    if (!measured)
+    {
+        error_print_(_T("latency measurement failed, peak to noise %lf.\n"), peakToNoise);
+        return;
+    }
+
+    if (GetAudioProperty(m_usbDeviceHandle, &m_audioProperty))
+    {
+        LONG reported = 2 * m_blockFrames + m_audioProperty.InputLatencyOffset + m_audioProperty.OutputLatencyOffset;
+        LONG correction = (LONG)floor(delaySamples + 0.5) - reported;
+
+        info_print_(_T("measured round trip %lf samples, peak to noise %lf, reported %d samples, correction %d samples.\n"), delaySamples, peakToNoise, reported, correction);
+        if (StoreLatencyCorrection((ULONG)m_sampleRate, m_blockFrames, correction))
+        {
+            m_isRequireLatencyChange = true;
+        }
+    }
+}
+
+_Use_decl_annotations_
+bool CUSBAsio::LoadLatencyCorrection(ULONG sampleRate, ULONG bufferSize, LONG & correction)
+{
+    HKEY  hKey;
+    ULONG temp = 0;
+    DWORD size = sizeof(ULONG);
+    TCHAR valueName[32] = {0};
+
+    correction = 0;
+    _stprintf_s(valueName, _countof(valueName), _T("%u_%u"), sampleRate, bufferSize);
+
+    LONG result = RegOpenKeyEx(HKEY_CURRENT_USER, c_MeasuredLatencyKeyName, 0, KEY_READ, &hKey);
+    if (result != ERROR_SUCCESS)
+    {
+        return false;
+    }
+    result = RegQueryValueEx(hKey, valueName, 0, nullptr, (PBYTE)&temp, &size);
+    RegCloseKey(hKey);
+    if (result != ERROR_SUCCESS)
+    {
+        return false;
+    }
+
+    correction = (LONG)temp;
+    return true;
+}
+
+_Use_decl_annotations_
+bool CUSBAsio::StoreLatencyCorrection(ULONG sampleRate, ULONG bufferSize, LONG correction)
+{
+    HKEY  hKey;
+    ULONG temp = (ULONG)correction;
+    TCHAR valueName[32] = {0};
+
+    _stprintf_s(valueName, _countof(valueName), _T("%u_%u"), sampleRate, bufferSize);
+
+    LONG result = RegCreateKeyEx(HKEY_CURRENT_USER, c_MeasuredLatencyKeyName, 0, nullptr, REG_OPTION_NON_VOLATILE, KEY_WRITE, nullptr, &hKey, nullptr);
+    if (result != ERROR_SUCCESS)
+    {
+        error_print_(_T("cannot create the measured latency key, %d.\n"), result);
+        return false;
+    }
+    result = RegSetValueEx(hKey, valueName, 0, REG_DWORD, (const BYTE *)&temp, sizeof(temp));
+    RegCloseKey(hKey);
+
+    return result == ERROR_SUCCESS;
+}
+
 bool CUSBAsio::ApplySettings()
 {
     LONG  result;
@@ -1531,6 +1768,7 @@ bool CUSBAsio::ApplySettings()
     m_driverFlags.BufferThreadPriority = UAC_DEFAULT_BUFFER_THREAD_PRIORITY;
     m_driverFlags.ClassicFramesPerIrp2 = UAC_DEFAULT_CLASSIC_FRAMES_PER_IRP;
     m_driverFlags.SuggestedBufferPeriod = UAC_DEFAULT_ASIO_BUFFER_SIZE;
+    m_driverFlags.SampleRateWindowMs = UAC_DEFAULT_SAMPLE_RATE_WINDOW_MS;
     m_threadPriority = 2;
     m_isDropoutDetectionSetting = UAC_DEFAULT_DROPOUT_DETECTION;
 
@@ -1634,6 +1872,13 @@ bool CUSBAsio::ApplySettings()
             m_driverFlags.BufferThreadPriority = temp;
         }
 
+        size = sizeof(ULONG);
+        result = RegQueryValueEx(hKey, c_SampleRateWindowName, 0, nullptr, (PBYTE)&temp, &size);
+        if (result == ERROR_SUCCESS)
+        {
+            m_driverFlags.SampleRateWindowMs = temp;
+        }
+
         size = sizeof(ULONG);
         result = RegQueryValueEx(hKey, c_DropoutDetectionName, 0, nullptr, (PBYTE)&temp, &size);
         if (result == ERROR_SUCCESS)
@@ -1641,6 +1886,20 @@ bool CUSBAsio::ApplySettings()
             m_isDropoutDetectionSetting = temp != 0;
         }
 
+        size = sizeof(ULONG);
+        result = RegQueryValueEx(hKey, c_LoopbackInputChannelName, 0, nullptr, (PBYTE)&temp, &size);
+        if (result == ERROR_SUCCESS)
+        {
+            m_loopbackInputChannel = temp;
+        }
+
+        size = sizeof(ULONG);
+        result = RegQueryValueEx(hKey, c_LoopbackOutputChannelName, 0, nullptr, (PBYTE)&temp, &size);
+        if (result == ERROR_SUCCESS)
+        {
+            m_loopbackOutputChannel = temp;
+        }
+
         m_driverFlags.SuggestedBufferPeriod = m_blockFrames;
 
         RegCloseKey(hKey);
@@ -1955,6 +2214,11 @@ unsigned int __stdcall CUSBAsio::AsioResetThread(void * param)
                     self->m_callbacks->asioMessage(kAsioOverload, 0, nullptr, nullptr);
                 }
             }
+            if (self->m_isRequireLatencyAnalysis)
+            {
+                self->m_isRequireLatencyAnalysis = false;
+                self->CompleteLatencyMeasurement();
+            }
             if (self->m_isRequireLatencyChange)
             {
                 self->m_isRequireLatencyChange = false;
@@ -2129,6 +2393,12 @@ unsigned int __stdcall CUSBAsio::WorkerThread(void * param)
                 setAsioResetEvent = true;
                 recHdr->DeviceStatus &= ~((ULONG)toInt(DeviceStatuses::LatencyChanged));
             }
+            if ((curHdr.DeviceStatus & toInt(DeviceStatuses::OverloadPredicted)) != 0)
+            {
+                // Only an early warning, the stream keeps running.
+                info_print_(_T("overload predicted.\n"));
+                recHdr->DeviceStatus &= ~((ULONG)toInt(DeviceStatuses::OverloadPredicted));
+            }
             if ((curHdr.DeviceStatus & toInt(DeviceStatuses::ResetRequired)) != 0 ||
                 (curHdr.CurrentSampleRate != (ULONG)self->m_sampleRate))
             {
@@ -37,6 +37,7 @@ Environment:
 #include "combase.h"
 #include "iasiodrv.h"
 #include "UAC_User.h"
+#include "LatencyAnalyzer.h"
 
 #define ASIO_THREAD_STATISTICS
 
@@ -214,6 +215,12 @@ class CUSBAsio : public IASIO, public CUnknown
     HANDLE                        m_terminateAsioResetEvent{nullptr};
     HANDLE                        m_asioResetThread{nullptr};
     HANDLE                        m_outputReadyBlockEvent{nullptr};
+    LatencyAnalyzer               m_latencyAnalyzer;
+    std::vector<float>            m_loopbackInput;
+    std::vector<float>            m_loopbackOutput;
+    ULONG                         m_loopbackInputChannel{0};  // 1-based, 0 if no loopback is connected
+    ULONG                         m_loopbackOutputChannel{0}; // 1-based, 0 if no loopback is connected
+    bool                          m_isRequireLatencyAnalysis{false};
 
     static unsigned int __stdcall WorkerThread(
         _In_ void * Param
@@ -223,6 +230,21 @@ class CUSBAsio : public IASIO, public CUnknown
     );
 
     bool  MeasureLatency();
+    bool  StartLatencyMeasurement();
+    void  ProcessLatencyMeasurement(
+        _In_ long index
+    );
+    void  CompleteLatencyMeasurement();
+    bool  LoadLatencyCorrection(
+        _In_ ULONG   sampleRate,
+        _In_ ULONG   bufferSize,
+        _Out_ LONG & correction
+    );
+    bool  StoreLatencyCorrection(
+        _In_ ULONG sampleRate,
+        _In_ ULONG bufferSize,
+        _In_ LONG  correction
+    );
     bool  ApplySettings();
     bool  ExecuteControlPanel();
     ULONG CalcInputLatency(
@@ -0,0 +1,235 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+// ASIO is a trademark and software of Steinberg Media Technologies GmbH
+
+/*++
+
+Module Name:
+
+    LatencyAnalyzerTest.cpp
+
+Abstract:
+
+    Test LatencyAnalyzer. The maximum length sequence of order 15 must be
+    balanced and have a flat circular autocorrelation. The order 15 sequence,
+    delayed by a known fractional number of samples with a windowed sinc,
+    attenuated and with noise added, must be measured within 0.05 samples.
+    The same must hold through ProcessBlock() on a simulated loopback, fed
+    one ASIO buffer at a time, and a recording without the sequence must be
+    rejected.
+
+Environment:
+
+    User mode
+
+--*/
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "LatencyAnalyzer.h"
+#include "HostTest.h"
+
+namespace
+{
+const double   c_pi = 3.14159265358979323846;
+const uint32_t c_mlsOrder = 15;
+const float    c_amplitude = 0.25f; // -12 dBFS, as USBAsio.cpp plays it.
+const double   c_maxErrorSamples = 0.05;
+
+// Half width of the windowed sinc that delays the signals by a fraction of a sample.
+const int c_delayTaps = 64;
+} // namespace
+
+//
+// The value of a signal at a fractional position, interpolated with a
+// Blackman windowed sinc. This is the response of a band limited loopback
+// with a non-integer delay.
+//
+static double FractionalSample(
+    const std::vector<float> & signal,
+    double                     position
+)
+{
+    int64_t center = (int64_t)std::floor(position);
+    double  value = 0.0;
+    for (int64_t index = center - c_delayTaps; index <= center + c_delayTaps; ++index)
+    {
+        if ((index < 0) || (index >= (int64_t)signal.size()))
+        {
+            continue;
+        }
+        double x = position - (double)index;
+        if (std::fabs(x) >= c_delayTaps + 1)
+        {
+            continue;
+        }
+        double sinc = (x == 0.0) ? 1.0 : std::sin(c_pi * x) / (c_pi * x);
+        double phase = c_pi * x / (double)(c_delayTaps + 1);
+        double window = 0.42 + 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+        value += signal[(size_t)index] * sinc * window;
+    }
+    return value;
+}
+
+static void TestMls()
+{
+    std::vector<float> sequence;
+    LatencyAnalyzer::GenerateMls(c_mlsOrder, 1.0f, sequence);
+
+    const size_t length = (1U << c_mlsOrder) - 1;
+    HOST_TEST_EXPECT(sequence.size() == length, "the sequence has %zu samples, expected %zu", sequence.size(), length);
+    if (sequence.size() != length)
+    {
+        return;
+    }
+
+    size_t ones = 0;
+    for (float sample : sequence)
+    {
+        ones += (sample > 0.0f) ? 1 : 0;
+    }
+    HOST_TEST_EXPECT(ones == (length + 1) / 2, "%zu of %zu samples are positive, expected %zu", ones, length, (length + 1) / 2);
+
+    // The circular autocorrelation of a maximum length sequence is -1 at every lag but 0.
+    std::mt19937                          random(1);
+    std::uniform_int_distribution<size_t> lags(1, length - 1);
+    for (int i = 0; i < 64; ++i)
+    {
+        size_t lag = (i < 16) ? (size_t)i + 1 : lags(random);
+        double correlation = 0.0;
+        for (size_t n = 0; n < length; ++n)
+        {
+            correlation += (double)sequence[n] * (double)sequence[(n + lag) % length];
+        }
+        HOST_TEST_EXPECT(correlation == -1.0, "the circular autocorrelation at lag %zu is %.0f, expected -1", lag, correlation);
+    }
+
+    LatencyAnalyzer::GenerateMls(9, 1.0f, sequence);
+    HOST_TEST_EXPECT(sequence.empty(), "a sequence of an unsupported order was generated");
+}
+
+static void TestFractionalDelay(
+    double delaySamples,
+    float  gain,
+    double noiseRms
+)
+{
+    const size_t       maxDelaySamples = 4096;
+    std::vector<float> stimulus;
+    LatencyAnalyzer::GenerateMls(c_mlsOrder, c_amplitude, stimulus);
+
+    std::mt19937                     random((uint32_t)(delaySamples * 100.0));
+    std::normal_distribution<double> noise(0.0, noiseRms);
+    std::vector<float>               response(stimulus.size() + maxDelaySamples);
+    for (size_t n = 0; n < response.size(); ++n)
+    {
+        response[n] = (float)(gain * FractionalSample(stimulus, (double)n - delaySamples) + ((noiseRms > 0.0) ? noise(random) : 0.0));
+    }
+
+    double measuredSamples = 0.0;
+    double peakToNoise = 0.0;
+    bool   found = LatencyAnalyzer::CrossCorrelate(stimulus, response, measuredSamples, peakToNoise);
+    double errorSamples = measuredSamples - delaySamples;
+    printf("delay %9.3f, gain %.2f, noise %.3f: measured %9.3f, error %+.3f, peak to noise %.0f\n", delaySamples, gain, noiseRms, measuredSamples, errorSamples, peakToNoise);
+
+    HOST_TEST_EXPECT(found, "no correlation peak for a delay of %.3f samples", delaySamples);
+    HOST_TEST_EXPECT(std::fabs(errorSamples) <= c_maxErrorSamples, "a delay of %.3f samples was measured as %.3f", delaySamples, measuredSamples);
+    HOST_TEST_EXPECT(peakToNoise >= 8.0, "the peak to noise ratio is %.1f for a delay of %.3f samples", peakToNoise, delaySamples);
+}
+
+//
+// The output of each ASIO buffer comes back at the input delaySamples later.
+// The delay is longer than a buffer and the interpolation kernel, so the
+// input of a buffer only depends on the outputs of the previous ones.
+//
+static void TestLoopback(
+    double   delaySamples,
+    uint32_t bufferFrames,
+    bool     connected
+)
+{
+    const uint32_t settleSamples = 24000;
+    const uint32_t maxDelaySamples = 4 * bufferFrames + 4800;
+
+    std::mt19937                     random(bufferFrames);
+    std::normal_distribution<double> noise(0.0, 0.001);
+    std::vector<float>               played;
+    std::vector<float>               input(bufferFrames);
+    std::vector<float>               output(bufferFrames);
+    LatencyAnalyzer                  analyzer;
+
+    double measuredSamples = 0.0;
+    double peakToNoise = 0.0;
+    HOST_TEST_EXPECT(!analyzer.Analyze(measuredSamples, peakToNoise), "analyzed before the start");
+
+    analyzer.Start(c_mlsOrder, settleSamples, maxDelaySamples, c_amplitude);
+    HOST_TEST_EXPECT(analyzer.GetState() == LatencyAnalyzer::State::Running, "not running after the start");
+
+    uint32_t buffers = 0;
+    while ((analyzer.GetState() == LatencyAnalyzer::State::Running) && (buffers < 1000))
+    {
+        for (uint32_t frame = 0; frame < bufferFrames; ++frame)
+        {
+            double position = (double)(played.size() + frame) - delaySamples;
+            input[frame] = (float)((connected ? 0.7 * FractionalSample(played, position) : 0.0) + noise(random));
+        }
+        analyzer.ProcessBlock(input.data(), output.data(), bufferFrames);
+        played.insert(played.end(), output.begin(), output.end());
+        ++buffers;
+    }
+
+    size_t expectedBuffers = (settleSamples + ((1U << c_mlsOrder) - 1) + maxDelaySamples + bufferFrames - 1) / bufferFrames;
+    HOST_TEST_EXPECT(analyzer.GetState() == LatencyAnalyzer::State::Completed, "not completed after %u buffers", buffers);
+    HOST_TEST_EXPECT(buffers == expectedBuffers, "completed after %u buffers, expected %zu", buffers, expectedBuffers);
+
+    bool analyzed = analyzer.Analyze(measuredSamples, peakToNoise);
+    printf("loopback %s, delay %9.3f, buffer %4u: %s, measured %9.3f, peak to noise %.1f\n", connected ? "connected" : "open", delaySamples, bufferFrames, analyzed ? "accepted" : "rejected", measuredSamples, peakToNoise);
+
+    if (connected)
+    {
+        HOST_TEST_EXPECT(analyzed, "the loopback was rejected, peak to noise %.1f", peakToNoise);
+        HOST_TEST_EXPECT(std::fabs(measuredSamples - delaySamples) <= c_maxErrorSamples, "a loopback of %.3f samples was measured as %.3f", delaySamples, measuredSamples);
+    }
+    else
+    {
+        HOST_TEST_EXPECT(!analyzed, "an open loopback was measured as %.3f samples, peak to noise %.1f", measuredSamples, peakToNoise);
+    }
+
+    // The output is silent before and after the sequence.
+    bool silent = true;
+    for (size_t n = 0; n < played.size(); ++n)
+    {
+        if ((n < settleSamples) || (n >= settleSamples + ((1U << c_mlsOrder) - 1)))
+        {
+            silent = silent && (played[n] == 0.0f);
+        }
+    }
+    HOST_TEST_EXPECT(silent, "the output is not silent outside of the sequence");
+
+    analyzer.Reset();
+    HOST_TEST_EXPECT(analyzer.GetState() == LatencyAnalyzer::State::Idle, "not idle after a reset");
+}
+
+int main()
+{
+    TestMls();
+
+    const double delays[] = {20.0, 37.25, 480.5, 1000.75, 1234.1, 2047.9, 3000.05, 4000.375};
+    for (double delaySamples : delays)
+    {
+        TestFractionalDelay(delaySamples, 1.0f, 0.0);
+        TestFractionalDelay(delaySamples, 0.5f, 0.01);
+    }
+
+    TestLoopback(1234.4, 64, true);
+    TestLoopback(2345.6, 256, true);
+    TestLoopback(1234.4, 64, false);
+
+    return HOST_TEST_RESULT();
+}
@@ -30,6 +30,7 @@ Environment:
 #include "ErrorStatistics.h"
 #include "AsioBufferObject.h"
 #include "USBAudioDataFormat.h"
+#include "InterleaveKernels.h"
 
 #ifndef __INTELLISENSE__
 #include "AsioBufferObject.tmh"
@@ -282,6 +283,8 @@ AsioBufferObject::SetBuffer(
     RtlZeroMemory(m_playBuffer, m_playBufferSize);
     RtlZeroMemory(m_recBuffer, m_recBufferSize);
 
+    SelectConverters();
+
     PKEVENT tempNotificationEvent = nullptr;
 #ifdef _WIN64
     if (m_playHeader->Is32bitProcess)
@@ -403,6 +406,11 @@ AsioBufferObject::UnsetBuffer()
     m_playBuffer = nullptr;
     m_playBufferSize = 0;
 
+    m_playKernel = INTERLEAVE_KERNEL_INFO{};
+    m_recKernel = INTERLEAVE_KERNEL_INFO{};
+    m_playKernelChannels = 0;
+    m_recKernelChannels = 0;
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "%!FUNC! Exit");
 
     return status;
@@ -489,134 +497,30 @@ AsioBufferObject::CopyFromAsioToOutputData(
     IF_TRUE_ACTION_JUMP(length == 0, status = STATUS_INVALID_PARAMETER, CopyFromAsioToOutputData_Exit);
     IF_TRUE_ACTION_JUMP(m_deviceContext == nullptr, status = STATUS_UNSUCCESSFUL, CopyFromAsioToOutputData_Exit);
 
-    LONGLONG asioPosition = m_readPosition;
-    m_readPosition += samples;
-    ULONG asioReadStartIndex = (ULONG)((asioPosition + m_deviceContext->Params.PreSendFrames) % (m_bufferLength));
-    ULONG asioReadEndIndex = (ULONG)((asioPosition + samples + m_deviceContext->Params.PreSendFrames) % (m_bufferLength));
-
-    ULONG asioSampleSize = USBAudioDataFormat::ConverSampleTypeToBytesPerSample(m_deviceContext->AudioProperty.SampleType);
-    ULONG asioByteOffset = asioSampleSize - usbBytesPerSample;
+    LONGLONG asioPosition = m_readPosition.Current();
+    ULONG    asioReadStartIndex = (ULONG)((asioPosition + m_deviceContext->Params.PreSendFrames) % (m_bufferLength));
 
     //
     // ASIO provides audio samples in a non-interleaved format. These samples
     // are converted and copied into an interleaved format suitable for USB
-    // isochronous transfer.
+    // isochronous transfer by the converter selected in SelectConverters().
+    // The copy is split at the end of the ASIO ring buffer.
     //
-    switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
+    if (m_playKernel.Interleave != nullptr)
     {
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM: {
-        for (ULONG asioCh = 0; asioCh < m_playChannels; ++asioCh)
-        {
-            ULONG usbCh = asioCh;
-            if (usbCh >= m_deviceContext->OutputUsbChannels)
-            {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_ASIO, "ASIO OUT channel %u is not mapped", asioCh);
-                continue;
-            }
-            ULONG samplesFirst = samples;
-            if (asioReadStartIndex > asioReadEndIndex)
-            {
-                samplesFirst = m_bufferLength - asioReadStartIndex;
-            }
+        ULONG samplesFirst = MIN(samples, m_bufferLength - asioReadStartIndex);
 
-            if ((m_playChannelsMap & (1ULL << asioCh)) != 0)
-            {
-                volatile BYTE * asioBuffer = m_playBuffer + (m_bufferLength * asioSampleSize * asioCh);
-                switch (usbBytesPerSample)
-                {
-                case 1:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample] = asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset];
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        volatile BYTE * src = &(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                        BYTE *          dst = &(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        *dst = *src;
-                    }
-                    break;
-                case 2:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(USHORT *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(USHORT *)&(asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(USHORT *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(USHORT *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                    }
-                    break;
-                case 3:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        volatile BYTE * src = &(asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset]);
-                        BYTE *          dst = &(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        volatile BYTE * src = &(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                        BYTE *          dst = &(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                    }
-                    break;
-                case 4:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(ULONG *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(ULONG *)&(asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(ULONG *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(ULONG *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                    }
-                    break;
-                default:
-                    break; // max 32bit
-                }
-            }
-        }
-    }
-    break;
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
-        ASSERT(usbBytesPerSample == 4);
-        ASSERT(asioSampleSize == 4);
-        for (ULONG asioCh = 0; asioCh < m_playChannels; ++asioCh)
+        ASSERT(m_playKernel.UsbBytesPerSample == usbBytesPerSample);
+        m_playKernel.Interleave(outBuffer, bytesPerBlock, m_playChannelBuffers, asioReadStartIndex, m_playKernelChannels, samplesFirst);
+        if (samples > samplesFirst)
         {
-            ULONG usbCh = asioCh;
-            if (usbCh >= m_deviceContext->OutputUsbChannels)
-            {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_ASIO, "ASIO OUT channel %u is not mapped", asioCh);
-                continue;
-            }
-            ULONG samplesFirst = samples;
-            if (asioReadStartIndex > asioReadEndIndex)
-            {
-                samplesFirst = m_bufferLength - asioReadStartIndex;
-            }
-
-            if ((m_playChannelsMap & (1ULL << asioCh)) != 0)
-            {
-                volatile BYTE * asioBuffer = m_playBuffer + (m_bufferLength * asioSampleSize * asioCh);
-                for (ULONG index = 0; index < samplesFirst; ++index)
-                {
-                    *(float *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(float *)&(asioBuffer[(asioReadStartIndex + index) * asioSampleSize + asioByteOffset]);
-                }
-                for (ULONG index = samplesFirst; index < samples; ++index)
-                {
-                    *(float *)&(outBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]) = *(float *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                }
-            }
+            m_playKernel.Interleave(outBuffer + samplesFirst * bytesPerBlock, bytesPerBlock, m_playChannelBuffers, 0, m_playKernelChannels, samples - samplesFirst);
         }
     }
-    break;
-    default:
-        break;
-    }
 
+    // The samples are published as read only after they have been copied, so that the
+    // mixing engine thread does not hand them back to the ASIO client while they are read.
+    m_readPosition.Publish(asioPosition + samples);
     _InterlockedExchange64((volatile LONG64 *)&m_recHeader->PlayBufferPosition, asioPosition + samples);
 
 CopyFromAsioToOutputData_Exit:
@@ -650,151 +554,119 @@ AsioBufferObject::CopyToAsioFromInputData(
     IF_TRUE_ACTION_JUMP(length == 0, status = STATUS_INVALID_PARAMETER, CopyToAsioFromInputData_Exit);
     IF_TRUE_ACTION_JUMP(m_deviceContext == nullptr, status = STATUS_UNSUCCESSFUL, CopyToAsioFromInputData_Exit);
 
-    LONGLONG asioPosition = m_writePosition;
-    m_writePosition += samples;
+    LONGLONG asioPosition = m_writePosition.Current();
 
     const ULONG asioWriteStartIndex = (ULONG)((asioPosition) % (m_bufferLength));
-    const ULONG asioWriteEndIndex = (ULONG)((asioPosition + samples) % (m_bufferLength));
-
-    ULONG asioSampleSize = USBAudioDataFormat::ConverSampleTypeToBytesPerSample(m_deviceContext->AudioProperty.SampleType);
-    ULONG asioByteOffset = asioSampleSize - usbBytesPerSample;
 
-    switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
+    //
+    // The interleaved USB samples are split into the non-interleaved ASIO buffers
+    // by the converter selected in SelectConverters(). If the ASIO sample is wider
+    // than the USB sample, the converter also clears the unused low-order bytes.
+    // The copy is split at the end of the ASIO ring buffer.
+    //
+    if (m_recKernel.Deinterleave != nullptr)
     {
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM: {
-        for (ULONG asioCh = 0; asioCh < m_recChannels; ++asioCh)
+        ULONG samplesFirst = MIN(samples, m_bufferLength - asioWriteStartIndex);
+
+        ASSERT(m_recKernel.UsbBytesPerSample == usbBytesPerSample);
+        m_recKernel.Deinterleave(inBuffer, bytesPerBlock, m_recChannelBuffers, asioWriteStartIndex, m_recKernelChannels, samplesFirst);
+        if (samples > samplesFirst)
         {
-            ULONG usbCh = asioCh;
-            if (usbCh >= m_deviceContext->InputUsbChannels)
-            {
-                // TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "ASIO IN channel %u is not mapped", asioCh);
-                continue;
-            }
-            if ((m_recChannelsMap & (1ULL << asioCh)) != 0)
-            {
-                ULONG samplesFirst = samples;
-                PBYTE asioBuffer = (PBYTE)m_recBuffer + (m_bufferLength * asioSampleSize * asioCh);
-
-                // Since asioSampleSize and usbBytesPerSample are usually the same,
-                // zero-clearing is not necessary. However, if asioSampleSize is larger,
-                // we clear the entire buffer once.
-                //
-                // To improve efficiency, instead of writing zeros sparsely,
-                // we use RtlZeroMemory to clear the entire buffer at once.
-                if (asioSampleSize > usbBytesPerSample)
-                {
-                    if (asioWriteStartIndex > asioWriteEndIndex)
-                    {
-                        samplesFirst = m_bufferLength - asioWriteStartIndex;
-                        RtlZeroMemory(&(asioBuffer[asioWriteStartIndex * asioSampleSize + asioByteOffset]), samplesFirst * usbBytesPerSample);
-                        RtlZeroMemory(&(asioBuffer[asioByteOffset]), (samples - samplesFirst) * usbBytesPerSample);
-                    }
-                    else
-                    {
-                        RtlZeroMemory(&(asioBuffer[asioWriteStartIndex * asioSampleSize + asioByteOffset]), samplesFirst * usbBytesPerSample);
-                    }
-                }
-                switch (usbBytesPerSample)
-                {
-                case 1:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        BYTE * src = &(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        BYTE * dst = &(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]);
-                        *dst = *src;
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        BYTE * src = &(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        BYTE * dst = &(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                        *dst = *src;
-                    }
-                    break;
-                case 2:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(USHORT *)&(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]) = *(USHORT *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(USHORT *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]) = *(USHORT *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    break;
-                case 3:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        BYTE * src = &(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        BYTE * dst = &(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]);
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        BYTE * src = &(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                        BYTE * dst = &(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]);
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                        *dst++ = *src++;
-                    }
-                    break;
-                case 4:
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(ULONG *)&(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]) = *(ULONG *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(ULONG *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]) = *(ULONG *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    break;
-                default:
-                    break; // max 32bit
-                }
-            }
+            m_recKernel.Deinterleave(inBuffer + samplesFirst * bytesPerBlock, bytesPerBlock, m_recChannelBuffers, 0, m_recKernelChannels, samples - samplesFirst);
         }
     }
-    break;
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
-        ASSERT(usbBytesPerSample == 4);
-        ASSERT(asioSampleSize == 4);
-        for (ULONG asioCh = 0; asioCh < m_recChannels; ++asioCh)
+
+    m_writePosition.Publish(asioPosition + samples);
+    _InterlockedExchange64((volatile LONG64 *)&m_recHeader->RecCurrentPosition, asioPosition + samples);
+
+CopyToAsioFromInputData_Exit:
+    // TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "%!FUNC! Exit");
+
+    return status;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+AsioBufferObject::SelectConverter(
+    bool isInput
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    PAGED_CODE();
+
+    INTERLEAVE_KERNEL_INFO & kernelInfo = isInput ? m_recKernel : m_playKernel;
+    PUCHAR *                 channelBuffers = isInput ? m_recChannelBuffers : m_playChannelBuffers;
+    ULONG &                  kernelChannels = isInput ? m_recKernelChannels : m_playKernelChannels;
+    PBYTE                    asioBuffer = isInput ? m_recBuffer : m_playBuffer;
+    ULONGLONG                channelsMap = isInput ? m_recChannelsMap : m_playChannelsMap;
+    ULONG                    asioChannels = isInput ? m_recChannels : m_playChannels;
+    ULONG                    usbChannels = isInput ? m_deviceContext->InputUsbChannels : m_deviceContext->OutputUsbChannels;
+    ULONG                    usbBytesPerSample = isInput ? m_deviceContext->AudioProperty.InputBytesPerSample : m_deviceContext->AudioProperty.OutputBytesPerSample;
+    ULONG                    asioSampleSize = USBAudioDataFormat::ConverSampleTypeToBytesPerSample(m_deviceContext->AudioProperty.SampleType);
+    InterleaveChannelClass   channelClass = InterleaveChannelClass::Dense;
+
+    kernelInfo = INTERLEAVE_KERNEL_INFO{};
+    RtlZeroMemory(channelBuffers, sizeof(PUCHAR) * UAC_MAX_ASIO_CHANNELS);
+    kernelChannels = 0;
+
+    RETURN_NTSTATUS_IF_TRUE(asioBuffer == nullptr, STATUS_INVALID_DEVICE_STATE);
+
+    //
+    // ASIO channel n is transferred on USB channel n. Channels that are not
+    // enabled in the channel map are left as nullptr and skipped by the kernel.
+    //
+    kernelChannels = MIN(MIN(asioChannels, usbChannels), UAC_MAX_ASIO_CHANNELS);
+    for (ULONG ch = 0; ch < kernelChannels; ++ch)
+    {
+        if ((channelsMap & (1ULL << ch)) != 0)
         {
-            ULONG usbCh = asioCh;
-            if (usbCh >= m_deviceContext->InputUsbChannels)
-            {
-                // TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "ASIO IN channel %u is not mapped", asioCh);
-                continue;
-            }
-            if ((m_recChannelsMap & (1ULL << asioCh)) != 0)
-            {
-                ULONG samplesFirst = samples;
-                PBYTE asioBuffer = (PBYTE)m_recBuffer + (m_bufferLength * asioSampleSize * asioCh);
-                if (usbBytesPerSample == 4)
-                {
-                    for (ULONG index = 0; index < samplesFirst; ++index)
-                    {
-                        *(float *)&(asioBuffer[(asioWriteStartIndex + index) * asioSampleSize + asioByteOffset]) = *(float *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                    for (ULONG index = samplesFirst; index < samples; ++index)
-                    {
-                        *(float *)&(asioBuffer[(index - samplesFirst) * asioSampleSize + asioByteOffset]) = *(float *)&(inBuffer[index * bytesPerBlock + usbCh * usbBytesPerSample]);
-                    }
-                }
-            }
+            channelBuffers[ch] = asioBuffer + (m_bufferLength * asioSampleSize * ch);
+        }
+        else
+        {
+            channelClass = InterleaveChannelClass::Sparse;
         }
     }
-    break;
+    if ((kernelChannels % 4) != 0)
+    {
+        channelClass = InterleaveChannelClass::Sparse;
+    }
+
+    switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
+    {
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM:
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT:
+        status = InterleaveKernels::Select(usbBytesPerSample, asioSampleSize, channelClass, kernelInfo);
+        break;
     default:
+        // The other sample formats are not transferred through ASIO.
+        status = STATUS_NOT_SUPPORTED;
         break;
     }
 
-    _InterlockedExchange64((volatile LONG64 *)&m_recHeader->RecCurrentPosition, asioPosition + samples);
+    return status;
+}
 
-CopyToAsioFromInputData_Exit:
-    // TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "%!FUNC! Exit");
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void AsioBufferObject::SelectConverters()
+{
+    PAGED_CODE();
 
-    return status;
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "%!FUNC! Entry");
+
+    if (m_playBuffer != nullptr)
+    {
+        (void)SelectConverter(false);
+    }
+    if (m_recBuffer != nullptr)
+    {
+        (void)SelectConverter(true);
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, "%!FUNC! Exit");
 }
 
 _Use_decl_annotations_
@@ -806,6 +678,29 @@ void AsioBufferObject::SetRecDeviceStatus(
     InterlockedOr((PLONG)&m_recHeader->DeviceStatus, toInt(statuses));
 }
 
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void AsioBufferObject::SetMeasuredSampleRate(
+    ULONGLONG inputSampleRateQ16,
+    ULONGLONG outputSampleRateQ16
+)
+{
+    // The ASIO driver may be a 32-bit process, so the values are written atomically.
+    _InterlockedExchange64((volatile LONG64 *)&m_recHeader->InputMeasuredSampleRate, (LONG64)inputSampleRateQ16);
+    _InterlockedExchange64((volatile LONG64 *)&m_recHeader->OutputMeasuredSampleRate, (LONG64)outputSampleRateQ16);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void AsioBufferObject::SetOffsetFrames(
+    ULONG inputOffsetFrame,
+    ULONG outputOffsetFrame
+)
+{
+    InterlockedExchange((PLONG)&m_recHeader->InputOffsetFrame, (LONG)inputOffsetFrame);
+    InterlockedExchange((PLONG)&m_recHeader->OutputOffsetFrame, (LONG)outputOffsetFrame);
+}
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 bool AsioBufferObject::EvaluatePositionAndNotifyIfNeeded(
@@ -821,6 +716,8 @@ bool AsioBufferObject::EvaluatePositionAndNotifyIfNeeded(
 {
     bool     asioNotify = false;
     LONGLONG asioNotifyPosition = m_notifyPosition;
+    LONGLONG asioReadPosition = m_readPosition.Acquire();
+    LONGLONG asioWritePosition = m_writePosition.Current();
 
     PAGED_CODE();
 
@@ -828,22 +725,22 @@ bool AsioBufferObject::EvaluatePositionAndNotifyIfNeeded(
 
     if (hasInputIsochronousInterface && hasOutputIsochronousInterface)
     {
-        asioNotify = ((m_writePosition - asioNotifyPosition) >= m_bufferPeriod) && ((m_readPosition - asioNotifyPosition) >= m_bufferPeriod);
+        asioNotify = ((asioWritePosition - asioNotifyPosition) >= m_bufferPeriod) && ((asioReadPosition - asioNotifyPosition) >= m_bufferPeriod);
     }
     else if (!hasInputIsochronousInterface)
     {
         // output only
-        asioNotify = ((m_readPosition - asioNotifyPosition) >= m_bufferPeriod);
+        asioNotify = ((asioReadPosition - asioNotifyPosition) >= m_bufferPeriod);
     }
     else if (!hasOutputIsochronousInterface)
     {
         // input only
-        asioNotify = ((m_writePosition - asioNotifyPosition) >= m_bufferPeriod);
+        asioNotify = ((asioWritePosition - asioNotifyPosition) >= m_bufferPeriod);
     }
 
     if (asioNotify)
     {
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_ASIO, " - asio notify: write position %llu, read position %llu, notify position %llu, buffer period %u, current time %llu us, last asio notify %llu us, notify count %llu", m_writePosition, m_readPosition, m_notifyPosition, m_bufferPeriod, currentTimePCUs, lastAsioNotifyPCUs, asioNotifyCount);
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_ASIO, " - asio notify: write position %llu, read position %llu, notify position %llu, buffer period %u, current time %llu us, last asio notify %llu us, notify count %llu", asioWritePosition, asioReadPosition, m_notifyPosition, m_bufferPeriod, currentTimePCUs, lastAsioNotifyPCUs, asioNotifyCount);
         asioNotify = true;
         m_notifyPosition += m_bufferPeriod;
         // Notify the position before counting up.
@@ -27,6 +27,8 @@ Environment:
 
 #include <acx.h>
 #include "UAC_User.h"
+#include "InterleaveKernels.h"
+#include "AsioPosition.h"
 
 class AsioBufferObject
 {
@@ -103,6 +105,22 @@ class AsioBufferObject
         _In_ DeviceStatuses DeviceStatuses
     );
 
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void
+    SetMeasuredSampleRate(
+        _In_ ULONGLONG inputSampleRateQ16,
+        _In_ ULONGLONG outputSampleRateQ16
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void
+    SetOffsetFrames(
+        _In_ ULONG inputOffsetFrame,
+        _In_ ULONG outputOffsetFrame
+    );
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     bool EvaluatePositionAndNotifyIfNeeded(
@@ -124,6 +142,10 @@ class AsioBufferObject
     PAGED_CODE_SEG
     void SetReady();
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void SelectConverters();
+
     static __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     AsioBufferObject * Create(_In_ PDEVICE_CONTEXT deviceContext);
@@ -141,6 +163,13 @@ class AsioBufferObject
         _Out_ PVOID & systemAddress
     );
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS
+    SelectConverter(
+        _In_ bool isInput
+    );
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     void
@@ -166,15 +195,21 @@ class AsioBufferObject
     ULONG                                 m_playChannels{0};
     ULONG                                 m_bufferLength{0};
     ULONG                                 m_bufferPeriod{0};
-    LONGLONG                              m_position{0LL};
+    // Each position has a single writer. m_readPosition is advanced by the render thread when it is
+    // split, and read by the mixing engine thread; the others stay on the mixing engine thread.
+    AsioPosition                          m_readPosition;
+    AsioPosition                          m_writePosition;
     LONGLONG                              m_notifyPosition{0LL};
-    LONGLONG                              m_readPosition{0LL};
-    LONGLONG                              m_writePosition{0LL};
-    WDFSPINLOCK                           m_positionSpinLock{nullptr};
     PKEVENT                               m_userNotificationEvent{nullptr};
     PKEVENT                               m_outputReadyEvent{nullptr};
     ULONGLONG                             m_playChannelsMap{0ULL};
     ULONGLONG                             m_recChannelsMap{0ULL};
+    INTERLEAVE_KERNEL_INFO                m_playKernel{};
+    INTERLEAVE_KERNEL_INFO                m_recKernel{};
+    ULONG                                 m_playKernelChannels{0};
+    ULONG                                 m_recKernelChannels{0};
+    PUCHAR                                m_playChannelBuffers[UAC_MAX_ASIO_CHANNELS]{}; // Start of the ASIO ring buffer of each USB channel, nullptr if not mapped.
+    PUCHAR                                m_recChannelBuffers[UAC_MAX_ASIO_CHANNELS]{};  // Start of the ASIO ring buffer of each USB channel, nullptr if not mapped.
 };
 
 #endif
@@ -0,0 +1,51 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    AsioPosition.cpp
+
+Abstract:
+
+    Implement a sample position of the ASIO buffer that one thread advances
+    and another thread reads.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "AsioPosition.h"
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+LONGLONG
+AsioPosition::Current()
+{
+    return ReadNoFence64(&m_position);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void AsioPosition::Publish(
+    LONGLONG position
+)
+{
+    WriteRelease64(&m_position, position);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+LONGLONG
+AsioPosition::Acquire()
+{
+    return ReadAcquire64(&m_position);
+}
@@ -0,0 +1,59 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    AsioPosition.h
+
+Abstract:
+
+    Define a sample position of the ASIO buffer that one thread advances and
+    another thread reads.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _ASIOPOSITION_H_
+#define _ASIOPOSITION_H_
+
+//
+// The position has a single writer, so it is a 64-bit value without a lock.
+// The writer reads it with Current() and, once it is done with the samples
+// up to the new position, stores it with Publish(), a release store. A reader
+// on another thread loads it with Acquire(), so the accesses of the writer
+// to the samples before the position happen before the accesses of the
+// reader that follow the load.
+//
+class AsioPosition
+{
+  public:
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    LONGLONG
+    Current();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Publish(
+        _In_ LONGLONG position
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    LONGLONG
+    Acquire();
+
+  protected:
+    volatile LONG64 m_position{0LL};
+};
+
+#endif
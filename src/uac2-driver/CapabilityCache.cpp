@@ -0,0 +1,253 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    CapabilityCache.cpp
+
+Abstract:
+
+    Implement a class that keeps a snapshot of the device capabilities in the
+    device hardware key so that the range requests can be skipped on the
+    next start.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "Driver.h"
+#include "Device.h"
+#include "Public.h"
+#include "Common.h"
+#include "CapabilityCache.h"
+
+#ifndef __INTELLISENSE__
+#include "CapabilityCache.tmh"
+#endif
+
+DECLARE_CONST_UNICODE_STRING(c_CapabilityCacheValueName, L"CapabilityCache");
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+CapabilityCache *
+CapabilityCache::Create(
+    WDFDEVICE device
+)
+{
+    PAGED_CODE();
+
+    return new (POOL_FLAG_NON_PAGED, DRIVER_TAG) CapabilityCache(device);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+CapabilityCache::CapabilityCache(
+    WDFDEVICE device
+)
+    : m_device(device)
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+CapabilityCache::~CapabilityCache()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG
+CapabilityCache::HashConfigurationDescriptor(
+    const PUSB_CONFIGURATION_DESCRIPTOR configurationDescriptor
+)
+{
+    const UCHAR * bytes = (const UCHAR *)configurationDescriptor;
+    ULONG         hash = 2166136261UL;
+
+    PAGED_CODE();
+
+    for (ULONG index = 0; index < configurationDescriptor->wTotalLength; index++)
+    {
+        hash ^= bytes[index];
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+CapabilityCache::Load(
+    const USB_DEVICE_DESCRIPTOR &       deviceDescriptor,
+    const PUSB_CONFIGURATION_DESCRIPTOR configurationDescriptor
+)
+{
+    NTSTATUS            status = STATUS_SUCCESS;
+    WDFKEY              key = nullptr;
+    CAPABILITY_SNAPSHOT snapshot{};
+    ULONG               length = 0;
+    ULONG               type = REG_NONE;
+
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    RETURN_NTSTATUS_IF_TRUE(configurationDescriptor == nullptr, STATUS_INVALID_PARAMETER);
+
+    RtlZeroMemory(&m_snapshot, sizeof(m_snapshot));
+    m_snapshot.Version = c_version;
+    m_snapshot.Size = sizeof(m_snapshot);
+    m_snapshot.VendorId = deviceDescriptor.idVendor;
+    m_snapshot.ProductId = deviceDescriptor.idProduct;
+    m_snapshot.DeviceRelease = deviceDescriptor.bcdDevice;
+    m_snapshot.ConfigurationHash = HashConfigurationDescriptor(configurationDescriptor);
+    m_valid = false;
+    m_dirty = true;
+
+    status = WdfDeviceOpenRegistryKey(m_device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &key);
+    if (NT_SUCCESS(status))
+    {
+        status = WdfRegistryQueryValue(key, &c_CapabilityCacheValueName, sizeof(snapshot), &snapshot, &length, &type);
+        WdfRegistryClose(key);
+    }
+
+    //
+    // A snapshot of another layout, another device or another configuration descriptor is
+    // discarded, and so is one that has been reused c_refreshInterval times, so that a
+    // device whose ranges changed without a new bcdDevice is picked up again.
+    //
+    if (NT_SUCCESS(status) &&
+        (type == REG_BINARY) &&
+        (length == sizeof(snapshot)) &&
+        (snapshot.Version == m_snapshot.Version) &&
+        (snapshot.Size == m_snapshot.Size) &&
+        (snapshot.VendorId == m_snapshot.VendorId) &&
+        (snapshot.ProductId == m_snapshot.ProductId) &&
+        (snapshot.DeviceRelease == m_snapshot.DeviceRelease) &&
+        (snapshot.ConfigurationHash == m_snapshot.ConfigurationHash) &&
+        (snapshot.NumOfClockSources <= UAC_MAX_CLOCK_SOURCE) &&
+        (snapshot.UseCount < c_refreshInterval))
+    {
+        m_snapshot = snapshot;
+        m_snapshot.UseCount++;
+        m_valid = true;
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - capability snapshot %s, vid %04x, pid %04x, release %04x, hash %08x, use count %u", m_valid ? "reused" : "rebuilt", m_snapshot.VendorId, m_snapshot.ProductId, m_snapshot.DeviceRelease, m_snapshot.ConfigurationHash, m_snapshot.UseCount);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+
+    return STATUS_SUCCESS;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+CapabilityCache::Save()
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    WDFKEY   key = nullptr;
+
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    if (m_dirty)
+    {
+        status = WdfDeviceOpenRegistryKey(m_device, PLUGPLAY_REGKEY_DEVICE, KEY_WRITE, WDF_NO_OBJECT_ATTRIBUTES, &key);
+        if (NT_SUCCESS(status))
+        {
+            status = WdfRegistryAssignValue(key, &c_CapabilityCacheValueName, REG_BINARY, sizeof(m_snapshot), &m_snapshot);
+            WdfRegistryClose(key);
+        }
+        if (NT_SUCCESS(status))
+        {
+            m_dirty = false;
+        }
+        else
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, " - the capability snapshot could not be saved %!STATUS!", status);
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+
+    return status;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool CapabilityCache::IsValid() const
+{
+    PAGED_CODE();
+
+    return m_valid;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool CapabilityCache::GetSupportedSampleRate(
+    UCHAR   clockSourceID,
+    ULONG & supportedSampleRate
+) const
+{
+    PAGED_CODE();
+
+    supportedSampleRate = 0;
+
+    if (m_valid)
+    {
+        for (ULONG index = 0; index < m_snapshot.NumOfClockSources; index++)
+        {
+            if (m_snapshot.ClockSource[index].ClockSourceID == clockSourceID)
+            {
+                supportedSampleRate = m_snapshot.ClockSource[index].SupportedSampleRate;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void CapabilityCache::SetSupportedSampleRate(
+    UCHAR clockSourceID,
+    ULONG supportedSampleRate
+)
+{
+    PAGED_CODE();
+
+    ULONG index = 0;
+
+    for (; index < m_snapshot.NumOfClockSources; index++)
+    {
+        if (m_snapshot.ClockSource[index].ClockSourceID == clockSourceID)
+        {
+            break;
+        }
+    }
+
+    if (index < UAC_MAX_CLOCK_SOURCE)
+    {
+        m_snapshot.ClockSource[index].ClockSourceID = clockSourceID;
+        m_snapshot.ClockSource[index].SupportedSampleRate = supportedSampleRate;
+        if (index == m_snapshot.NumOfClockSources)
+        {
+            m_snapshot.NumOfClockSources++;
+        }
+        m_dirty = true;
+    }
+}
@@ -0,0 +1,120 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    CapabilityCache.h
+
+Abstract:
+
+    Define a class that keeps a snapshot of the device capabilities in the
+    device hardware key so that the range requests can be skipped on the
+    next start.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _CAPABILITY_CACHE_H_
+#define _CAPABILITY_CACHE_H_
+
+#include <acx.h>
+#include "Public.h"
+
+typedef struct _CAPABILITY_CACHE_CLOCK_SOURCE
+{
+    UCHAR ClockSourceID;
+    UCHAR Reserved[3];
+    ULONG SupportedSampleRate; // Bitmask of c_SampleRateList.
+} CAPABILITY_CACHE_CLOCK_SOURCE;
+
+//
+// The layout stored as REG_BINARY. Version is incremented whenever the layout or
+// the meaning of a field changes, so that an old snapshot is discarded.
+//
+typedef struct _CAPABILITY_SNAPSHOT
+{
+    ULONG                         Version;
+    ULONG                         Size;
+    USHORT                        VendorId;
+    USHORT                        ProductId;
+    USHORT                        DeviceRelease;
+    USHORT                        NumOfClockSources;
+    ULONG                         ConfigurationHash; // FNV-1a of the whole configuration descriptor.
+    ULONG                         UseCount;          // Number of starts that reused this snapshot.
+    CAPABILITY_CACHE_CLOCK_SOURCE ClockSource[UAC_MAX_CLOCK_SOURCE];
+} CAPABILITY_SNAPSHOT;
+
+class CapabilityCache
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    CapabilityCache(
+        _In_ WDFDEVICE device
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual ~CapabilityCache();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS Load(
+        _In_ const USB_DEVICE_DESCRIPTOR &         deviceDescriptor,
+        _In_ const PUSB_CONFIGURATION_DESCRIPTOR configurationDescriptor
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS Save();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool IsValid() const;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool GetSupportedSampleRate(
+        _In_ UCHAR    clockSourceID,
+        _Out_ ULONG & supportedSampleRate
+    ) const;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void SetSupportedSampleRate(
+        _In_ UCHAR clockSourceID,
+        _In_ ULONG supportedSampleRate
+    );
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    CapabilityCache * Create(
+        _In_ WDFDEVICE device
+    );
+
+  private:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    static ULONG HashConfigurationDescriptor(
+        _In_ const PUSB_CONFIGURATION_DESCRIPTOR configurationDescriptor
+    );
+
+    static const ULONG c_version = 1;
+    static const ULONG c_refreshInterval = 16; // A snapshot is rebuilt from the device after this many reuses.
+
+    WDFDEVICE           m_device{nullptr};
+    CAPABILITY_SNAPSHOT m_snapshot{};
+    bool                m_valid{false};
+    bool                m_dirty{false};
+};
+
+#endif
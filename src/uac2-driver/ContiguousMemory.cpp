@@ -16,7 +16,6 @@ Abstract:
 
     Implements a class that manages contiguous memory.
 
-
 Environment:
 
     Kernel-mode Driver Framework
@@ -31,6 +30,8 @@ Environment:
 #include "ContiguousMemory.h"
 #include "USBAudioConfiguration.h"
 
+static_assert(toULONG(IsoDirection::NumOfIsoDirection) <= IsoBufferSlab::c_maxRegions, "IsoBufferSlab has a region per direction");
+
 #ifndef __INTELLISENSE__
 #include "ContiguousMemory.tmh"
 #endif
@@ -73,6 +74,10 @@ Routine Description:
     Allocates contiguous memory for use in isochronous transfers. The optimal
     size of this area is calculated based on the contents of the USB Audio
     configuration.
+    The buffers of all directions and IRPs are carved out of a single slab.
+    Each slice starts on a cache line and is followed by guard bytes, which
+    are checked when the memory is cleared or freed. If the slab cannot be
+    allocated, each buffer is allocated separately as before.
 
 Arguments:
 
@@ -84,6 +89,9 @@ Arguments:
 
     framesPerMs -
 
+    stagedOutput - The mixing engine mixes the output in a cached staging
+    buffer and publishes it to the slab, which is then write-combined.
+
 Return Value:
 
     NTSTATUS - NT status value
@@ -93,7 +101,8 @@ ContiguousMemory::Allocate(
     USBAudioConfiguration * usbAudioConfiguration,
     ULONG                   maxBurstOverride,
     ULONG                   maxClassicFramesPerIrp,
-    ULONG                   framesPerMs
+    ULONG                   framesPerMs,
+    bool                    stagedOutput
 )
 {
     NTSTATUS         status = STATUS_SUCCESS;
@@ -109,9 +118,23 @@ ContiguousMemory::Allocate(
     boundaryAddressMultiple.QuadPart = 0;
     highestAcceptableAddress.QuadPart = 0xffffffff;
 
+    Free();
+
+    auto allocateScope = wil::scope_exit([&]() {
+        if (!NT_SUCCESS(status))
+        {
+            Free();
+        }
+    });
+
+    m_cacheType = stagedOutput ? MmWriteCombined : MmNonCached;
+    m_slabLayout.Reset();
+
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - this, m_contiguousMemory, %p, %p", this, m_contiguousMemory);
     for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
     {
+        m_contiguousMemorySize[direction] = 0;
+
         if ((static_cast<IsoDirection>(direction) == IsoDirection::In) && !usbAudioConfiguration->hasInputIsochronousInterface())
         {
             continue;
@@ -123,29 +146,82 @@ ContiguousMemory::Allocate(
         ULONG maxPacketSize = GetMaxPacketSize(usbAudioConfiguration, static_cast<IsoDirection>(direction));
         if (maxPacketSize == 0)
         {
-            return STATUS_UNSUCCESSFUL;
+            status = STATUS_UNSUCCESSFUL;
+            return status;
         }
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - maxPaccketSize %s = %d", GetDirectionString((IsoDirection)direction), maxPacketSize);
 
         // >>comment-001<<
         m_contiguousMemorySize[direction] = maxPacketSize * maxBurstOverride * maxClassicFramesPerIrp * framesPerMs;
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Max Contiguous Memory Size = %d", m_contiguousMemorySize[direction]);
+        m_slabLayout.SetBufferSize(direction, m_contiguousMemorySize[direction], UAC_MAX_IRP_NUMBER);
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Max Contiguous Memory Size = %d, stride = %u", m_contiguousMemorySize[direction], m_slabLayout.GetStride(direction));
 
-        for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+        if ((static_cast<IsoDirection>(direction) == IsoDirection::Out) && stagedOutput)
+        {
+            // One output packet is mixed at a time.
+            m_stagingBufferSize = static_cast<ULONG>(ALIGN_UP_BY(maxPacketSize * maxBurstOverride, IsoBufferSlab::c_sliceAlignment));
+        }
+    }
+
+    SIZE_T slabSize = m_slabLayout.GetSlabSize();
+    m_slab = (PUCHAR)MmAllocateContiguousMemorySpecifyCache(slabSize, lowestAcceptableAddress, highestAcceptableAddress, boundaryAddressMultiple, m_cacheType);
+    if (m_slab != nullptr)
+    {
+        m_slabSize = slabSize;
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - slab = %p, size = %Iu, cache type %u", m_slab, m_slabSize, static_cast<ULONG>(m_cacheType));
+
+        m_slabLayout.Carve(m_slab);
+        for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
         {
-            m_contiguousMemory[direction][index] = (PUCHAR)MmAllocateContiguousMemorySpecifyCache(m_contiguousMemorySize[direction], lowestAcceptableAddress, highestAcceptableAddress, boundaryAddressMultiple, MmNonCached);
-            if (m_contiguousMemory[direction][index] == nullptr)
+            if (m_contiguousMemorySize[direction] == 0)
             {
-                return STATUS_INSUFFICIENT_RESOURCES;
+                continue;
             }
+            for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+            {
+                m_contiguousMemory[direction][index] = m_slabLayout.GetBuffer(direction, index);
 
-            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "[%s][%d] = %p", GetDirectionString((IsoDirection)direction), index, m_contiguousMemory[direction][index]);
+                TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "[%s][%d] = %p", GetDirectionString((IsoDirection)direction), index, m_contiguousMemory[direction][index]);
+            }
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - m_contiguousMemory[%d], %p", direction, m_contiguousMemory[direction]);
+        }
+    }
+    else
+    {
+        TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, " - slab of %Iu bytes is not available, allocating the buffers separately", slabSize);
 
-            RtlZeroMemory(m_contiguousMemory[direction][index], m_contiguousMemorySize[direction]);
+        for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
+        {
+            if (m_contiguousMemorySize[direction] == 0)
+            {
+                continue;
+            }
+            for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+            {
+                m_contiguousMemory[direction][index] = (PUCHAR)MmAllocateContiguousMemorySpecifyCache(m_contiguousMemorySize[direction], lowestAcceptableAddress, highestAcceptableAddress, boundaryAddressMultiple, m_cacheType);
+                if (m_contiguousMemory[direction][index] == nullptr)
+                {
+                    status = STATUS_INSUFFICIENT_RESOURCES;
+                    return status;
+                }
 
-            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "[%s][%d] = %p", GetDirectionString((IsoDirection)direction), index, m_contiguousMemory[direction][index]);
+                RtlZeroMemory(m_contiguousMemory[direction][index], m_contiguousMemorySize[direction]);
+
+                TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "[%s][%d] = %p", GetDirectionString((IsoDirection)direction), index, m_contiguousMemory[direction][index]);
+            }
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - m_contiguousMemory[%d], %p", direction, m_contiguousMemory[direction]);
+        }
+    }
+
+    if (m_stagingBufferSize != 0)
+    {
+        m_stagingBuffer = (PUCHAR)ExAllocatePool2(POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED, m_stagingBufferSize, DRIVER_TAG);
+        if (m_stagingBuffer == nullptr)
+        {
+            // The output is mixed directly in the slab.
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, " - staging buffer of %u bytes is not available", m_stagingBufferSize);
+            m_stagingBufferSize = 0;
         }
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - m_contiguousMemory[%d], %p", direction, m_contiguousMemory[direction]);
     }
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
@@ -162,18 +238,37 @@ ContiguousMemory::Free()
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
+    if (m_slab != nullptr)
     {
-        for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+        m_slabLayout.VerifyGuardBytes();
+        MmFreeContiguousMemory(m_slab);
+        m_slab = nullptr;
+        m_slabSize = 0;
+        m_slabLayout.Reset();
+        RtlZeroMemory(m_contiguousMemory, sizeof(m_contiguousMemory));
+    }
+    else
+    {
+        for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
         {
-            if (m_contiguousMemory[direction][index] != nullptr)
+            for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
             {
-                MmFreeContiguousMemory(m_contiguousMemory[direction][index]);
-                m_contiguousMemory[direction][index] = nullptr;
+                if (m_contiguousMemory[direction][index] != nullptr)
+                {
+                    MmFreeContiguousMemory(m_contiguousMemory[direction][index]);
+                    m_contiguousMemory[direction][index] = nullptr;
+                }
             }
         }
     }
 
+    if (m_stagingBuffer != nullptr)
+    {
+        ExFreePoolWithTag(m_stagingBuffer, DRIVER_TAG);
+        m_stagingBuffer = nullptr;
+    }
+    m_stagingBufferSize = 0;
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 
     return STATUS_SUCCESS;
@@ -199,6 +294,8 @@ ContiguousMemory::Clear()
         }
     }
 
+    m_slabLayout.VerifyGuardBytes();
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 
     return STATUS_SUCCESS;
@@ -309,3 +406,28 @@ ContiguousMemory::GetMaxPacketSize(
 
     return maxPacketSize;
 }
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+PUCHAR
+ContiguousMemory::GetStagingBuffer(
+    ULONG length
+)
+/*++
+
+Routine Description:
+
+    Returns the cached buffer the output packet of the specified length is
+    mixed in, or nullptr if the output is mixed directly in the slab.
+
+--*/
+{
+    PUCHAR stagingBuffer = nullptr;
+
+    if ((m_stagingBuffer != nullptr) && (length <= m_stagingBufferSize))
+    {
+        stagingBuffer = m_stagingBuffer;
+    }
+
+    return stagingBuffer;
+}
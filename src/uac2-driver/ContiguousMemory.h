@@ -14,6 +14,9 @@ Module Name:
 Abstract:
 
     Defines a class that manages ContiguousMemory.
+    The buffers of all the isochronous transfers are carved out of a single
+    contiguous slab as cache-line aligned slices separated by guard bytes,
+    laid out by IsoBufferSlab.
 
 Environment:
 
@@ -24,6 +27,9 @@ Environment:
 #ifndef _CONTIGUOUSMEMORY_H_
 #define _CONTIGUOUSMEMORY_H_
 
+#include "StreamPlatform.h"
+#include "IsoBufferSlab.h"
+
 class ContiguousMemory
 {
   public:
@@ -41,7 +47,8 @@ class ContiguousMemory
         _In_ USBAudioConfiguration * usbAudioConfiguration,
         _In_ ULONG                   maxBurstOverride,
         _In_ ULONG                   maxClassicFramesPerIrp,
-        _In_ ULONG                   framesPerMs
+        _In_ ULONG                   framesPerMs,
+        _In_ bool                    stagedOutput
     );
 
     __drv_maxIRQL(PASSIVE_LEVEL)
@@ -84,6 +91,13 @@ class ContiguousMemory
         _In_ IsoDirection direction
     );
 
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    PUCHAR
+    GetStagingBuffer(
+        _In_ ULONG length
+    );
+
     static __drv_maxIRQL(DISPATCH_LEVEL)
     PAGED_CODE_SEG
     ContiguousMemory * Create();
@@ -97,8 +111,14 @@ class ContiguousMemory
         _In_ IsoDirection            direction
     );
 
-    ULONG  m_contiguousMemorySize[toInt(IsoDirection::NumOfIsoDirection)]{0};
-    PUCHAR m_contiguousMemory[toInt(IsoDirection::NumOfIsoDirection)][UAC_MAX_IRP_NUMBER]{};
+    ULONG               m_contiguousMemorySize[toInt(IsoDirection::NumOfIsoDirection)]{0};
+    PUCHAR              m_contiguousMemory[toInt(IsoDirection::NumOfIsoDirection)][UAC_MAX_IRP_NUMBER]{};
+    PUCHAR              m_slab{nullptr};              // nullptr when the slices were allocated one by one.
+    SIZE_T              m_slabSize{0};
+    IsoBufferSlab       m_slabLayout;
+    MEMORY_CACHING_TYPE m_cacheType{MmNonCached};
+    PUCHAR              m_stagingBuffer{nullptr};     // Cached buffer the output is mixed in before it is published.
+    ULONG               m_stagingBufferSize{0};
 };
 
 #endif
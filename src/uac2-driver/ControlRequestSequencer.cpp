@@ -0,0 +1,168 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    ControlRequestSequencer.cpp
+
+Abstract:
+
+    Implement the spacing and retry policy of the control requests.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "ControlRequestSequencer.h"
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "ControlRequestSequencer.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS ControlRequestSequencer::Run(
+    ControlRequestTransport &      transport,
+    const CONTROL_REQUEST_POLICY & policy,
+    bool                           isGet,
+    LONGLONG &                     lastRequestTime
+)
+/*++
+
+Routine Description:
+
+    Sends the request up to policy.RequestRetry times.
+    - A stall, or a device that is gone, ends the request.
+    - A babble is retried after RetryBackoffMs, doubled on every retry up to
+      16 times. A request that succeeds after a babble is sent once more
+      after RetryBackoffMs, because the data of the babbled transfer may
+      still be in the device. The last babble returns STATUS_BUFFER_TOO_SMALL.
+    - Any other failure is retried once with RetryTimeoutMs.
+
+Return Value:
+
+    NTSTATUS - the status of the last send
+
+--*/
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    ULONG    timeoutMs = policy.RequestTimeoutMs;
+    bool     babbleDetected = false;
+
+    PAGED_CODE();
+
+    for (ULONG retry = 0; retry < policy.RequestRetry; ++retry)
+    {
+        //
+        // Since some devices may return incorrect responses when sending
+        // Vendor Requests in succession, an interval is required.
+        //
+        if (!isGet || !policy.SkipIntervalForGet)
+        {
+            WaitForInterval(transport, policy.RequestIntervalMs, lastRequestTime);
+        }
+
+        lastRequestTime = transport.QueryTime();
+
+        ControlTransferError error = ControlTransferError::None;
+        status = transport.Send(timeoutMs, error);
+
+        if (!NT_SUCCESS(status))
+        {
+            if (error == ControlTransferError::Stall)
+            {
+                break;
+            }
+            if (status != STATUS_DEVICE_BUSY)
+            {
+                transport.CountFailure();
+            }
+            if ((status == STATUS_NO_SUCH_DEVICE) || (status == STATUS_DEVICE_DOES_NOT_EXIST))
+            {
+                break;
+            }
+            if (error == ControlTransferError::Babble)
+            {
+                if (retry == policy.RequestRetry - 1)
+                {
+                    status = STATUS_BUFFER_TOO_SMALL;
+                    break;
+                }
+                SleepUnlocked(transport, ((LONGLONG)policy.RetryBackoffMs << min(retry, 4UL)) * 10000LL);
+                babbleDetected = true;
+                continue;
+            }
+            if (retry != 0)
+            {
+                break;
+            }
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CTRLREQUEST, "retry...");
+            timeoutMs = policy.RetryTimeoutMs;
+            continue;
+        }
+
+        if (babbleDetected)
+        {
+            SleepUnlocked(transport, (LONGLONG)policy.RetryBackoffMs * 10000LL);
+            babbleDetected = false;
+            continue;
+        }
+        if (retry != 0)
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CTRLREQUEST, "retry succeed.");
+        }
+        break;
+    }
+
+    return status;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void ControlRequestSequencer::WaitForInterval(
+    ControlRequestTransport & transport,
+    ULONG                     requestIntervalMs,
+    const LONGLONG &          lastRequestTime
+)
+{
+    PAGED_CODE();
+
+    // Another thread may send a request while the lock is released, so the
+    // interval is measured again from its request after every sleep.
+    for (;;)
+    {
+        LONGLONG dueTime = lastRequestTime + ((LONGLONG)requestIntervalMs * 10000LL);
+        if (transport.QueryTime() >= dueTime)
+        {
+            break;
+        }
+        transport.Unlock();
+        transport.DelayUntil(dueTime);
+        transport.Lock();
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void ControlRequestSequencer::SleepUnlocked(
+    ControlRequestTransport & transport,
+    LONGLONG                  duration
+)
+{
+    PAGED_CODE();
+
+    LONGLONG dueTime = transport.QueryTime() + duration;
+
+    transport.Unlock();
+    transport.DelayUntil(dueTime);
+    transport.Lock();
+}
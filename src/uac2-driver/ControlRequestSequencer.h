@@ -0,0 +1,126 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    ControlRequestSequencer.h
+
+Abstract:
+
+    Define the spacing and retry policy of the control requests, separated
+    from the URB and the wait lock that ControlRequest() sends them with.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _CONTROLREQUESTSEQUENCER_H_
+#define _CONTROLREQUESTSEQUENCER_H_
+
+//
+// The USBD status of a failed control transfer, as far as the policy needs it.
+//
+enum class ControlTransferError
+{
+    None,
+    Stall,  // USBD_STATUS_STALL_PID
+    Babble, // USBD_STATUS_BABBLE_DETECTED
+    Other,
+};
+
+//
+// The operations the policy needs from the device and the OS. ControlRequest()
+// implements them on the URB and the control request wait lock of the device.
+//
+class ControlRequestTransport
+{
+  public:
+    // Sends the request once and waits for its completion. Called with the lock held.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual NTSTATUS Send(
+        _In_ ULONG                   timeoutMs,
+        _Out_ ControlTransferError & error
+    ) = 0;
+
+    // Returns the system time in 100ns units.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual LONGLONG QueryTime() = 0;
+
+    // Sleeps until the system time reaches time. Called without the lock.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual void DelayUntil(
+        _In_ LONGLONG time
+    ) = 0;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual void Lock() = 0;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual void Unlock() = 0;
+
+    // Counts a failure other than STATUS_DEVICE_BUSY in the error statistics.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual void CountFailure() = 0;
+};
+
+typedef struct CONTROL_REQUEST_POLICY_
+{
+    ULONG RequestIntervalMs;  // Minimum interval between two control requests.
+    bool  SkipIntervalForGet; // GET requests are sent without waiting for RequestIntervalMs.
+    ULONG RequestRetry;       // Maximum number of sends.
+    ULONG RetryBackoffMs;     // Initial wait after a babble, doubled on every retry.
+    ULONG RequestTimeoutMs;   // Timeout of the first send, 0 = infinite wait.
+    ULONG RetryTimeoutMs;     // Timeout of the send that follows a failure other than a babble.
+} CONTROL_REQUEST_POLICY;
+
+//
+// Sends one control request through the transport. The lock of the transport
+// is held on entry and on return; it is released only while the policy sleeps,
+// so that the other threads can send their requests in the meantime.
+// lastRequestTime is shared by all the requests of the device and is only
+// accessed with the lock held.
+//
+class ControlRequestSequencer
+{
+  public:
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS Run(
+        _In_ ControlRequestTransport &      transport,
+        _In_ const CONTROL_REQUEST_POLICY & policy,
+        _In_ bool                           isGet,
+        _Inout_ LONGLONG &                  lastRequestTime
+    );
+
+  private:
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void WaitForInterval(
+        _In_ ControlRequestTransport & transport,
+        _In_ ULONG                     requestIntervalMs,
+        _In_ const LONGLONG &          lastRequestTime
+    );
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void SleepUnlocked(
+        _In_ ControlRequestTransport & transport,
+        _In_ LONGLONG                  duration
+    );
+};
+
+#endif
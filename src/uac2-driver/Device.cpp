@@ -31,12 +31,18 @@ Environment:
 #include "USBAudio.h"
 #include "USBAudioConfiguration.h"
 #include "ContiguousMemory.h"
+#include "IsoRequestPool.h"
 #include "TransferObject.h"
 #include "StreamObject.h"
 #include "RtPacketObject.h"
 #include "AsioBufferObject.h"
 #include "StreamEngine.h"
 #include "ErrorStatistics.h"
+#include "LatencyStatistics.h"
+#include "OverloadPredictor.h"
+#include "OffsetTuner.h"
+#include "EventTrace.h"
+#include "CapabilityCache.h"
 #include "CircuitHelper.h"
 
 #ifndef __INTELLISENSE__
@@ -60,8 +66,12 @@ UNICODE_STRING g_RegistryPath{}; // This is used to store the registry settings
 // At this time, all devices operate correctly with a unified behavior,
 // so only the default parameters are defined.
 //
+// RateEstimator, StagedOutputBuffer, MixBus, SplitRenderThread, DeadlineWakeUp,
+// AutoTuneOffsets and PredictOverload can also be overridden per device from
+// the registry (see ReadSupportedControlOverrides).
+//
 static const UAC_SUPPORTED_CONTROL_LIST g_SupportedControlList[] = {
-    {0xffff, 0xffff, 0x0000, 0x0000, true, true, true, false, 5000 /* 5sec */, 3, 1},
+    {0xffff, 0xffff, 0x0000, 0x0000, true, true, true, false, 5000 /* 5sec */, 3, 1, RateEstimatorType::Direct, 10 /* ms */, false, 100 /* ms */, false, MixBusType::Native, false, false, false, false},
 };
 
 static const int g_SupportedControlCount = sizeof(g_SupportedControlList) / sizeof(g_SupportedControlList[0]);
@@ -248,6 +258,12 @@ static NTSTATUS GetHubCount(
     _Out_ ULONG &        hubCount
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static void ReadSupportedControlOverrides(
+    _In_ PDEVICE_CONTEXT deviceContext
+);
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static NTSTATUS
@@ -281,6 +297,12 @@ static NTSTATUS CalculateUsbLatency(
     _Out_ PUAC_USB_LATENCY usbLatency
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+static void ApplyTunedOffsets(
+    _In_ PDEVICE_CONTEXT deviceContext
+);
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static void BuildChannelMap(
@@ -660,12 +682,27 @@ Return Value:
     deviceContext->ContiguousMemory = ContiguousMemory::Create();
     RETURN_NTSTATUS_IF_TRUE(deviceContext->ContiguousMemory == nullptr, STATUS_INSUFFICIENT_RESOURCES);
 
+    deviceContext->IsoRequestPool = IsoRequestPool::Create(deviceContext);
+    RETURN_NTSTATUS_IF_TRUE(deviceContext->IsoRequestPool == nullptr, STATUS_INSUFFICIENT_RESOURCES);
+
     deviceContext->RtPacketObject = RtPacketObject::Create(deviceContext);
     RETURN_NTSTATUS_IF_TRUE(deviceContext->RtPacketObject == nullptr, STATUS_INSUFFICIENT_RESOURCES);
 
     deviceContext->ErrorStatistics = ErrorStatistics::Create();
     RETURN_NTSTATUS_IF_TRUE(deviceContext->ErrorStatistics == nullptr, STATUS_INSUFFICIENT_RESOURCES);
 
+    deviceContext->LatencyStatistics = LatencyStatistics::Create();
+    RETURN_NTSTATUS_IF_TRUE(deviceContext->LatencyStatistics == nullptr, STATUS_INSUFFICIENT_RESOURCES);
+
+    deviceContext->OverloadPredictor = OverloadPredictor::Create();
+    RETURN_NTSTATUS_IF_TRUE(deviceContext->OverloadPredictor == nullptr, STATUS_INSUFFICIENT_RESOURCES);
+
+    deviceContext->EventTrace = EventTrace::Create();
+    RETURN_NTSTATUS_IF_TRUE(deviceContext->EventTrace == nullptr, STATUS_INSUFFICIENT_RESOURCES);
+
+    deviceContext->CapabilityCache = CapabilityCache::Create(device);
+    RETURN_NTSTATUS_IF_TRUE(deviceContext->CapabilityCache == nullptr, STATUS_INSUFFICIENT_RESOURCES);
+
     //
     // The driver calls this DDI in its AddDevice callback after creating the PnP
     // device. ACX uses this call to apply any post device settings.
@@ -734,6 +771,13 @@ Return Value:
         return status;
     }
 
+    status = WdfWaitLockCreate(&attributes, &deviceContext->ControlRequestWaitLock);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "WdfWaitLockCreate failed %!STATUS!", status);
+        return status;
+    }
+
     status = ReadAndSelectDescriptors(device);
     if (!NT_SUCCESS(status))
     {
@@ -755,6 +799,7 @@ Return Value:
         deviceContext->Params.BufferThreadPriority = UAC_DEFAULT_BUFFER_THREAD_PRIORITY;
         deviceContext->Params.ClassicFramesPerIrp2 = UAC_DEFAULT_CLASSIC_FRAMES_PER_IRP;
         deviceContext->Params.SuggestedBufferPeriod = UAC_DEFAULT_SUGGESTED_BUFFER_PERIOD;
+        deviceContext->Params.SampleRateWindowMs = UAC_DEFAULT_SAMPLE_RATE_WINDOW_MS;
 
         deviceContext->SupportedControl = g_SupportedControlList[0];
         for (int i = 1; i < g_SupportedControlCount; ++i)
@@ -770,6 +815,8 @@ Return Value:
             }
         }
 
+        ReadSupportedControlOverrides(deviceContext);
+
         deviceContext->DesiredSampleFormat = UACSampleFormat::UAC_SAMPLE_FORMAT_PCM;
     }
 
@@ -854,6 +901,12 @@ Return Value:
         //
         RETURN_NTSTATUS_IF_FAILED(deviceContext->UsbAudioConfiguration->ParseDescriptors(deviceContext->UsbConfigurationDescriptor));
 
+        //
+        // Loads the capabilities saved on the previous start. If the snapshot matches this
+        // device and configuration descriptor, the range requests below are answered from it.
+        //
+        RETURN_NTSTATUS_IF_FAILED(deviceContext->CapabilityCache->Load(deviceContext->UsbDeviceDescriptor, deviceContext->UsbConfigurationDescriptor));
+
         //
         // Queries all control settings for the current device.
         // Immediately after connecting the device, if you make an inquiry, it
@@ -869,6 +922,11 @@ Return Value:
             ++retryCount;
         }
 
+        if (NT_SUCCESS(status))
+        {
+            deviceContext->CapabilityCache->Save();
+        }
+
         // TBD
         // Normally it is read from the registry and written to the registry when the device is destroyed.
         //
@@ -952,7 +1010,20 @@ Return Value:
     // with 4GB or more of memory, contiguous memory is allocated in
     // an area less than 4GB.
     //
-    RETURN_NTSTATUS_IF_FAILED(deviceContext->ContiguousMemory->Allocate(deviceContext->UsbAudioConfiguration, deviceContext->SupportedControl.MaxBurstOverride, UAC_MAX_CLASSIC_FRAMES_PER_IRP, deviceContext->FramesPerMs));
+    RETURN_NTSTATUS_IF_FAILED(deviceContext->ContiguousMemory->Allocate(deviceContext->UsbAudioConfiguration, deviceContext->SupportedControl.MaxBurstOverride, UAC_MAX_CLASSIC_FRAMES_PER_IRP, deviceContext->FramesPerMs, deviceContext->SupportedControl.StagedOutputBuffer));
+
+    //
+    // The requests and URBs of the isochronous transfers are created on
+    // their pipes by the first transfer and re-armed on every transfer
+    // after that. If this fails, the transfer objects create their own
+    // requests as before.
+    //
+    status = deviceContext->IsoRequestPool->Allocate(UAC_MAX_CLASSIC_FRAMES_PER_IRP, deviceContext->FramesPerMs);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "IsoRequestPool::Allocate failed %!STATUS!", status);
+        status = STATUS_SUCCESS;
+    }
 
     //
     // The driver uses this DDI to associate a circuit to a device. After
@@ -1010,6 +1081,12 @@ Return Value:
     deviceContext = GetDeviceContext(device);
     NT_ASSERT(deviceContext != nullptr);
 
+    if (deviceContext->IsoRequestPool != nullptr)
+    {
+        deviceContext->IsoRequestPool->Report();
+        deviceContext->IsoRequestPool->Free();
+    }
+
     if (deviceContext->ContiguousMemory != nullptr)
     {
         delete deviceContext->ContiguousMemory;
@@ -1046,6 +1123,12 @@ Return Value:
         deviceContext->ErrorStatistics = nullptr;
     }
 
+    if (deviceContext->OffsetTuner != nullptr)
+    {
+        delete deviceContext->OffsetTuner;
+        deviceContext->OffsetTuner = nullptr;
+    }
+
     //
     // The driver uses this DDI to delete a circuit from the current device.
     //
@@ -2213,6 +2296,40 @@ Return Value:
 
     pDevContext = GetDeviceContext(device);
 
+    //
+    // The objects created in USBAudioAcxDriverCreateDevice live as long as the device,
+    // across ReleaseHardware and PrepareHardware, and are deleted here.
+    //
+    if (pDevContext->LatencyStatistics != nullptr)
+    {
+        delete pDevContext->LatencyStatistics;
+        pDevContext->LatencyStatistics = nullptr;
+    }
+
+    if (pDevContext->OverloadPredictor != nullptr)
+    {
+        delete pDevContext->OverloadPredictor;
+        pDevContext->OverloadPredictor = nullptr;
+    }
+
+    if (pDevContext->EventTrace != nullptr)
+    {
+        delete pDevContext->EventTrace;
+        pDevContext->EventTrace = nullptr;
+    }
+
+    if (pDevContext->CapabilityCache != nullptr)
+    {
+        delete pDevContext->CapabilityCache;
+        pDevContext->CapabilityCache = nullptr;
+    }
+
+    if (pDevContext->IsoRequestPool != nullptr)
+    {
+        delete pDevContext->IsoRequestPool;
+        pDevContext->IsoRequestPool = nullptr;
+    }
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
@@ -2540,6 +2657,13 @@ ActivateAudioInterface(
 
     BuildChannelMap(deviceContext);
 
+    // Resolve the ASIO format converters once for the new format so that the
+    // mixing thread does not branch on the sample format for every buffer.
+    if (deviceContext->AsioBufferObject != nullptr)
+    {
+        deviceContext->AsioBufferObject->SelectConverters();
+    }
+
     if (deviceContext->UsbAudioConfiguration->hasInputIsochronousInterface() || deviceContext->UsbAudioConfiguration->hasOutputIsochronousInterface())
     {
         status = STATUS_SUCCESS;
@@ -2657,6 +2781,22 @@ NTSTATUS CalculateUsbLatency(
     }
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "Out Offset : %ums, %uframes, %uframes minimum", usbLatency->OutputOffsetMs, usbLatency->OutputOffsetFrame, usbLatency->OutputMinOffsetFrame);
 
+    if (deviceContext->SupportedControl.AutoTuneOffsets)
+    {
+        // The offsets chosen by OffsetTuner in the previous stream replace the configured ones.
+        if (deviceContext->TunedInputOffsetFrame != 0)
+        {
+            usbLatency->InputOffsetFrame = deviceContext->TunedInputOffsetFrame;
+            usbLatency->InputOffsetMs = usbLatency->InputOffsetFrame / deviceContext->FramesPerMs;
+        }
+        if (deviceContext->TunedOutputOffsetFrame != 0)
+        {
+            usbLatency->OutputOffsetFrame = max(deviceContext->TunedOutputOffsetFrame, usbLatency->OutputMinOffsetFrame);
+            usbLatency->OutputOffsetMs = usbLatency->OutputOffsetFrame / deviceContext->FramesPerMs;
+        }
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "Tuned Offset : In %uframes, Out %uframes", usbLatency->InputOffsetFrame, usbLatency->OutputOffsetFrame);
+    }
+
     usbLatency->InputDriverBuffer = (ULONG)((double)(sampleRate * (classicFramesPerIrp * deviceContext->FramesPerMs + usbLatency->InputOffsetFrame)) / (double)(deviceContext->FramesPerMs * 1000));
     usbLatency->OutputDriverBuffer = (ULONG)((double)(sampleRate * usbLatency->OutputOffsetFrame /* - usbLatency->InputOffsetFrame */) / (double)(deviceContext->FramesPerMs * 1000));
 
@@ -2684,6 +2824,92 @@ NTSTATUS CalculateUsbLatency(
     return STATUS_SUCCESS;
 }
 
+NONPAGED_CODE_SEG
+_Use_decl_annotations_
+void UpdateTunedOffsets(
+    PDEVICE_CONTEXT deviceContext,
+    ULONG           inputOffsetFrame,
+    ULONG           outputOffsetFrame
+)
+/*++
+
+Routine Description:
+
+    Stores the offsets chosen by OffsetTuner. The running stream keeps its
+    offsets and the latencies reported for them; the new ones are applied
+    by ApplyTunedOffsets when the stream starts again. It is called from
+    the mixing engine thread, so it must stay in non-paged code.
+
+--*/
+{
+    deviceContext->TunedInputOffsetFrame = inputOffsetFrame;
+    deviceContext->TunedOutputOffsetFrame = outputOffsetFrame;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - Tuned Offset for the next stream start In %u frames, Out %u frames", inputOffsetFrame, outputOffsetFrame);
+}
+
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+void ApplyTunedOffsets(
+    PDEVICE_CONTEXT deviceContext
+)
+/*++
+
+Routine Description:
+
+    Called before a stream starts. Applies the offsets stored by
+    UpdateTunedOffsets and reports the latencies they result in. Any change
+    of the latencies is notified to the ASIO client with LatencyChanged, so
+    that it queries them again.
+
+--*/
+{
+    PAGED_CODE();
+
+    if (!deviceContext->SupportedControl.AutoTuneOffsets)
+    {
+        return;
+    }
+
+    if (deviceContext->OffsetTuner == nullptr)
+    {
+        deviceContext->OffsetTuner = OffsetTuner::Create();
+        if (deviceContext->OffsetTuner == nullptr)
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "OffsetTuner::Create failed, the offsets are not tuned");
+            return;
+        }
+    }
+
+    if (((deviceContext->TunedInputOffsetFrame == 0) || (deviceContext->TunedInputOffsetFrame == deviceContext->UsbLatency.InputOffsetFrame)) &&
+        ((deviceContext->TunedOutputOffsetFrame == 0) || (deviceContext->TunedOutputOffsetFrame == deviceContext->UsbLatency.OutputOffsetFrame)))
+    {
+        return;
+    }
+
+    const ULONG inputLatency = deviceContext->UsbLatency.InputLatency;
+    const ULONG outputLatency = deviceContext->UsbLatency.OutputLatency;
+
+    RtlZeroMemory(&deviceContext->UsbLatency, sizeof(UAC_USB_LATENCY));
+    CalculateUsbLatency(deviceContext, &deviceContext->UsbLatency);
+
+    deviceContext->AudioProperty.InputLatencyOffset = deviceContext->UsbLatency.InputLatency;
+    deviceContext->AudioProperty.OutputLatencyOffset = deviceContext->UsbLatency.OutputLatency;
+    deviceContext->AudioProperty.InputDriverBuffer = deviceContext->UsbLatency.InputDriverBuffer;
+    deviceContext->AudioProperty.OutputDriverBuffer = deviceContext->UsbLatency.OutputDriverBuffer;
+
+    if (deviceContext->AsioBufferObject != nullptr && deviceContext->AsioBufferObject->IsRecHeaderRegistered())
+    {
+        deviceContext->AsioBufferObject->SetOffsetFrames(deviceContext->UsbLatency.InputOffsetFrame, deviceContext->UsbLatency.OutputOffsetFrame);
+        if ((deviceContext->UsbLatency.InputLatency != inputLatency) || (deviceContext->UsbLatency.OutputLatency != outputLatency))
+        {
+            deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::LatencyChanged);
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - Tuned Latency Offset In %d samples, Out %d samples", deviceContext->AudioProperty.InputLatencyOffset, deviceContext->AudioProperty.OutputLatencyOffset);
+}
+
 PAGED_CODE_SEG
 static _Use_decl_annotations_
 void BuildChannelMap(
@@ -2748,6 +2974,15 @@ NTSTATUS SetPipeInformation(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    //
+    // The pipes selected below have new I/O targets. The pooled requests
+    // created on the previous ones are created again on their next use.
+    //
+    if (deviceContext->IsoRequestPool != nullptr)
+    {
+        deviceContext->IsoRequestPool->InvalidatePipes();
+    }
+
     // deviceContext->PipeInformationIn       = nullptr;
     // deviceContext->PipeInformationOut      = nullptr;
     // deviceContext->PipeInformationFeedback = nullptr;
@@ -2963,6 +3198,72 @@ NTSTATUS GetHubCount(
     return status;
 }
 
+//
+// The streaming options of g_SupportedControlList can be overridden per device
+// by REG_DWORD values in the device hardware key (see USBAudio2-ACX_AddReg in
+// the INF), so that an option can be enabled for a device before it has its
+// own row. A value that is absent or out of range leaves the row unchanged.
+//
+PAGED_CODE_SEG
+static _Use_decl_annotations_
+void ReadSupportedControlOverrides(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    WDFKEY   key = nullptr;
+    ULONG    value = 0;
+
+    DECLARE_CONST_UNICODE_STRING(rateEstimatorValueName, L"RateEstimator");
+    DECLARE_CONST_UNICODE_STRING(stagedOutputBufferValueName, L"StagedOutputBuffer");
+    DECLARE_CONST_UNICODE_STRING(mixBusValueName, L"MixBus");
+    DECLARE_CONST_UNICODE_STRING(splitRenderThreadValueName, L"SplitRenderThread");
+    DECLARE_CONST_UNICODE_STRING(deadlineWakeUpValueName, L"DeadlineWakeUp");
+    DECLARE_CONST_UNICODE_STRING(autoTuneOffsetsValueName, L"AutoTuneOffsets");
+    DECLARE_CONST_UNICODE_STRING(predictOverloadValueName, L"PredictOverload");
+
+    PAGED_CODE();
+
+    status = WdfDeviceOpenRegistryKey(deviceContext->Device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &key);
+    if (!NT_SUCCESS(status))
+    {
+        return;
+    }
+
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &rateEstimatorValueName, &value)) && (value <= toInt(RateEstimatorType::Pll)))
+    {
+        deviceContext->SupportedControl.RateEstimator = static_cast<RateEstimatorType>(value);
+    }
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &stagedOutputBufferValueName, &value)))
+    {
+        deviceContext->SupportedControl.StagedOutputBuffer = (value != 0);
+    }
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &mixBusValueName, &value)) && (value <= toInt(MixBusType::FloatDither)))
+    {
+        deviceContext->SupportedControl.MixBus = static_cast<MixBusType>(value);
+    }
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &splitRenderThreadValueName, &value)))
+    {
+        deviceContext->SupportedControl.SplitRenderThread = (value != 0);
+    }
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &deadlineWakeUpValueName, &value)))
+    {
+        deviceContext->SupportedControl.DeadlineWakeUp = (value != 0);
+    }
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &autoTuneOffsetsValueName, &value)))
+    {
+        deviceContext->SupportedControl.AutoTuneOffsets = (value != 0);
+    }
+    if (NT_SUCCESS(WdfRegistryQueryULong(key, &predictOverloadValueName, &value)))
+    {
+        deviceContext->SupportedControl.PredictOverload = (value != 0);
+    }
+
+    WdfRegistryClose(key);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - rate estimator %u, staged output %!bool!, mix bus %u, split render %!bool!, deadline wake up %!bool!, auto tune %!bool!, predict overload %!bool!", toInt(deviceContext->SupportedControl.RateEstimator), deviceContext->SupportedControl.StagedOutputBuffer, toInt(deviceContext->SupportedControl.MixBus), deviceContext->SupportedControl.SplitRenderThread, deviceContext->SupportedControl.DeadlineWakeUp, deviceContext->SupportedControl.AutoTuneOffsets, deviceContext->SupportedControl.PredictOverload);
+}
+
 PAGED_CODE_SEG
 _Use_decl_annotations_
 ULONG
@@ -3663,7 +3964,9 @@ bool IsValidFlags(
         (flags->InputHubOffset > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
         ((flags->OutputBufferOperationOffset & 0xfffffff) > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
         (flags->OutputHubOffset > UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_IRP_NUMBER * 8) ||
-        (flags->BufferThreadPriority > HIGH_PRIORITY))
+        (flags->BufferThreadPriority > HIGH_PRIORITY) ||
+        ((flags->SampleRateWindowMs != 0) && (flags->SampleRateWindowMs < UAC_MIN_SAMPLE_RATE_WINDOW_MS)) ||
+        (flags->SampleRateWindowMs > UAC_MAX_SAMPLE_RATE_WINDOW_MS))
     {
         isValid = false;
     }
@@ -3700,6 +4003,10 @@ NTSTATUS ConvertFlags(
     flags->ClassicFramesPerIrp2 = g_DriverSettingsTable[bufferSizeIndex].Parameter.ClassicFramesPerIrp2;
     flags->OutputBufferOperationOffset = g_DriverSettingsTable[bufferSizeIndex].Parameter.OutputBufferOperationOffset;
     flags->InputBufferOperationOffset = g_DriverSettingsTable[bufferSizeIndex].Parameter.InputBufferOperationOffset;
+    if (flags->SampleRateWindowMs == 0)
+    {
+        flags->SampleRateWindowMs = UAC_DEFAULT_SAMPLE_RATE_WINDOW_MS;
+    }
 
     return STATUS_SUCCESS;
 }
@@ -3766,6 +4073,107 @@ Exit:
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
 }
 
+PAGED_CODE_SEG
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverGetStatistics(
+    WDFOBJECT  object,
+    WDFREQUEST request
+)
+{
+    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    ACX_REQUEST_PARAMETERS params{};
+    ULONG_PTR              outDataCb = 0;
+
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_STATISTICS));
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
+                         (params.Parameters.Property.ControlCb != 0) ||
+                         (params.Parameters.Property.Value == nullptr) ||
+                         (params.Parameters.Property.ValueCb < sizeof(UAC_STATISTICS))),
+                        ASSERT(FALSE);
+                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
+                                                                         Exit);
+    IF_TRUE_ACTION_JUMP(deviceContext->LatencyStatistics == nullptr, outDataCb = 0; status = STATUS_UNSUCCESSFUL;, Exit);
+    IF_TRUE_ACTION_JUMP(deviceContext->OverloadPredictor == nullptr, outDataCb = 0; status = STATUS_UNSUCCESSFUL;, Exit);
+
+    // LatencyStatistics clears the whole structure, so it is filled first.
+    deviceContext->LatencyStatistics->GetStatistics(*static_cast<PUAC_STATISTICS>(params.Parameters.Property.Value));
+    deviceContext->OverloadPredictor->GetStatistics(*static_cast<PUAC_STATISTICS>(params.Parameters.Property.Value));
+
+    outDataCb = sizeof(UAC_STATISTICS);
+
+    status = STATUS_SUCCESS;
+Exit:
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+}
+
+PAGED_CODE_SEG
+_Use_decl_annotations_
+VOID EvtUSBAudioAcxDriverGetEventTrace(
+    WDFOBJECT  object,
+    WDFREQUEST request
+)
+{
+    NTSTATUS               status = STATUS_NOT_SUPPORTED;
+    ACX_REQUEST_PARAMETERS params{};
+    ULONG_PTR              outDataCb = 0;
+
+    WDFDEVICE device = AcxCircuitGetWdfDevice((ACXCIRCUIT)object);
+    ASSERT(device != nullptr);
+
+    PDEVICE_CONTEXT deviceContext = GetDeviceContext(device);
+    ASSERT(deviceContext != nullptr);
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ACX_REQUEST_PARAMETERS_INIT(&params);
+    AcxRequestGetParameters(request, &params);
+
+    ASSERT(params.Type == AcxRequestTypeProperty);
+    ASSERT(params.Parameters.Property.Verb == AcxPropertyVerbGet);
+    ASSERT(params.Parameters.Property.Control == nullptr);
+    ASSERT(params.Parameters.Property.ControlCb == 0);
+    ASSERT(params.Parameters.Property.Value != nullptr);
+    ASSERT(params.Parameters.Property.ValueCb == sizeof(UAC_EVENT_TRACE));
+
+    IF_TRUE_ACTION_JUMP(((params.Parameters.Property.Control != nullptr) ||
+                         (params.Parameters.Property.ControlCb != 0) ||
+                         (params.Parameters.Property.Value == nullptr) ||
+                         (params.Parameters.Property.ValueCb < sizeof(UAC_EVENT_TRACE))),
+                        ASSERT(FALSE);
+                        outDataCb = 0; status = STATUS_INVALID_PARAMETER;,
+                                                                         Exit);
+    IF_TRUE_ACTION_JUMP(deviceContext->EventTrace == nullptr, outDataCb = 0; status = STATUS_UNSUCCESSFUL;, Exit);
+
+    status = deviceContext->EventTrace->Drain(*static_cast<PUAC_EVENT_TRACE>(params.Parameters.Property.Value));
+    IF_FAILED_ACTION_JUMP(status, outDataCb = 0;, Exit);
+
+    outDataCb = sizeof(UAC_EVENT_TRACE);
+
+Exit:
+    WdfRequestCompleteWithInformation(request, status, outDataCb);
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
+}
+
 PAGED_CODE_SEG
 _Use_decl_annotations_
 VOID EvtUSBAudioAcxDriverGetChannelInfo(
@@ -4153,7 +4561,8 @@ VOID EvtUSBAudioAcxDriverSetFlags(
              (deviceContext->Params.OutputBufferOperationOffset != flags->OutputBufferOperationOffset) ||
              (deviceContext->Params.OutputHubOffset != flags->OutputHubOffset) ||
              (deviceContext->Params.BufferThreadPriority != flags->BufferThreadPriority) ||
-             (deviceContext->Params.SuggestedBufferPeriod != flags->SuggestedBufferPeriod))
+             (deviceContext->Params.SuggestedBufferPeriod != flags->SuggestedBufferPeriod) ||
+             (deviceContext->Params.SampleRateWindowMs != ((flags->SampleRateWindowMs != 0) ? flags->SampleRateWindowMs : UAC_DEFAULT_SAMPLE_RATE_WINDOW_MS)))
     {
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - FirstPacketLatency        = %u -> %u", deviceContext->Params.FirstPacketLatency, flags->FirstPacketLatency);
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - ClassicFramesPerIrp       = %u -> %u", deviceContext->Params.ClassicFramesPerIrp, flags->ClassicFramesPerIrp);
@@ -4168,6 +4577,7 @@ VOID EvtUSBAudioAcxDriverSetFlags(
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - OutputHubOffset              = %u -> %u", deviceContext->Params.OutputHubOffset, flags->OutputHubOffset);
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - BufferThreadPriority      = %u -> %u", deviceContext->Params.BufferThreadPriority, flags->BufferThreadPriority);
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - SuggestedBufferPeriod     = %u -> %u", deviceContext->Params.SuggestedBufferPeriod, flags->SuggestedBufferPeriod);
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - SampleRateWindowMs        = %u -> %u", deviceContext->Params.SampleRateWindowMs, flags->SampleRateWindowMs);
 
         WdfWaitLockAcquire(deviceContext->StreamWaitLock, nullptr);
         TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_MULTICLIENT, " - start counter asio %ld, start counter acx audio %ld, start counter iso stream %ld", deviceContext->StartCounterAsio, deviceContext->StartCounterWdmAudio, deviceContext->StartCounterIsoStream);
@@ -4194,6 +4604,7 @@ VOID EvtUSBAudioAcxDriverSetFlags(
         deviceContext->Params.BufferThreadPriority = tempFlags.BufferThreadPriority;
         deviceContext->Params.ClassicFramesPerIrp2 = tempFlags.ClassicFramesPerIrp2;
         deviceContext->Params.SuggestedBufferPeriod = tempFlags.SuggestedBufferPeriod;
+        deviceContext->Params.SampleRateWindowMs = tempFlags.SampleRateWindowMs;
 
         ULONG desiredFormatType = NS_USBAudio0200::FORMAT_TYPE_I;
         ULONG desiredFormat = NS_USBAudio0200::PCM;
@@ -5285,6 +5696,8 @@ NTSTATUS StartIsoStream(
     }
     RETURN_NTSTATUS_IF_FAILED(status);
 
+    ApplyTunedOffsets(deviceContext);
+
     if ((deviceContext->OutputInterfaceAndPipe.Pipe != nullptr) && (deviceContext->InputInterfaceAndPipe.Pipe == nullptr))
     { // output only
         deviceContext->StreamObject = StreamObject::Create(deviceContext, StreamStatuses::OutputStable, StreamStatuses::OutputStreaming, (StreamStatuses)(toInt(StreamStatuses::OutputStable) | toInt(StreamStatuses::OutputStreaming)));
@@ -5797,6 +6210,10 @@ NTSTATUS StopIsoStream(
     {
         deviceContext->ErrorStatistics->Report();
     }
+    if (deviceContext->IsoRequestPool != nullptr)
+    {
+        deviceContext->IsoRequestPool->Report();
+    }
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
     return status;
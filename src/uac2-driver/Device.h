@@ -41,12 +41,18 @@ Environment:
 
 class CStreamEngine;
 class ContiguousMemory;
+class IsoRequestPool;
 class MixingEngineThread;
 class RtPacketObject;
 class StreamObject;
 class TransferObject;
 class AsioBufferObject;
 class ErrorStatistics;
+class LatencyStatistics;
+class OverloadPredictor;
+class OffsetTuner;
+class EventTrace;
+class CapabilityCache;
 class USBAudioConfiguration;
 
 EXTERN_C_START
@@ -80,21 +86,81 @@ typedef struct UAC_LATENCY_OFFSET_LIST_
     ULONG OutputHubOffset;
 } UAC_LATENCY_OFFSET_LIST, *PUAC_LATENCY_OFFSET_LIST;
 
+//
+// Selects how the size of the output packets is derived from the device rate.
+// Direct: the samples reported for the previous IRP are sent as they are.
+// Pll:    the reported rate is smoothed by RateEstimator.
+//
+enum class RateEstimatorType
+{
+    Direct = 0,
+    Pll
+};
+
+constexpr int toInt(RateEstimatorType estimatorType)
+{
+    return static_cast<int>(estimatorType);
+}
+
+//
+// Selects how the render devices are mixed into the USB packets.
+// Native:      each device is added in the USB format, saturating on every add.
+// Float:       the devices are accumulated in float and quantized once.
+// FloatDither: as Float, with TPDF dither for 16-bit and 24-bit USB formats.
+//
+enum class MixBusType
+{
+    Native = 0,
+    Float,
+    FloatDither
+};
+
+constexpr int toInt(MixBusType mixBusType)
+{
+    return static_cast<int>(mixBusType);
+}
+
 typedef struct UAC_SUPPORTED_CONTROL_LIST_
 {
-    USHORT VendorId;
-    USHORT ProductId;
-    USHORT DeviceRelease;
-    USHORT DeviceReleaseMask;
-    bool   ClassRequestSupported;
-    bool   VendorRequestSupported;
-    bool   AvoidToSetSameAlternate;
-    bool   SkipInitialSamples;
-    ULONG  RequestTimeOut;
-    ULONG  RequestRetry;
-    ULONG  MaxBurstOverride;
+    USHORT            VendorId;
+    USHORT            ProductId;
+    USHORT            DeviceRelease;
+    USHORT            DeviceReleaseMask;
+    bool              ClassRequestSupported;
+    bool              VendorRequestSupported;
+    bool              AvoidToSetSameAlternate;
+    bool              SkipInitialSamples;
+    ULONG             RequestTimeOut;
+    ULONG             RequestRetry;
+    ULONG             MaxBurstOverride;
+    RateEstimatorType RateEstimator;
+    ULONG             RequestIntervalMs;   // Minimum interval between two control requests.
+    bool              SkipIntervalForGet;  // GET requests are sent without waiting for RequestIntervalMs. They are still sent one at a time.
+    ULONG             RetryBackoffMs;      // Initial wait after a babble, doubled on every retry.
+    bool              StagedOutputBuffer;  // The output is mixed in cached memory and published to a write-combined iso buffer.
+    MixBusType        MixBus;
+    bool              SplitRenderThread;   // The output packets are written by a render thread in parallel with the input.
+    bool              DeadlineWakeUp;      // The mixing engine thread sleeps until the next packet or ASIO boundary instead of waking up periodically.
+    bool              AutoTuneOffsets;     // The buffer operation offsets are adjusted from the measured latencies.
+    bool              PredictOverload;     // OverloadPredicted is raised before a dropout.
 } UAC_SUPPORTED_CONTROL_LIST, *PUAC_SUPPORTED_CONTROL_LIST;
 
+//
+// The result of the last GET CUR request. An identical request issued within
+// RequestIntervalMs is answered from here instead of being sent again.
+//
+typedef struct CONTROL_REQUEST_CACHE_
+{
+    bool          Valid;
+    UCHAR         RequestType;
+    UCHAR         Request;
+    USHORT        Value;
+    USHORT        Index;
+    ULONG         DataLength;
+    LARGE_INTEGER CompletionTime;
+    UCHAR         Data[16];
+} CONTROL_REQUEST_CACHE, *PCONTROL_REQUEST_CACHE;
+
 typedef struct UAC_USB_LATENCY_
 {
     ULONG InputOffsetMs;
@@ -167,6 +233,7 @@ typedef struct _DEVICE_CONTEXT
         ULONG BufferFlags;
         ULONG ClassicFramesPerIrp2;
         ULONG SuggestedBufferPeriod;
+        ULONG SampleRateWindowMs;
     } INTERNAL_PARAMETERS;
 
     typedef struct FEEDBACK_PROPERTY_
@@ -197,8 +264,11 @@ typedef struct _DEVICE_CONTEXT
     UCHAR                              NumberOfConfiguredInterfaces;
     USBAudioConfiguration *            UsbAudioConfiguration;
     ContiguousMemory *                 ContiguousMemory;
+    IsoRequestPool *                   IsoRequestPool;
     RtPacketObject *                   RtPacketObject;
     WDFWAITLOCK                        StreamWaitLock;
+    WDFWAITLOCK                        ControlRequestWaitLock;
+    CONTROL_REQUEST_CACHE              ControlRequestCache;
     CStreamEngine **                   RenderStreamEngine;
     CStreamEngine **                   CaptureStreamEngine;
     ULONG                              NumOfInputDevices;
@@ -246,7 +316,14 @@ typedef struct _DEVICE_CONTEXT
     WDFFILEOBJECT        ResetRequestOwner;
     UACSampleFormat      SampleFormatBackup;
     ErrorStatistics *    ErrorStatistics;
+    LatencyStatistics *  LatencyStatistics;
+    OverloadPredictor *  OverloadPredictor;
+    OffsetTuner *        OffsetTuner; // Created by the first stream start with AutoTuneOffsets.
+    EventTrace *         EventTrace;
+    CapabilityCache *    CapabilityCache;
     UAC_USB_LATENCY      UsbLatency;
+    ULONG                TunedInputOffsetFrame; // Offsets chosen by OffsetTuner for the next stream start, 0 if not tuned.
+    ULONG                TunedOutputOffsetFrame;
     UACSampleFormat      DesiredSampleFormat;
     UCHAR                ClockSelectorId;
     ULONG                AcClockSources;
@@ -397,6 +474,14 @@ GetCurrentFrame(
     _In_ PDEVICE_CONTEXT deviceContext
 );
 
+__drv_maxIRQL(DISPATCH_LEVEL)
+NONPAGED_CODE_SEG
+void UpdateTunedOffsets(
+    _In_ PDEVICE_CONTEXT deviceContext,
+    _In_ ULONG           inputOffsetFrame,
+    _In_ ULONG           outputOffsetFrame
+);
+
 __drv_maxIRQL(DISPATCH_LEVEL)
 NONPAGED_CODE_SEG
 ULONGLONG
@@ -634,6 +719,20 @@ VOID EvtUSBAudioAcxDriverReleaseAsioOwnership(
     _In_ WDFREQUEST request
 );
 
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+VOID EvtUSBAudioAcxDriverGetStatistics(
+    _In_ WDFOBJECT  object,
+    _In_ WDFREQUEST request
+);
+
+__drv_maxIRQL(PASSIVE_LEVEL)
+PAGED_CODE_SEG
+VOID EvtUSBAudioAcxDriverGetEventTrace(
+    _In_ WDFOBJECT  object,
+    _In_ WDFREQUEST request
+);
+
 EVT_WDF_REQUEST_COMPLETION_ROUTINE USBAudioAcxDriverEvtIsoRequestCompletionRoutine;
 
 __drv_maxIRQL(DISPATCH_LEVEL)
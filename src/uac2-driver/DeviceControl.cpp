@@ -34,6 +34,7 @@ Environment:
 #include "USBAudio.h"
 #include "USBAudioConfiguration.h"
 #include "ErrorStatistics.h"
+#include "ControlRequestSequencer.h"
 
 #ifndef __INTELLISENSE__
 #include "DeviceControl.tmh"
@@ -41,6 +42,204 @@ Environment:
 
 #define UsbMakeBmRequestType(Dir, Type, Recipient) (UCHAR)(((Dir & 0x1) << 7) | ((Type & 0x3) << 5) | (Recipient & 0x1f))
 
+//
+// Sends the URB of one control request for ControlRequestSequencer, under the
+// control request wait lock of the device.
+//
+class UrbControlTransport : public ControlRequestTransport
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    UrbControlTransport(
+        _In_ PDEVICE_CONTEXT deviceContext,
+        _In_ PURB            urb,
+        _In_ USHORT          function,
+        _In_ UCHAR           requestType,
+        _In_ UCHAR           request,
+        _In_ USHORT          value,
+        _In_ USHORT          index,
+        _Inout_ PVOID        dataBuffer,
+        _In_ ULONG           dataBufferLength
+    )
+        : m_deviceContext(deviceContext), m_urb(urb), m_function(function), m_requestType(requestType), m_request(request), m_value(value), m_index(index), m_dataBuffer(dataBuffer), m_dataBufferLength(dataBufferLength)
+    {
+        PAGED_CODE();
+    }
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS Send(
+        _In_ ULONG                   timeoutMs,
+        _Out_ ControlTransferError & error
+    ) override;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONGLONG QueryTime() override;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void DelayUntil(
+        _In_ LONGLONG time
+    ) override;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Lock() override;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Unlock() override;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void CountFailure() override;
+
+  private:
+    PDEVICE_CONTEXT m_deviceContext;
+    PURB            m_urb;
+    USHORT          m_function;
+    UCHAR           m_requestType;
+    UCHAR           m_request;
+    USHORT          m_value;
+    USHORT          m_index;
+    PVOID           m_dataBuffer;
+    ULONG           m_dataBufferLength;
+};
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS UrbControlTransport::Send(
+    ULONG                  timeoutMs,
+    ControlTransferError & error
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG    direction = (m_requestType >> 7) & 0x1;
+    ULONG    type = m_requestType & 0x7f;
+
+    PAGED_CODE();
+
+    error = ControlTransferError::None;
+
+    if (type < 0x10)
+    {
+        UsbBuildFeatureRequest(
+            m_urb,
+            m_function,
+            m_value,
+            m_index,
+            nullptr
+        );
+    }
+    else
+    {
+        UsbBuildVendorRequest(
+            m_urb,
+            m_function,
+            sizeof(_URB_CONTROL_VENDOR_OR_CLASS_REQUEST),
+            ((direction == 1) ? (USBD_SHORT_TRANSFER_OK | USBD_TRANSFER_DIRECTION_IN) : 0),
+            0,
+            m_request,
+            m_value,
+            m_index,
+            m_dataBuffer,
+            nullptr,
+            m_dataBufferLength,
+            nullptr
+        );
+    }
+
+    if (timeoutMs != 0)
+    {
+        status = SendUrbSyncWithTimeout(m_deviceContext, m_urb, timeoutMs);
+    }
+    else
+    {
+        status = SendUrbSync(m_deviceContext, m_urb);
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CTRLREQUEST, "Vendor control request success, type %02x, request %02x, value %04x, index %04x, Status %08x ,URB status %08x", m_requestType, m_request, m_value, m_index, status, m_urb->UrbControlVendorClassRequest.Hdr.Status);
+        return status;
+    }
+
+    TraceEvents(TRACE_LEVEL_ERROR, TRACE_CTRLREQUEST, "Vendor control request failed, type %02x, request %02x, value %04x, index %04x, Status %!STATUS! ,URB status 0x%x", m_requestType, m_request, m_value, m_index, status, m_urb->UrbControlVendorClassRequest.Hdr.Status);
+    switch (m_urb->UrbControlVendorClassRequest.Hdr.Status)
+    {
+    case USBD_STATUS_STALL_PID:
+        error = ControlTransferError::Stall;
+        break;
+    case USBD_STATUS_BABBLE_DETECTED:
+        error = ControlTransferError::Babble;
+        break;
+    default:
+        error = ControlTransferError::Other;
+        break;
+    }
+
+    return status;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONGLONG UrbControlTransport::QueryTime()
+{
+    LARGE_INTEGER currentTime;
+
+    PAGED_CODE();
+
+    KeQuerySystemTime(&currentTime);
+    return currentTime.QuadPart;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void UrbControlTransport::DelayUntil(
+    LONGLONG time
+)
+{
+    LARGE_INTEGER waitTime;
+
+    PAGED_CODE();
+
+    // A positive value is an absolute system time.
+    waitTime.QuadPart = time;
+    KeDelayExecutionThread(KernelMode, FALSE, &waitTime);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void UrbControlTransport::Lock()
+{
+    PAGED_CODE();
+
+    WdfWaitLockAcquire(m_deviceContext->ControlRequestWaitLock, nullptr);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void UrbControlTransport::Unlock()
+{
+    PAGED_CODE();
+
+    WdfWaitLockRelease(m_deviceContext->ControlRequestWaitLock);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void UrbControlTransport::CountFailure()
+{
+    PAGED_CODE();
+
+    m_deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::VendorControlFailed, 0);
+    // InterlockedIncrement((PLONG)&deviceContext->TotalDriverError);
+    // InterlockedIncrement((PLONG)&deviceContext->DriverError[0]);
+    // InterlockedIncrement((PLONG)&deviceContext->DriverError[2]);
+}
+
 __drv_maxIRQL(PASSIVE_LEVEL)
 PAGED_CODE_SEG
 static NTSTATUS
@@ -85,7 +284,6 @@ ControlRequest(
         return STATUS_UNSUCCESSFUL;
     }
 
-    ULONG  requestTimeoutMs = deviceContext->SupportedControl.RequestTimeOut;
     USHORT function;
     switch (type)
     {
@@ -120,6 +318,42 @@ ControlRequest(
         return STATUS_INVALID_PARAMETER;
     }
 
+    //
+    // Control requests are serialized so that the interval between them is kept
+    // even when they are issued from several threads. ControlRequestSequencer
+    // releases the lock while it waits for the interval or a retry.
+    //
+    WaitLocker controlRequestLocker(deviceContext->ControlRequestWaitLock, nullptr);
+
+    PCONTROL_REQUEST_CACHE cache = &deviceContext->ControlRequestCache;
+    bool                   isCacheable = (direction == 1) && ((type & 0x60) == 0x20) && (request == NS_USBAudio0200::CUR) && (dataBufferLength <= sizeof(cache->Data));
+
+    if (direction == 0)
+    {
+        // A SET request may change the value returned by any GET request.
+        cache->Valid = false;
+    }
+    else if (isCacheable && cache->Valid && (cache->RequestType == requestType) && (cache->Request == request) && (cache->Value == value) && (cache->Index == index) && (cache->DataLength == dataBufferLength))
+    {
+        LARGE_INTEGER currentTime;
+        KeQuerySystemTime(&currentTime);
+
+        //
+        // An identical GET CUR issued within the request interval would have waited for
+        // that interval, so it is answered with the result of the previous one instead.
+        //
+        if ((currentTime.QuadPart - cache->CompletionTime.QuadPart) < ((LONGLONG)deviceContext->SupportedControl.RequestIntervalMs * 10000LL))
+        {
+            RtlCopyMemory(dataBuffer, cache->Data, cache->DataLength);
+            if (dataLength != nullptr)
+            {
+                *dataLength = cache->DataLength;
+            }
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_CTRLREQUEST, "Class control request coalesced, type %02x, request %02x, value %04x, index %04x", requestType, request, value, index);
+            return STATUS_SUCCESS;
+        }
+    }
+
     status = WdfUsbTargetDeviceCreateUrb(
         deviceContext->UsbDevice,
         nullptr,
@@ -136,126 +370,39 @@ ControlRequest(
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    bool bubbleDetected = false;
+    UrbControlTransport transport(deviceContext, urb, function, requestType, request, value, index, dataBuffer, dataBufferLength);
 
-    ULONG maxRetry = deviceContext->SupportedControl.RequestRetry;
-    for (ULONG retry = 0; retry < maxRetry; ++retry)
-    {
-        if (type < 0x10)
-        {
-            UsbBuildFeatureRequest(
-                urb,
-                function,
-                value,
-                index,
-                nullptr
-            );
-        }
-        else
-        {
-            UsbBuildVendorRequest(
-                urb,
-                function,
-                sizeof(_URB_CONTROL_VENDOR_OR_CLASS_REQUEST),
-                ((direction == 1) ? (USBD_SHORT_TRANSFER_OK | USBD_TRANSFER_DIRECTION_IN) : 0),
-                0,
-                request,
-                value,
-                index,
-                dataBuffer,
-                nullptr,
-                dataBufferLength,
-                nullptr
-            );
-        }
-
-        //
-        // ince some devices may return incorrect responses when sending
-        // Vendor Requests in succession, an interval of 10 ms is required.
-        //
-        LARGE_INTEGER waitTime;
-        waitTime.QuadPart = deviceContext->LastVendorRequestTime.QuadPart + (10LL * 10000LL);
+    CONTROL_REQUEST_POLICY policy;
+    policy.RequestIntervalMs = deviceContext->SupportedControl.RequestIntervalMs;
+    policy.SkipIntervalForGet = deviceContext->SupportedControl.SkipIntervalForGet;
+    policy.RequestRetry = deviceContext->SupportedControl.RequestRetry;
+    policy.RetryBackoffMs = deviceContext->SupportedControl.RetryBackoffMs;
+    policy.RequestTimeoutMs = deviceContext->SupportedControl.RequestTimeOut;
+    policy.RetryTimeoutMs = msTimeout;
 
-        KeDelayExecutionThread(KernelMode, FALSE, &waitTime);
-
-        KeQuerySystemTime(&deviceContext->LastVendorRequestTime);
-
-        if (requestTimeoutMs != 0)
-        {
-            status = SendUrbSyncWithTimeout(deviceContext, urb, requestTimeoutMs);
-        }
-        else
-        {
-            status = SendUrbSync(deviceContext, urb);
-        }
+    status = ControlRequestSequencer::Run(transport, policy, direction == 1, deviceContext->LastVendorRequestTime.QuadPart);
 
-        if (!NT_SUCCESS(status))
+    if (direction == 0)
+    {
+        // A GET request of another thread may have completed while the lock was released.
+        cache->Valid = false;
+    }
+    if (NT_SUCCESS(status))
+    {
+        if (dataLength != nullptr)
         {
-            TraceEvents(TRACE_LEVEL_ERROR, TRACE_CTRLREQUEST, "Vendor control request failed, type %02x, request %02x, value %04x, index %04x, Status %!STATUS! ,URB status 0x%x", requestType, request, value, index, status, urb->UrbControlVendorClassRequest.Hdr.Status);
-            if (urb->UrbControlVendorClassRequest.Hdr.Status == USBD_STATUS_STALL_PID)
-            {
-                break;
-            }
-            if (status != STATUS_DEVICE_BUSY)
-            {
-                deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::VendorControlFailed, 0);
-                // InterlockedIncrement((PLONG)&deviceContext->TotalDriverError);
-                // InterlockedIncrement((PLONG)&deviceContext->DriverError[0]);
-                // InterlockedIncrement((PLONG)&deviceContext->DriverError[2]);
-            }
-            if (status == STATUS_NO_SUCH_DEVICE || status == STATUS_DEVICE_DOES_NOT_EXIST)
-            {
-                break;
-            }
-            if (urb->UrbControlVendorClassRequest.Hdr.Status == USBD_STATUS_BABBLE_DETECTED)
-            {
-                if (retry == maxRetry - 1)
-                {
-                    status = STATUS_BUFFER_TOO_SMALL;
-                    break;
-                }
-                else
-                {
-                    LARGE_INTEGER sleepTime;
-                    sleepTime.QuadPart = -100LL * 10000LL;
-                    KeDelayExecutionThread(KernelMode, FALSE, &sleepTime);
-                    bubbleDetected = true;
-                    continue;
-                }
-            }
-            else
-            {
-                if (retry == 0)
-                {
-                    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CTRLREQUEST, "retry...");
-                    requestTimeoutMs = msTimeout;
-                }
-                else
-                {
-                    break;
-                }
-            }
+            *dataLength = urb->UrbControlVendorClassRequest.TransferBufferLength;
         }
-        if (NT_SUCCESS(status))
+        if (isCacheable && (urb->UrbControlVendorClassRequest.TransferBufferLength == dataBufferLength))
         {
-            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CTRLREQUEST, "Vendor control request success, type %02x, request %02x, value %04x, index %04x, Status %08x ,URB status %08x", requestType, request, value, index, status, urb->UrbControlVendorClassRequest.Hdr.Status);
-            if (bubbleDetected)
-            {
-                LARGE_INTEGER sleepTime;
-                sleepTime.QuadPart = -100LL * 10000LL;
-                KeDelayExecutionThread(KernelMode, FALSE, &sleepTime);
-                bubbleDetected = false;
-                continue;
-            }
-            if (dataLength != nullptr)
-            {
-                *dataLength = urb->UrbControlVendorClassRequest.TransferBufferLength;
-            }
-            if (retry != 0)
-            {
-                TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CTRLREQUEST, "retry succeed.");
-            }
-            break;
+            cache->RequestType = requestType;
+            cache->Request = request;
+            cache->Value = value;
+            cache->Index = index;
+            cache->DataLength = dataBufferLength;
+            RtlCopyMemory(cache->Data, dataBuffer, dataBufferLength);
+            KeQuerySystemTime(&cache->CompletionTime);
+            cache->Valid = true;
         }
     }
 
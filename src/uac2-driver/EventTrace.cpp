@@ -0,0 +1,125 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    EventTrace.cpp
+
+Abstract:
+
+    Implement a lock-free ring of fixed-size binary records that replaces the
+    formatted traces in the stream hot paths.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "Driver.h"
+#include "Device.h"
+#include "Public.h"
+#include "Common.h"
+#include "EventTrace.h"
+
+#ifndef __INTELLISENSE__
+#include "EventTrace.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+EventTrace *
+EventTrace::Create()
+{
+    PAGED_CODE();
+
+    return new (POOL_FLAG_NON_PAGED, DRIVER_TAG) EventTrace();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+EventTrace::EventTrace()
+{
+    PAGED_CODE();
+
+    static_assert((c_records & (c_records - 1)) == 0, "c_records must be a power of two");
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+EventTrace::~EventTrace()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+EventTrace::Drain(
+    UAC_EVENT_TRACE & eventTrace
+)
+{
+    LARGE_INTEGER frequency{};
+
+    PAGED_CODE();
+
+    RETURN_NTSTATUS_IF_TRUE(InterlockedCompareExchange(&m_draining, 1, 0) != 0, STATUS_DEVICE_BUSY);
+
+    LONG64 head = ReadAcquire64(&m_head);
+    LONG64 tail = m_tail;
+    LONG64 lost = 0LL;
+
+    if (head - tail > (LONG64)c_records)
+    {
+        lost = head - tail - (LONG64)c_records;
+        tail = head - (LONG64)c_records;
+    }
+
+    ULONG records = (ULONG)min(head - tail, (LONG64)UAC_EVENT_TRACE_RECORDS);
+
+    for (ULONG i = 0; i < records; ++i)
+    {
+        const LONG64             recordNumber = tail + i;
+        const UAC_EVENT_RECORD & record = m_records[recordNumber & (c_records - 1)];
+        const ULONG              sequence = (ULONG)(recordNumber + 1);
+
+        ULONG sequenceBefore = (ULONG)ReadAcquire((volatile LONG *)&record.Sequence);
+        eventTrace.Record[i] = record;
+        KeMemoryBarrier();
+        ULONG sequenceAfter = (ULONG)ReadNoFence((volatile LONG *)&record.Sequence);
+
+        if ((sequenceBefore == sequence) && (sequenceAfter == sequence))
+        {
+            continue;
+        }
+        if ((LONG)(sequenceAfter - sequence) > 0)
+        {
+            // The record was overwritten by a producer that wrapped around the ring.
+            RtlZeroMemory(&eventTrace.Record[i], sizeof(UAC_EVENT_RECORD));
+            ++lost;
+            continue;
+        }
+        // The producer has not finished the record yet, so it is read by the next call.
+        records = i;
+        break;
+    }
+    RtlZeroMemory(&eventTrace.Record[records], sizeof(UAC_EVENT_RECORD) * (UAC_EVENT_TRACE_RECORDS - records));
+
+    KeQueryPerformanceCounter(&frequency);
+    eventTrace.Length = sizeof(UAC_EVENT_TRACE);
+    eventTrace.Records = records;
+    eventTrace.Frequency = (ULONGLONG)frequency.QuadPart;
+    eventTrace.FirstRecord = (ULONGLONG)tail;
+    eventTrace.Lost = (ULONGLONG)lost;
+
+    m_tail = tail + records;
+    InterlockedExchange(&m_draining, 0);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,95 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    EventTrace.h
+
+Abstract:
+
+    Define a lock-free ring of fixed-size binary records that replaces the
+    formatted traces in the stream hot paths.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _EVENT_TRACE_H_
+#define _EVENT_TRACE_H_
+
+#include <acx.h>
+#include "UAC_User.h"
+
+//
+// Any number of producers at DISPATCH_LEVEL or below call Log(). A producer
+// claims a record number with one interlocked increment and never waits.
+// The record carries its number in Sequence, which is cleared while the record
+// is written, so Drain() can detect a record that was overwritten while it
+// was copied.
+//
+class EventTrace
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    EventTrace();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual ~EventTrace();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    FORCEINLINE
+    void Log(
+        _In_ UACEventId eventId,
+        _In_ LONG       payload0 = 0,
+        _In_ LONG       payload1 = 0,
+        _In_ LONG       payload2 = 0,
+        _In_ LONG       payload3 = 0
+    )
+    {
+        LONG64             recordNumber = InterlockedIncrement64(&m_head) - 1;
+        UAC_EVENT_RECORD & record = m_records[recordNumber & (c_records - 1)];
+
+        InterlockedExchange((volatile LONG *)&record.Sequence, 0);
+        record.Timestamp = KeQueryPerformanceCounter(nullptr).QuadPart;
+        record.EventId = toUShort(eventId);
+        record.Processor = (USHORT)KeGetCurrentProcessorIndex();
+        record.Payload[0] = payload0;
+        record.Payload[1] = payload1;
+        record.Payload[2] = payload2;
+        record.Payload[3] = payload3;
+        WriteRelease((volatile LONG *)&record.Sequence, (LONG)(recordNumber + 1));
+    }
+
+    // Copies the records written since the previous call, oldest first.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS
+    Drain(
+        _Out_ UAC_EVENT_TRACE & eventTrace
+    );
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    EventTrace * Create();
+
+  private:
+    static const ULONG c_records = 4096; // must be a power of two
+
+    volatile LONG64  m_head{0LL};
+    LONG64           m_tail{0LL};
+    volatile LONG    m_draining{0};
+    UAC_EVENT_RECORD m_records[c_records]{};
+};
+
+#endif
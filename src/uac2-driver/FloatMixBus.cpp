@@ -0,0 +1,541 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    FloatMixBus.cpp
+
+Abstract:
+
+    Implement the kernels of the 32-bit float mix bus.
+    The load and accumulate kernels convert each sample width to float with
+    a full-scale of 1.0. The store kernels clamp and round the bus once, and
+    are vectorized for SSE2 (x64) and NEON (ARM64). TPDF dither of +/-1 LSB
+    is added for 16-bit and 24-bit targets when requested.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "FloatMixBus.h"
+
+#if defined(_M_X64)
+#include <immintrin.h>
+#elif defined(_M_ARM64)
+#include <arm64_neon.h>
+#endif
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "FloatMixBus.tmh"
+#endif
+
+//
+// Reads one sample and returns it with a full-scale of 1.0.
+//
+typedef float (*FLOAT_BUS_READ)(
+    _In_ const UCHAR * src
+);
+
+//
+// Sample readers
+//
+
+NONPAGED_CODE_SEG
+static float ReadSample16(
+    _In_ const UCHAR * src
+)
+{
+    return (float)(*(const UNALIGNED SHORT *)src) * (1.0f / 32768.0f);
+}
+
+NONPAGED_CODE_SEG
+static float ReadSample24(
+    _In_ const UCHAR * src
+)
+{
+    LONG sample = (LONG)((ULONG)src[0] + ((ULONG)src[1] << 8)) + ((LONG)((const CHAR *)src)[2] << 16);
+    return (float)sample * (1.0f / 8388608.0f);
+}
+
+NONPAGED_CODE_SEG
+static float ReadSample32(
+    _In_ const UCHAR * src
+)
+{
+    return (float)(*(const UNALIGNED LONG *)src) * (1.0f / 2147483648.0f);
+}
+
+NONPAGED_CODE_SEG
+static float ReadSampleFloat(
+    _In_ const UCHAR * src
+)
+{
+    return *(const UNALIGNED float *)src;
+}
+
+//
+// Load and accumulate kernels
+//
+
+template <FLOAT_BUS_READ readSample, ULONG bytesPerSample>
+NONPAGED_CODE_SEG
+static void LoadSamples(
+    _Out_ float *      bus,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    for (ULONG i = 0; i < samples; i++)
+    {
+        bus[i] = readSample(src + i * bytesPerSample);
+    }
+}
+
+template <FLOAT_BUS_READ readSample, ULONG bytesPerSample>
+NONPAGED_CODE_SEG
+static void AccumulateFrames(
+    _Inout_ float *    bus,
+    _In_ ULONG         busFrameSamples,
+    _In_ const UCHAR * src,
+    _In_ ULONG         srcFrameBytes,
+    _In_ ULONG         channels,
+    _In_ ULONG         frames
+)
+{
+    for (ULONG frame = 0; frame < frames; frame++)
+    {
+        for (ULONG ch = 0; ch < channels; ch++)
+        {
+            bus[ch] += readSample(src + ch * bytesPerSample);
+        }
+        bus += busFrameSamples;
+        src += srcFrameBytes;
+    }
+}
+
+//
+// Dither
+//
+
+NONPAGED_CODE_SEG
+static ULONG NextRandom(
+    _Inout_ ULONG & seed
+)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+//
+// Returns triangular noise in [-1.0, 1.0), the difference of two uniform values.
+//
+NONPAGED_CODE_SEG
+static float NextDither(
+    _Inout_ FLOAT_BUS_DITHER & dither
+)
+{
+    float first = (float)(NextRandom(dither.Seed[0]) >> 8) * (1.0f / 16777216.0f);
+    float second = (float)(NextRandom(dither.Seed[0]) >> 8) * (1.0f / 16777216.0f);
+    return first - second;
+}
+
+NONPAGED_CODE_SEG
+static LONG Quantize(
+    _In_ float value,
+    _In_ float minValue,
+    _In_ float maxValue
+)
+{
+    if (value > maxValue)
+    {
+        value = maxValue;
+    }
+    else if (value < minValue)
+    {
+        value = minValue;
+    }
+    // Rounds half away from zero. The vectorized kernels add the same 0.5 and truncate, so that they store the same samples.
+    return (LONG)((value >= 0.0f) ? (value + 0.5f) : (value - 0.5f));
+}
+
+//
+// Scalar store kernels
+//
+
+NONPAGED_CODE_SEG
+static void StoreSamples16Scalar(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+)
+{
+    PSHORT outSample = (PSHORT)dst;
+
+    for (ULONG i = 0; i < samples; i++)
+    {
+        float value = bus[i] * 32768.0f;
+        if (dither != nullptr)
+        {
+            value += NextDither(*dither);
+        }
+        outSample[i] = (SHORT)Quantize(value, -32768.0f, 32767.0f);
+    }
+}
+
+NONPAGED_CODE_SEG
+static void StoreSamples24Scalar(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+)
+{
+    for (ULONG i = 0; i < samples; i++)
+    {
+        PUCHAR outSample = dst + i * 3;
+        float  value = bus[i] * 8388608.0f;
+        if (dither != nullptr)
+        {
+            value += NextDither(*dither);
+        }
+        LONG thisSample = Quantize(value, -8388608.0f, 8388607.0f);
+        outSample[0] = (UCHAR)(thisSample);
+        outSample[1] = (UCHAR)(thisSample >> 8);
+        outSample[2] = (UCHAR)(thisSample >> 16);
+    }
+}
+
+NONPAGED_CODE_SEG
+static void StoreSamples32Scalar(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+)
+{
+    UNREFERENCED_PARAMETER(dither);
+
+    PLONG outSample = (PLONG)dst;
+
+    for (ULONG i = 0; i < samples; i++)
+    {
+        // 2147483520.0f is the largest float below 2^31.
+        outSample[i] = Quantize(bus[i] * 2147483648.0f, -2147483648.0f, 2147483520.0f);
+    }
+}
+
+NONPAGED_CODE_SEG
+static void StoreSamplesFloatScalar(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+)
+{
+    UNREFERENCED_PARAMETER(dither);
+
+    // Float targets are not clamped, the same as the float mix kernel.
+    RtlCopyMemory(dst, bus, samples * sizeof(float));
+}
+
+#if defined(_M_X64)
+//
+// SSE2 store kernels
+//
+
+//
+// Rounds half away from zero and converts to int32, as Quantize() does.
+// _mm_cvtps_epi32 would round half to even.
+//
+NONPAGED_CODE_SEG
+static __m128i QuantizeSse2(
+    _In_ __m128 value
+)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    return _mm_cvttps_epi32(_mm_add_ps(value, _mm_or_ps(half, _mm_and_ps(value, signMask))));
+}
+
+//
+// Returns triangular noise for four lanes, using one generator per lane.
+//
+NONPAGED_CODE_SEG
+static __m128 NextDitherSse2(
+    _Inout_ __m128i & seeds
+)
+{
+    const __m128i one = _mm_set1_epi32(0x3f800000);
+    __m128        uniform[2];
+
+    for (ULONG draw = 0; draw < 2; draw++)
+    {
+        seeds = _mm_xor_si128(seeds, _mm_slli_epi32(seeds, 13));
+        seeds = _mm_xor_si128(seeds, _mm_srli_epi32(seeds, 17));
+        seeds = _mm_xor_si128(seeds, _mm_slli_epi32(seeds, 5));
+        // The upper 23 bits form the mantissa of a float in [1.0, 2.0).
+        uniform[draw] = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(seeds, 9), one));
+    }
+    return _mm_sub_ps(uniform[0], uniform[1]);
+}
+
+NONPAGED_CODE_SEG
+static void StoreSamples16Sse2(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+)
+{
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 minSample = _mm_set1_ps(-32768.0f);
+    const __m128 maxSample = _mm_set1_ps(32767.0f);
+    __m128i      seeds = (dither != nullptr) ? _mm_loadu_si128((const __m128i *)dither->Seed) : _mm_setzero_si128();
+    ULONG        i = 0;
+
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m128 low = _mm_mul_ps(_mm_loadu_ps(bus + i), scale);
+        __m128 high = _mm_mul_ps(_mm_loadu_ps(bus + i + 4), scale);
+        if (dither != nullptr)
+        {
+            low = _mm_add_ps(low, NextDitherSse2(seeds));
+            high = _mm_add_ps(high, NextDitherSse2(seeds));
+        }
+        // Clamp before the conversion, which returns 0x80000000 for values out of range.
+        low = _mm_min_ps(_mm_max_ps(low, minSample), maxSample);
+        high = _mm_min_ps(_mm_max_ps(high, minSample), maxSample);
+        _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_packs_epi32(QuantizeSse2(low), QuantizeSse2(high)));
+    }
+    if (dither != nullptr)
+    {
+        _mm_storeu_si128((__m128i *)dither->Seed, seeds);
+    }
+    StoreSamples16Scalar(dst + i * 2, bus + i, samples - i, dither);
+}
+
+NONPAGED_CODE_SEG
+static void StoreSamples32Sse2(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+)
+{
+    const __m128 scale = _mm_set1_ps(2147483648.0f);
+    const __m128 minSample = _mm_set1_ps(-2147483648.0f);
+    const __m128 maxSample = _mm_set1_ps(2147483520.0f);
+    ULONG        i = 0;
+
+    for (; i + 4 <= samples; i += 4)
+    {
+        __m128 value = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(bus + i), scale), minSample), maxSample);
+        _mm_storeu_si128((__m128i *)(dst + i * 4), QuantizeSse2(value));
+    }
+    StoreSamples32Scalar(dst + i * 4, bus + i, samples - i, dither);
+}
+#endif
+
+#if defined(_M_ARM64)
+//
+// NEON store kernels
+// These are used without dither, the dithered stores use the scalar kernels.
+//
+
+//
+// Rounds half away from zero and converts to int32, as Quantize() does.
+// vcvtnq_s32_f32 would round half to even. The conversion saturates to the
+// range of int32.
+//
+NONPAGED_CODE_SEG
+static int32x4_t QuantizeNeon(
+    _In_ float32x4_t value
+)
+{
+    float32x4_t half = vbslq_f32(vdupq_n_u32(0x80000000), value, vdupq_n_f32(0.5f));
+
+    return vcvtq_s32_f32(vaddq_f32(value, half));
+}
+
+NONPAGED_CODE_SEG
+static void StoreSamples16Neon(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+)
+{
+    ULONG i = 0;
+
+    for (; i + 8 <= samples; i += 8)
+    {
+        // The narrowing saturates to the range of int16, the same as clamping before the rounding.
+        int32x4_t low = QuantizeNeon(vmulq_n_f32(vld1q_f32(bus + i), 32768.0f));
+        int32x4_t high = QuantizeNeon(vmulq_n_f32(vld1q_f32(bus + i + 4), 32768.0f));
+        vst1q_s16((int16_t *)(dst + i * 2), vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+    }
+    StoreSamples16Scalar(dst + i * 2, bus + i, samples - i, dither);
+}
+
+NONPAGED_CODE_SEG
+static void StoreSamples32Neon(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+)
+{
+    const float32x4_t minSample = vdupq_n_f32(-2147483648.0f);
+    const float32x4_t maxSample = vdupq_n_f32(2147483520.0f);
+    ULONG             i = 0;
+
+    for (; i + 4 <= samples; i += 4)
+    {
+        // Clamp as StoreSamples32Scalar() does; the saturation of the conversion would store 0x7fffffff for +1.0.
+        float32x4_t value = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(bus + i), 2147483648.0f), minSample), maxSample);
+        vst1q_s32((int32_t *)(dst + i * 4), QuantizeNeon(value));
+    }
+    StoreSamples32Scalar(dst + i * 4, bus + i, samples - i, dither);
+}
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+FloatMixBus::Select(
+    bool                 sourceIsFloat,
+    ULONG                sourceBytesPerSample,
+    bool                 targetIsFloat,
+    ULONG                targetBytesPerSample,
+    bool                 dither,
+    FLOAT_MIX_BUS_INFO & busInfo
+)
+/*++
+
+Routine Description:
+
+    Selects the kernels of the float mix bus for the Acx Audio (source) and
+    USB (target) sample formats.
+
+Arguments:
+
+    dither - TPDF dither is added when the target is 16-bit or 24-bit PCM.
+
+Return Value:
+
+    NTSTATUS - STATUS_NOT_SUPPORTED if either format cannot be handled.
+
+--*/
+{
+    PAGED_CODE();
+
+    busInfo = FLOAT_MIX_BUS_INFO{};
+
+    if (sourceIsFloat)
+    {
+        RETURN_NTSTATUS_IF_TRUE(sourceBytesPerSample != sizeof(float), STATUS_NOT_SUPPORTED);
+        busInfo.Accumulate = AccumulateFrames<ReadSampleFloat, 4>;
+    }
+    else
+    {
+        switch (sourceBytesPerSample)
+        {
+        case 2:
+            busInfo.Accumulate = AccumulateFrames<ReadSample16, 2>;
+            break;
+        case 3:
+            busInfo.Accumulate = AccumulateFrames<ReadSample24, 3>;
+            break;
+        case 4:
+            busInfo.Accumulate = AccumulateFrames<ReadSample32, 4>;
+            break;
+        default:
+            return STATUS_NOT_SUPPORTED;
+        }
+    }
+
+    if (targetIsFloat)
+    {
+        RETURN_NTSTATUS_IF_TRUE(targetBytesPerSample != sizeof(float), STATUS_NOT_SUPPORTED);
+        busInfo.Load = LoadSamples<ReadSampleFloat, 4>;
+        busInfo.Store = StoreSamplesFloatScalar;
+    }
+    else
+    {
+        switch (targetBytesPerSample)
+        {
+        case 2:
+            busInfo.Load = LoadSamples<ReadSample16, 2>;
+            busInfo.Store = StoreSamples16Scalar;
+            busInfo.Dither = dither;
+            break;
+        case 3:
+            busInfo.Load = LoadSamples<ReadSample24, 3>;
+            busInfo.Store = StoreSamples24Scalar;
+            busInfo.Dither = dither;
+            break;
+        case 4:
+            // A float mantissa is shorter than 32 bits, so dither would only add noise.
+            busInfo.Load = LoadSamples<ReadSample32, 4>;
+            busInfo.Store = StoreSamples32Scalar;
+            break;
+        default:
+            return STATUS_NOT_SUPPORTED;
+        }
+    }
+    busInfo.StoreType = MixKernelType::Scalar;
+
+#if defined(_M_X64)
+    if (!targetIsFloat && (targetBytesPerSample == 2))
+    {
+        busInfo.Store = StoreSamples16Sse2;
+        busInfo.StoreType = MixKernelType::Sse2;
+    }
+    else if (!targetIsFloat && (targetBytesPerSample == 4))
+    {
+        busInfo.Store = StoreSamples32Sse2;
+        busInfo.StoreType = MixKernelType::Sse2;
+    }
+#elif defined(_M_ARM64)
+    if (!targetIsFloat && (targetBytesPerSample == 2) && !busInfo.Dither)
+    {
+        busInfo.Store = StoreSamples16Neon;
+        busInfo.StoreType = MixKernelType::Neon;
+    }
+    else if (!targetIsFloat && (targetBytesPerSample == 4))
+    {
+        busInfo.Store = StoreSamples32Neon;
+        busInfo.StoreType = MixKernelType::Neon;
+    }
+#endif
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - float mix bus, source %!bool! %u, target %!bool! %u, dither %!bool!, store type %u", sourceIsFloat, sourceBytesPerSample, targetIsFloat, targetBytesPerSample, busInfo.Dither, static_cast<ULONG>(busInfo.StoreType));
+
+    return STATUS_SUCCESS;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void FloatMixBus::InitializeDither(
+    FLOAT_BUS_DITHER & dither
+)
+{
+    // Any non-zero seeds work; distinct seeds keep the lanes uncorrelated.
+    dither.Seed[0] = 0x2545f491;
+    dither.Seed[1] = 0x9e3779b9;
+    dither.Seed[2] = 0x7f4a7c15;
+    dither.Seed[3] = 0x1b873593;
+}
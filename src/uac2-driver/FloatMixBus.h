@@ -0,0 +1,105 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    FloatMixBus.h
+
+Abstract:
+
+    Define the kernels of the 32-bit float mix bus. The render devices are
+    accumulated in float without clamping, and the sum is quantized to the
+    USB sample format once, optionally with TPDF dither.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _FLOATMIXBUS_H_
+#define _FLOATMIXBUS_H_
+
+#include "MixKernels.h"
+
+//
+// State of the TPDF dither generator. Each of the four xorshift32 generators
+// feeds one lane of the vectorized kernels, the scalar kernels use the first.
+//
+typedef struct _FLOAT_BUS_DITHER
+{
+    ULONG Seed[4];
+} FLOAT_BUS_DITHER;
+
+//
+// Replaces 'samples' contiguous bus samples with the samples in src.
+//
+typedef void (*FLOAT_BUS_LOAD)(
+    _Out_ float *      bus,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+);
+
+//
+// Adds 'frames' frames of 'channels' contiguous samples from src into the bus.
+// busFrameSamples is the stride between bus frames in samples, srcFrameBytes
+// the stride between source frames in bytes.
+//
+typedef void (*FLOAT_BUS_ACCUMULATE)(
+    _Inout_ float *    bus,
+    _In_ ULONG         busFrameSamples,
+    _In_ const UCHAR * src,
+    _In_ ULONG         srcFrameBytes,
+    _In_ ULONG         channels,
+    _In_ ULONG         frames
+);
+
+//
+// Quantizes 'samples' contiguous bus samples into dst. dither is nullptr
+// when no dither is added.
+//
+typedef void (*FLOAT_BUS_STORE)(
+    _Out_ PUCHAR                  dst,
+    _In_ const float *            bus,
+    _In_ ULONG                    samples,
+    _Inout_opt_ FLOAT_BUS_DITHER * dither
+);
+
+typedef struct _FLOAT_MIX_BUS_INFO
+{
+    FLOAT_BUS_LOAD       Load{nullptr};       // USB format to bus.
+    FLOAT_BUS_ACCUMULATE Accumulate{nullptr}; // Acx Audio format to bus.
+    FLOAT_BUS_STORE      Store{nullptr};      // Bus to USB format.
+    MixKernelType        StoreType{MixKernelType::None};
+    bool                 Dither{false};       // TPDF dither is added by Store.
+} FLOAT_MIX_BUS_INFO;
+
+class FloatMixBus
+{
+  public:
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS
+    Select(
+        _In_ bool                  sourceIsFloat,
+        _In_ ULONG                 sourceBytesPerSample,
+        _In_ bool                  targetIsFloat,
+        _In_ ULONG                 targetBytesPerSample,
+        _In_ bool                  dither,
+        _Out_ FLOAT_MIX_BUS_INFO & busInfo
+    );
+
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void InitializeDither(
+        _Out_ FLOAT_BUS_DITHER & dither
+    );
+};
+
+#endif
@@ -0,0 +1,545 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    InterleaveKernels.cpp
+
+Abstract:
+
+    Implement the kernels that convert between the non-interleaved ASIO
+    buffers and the interleaved USB isochronous buffer.
+    The USB buffer is processed in tiles of c_tileFrames frames so that the
+    tile stays in cache while every channel is visited. Within a tile, groups
+    of four mapped channels are transposed with SIMD shuffles where the
+    sample width allows it.
+    The kernels are generated from templates for every pair of USB and ASIO
+    sample sizes and for each channel class, and are looked up once when the
+    format or the ASIO buffer changes.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "InterleaveKernels.h"
+
+#if defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(_M_ARM64)
+#include <arm64_neon.h>
+#endif
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "InterleaveKernels.tmh"
+#endif
+
+// Number of frames per tile. 32 frames of 64 channels of 32-bit samples are 8 KB.
+static const ULONG c_tileFrames = 32;
+
+// Number of channels transposed together.
+static const ULONG c_channelGroup = 4;
+
+//
+// Sample copy
+// When the ASIO sample is wider than the USB sample, the USB sample occupies
+// the most significant bytes of the ASIO sample and the remaining bytes are zero.
+//
+
+template <ULONG usbBytes, ULONG asioBytes>
+FORCEINLINE void CopyUsbSampleFromAsio(
+    _Out_writes_bytes_(usbBytes) PUCHAR       usbSample,
+    _In_reads_bytes_(asioBytes) const UCHAR * asioSample
+)
+{
+    const UCHAR * src = asioSample + (asioBytes - usbBytes);
+
+    switch (usbBytes)
+    {
+    case 1:
+        usbSample[0] = src[0];
+        break;
+    case 2:
+        *(UNALIGNED USHORT *)usbSample = *(UNALIGNED const USHORT *)src;
+        break;
+    case 3:
+        *(UNALIGNED USHORT *)usbSample = *(UNALIGNED const USHORT *)src;
+        usbSample[2] = src[2];
+        break;
+    case 4:
+        *(UNALIGNED ULONG *)usbSample = *(UNALIGNED const ULONG *)src;
+        break;
+    default:
+        break;
+    }
+}
+
+template <ULONG usbBytes, ULONG asioBytes>
+FORCEINLINE void CopyAsioSampleFromUsb(
+    _Out_writes_bytes_(asioBytes) PUCHAR     asioSample,
+    _In_reads_bytes_(usbBytes) const UCHAR * usbSample
+)
+{
+    for (ULONG i = 0; i < asioBytes - usbBytes; ++i)
+    {
+        asioSample[i] = 0;
+    }
+    PUCHAR dst = asioSample + (asioBytes - usbBytes);
+
+    switch (usbBytes)
+    {
+    case 1:
+        dst[0] = usbSample[0];
+        break;
+    case 2:
+        *(UNALIGNED USHORT *)dst = *(UNALIGNED const USHORT *)usbSample;
+        break;
+    case 3:
+        *(UNALIGNED USHORT *)dst = *(UNALIGNED const USHORT *)usbSample;
+        dst[2] = usbSample[2];
+        break;
+    case 4:
+        *(UNALIGNED ULONG *)dst = *(UNALIGNED const ULONG *)usbSample;
+        break;
+    default:
+        break;
+    }
+}
+
+//
+// Four channel transposes
+// Each returns the number of frames it processed; the remaining frames of the
+// tile are copied one sample at a time. The generic version processes none.
+//
+
+template <ULONG usbBytes, ULONG asioBytes>
+FORCEINLINE ULONG InterleaveGroup(
+    _Inout_ PUCHAR                                   /* usbTile */,
+    _In_ ULONG                                       /* bytesPerBlock */,
+    _In_reads_(c_channelGroup) const UCHAR * const * /* asioSamples */,
+    _In_ ULONG                                       /* frames */
+)
+{
+    return 0;
+}
+
+template <ULONG usbBytes, ULONG asioBytes>
+FORCEINLINE ULONG DeinterleaveGroup(
+    _In_ const UCHAR *                        /* usbTile */,
+    _In_ ULONG                                /* bytesPerBlock */,
+    _In_reads_(c_channelGroup) PUCHAR const * /* asioSamples */,
+    _In_ ULONG                                /* frames */
+)
+{
+    return 0;
+}
+
+#if defined(_M_X64)
+template <>
+FORCEINLINE ULONG InterleaveGroup<4, 4>(
+    _Inout_ PUCHAR                                   usbTile,
+    _In_ ULONG                                       bytesPerBlock,
+    _In_reads_(c_channelGroup) const UCHAR * const * asioSamples,
+    _In_ ULONG                                       frames
+)
+{
+    ULONG frame = 0;
+
+    for (; frame + 4 <= frames; frame += 4)
+    {
+        __m128 row0 = _mm_loadu_ps((const float *)(asioSamples[0] + frame * 4));
+        __m128 row1 = _mm_loadu_ps((const float *)(asioSamples[1] + frame * 4));
+        __m128 row2 = _mm_loadu_ps((const float *)(asioSamples[2] + frame * 4));
+        __m128 row3 = _mm_loadu_ps((const float *)(asioSamples[3] + frame * 4));
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+        _mm_storeu_ps((float *)(usbTile + (frame + 0) * bytesPerBlock), row0);
+        _mm_storeu_ps((float *)(usbTile + (frame + 1) * bytesPerBlock), row1);
+        _mm_storeu_ps((float *)(usbTile + (frame + 2) * bytesPerBlock), row2);
+        _mm_storeu_ps((float *)(usbTile + (frame + 3) * bytesPerBlock), row3);
+    }
+    return frame;
+}
+
+template <>
+FORCEINLINE ULONG DeinterleaveGroup<4, 4>(
+    _In_ const UCHAR *                        usbTile,
+    _In_ ULONG                                bytesPerBlock,
+    _In_reads_(c_channelGroup) PUCHAR const * asioSamples,
+    _In_ ULONG                                frames
+)
+{
+    ULONG frame = 0;
+
+    for (; frame + 4 <= frames; frame += 4)
+    {
+        __m128 row0 = _mm_loadu_ps((const float *)(usbTile + (frame + 0) * bytesPerBlock));
+        __m128 row1 = _mm_loadu_ps((const float *)(usbTile + (frame + 1) * bytesPerBlock));
+        __m128 row2 = _mm_loadu_ps((const float *)(usbTile + (frame + 2) * bytesPerBlock));
+        __m128 row3 = _mm_loadu_ps((const float *)(usbTile + (frame + 3) * bytesPerBlock));
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+        _mm_storeu_ps((float *)(asioSamples[0] + frame * 4), row0);
+        _mm_storeu_ps((float *)(asioSamples[1] + frame * 4), row1);
+        _mm_storeu_ps((float *)(asioSamples[2] + frame * 4), row2);
+        _mm_storeu_ps((float *)(asioSamples[3] + frame * 4), row3);
+    }
+    return frame;
+}
+
+template <>
+FORCEINLINE ULONG InterleaveGroup<2, 2>(
+    _Inout_ PUCHAR                                   usbTile,
+    _In_ ULONG                                       bytesPerBlock,
+    _In_reads_(c_channelGroup) const UCHAR * const * asioSamples,
+    _In_ ULONG                                       frames
+)
+{
+    ULONG frame = 0;
+
+    for (; frame + 8 <= frames; frame += 8)
+    {
+        __m128i ch0 = _mm_loadu_si128((const __m128i *)(asioSamples[0] + frame * 2));
+        __m128i ch1 = _mm_loadu_si128((const __m128i *)(asioSamples[1] + frame * 2));
+        __m128i ch2 = _mm_loadu_si128((const __m128i *)(asioSamples[2] + frame * 2));
+        __m128i ch3 = _mm_loadu_si128((const __m128i *)(asioSamples[3] + frame * 2));
+        __m128i ch01Lo = _mm_unpacklo_epi16(ch0, ch1);
+        __m128i ch01Hi = _mm_unpackhi_epi16(ch0, ch1);
+        __m128i ch23Lo = _mm_unpacklo_epi16(ch2, ch3);
+        __m128i ch23Hi = _mm_unpackhi_epi16(ch2, ch3);
+        __m128i frames01 = _mm_unpacklo_epi32(ch01Lo, ch23Lo);
+        __m128i frames23 = _mm_unpackhi_epi32(ch01Lo, ch23Lo);
+        __m128i frames45 = _mm_unpacklo_epi32(ch01Hi, ch23Hi);
+        __m128i frames67 = _mm_unpackhi_epi32(ch01Hi, ch23Hi);
+        _mm_storel_epi64((__m128i *)(usbTile + (frame + 0) * bytesPerBlock), frames01);
+        _mm_storel_epi64((__m128i *)(usbTile + (frame + 1) * bytesPerBlock), _mm_srli_si128(frames01, 8));
+        _mm_storel_epi64((__m128i *)(usbTile + (frame + 2) * bytesPerBlock), frames23);
+        _mm_storel_epi64((__m128i *)(usbTile + (frame + 3) * bytesPerBlock), _mm_srli_si128(frames23, 8));
+        _mm_storel_epi64((__m128i *)(usbTile + (frame + 4) * bytesPerBlock), frames45);
+        _mm_storel_epi64((__m128i *)(usbTile + (frame + 5) * bytesPerBlock), _mm_srli_si128(frames45, 8));
+        _mm_storel_epi64((__m128i *)(usbTile + (frame + 6) * bytesPerBlock), frames67);
+        _mm_storel_epi64((__m128i *)(usbTile + (frame + 7) * bytesPerBlock), _mm_srli_si128(frames67, 8));
+    }
+    return frame;
+}
+
+template <>
+FORCEINLINE ULONG DeinterleaveGroup<2, 2>(
+    _In_ const UCHAR *                        usbTile,
+    _In_ ULONG                                bytesPerBlock,
+    _In_reads_(c_channelGroup) PUCHAR const * asioSamples,
+    _In_ ULONG                                frames
+)
+{
+    ULONG frame = 0;
+
+    for (; frame + 8 <= frames; frame += 8)
+    {
+        __m128i frames01 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(usbTile + (frame + 0) * bytesPerBlock)), _mm_loadl_epi64((const __m128i *)(usbTile + (frame + 1) * bytesPerBlock)));
+        __m128i frames23 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(usbTile + (frame + 2) * bytesPerBlock)), _mm_loadl_epi64((const __m128i *)(usbTile + (frame + 3) * bytesPerBlock)));
+        __m128i frames45 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(usbTile + (frame + 4) * bytesPerBlock)), _mm_loadl_epi64((const __m128i *)(usbTile + (frame + 5) * bytesPerBlock)));
+        __m128i frames67 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(usbTile + (frame + 6) * bytesPerBlock)), _mm_loadl_epi64((const __m128i *)(usbTile + (frame + 7) * bytesPerBlock)));
+        __m128i ch01Lo = _mm_unpacklo_epi32(frames01, frames23);
+        __m128i ch23Lo = _mm_unpackhi_epi32(frames01, frames23);
+        __m128i ch01Hi = _mm_unpacklo_epi32(frames45, frames67);
+        __m128i ch23Hi = _mm_unpackhi_epi32(frames45, frames67);
+        _mm_storeu_si128((__m128i *)(asioSamples[0] + frame * 2), _mm_unpacklo_epi64(ch01Lo, ch01Hi));
+        _mm_storeu_si128((__m128i *)(asioSamples[1] + frame * 2), _mm_unpackhi_epi64(ch01Lo, ch01Hi));
+        _mm_storeu_si128((__m128i *)(asioSamples[2] + frame * 2), _mm_unpacklo_epi64(ch23Lo, ch23Hi));
+        _mm_storeu_si128((__m128i *)(asioSamples[3] + frame * 2), _mm_unpackhi_epi64(ch23Lo, ch23Hi));
+    }
+    return frame;
+}
+#elif defined(_M_ARM64)
+FORCEINLINE void Transpose4x4(
+    _Inout_ int32x4_t & row0,
+    _Inout_ int32x4_t & row1,
+    _Inout_ int32x4_t & row2,
+    _Inout_ int32x4_t & row3
+)
+{
+    int32x4x2_t row01 = vtrnq_s32(row0, row1);
+    int32x4x2_t row23 = vtrnq_s32(row2, row3);
+    row0 = vcombine_s32(vget_low_s32(row01.val[0]), vget_low_s32(row23.val[0]));
+    row1 = vcombine_s32(vget_low_s32(row01.val[1]), vget_low_s32(row23.val[1]));
+    row2 = vcombine_s32(vget_high_s32(row01.val[0]), vget_high_s32(row23.val[0]));
+    row3 = vcombine_s32(vget_high_s32(row01.val[1]), vget_high_s32(row23.val[1]));
+}
+
+template <>
+FORCEINLINE ULONG InterleaveGroup<4, 4>(
+    _Inout_ PUCHAR                                   usbTile,
+    _In_ ULONG                                       bytesPerBlock,
+    _In_reads_(c_channelGroup) const UCHAR * const * asioSamples,
+    _In_ ULONG                                       frames
+)
+{
+    ULONG frame = 0;
+
+    for (; frame + 4 <= frames; frame += 4)
+    {
+        int32x4_t row0 = vld1q_s32((const int32_t *)(asioSamples[0] + frame * 4));
+        int32x4_t row1 = vld1q_s32((const int32_t *)(asioSamples[1] + frame * 4));
+        int32x4_t row2 = vld1q_s32((const int32_t *)(asioSamples[2] + frame * 4));
+        int32x4_t row3 = vld1q_s32((const int32_t *)(asioSamples[3] + frame * 4));
+        Transpose4x4(row0, row1, row2, row3);
+        vst1q_s32((int32_t *)(usbTile + (frame + 0) * bytesPerBlock), row0);
+        vst1q_s32((int32_t *)(usbTile + (frame + 1) * bytesPerBlock), row1);
+        vst1q_s32((int32_t *)(usbTile + (frame + 2) * bytesPerBlock), row2);
+        vst1q_s32((int32_t *)(usbTile + (frame + 3) * bytesPerBlock), row3);
+    }
+    return frame;
+}
+
+template <>
+FORCEINLINE ULONG DeinterleaveGroup<4, 4>(
+    _In_ const UCHAR *                        usbTile,
+    _In_ ULONG                                bytesPerBlock,
+    _In_reads_(c_channelGroup) PUCHAR const * asioSamples,
+    _In_ ULONG                                frames
+)
+{
+    ULONG frame = 0;
+
+    for (; frame + 4 <= frames; frame += 4)
+    {
+        int32x4_t row0 = vld1q_s32((const int32_t *)(usbTile + (frame + 0) * bytesPerBlock));
+        int32x4_t row1 = vld1q_s32((const int32_t *)(usbTile + (frame + 1) * bytesPerBlock));
+        int32x4_t row2 = vld1q_s32((const int32_t *)(usbTile + (frame + 2) * bytesPerBlock));
+        int32x4_t row3 = vld1q_s32((const int32_t *)(usbTile + (frame + 3) * bytesPerBlock));
+        Transpose4x4(row0, row1, row2, row3);
+        vst1q_s32((int32_t *)(asioSamples[0] + frame * 4), row0);
+        vst1q_s32((int32_t *)(asioSamples[1] + frame * 4), row1);
+        vst1q_s32((int32_t *)(asioSamples[2] + frame * 4), row2);
+        vst1q_s32((int32_t *)(asioSamples[3] + frame * 4), row3);
+    }
+    return frame;
+}
+#endif
+
+//
+// Tiled kernels
+//
+
+template <ULONG usbBytes, ULONG asioBytes, InterleaveChannelClass channelClass>
+NONPAGED_CODE_SEG
+static void InterleaveFrames(
+    _Inout_ PUCHAR      usbBuffer,
+    _In_ ULONG          bytesPerBlock,
+    _In_ PUCHAR const * asioChannels,
+    _In_ ULONG          asioStartFrame,
+    _In_ ULONG          channels,
+    _In_ ULONG          frames
+)
+{
+    for (ULONG tileStart = 0; tileStart < frames; tileStart += c_tileFrames)
+    {
+        ULONG  tileFrames = MIN(frames - tileStart, c_tileFrames);
+        PUCHAR usbTile = usbBuffer + tileStart * bytesPerBlock;
+        ULONG  asioFrame = asioStartFrame + tileStart;
+        ULONG  ch = 0;
+
+        for (; ch + c_channelGroup <= channels; ch += c_channelGroup)
+        {
+            ULONG         frame = 0;
+            const UCHAR * asioSamples[c_channelGroup] = {};
+            bool          groupMapped = true;
+
+            for (ULONG groupCh = 0; groupCh < c_channelGroup; ++groupCh)
+            {
+                if ((channelClass == InterleaveChannelClass::Sparse) && (asioChannels[ch + groupCh] == nullptr))
+                {
+                    groupMapped = false;
+                    break;
+                }
+                asioSamples[groupCh] = asioChannels[ch + groupCh] + asioFrame * asioBytes;
+            }
+            if (groupMapped)
+            {
+                frame = InterleaveGroup<usbBytes, asioBytes>(usbTile + ch * usbBytes, bytesPerBlock, asioSamples, tileFrames);
+            }
+            for (ULONG groupCh = 0; groupCh < c_channelGroup; ++groupCh)
+            {
+                if ((channelClass == InterleaveChannelClass::Sparse) && (asioChannels[ch + groupCh] == nullptr))
+                {
+                    continue;
+                }
+                const UCHAR * asioSample = asioChannels[ch + groupCh] + (asioFrame + frame) * asioBytes;
+                PUCHAR        usbSample = usbTile + frame * bytesPerBlock + (ch + groupCh) * usbBytes;
+                for (ULONG index = frame; index < tileFrames; ++index)
+                {
+                    CopyUsbSampleFromAsio<usbBytes, asioBytes>(usbSample, asioSample);
+                    asioSample += asioBytes;
+                    usbSample += bytesPerBlock;
+                }
+            }
+        }
+        for (; (channelClass == InterleaveChannelClass::Sparse) && (ch < channels); ++ch)
+        {
+            if (asioChannels[ch] == nullptr)
+            {
+                continue;
+            }
+            const UCHAR * asioSample = asioChannels[ch] + asioFrame * asioBytes;
+            PUCHAR        usbSample = usbTile + ch * usbBytes;
+            for (ULONG index = 0; index < tileFrames; ++index)
+            {
+                CopyUsbSampleFromAsio<usbBytes, asioBytes>(usbSample, asioSample);
+                asioSample += asioBytes;
+                usbSample += bytesPerBlock;
+            }
+        }
+    }
+}
+
+template <ULONG usbBytes, ULONG asioBytes, InterleaveChannelClass channelClass>
+NONPAGED_CODE_SEG
+static void DeinterleaveFrames(
+    _In_ const UCHAR *  usbBuffer,
+    _In_ ULONG          bytesPerBlock,
+    _In_ PUCHAR const * asioChannels,
+    _In_ ULONG          asioStartFrame,
+    _In_ ULONG          channels,
+    _In_ ULONG          frames
+)
+{
+    for (ULONG tileStart = 0; tileStart < frames; tileStart += c_tileFrames)
+    {
+        ULONG         tileFrames = MIN(frames - tileStart, c_tileFrames);
+        const UCHAR * usbTile = usbBuffer + tileStart * bytesPerBlock;
+        ULONG         asioFrame = asioStartFrame + tileStart;
+        ULONG         ch = 0;
+
+        for (; ch + c_channelGroup <= channels; ch += c_channelGroup)
+        {
+            ULONG  frame = 0;
+            PUCHAR asioSamples[c_channelGroup] = {};
+            bool   groupMapped = true;
+
+            for (ULONG groupCh = 0; groupCh < c_channelGroup; ++groupCh)
+            {
+                if ((channelClass == InterleaveChannelClass::Sparse) && (asioChannels[ch + groupCh] == nullptr))
+                {
+                    groupMapped = false;
+                    break;
+                }
+                asioSamples[groupCh] = asioChannels[ch + groupCh] + asioFrame * asioBytes;
+            }
+            if (groupMapped)
+            {
+                frame = DeinterleaveGroup<usbBytes, asioBytes>(usbTile + ch * usbBytes, bytesPerBlock, asioSamples, tileFrames);
+            }
+            for (ULONG groupCh = 0; groupCh < c_channelGroup; ++groupCh)
+            {
+                if ((channelClass == InterleaveChannelClass::Sparse) && (asioChannels[ch + groupCh] == nullptr))
+                {
+                    continue;
+                }
+                PUCHAR        asioSample = asioChannels[ch + groupCh] + (asioFrame + frame) * asioBytes;
+                const UCHAR * usbSample = usbTile + frame * bytesPerBlock + (ch + groupCh) * usbBytes;
+                for (ULONG index = frame; index < tileFrames; ++index)
+                {
+                    CopyAsioSampleFromUsb<usbBytes, asioBytes>(asioSample, usbSample);
+                    asioSample += asioBytes;
+                    usbSample += bytesPerBlock;
+                }
+            }
+        }
+        for (; (channelClass == InterleaveChannelClass::Sparse) && (ch < channels); ++ch)
+        {
+            if (asioChannels[ch] == nullptr)
+            {
+                continue;
+            }
+            PUCHAR        asioSample = asioChannels[ch] + asioFrame * asioBytes;
+            const UCHAR * usbSample = usbTile + ch * usbBytes;
+            for (ULONG index = 0; index < tileFrames; ++index)
+            {
+                CopyAsioSampleFromUsb<usbBytes, asioBytes>(asioSample, usbSample);
+                asioSample += asioBytes;
+                usbSample += bytesPerBlock;
+            }
+        }
+    }
+}
+
+//
+// Dispatch table
+// One entry for each pair of USB and ASIO sample sizes. The ASIO sample type is
+// derived from the wider of the input and output USB samples, so any USB sample
+// may be carried in an ASIO sample of the same size or wider.
+//
+
+typedef struct _INTERLEAVE_KERNEL_ENTRY
+{
+    ULONG               UsbBytesPerSample;
+    ULONG               AsioBytesPerSample;
+    INTERLEAVE_KERNEL   Interleave[toInt(InterleaveChannelClass::Count)];
+    DEINTERLEAVE_KERNEL Deinterleave[toInt(InterleaveChannelClass::Count)];
+} INTERLEAVE_KERNEL_ENTRY;
+
+#define INTERLEAVE_KERNEL_ENTRY_FOR(usbBytes, asioBytes)                          \
+    {                                                                             \
+        usbBytes,                                                                 \
+        asioBytes,                                                                \
+        {InterleaveFrames<usbBytes, asioBytes, InterleaveChannelClass::Sparse>,   \
+         InterleaveFrames<usbBytes, asioBytes, InterleaveChannelClass::Dense>},   \
+        {DeinterleaveFrames<usbBytes, asioBytes, InterleaveChannelClass::Sparse>, \
+         DeinterleaveFrames<usbBytes, asioBytes, InterleaveChannelClass::Dense>}  \
+    }
+
+static const INTERLEAVE_KERNEL_ENTRY c_interleaveKernelTable[] = {
+    INTERLEAVE_KERNEL_ENTRY_FOR(1, 2),
+    INTERLEAVE_KERNEL_ENTRY_FOR(1, 3),
+    INTERLEAVE_KERNEL_ENTRY_FOR(1, 4),
+    INTERLEAVE_KERNEL_ENTRY_FOR(2, 2),
+    INTERLEAVE_KERNEL_ENTRY_FOR(2, 3),
+    INTERLEAVE_KERNEL_ENTRY_FOR(2, 4),
+    INTERLEAVE_KERNEL_ENTRY_FOR(3, 3),
+    INTERLEAVE_KERNEL_ENTRY_FOR(3, 4),
+    INTERLEAVE_KERNEL_ENTRY_FOR(4, 4),
+};
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+InterleaveKernels::Select(
+    ULONG                    usbBytesPerSample,
+    ULONG                    asioBytesPerSample,
+    InterleaveChannelClass   channelClass,
+    INTERLEAVE_KERNEL_INFO & kernelInfo
+)
+{
+    NTSTATUS status = STATUS_NOT_SUPPORTED;
+
+    PAGED_CODE();
+
+    kernelInfo = INTERLEAVE_KERNEL_INFO{};
+
+    RETURN_NTSTATUS_IF_TRUE(toInt(channelClass) >= toInt(InterleaveChannelClass::Count), STATUS_INVALID_PARAMETER);
+
+    for (ULONG index = 0; index < ARRAYSIZE(c_interleaveKernelTable); ++index)
+    {
+        const INTERLEAVE_KERNEL_ENTRY & entry = c_interleaveKernelTable[index];
+        if ((entry.UsbBytesPerSample == usbBytesPerSample) && (entry.AsioBytesPerSample == asioBytesPerSample))
+        {
+            kernelInfo.Interleave = entry.Interleave[toInt(channelClass)];
+            kernelInfo.Deinterleave = entry.Deinterleave[toInt(channelClass)];
+            kernelInfo.UsbBytesPerSample = usbBytesPerSample;
+            kernelInfo.AsioBytesPerSample = asioBytesPerSample;
+            kernelInfo.ChannelClass = channelClass;
+            status = STATUS_SUCCESS;
+            break;
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_ASIO, " - interleave kernel, usbBytesPerSample %u, asioBytesPerSample %u, channelClass %d, %!STATUS!", usbBytesPerSample, asioBytesPerSample, toInt(channelClass), status);
+
+    return status;
+}
@@ -0,0 +1,95 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    InterleaveKernels.h
+
+Abstract:
+
+    Define the kernels that convert between the non-interleaved ASIO buffers
+    and the interleaved USB isochronous buffer.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _INTERLEAVEKERNELS_H_
+#define _INTERLEAVEKERNELS_H_
+
+//
+// Copies 'frames' frames from the ASIO channel buffers into the USB buffer.
+// asioChannels[ch] is the start of the ring buffer of USB channel ch, or nullptr
+// if the channel is not mapped. asioStartFrame must not cause the run to cross
+// the end of the ring; the caller splits the copy at the wrap point.
+//
+typedef void (*INTERLEAVE_KERNEL)(
+    _Inout_ PUCHAR      usbBuffer,
+    _In_ ULONG          bytesPerBlock,
+    _In_ PUCHAR const * asioChannels,
+    _In_ ULONG          asioStartFrame,
+    _In_ ULONG          channels,
+    _In_ ULONG          frames
+);
+
+//
+// Copies 'frames' frames from the USB buffer into the ASIO channel buffers.
+//
+typedef void (*DEINTERLEAVE_KERNEL)(
+    _In_ const UCHAR *  usbBuffer,
+    _In_ ULONG          bytesPerBlock,
+    _In_ PUCHAR const * asioChannels,
+    _In_ ULONG          asioStartFrame,
+    _In_ ULONG          channels,
+    _In_ ULONG          frames
+);
+
+//
+// Sparse: any number of channels, unmapped channels are nullptr.
+// Dense:  every channel is mapped and the number of channels is a multiple of four,
+//         so the kernel does not test for unmapped channels or a remainder.
+//
+enum class InterleaveChannelClass
+{
+    Sparse = 0,
+    Dense,
+    Count
+};
+
+constexpr int toInt(InterleaveChannelClass channelClass)
+{
+    return static_cast<int>(channelClass);
+}
+
+typedef struct _INTERLEAVE_KERNEL_INFO
+{
+    INTERLEAVE_KERNEL      Interleave{nullptr};
+    DEINTERLEAVE_KERNEL    Deinterleave{nullptr};
+    ULONG                  UsbBytesPerSample{0};
+    ULONG                  AsioBytesPerSample{0};
+    InterleaveChannelClass ChannelClass{InterleaveChannelClass::Sparse};
+} INTERLEAVE_KERNEL_INFO;
+
+class InterleaveKernels
+{
+  public:
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS
+    Select(
+        _In_ ULONG                     usbBytesPerSample,
+        _In_ ULONG                     asioBytesPerSample,
+        _In_ InterleaveChannelClass    channelClass,
+        _Out_ INTERLEAVE_KERNEL_INFO & kernelInfo
+    );
+};
+
+#endif
@@ -0,0 +1,225 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    IsoBufferSlab.cpp
+
+Abstract:
+
+    Implement the layout of the slab of the isochronous transfer buffers.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "IsoBufferSlab.h"
+
+#if defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "IsoBufferSlab.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void IsoBufferSlab::Reset()
+{
+    PAGED_CODE();
+
+    m_slab = nullptr;
+    RtlZeroMemory(m_bufferSize, sizeof(m_bufferSize));
+    RtlZeroMemory(m_numOfBuffers, sizeof(m_numOfBuffers));
+    RtlZeroMemory(m_sliceStride, sizeof(m_sliceStride));
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void IsoBufferSlab::SetBufferSize(
+    ULONG region,
+    ULONG bufferSize,
+    ULONG numOfBuffers
+)
+{
+    PAGED_CODE();
+
+    ASSERT(region < c_maxRegions);
+
+    m_bufferSize[region] = bufferSize;
+    m_numOfBuffers[region] = numOfBuffers;
+    m_sliceStride[region] = ((bufferSize != 0) && (numOfBuffers != 0)) ? static_cast<ULONG>(ALIGN_UP_BY(bufferSize, c_sliceAlignment)) + c_guardBytes : 0;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+SIZE_T IsoBufferSlab::GetSlabSize()
+{
+    SIZE_T slabSize = 0;
+
+    PAGED_CODE();
+
+    for (ULONG region = 0; region < c_maxRegions; ++region)
+    {
+        slabSize += static_cast<SIZE_T>(m_sliceStride[region]) * m_numOfBuffers[region];
+    }
+
+    return slabSize;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG IsoBufferSlab::GetStride(
+    ULONG region
+)
+{
+    PAGED_CODE();
+
+    return (region < c_maxRegions) ? m_sliceStride[region] : 0;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void IsoBufferSlab::Carve(
+    PUCHAR slab
+)
+{
+    PAGED_CODE();
+
+    m_slab = slab;
+
+    for (ULONG region = 0; region < c_maxRegions; ++region)
+    {
+        for (ULONG index = 0; (m_sliceStride[region] != 0) && (index < m_numOfBuffers[region]); ++index)
+        {
+            PUCHAR buffer = GetBuffer(region, index);
+            RtlZeroMemory(buffer, m_bufferSize[region]);
+            RtlFillMemory(buffer + m_bufferSize[region], m_sliceStride[region] - m_bufferSize[region], c_guardPattern);
+        }
+    }
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+PUCHAR IsoBufferSlab::GetBuffer(
+    ULONG region,
+    ULONG index
+)
+{
+    if ((m_slab == nullptr) || (region >= c_maxRegions) || (index >= m_numOfBuffers[region]) || (m_sliceStride[region] == 0))
+    {
+        return nullptr;
+    }
+
+    SIZE_T offset = 0;
+    for (ULONG preceding = 0; preceding < region; ++preceding)
+    {
+        offset += static_cast<SIZE_T>(m_sliceStride[preceding]) * m_numOfBuffers[preceding];
+    }
+
+    return m_slab + offset + static_cast<SIZE_T>(m_sliceStride[region]) * index;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool IsoBufferSlab::VerifyGuardBytes()
+/*++
+
+Routine Description:
+
+    A corrupted guard is reported and filled again, so that each overrun
+    is reported once.
+
+Return Value:
+
+    true if all guard bytes are intact.
+
+--*/
+{
+    bool result = true;
+
+    PAGED_CODE();
+
+    if (m_slab == nullptr)
+    {
+        return result;
+    }
+
+    for (ULONG region = 0; region < c_maxRegions; ++region)
+    {
+        if (m_sliceStride[region] == 0)
+        {
+            continue;
+        }
+        ULONG guardBytes = m_sliceStride[region] - m_bufferSize[region];
+        for (ULONG index = 0; index < m_numOfBuffers[region]; ++index)
+        {
+            PUCHAR guard = GetBuffer(region, index) + m_bufferSize[region];
+            for (ULONG offset = 0; offset < guardBytes; ++offset)
+            {
+                if (guard[offset] != c_guardPattern)
+                {
+                    TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, " - guard bytes of region %u, buffer %u are corrupted at offset %u, 0x%02x", region, index, offset, guard[offset]);
+                    RtlFillMemory(guard, guardBytes, c_guardPattern);
+                    result = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void IsoBufferSlab::Publish(
+    PUCHAR        dst,
+    const UCHAR * src,
+    ULONG         length
+)
+/*++
+
+Routine Description:
+
+    Copies a mixed output packet from the staging buffer to the device
+    buffer. On x64 the aligned part is written with non-temporal stores, so
+    that it is combined into full bus writes and does not evict the mixing
+    data from the cache.
+
+--*/
+{
+#if defined(_M_X64)
+    ULONG head = static_cast<ULONG>((sizeof(__m128i) - ((ULONG_PTR)dst & (sizeof(__m128i) - 1))) & (sizeof(__m128i) - 1));
+    if (head > length)
+    {
+        head = length;
+    }
+    RtlCopyMemory(dst, src, head);
+    dst += head;
+    src += head;
+    length -= head;
+
+    ULONG blocks = length / sizeof(__m128i);
+    for (ULONG i = 0; i < blocks; ++i)
+    {
+        _mm_stream_si128((__m128i *)dst + i, _mm_loadu_si128((const __m128i *)src + i));
+    }
+    RtlCopyMemory(dst + blocks * sizeof(__m128i), src + blocks * sizeof(__m128i), length - blocks * sizeof(__m128i));
+
+    // The streaming stores are weakly ordered; make them visible before the URB is submitted.
+    _mm_sfence();
+#else
+    RtlCopyMemory(dst, src, length);
+#endif
+}
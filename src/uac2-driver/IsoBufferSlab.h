@@ -0,0 +1,100 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    IsoBufferSlab.h
+
+Abstract:
+
+    Define the layout of the slab that ContiguousMemory carves the buffers
+    of the isochronous transfers from, and the copy that publishes a staged
+    output packet to it.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _ISOBUFFERSLAB_H_
+#define _ISOBUFFERSLAB_H_
+
+//
+// The slab holds one region per direction, one after the other. Each region
+// holds numOfBuffers slices of the same stride; a slice is a buffer that
+// starts on a cache line, followed by at least c_guardBytes guard bytes up to
+// the next cache line. The slab itself must start on a cache line.
+//
+class IsoBufferSlab
+{
+  public:
+    static const ULONG c_maxRegions = 3;
+    static const ULONG c_sliceAlignment = SYSTEM_CACHE_ALIGNMENT_SIZE;
+    static const ULONG c_guardBytes = SYSTEM_CACHE_ALIGNMENT_SIZE;
+    static const UCHAR c_guardPattern = 0xfd;
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Reset();
+
+    // Sets the size and number of the buffers of a region. A region without buffers takes no space.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void SetBufferSize(
+        _In_ ULONG region,
+        _In_ ULONG bufferSize,
+        _In_ ULONG numOfBuffers
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    SIZE_T GetSlabSize();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG GetStride(
+        _In_ ULONG region
+    );
+
+    // Zero-fills the buffers of a slab of GetSlabSize() bytes and fills their guard bytes.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Carve(
+        _In_ PUCHAR slab
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    PUCHAR GetBuffer(
+        _In_ ULONG region,
+        _In_ ULONG index
+    );
+
+    // Checks that nothing has been written past the end of any buffer of the slab.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool VerifyGuardBytes();
+
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Publish(
+        _Out_ PUCHAR       dst,
+        _In_ const UCHAR * src,
+        _In_ ULONG         length
+    );
+
+  private:
+    PUCHAR m_slab{nullptr};
+    ULONG  m_bufferSize[c_maxRegions]{};
+    ULONG  m_numOfBuffers[c_maxRegions]{};
+    ULONG  m_sliceStride[c_maxRegions]{}; // Buffer size rounded up to c_sliceAlignment, plus c_guardBytes.
+};
+
+#endif
@@ -0,0 +1,384 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    IsoRequestPool.cpp
+
+Abstract:
+
+    Implements a class that keeps the requests and URBs of the isochronous
+    transfers for the lifetime of the device.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "Driver.h"
+#include "Device.h"
+#include "Public.h"
+#include "Common.h"
+#include "USBAudio.h"
+#include "IsoRequestPool.h"
+
+#ifndef __INTELLISENSE__
+#include "IsoRequestPool.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+IsoRequestPool * IsoRequestPool::Create(
+    PDEVICE_CONTEXT deviceContext
+)
+{
+    PAGED_CODE();
+
+    return new (POOL_FLAG_NON_PAGED, DRIVER_TAG) IsoRequestPool(deviceContext);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+IsoRequestPool::IsoRequestPool(
+    PDEVICE_CONTEXT deviceContext
+)
+    : m_deviceContext(deviceContext)
+{
+    NTSTATUS              status = STATUS_SUCCESS;
+    WDF_OBJECT_ATTRIBUTES attributes;
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = m_deviceContext->Device;
+    status = WdfSpinLockCreate(&attributes, &m_spinLock);
+    ASSERT(NT_SUCCESS(status));
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+IsoRequestPool::~IsoRequestPool()
+{
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    Free();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS IsoRequestPool::Allocate(
+    ULONG maxClassicFramesPerIrp,
+    ULONG framesPerMs
+)
+/*++
+
+Routine Description:
+
+    Sizes the pool for the largest number of IsoPackets the transfer
+    objects can use, so that the URBs do not depend on the selected sample
+    rate. The requests are created by Acquire() on the I/O target of the
+    pipe they are sent to, and are kept until InvalidatePipes() is called.
+
+Arguments:
+
+    maxClassicFramesPerIrp -
+
+    framesPerMs -
+
+Return Value:
+
+    NTSTATUS - NT status value
+
+--*/
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, %u, %u", maxClassicFramesPerIrp, framesPerMs);
+
+    RETURN_NTSTATUS_IF_TRUE(m_spinLock == nullptr, STATUS_INSUFFICIENT_RESOURCES);
+    RETURN_NTSTATUS_IF_TRUE(m_deviceContext->UsbDevice == nullptr, STATUS_INVALID_DEVICE_STATE);
+
+    Free();
+
+    WdfSpinLockAcquire(m_spinLock);
+    m_maxIsoPackets = min(maxClassicFramesPerIrp * framesPerMs, (ULONG)(UAC_MAX_CLASSIC_FRAMES_PER_IRP * UAC_MAX_FRAMES_PER_MS));
+    WdfSpinLockRelease(m_spinLock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!, max iso packets %u", status, m_maxIsoPackets);
+
+    return status;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+NTSTATUS IsoRequestPool::CreateEntry(
+    ISO_REQUEST_POOL_ENTRY & entry,
+    WDFIOTARGET              ioTarget
+)
+/*++
+
+Routine Description:
+
+    Creates the request of the entry on the I/O target of its pipe, and the
+    URB parented to it. The caller holds m_spinLock.
+
+--*/
+{
+    NTSTATUS              status = STATUS_SUCCESS;
+    WDF_OBJECT_ATTRIBUTES attributes;
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, ISOCHRONOUS_REQUEST_CONTEXT);
+    attributes.ParentObject = m_deviceContext->Device;
+    attributes.EvtCleanupCallback = USBAudioAcxDriverEvtIsoRequestContextCleanup;
+    status = WdfRequestCreate(&attributes, ioTarget, &entry.Request);
+    RETURN_NTSTATUS_IF_FAILED_MSG(status, "WdfRequestCreate failed");
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = entry.Request; // Specifying m_deviceContext->UsbDevice causes a DRIVER_IRQL_NOT_LESS_OR_EQUAL (d1) BSOD in USBXHCI.SYS.
+    status = WdfUsbTargetDeviceCreateIsochUrb(m_deviceContext->UsbDevice, &attributes, m_maxIsoPackets, &entry.UrbMemory, nullptr);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "WdfUsbTargetDeviceCreateIsochUrb failed %!STATUS!", status);
+        WdfObjectDelete(entry.Request);
+        RtlZeroMemory(&entry, sizeof(entry));
+        return status;
+    }
+
+    entry.PipeGeneration = m_pipeGeneration;
+    entry.Urb = static_cast<PURB>(WdfMemoryGetBuffer(entry.UrbMemory, nullptr));
+    entry.InUse = false;
+    ++m_numOfCreated;
+
+    return status;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void IsoRequestPool::Free()
+{
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    if (m_spinLock == nullptr)
+    {
+        return;
+    }
+
+    WdfSpinLockAcquire(m_spinLock);
+    for (ULONG direction = 0; direction < toULONG(IsoDirection::NumOfIsoDirection); ++direction)
+    {
+        for (ULONG index = 0; index < UAC_MAX_IRP_NUMBER; ++index)
+        {
+            ISO_REQUEST_POOL_ENTRY & entry = m_entries[direction][index];
+
+            // A request that is still in use is left to its parent device.
+            if ((entry.Request != nullptr) && !entry.InUse)
+            {
+                // The URB memory is deleted together with its parent request.
+                WdfObjectDelete(entry.Request);
+            }
+            RtlZeroMemory(&entry, sizeof(entry));
+        }
+    }
+    m_maxIsoPackets = 0;
+    m_numOfEntriesInUse = 0;
+    WdfSpinLockRelease(m_spinLock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void IsoRequestPool::InvalidatePipes()
+{
+    if (m_spinLock == nullptr)
+    {
+        return;
+    }
+
+    WdfSpinLockAcquire(m_spinLock);
+    ++m_pipeGeneration;
+    WdfSpinLockRelease(m_spinLock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! pipe generation %u", m_pipeGeneration);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+NTSTATUS IsoRequestPool::Acquire(
+    IsoDirection direction,
+    LONG         index,
+    WDFUSBPIPE   pipe,
+    ULONG        numIsoPackets,
+    WDFREQUEST & request,
+    WDFMEMORY &  urbMemory,
+    PURB &       urb
+)
+/*++
+
+Routine Description:
+
+    Re-arms the pooled request of the specified direction and index, after
+    creating it on the I/O target of the pipe if the entry has no request
+    created since the pipes were last selected.
+
+Return Value:
+
+    NTSTATUS - STATUS_INSUFFICIENT_RESOURCES when the pool cannot provide
+    the request, in which case the caller creates a request by itself.
+
+--*/
+{
+    NTSTATUS                 status = STATUS_SUCCESS;
+    WDF_REQUEST_REUSE_PARAMS reuseParams;
+    WDFIOTARGET              ioTarget = nullptr;
+
+    request = nullptr;
+    urbMemory = nullptr;
+    urb = nullptr;
+
+    RETURN_NTSTATUS_IF_TRUE(m_spinLock == nullptr, STATUS_INSUFFICIENT_RESOURCES);
+    RETURN_NTSTATUS_IF_TRUE((direction >= IsoDirection::NumOfIsoDirection) || (index < 0) || (index >= UAC_MAX_IRP_NUMBER) || (pipe == nullptr), STATUS_INSUFFICIENT_RESOURCES);
+
+    ioTarget = WdfUsbTargetPipeGetIoTarget(pipe);
+
+    WdfSpinLockAcquire(m_spinLock);
+
+    ISO_REQUEST_POOL_ENTRY & entry = m_entries[toInt(direction)][index];
+
+    if (entry.InUse || (numIsoPackets > m_maxIsoPackets))
+    {
+        WdfSpinLockRelease(m_spinLock);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // The pipes are created again when an alternate setting is selected.
+    // The handle of the new I/O target is not compared with the old one,
+    // because the framework may hand out the same value again.
+    if ((entry.Request != nullptr) && (entry.PipeGeneration != m_pipeGeneration))
+    {
+        WdfObjectDelete(entry.Request);
+        RtlZeroMemory(&entry, sizeof(entry));
+    }
+    if (entry.Request == nullptr)
+    {
+        status = CreateEntry(entry, ioTarget);
+        if (!NT_SUCCESS(status))
+        {
+            WdfSpinLockRelease(m_spinLock);
+            return status;
+        }
+    }
+
+    WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+    status = WdfRequestReuse(entry.Request, &reuseParams);
+    if (!NT_SUCCESS(status))
+    {
+        WdfSpinLockRelease(m_spinLock);
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "WdfRequestReuse failed %!STATUS!", status);
+        return status;
+    }
+
+    // A URB created by WdfUsbTargetDeviceCreateIsochUrb() is zero-filled, so the reused one is cleared as well.
+    RtlZeroMemory(entry.Urb, GET_ISO_URB_SIZE(numIsoPackets));
+    RtlZeroMemory(GetIsochronousRequestContext(entry.Request), sizeof(ISOCHRONOUS_REQUEST_CONTEXT));
+
+    entry.InUse = true;
+    request = entry.Request;
+    urbMemory = entry.UrbMemory;
+    urb = entry.Urb;
+
+    ++m_numOfAcquired;
+    ++m_numOfEntriesInUse;
+    if (m_numOfEntriesInUse > m_highWaterMark)
+    {
+        m_highWaterMark = m_numOfEntriesInUse;
+    }
+
+    WdfSpinLockRelease(m_spinLock);
+
+    return status;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void IsoRequestPool::Release(
+    IsoDirection direction,
+    LONG         index
+)
+{
+    if ((m_spinLock == nullptr) || (direction >= IsoDirection::NumOfIsoDirection) || (index < 0) || (index >= UAC_MAX_IRP_NUMBER))
+    {
+        return;
+    }
+
+    WdfSpinLockAcquire(m_spinLock);
+
+    ISO_REQUEST_POOL_ENTRY & entry = m_entries[toInt(direction)][index];
+    if (entry.InUse)
+    {
+        entry.InUse = false;
+        --m_numOfEntriesInUse;
+    }
+
+    WdfSpinLockRelease(m_spinLock);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void IsoRequestPool::Abandon(
+    IsoDirection direction,
+    LONG         index
+)
+{
+    if ((m_spinLock == nullptr) || (direction >= IsoDirection::NumOfIsoDirection) || (index < 0) || (index >= UAC_MAX_IRP_NUMBER))
+    {
+        return;
+    }
+
+    WdfSpinLockAcquire(m_spinLock);
+
+    ISO_REQUEST_POOL_ENTRY & entry = m_entries[toInt(direction)][index];
+    if (entry.InUse)
+    {
+        --m_numOfEntriesInUse;
+    }
+    if (entry.Request != nullptr)
+    {
+        ++m_numOfAbandoned;
+    }
+    RtlZeroMemory(&entry, sizeof(entry));
+
+    WdfSpinLockRelease(m_spinLock);
+
+    TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "%!FUNC! direction %d, index %d", toInt(direction), index);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void IsoRequestPool::CountAllocation()
+{
+    InterlockedIncrement((LONG *)&m_numOfAllocations);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void IsoRequestPool::Report()
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " IsoRequestPool high-water mark %u / %u, re-armed %u, created %u, allocated %u, abandoned %u", m_highWaterMark, toULONG(IsoDirection::NumOfIsoDirection) * UAC_MAX_IRP_NUMBER, m_numOfAcquired, m_numOfCreated, m_numOfAllocations, m_numOfAbandoned);
+}
@@ -0,0 +1,138 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    IsoRequestPool.h
+
+Abstract:
+
+    Define a class that keeps the requests and URBs of the isochronous
+    transfers for the lifetime of the device, so that they are re-armed
+    instead of being created again on every transfer and stream start.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _ISO_REQUEST_POOL_H_
+#define _ISO_REQUEST_POOL_H_
+
+//
+// One request and the URB parented to it. Each TransferObject always uses
+// the entry of its own direction and index. The request is created on the
+// I/O target of the pipe it is sent to, the first time it is acquired, and
+// is created again only after the pipes have been selected again.
+//
+typedef struct _ISO_REQUEST_POOL_ENTRY
+{
+    WDFREQUEST Request;
+    WDFMEMORY  UrbMemory;
+    PURB       Urb;
+    ULONG      PipeGeneration; // m_pipeGeneration of the pool when the request was created.
+    bool       InUse;
+} ISO_REQUEST_POOL_ENTRY;
+
+class IsoRequestPool
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    IsoRequestPool(
+        _In_ PDEVICE_CONTEXT deviceContext
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual ~IsoRequestPool();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS Allocate(
+        _In_ ULONG maxClassicFramesPerIrp,
+        _In_ ULONG framesPerMs
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    NONPAGED_CODE_SEG
+    void Free();
+
+    // Called whenever the pipes are selected again. The I/O target of a new
+    // pipe can have the same handle value as the deleted one, so the requests
+    // created before this call are never re-armed.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    NONPAGED_CODE_SEG
+    void InvalidatePipes();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    NTSTATUS Acquire(
+        _In_ IsoDirection  direction,
+        _In_ LONG          index,
+        _In_ WDFUSBPIPE    pipe,
+        _In_ ULONG         numIsoPackets,
+        _Out_ WDFREQUEST & request,
+        _Out_ WDFMEMORY &  urbMemory,
+        _Out_ PURB &       urb
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Release(
+        _In_ IsoDirection direction,
+        _In_ LONG         index
+    );
+
+    // Removes a request that may still be pending from the pool, so that it is
+    // never re-armed. It is deleted together with its parent device.
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Abandon(
+        _In_ IsoDirection direction,
+        _In_ LONG         index
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void CountAllocation();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Report();
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    IsoRequestPool * Create(
+        _In_ PDEVICE_CONTEXT deviceContext
+    );
+
+  private:
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    NTSTATUS CreateEntry(
+        _Inout_ ISO_REQUEST_POOL_ENTRY & entry,
+        _In_ WDFIOTARGET                 ioTarget
+    );
+
+    PDEVICE_CONTEXT        m_deviceContext{nullptr};
+    WDFSPINLOCK            m_spinLock{nullptr};
+    ULONG                  m_maxIsoPackets{0};      // Number of IsoPackets each pooled URB can hold.
+    ULONG                  m_pipeGeneration{0};     // Incremented by InvalidatePipes.
+    ULONG                  m_numOfEntriesInUse{0};
+    ULONG                  m_highWaterMark{0};      // Largest m_numOfEntriesInUse since Allocate.
+    ULONG                  m_numOfAcquired{0};      // Requests re-armed from the pool.
+    ULONG                  m_numOfAllocations{0};   // Requests created outside the pool.
+    ULONG                  m_numOfCreated{0};       // Requests created by the pool.
+    ULONG                  m_numOfAbandoned{0};     // Requests removed from the pool while they may be pending.
+    ISO_REQUEST_POOL_ENTRY m_entries[toInt(IsoDirection::NumOfIsoDirection)][UAC_MAX_IRP_NUMBER]{};
+};
+
+#endif
@@ -0,0 +1,128 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    LatencyStatistics.cpp
+
+Abstract:
+
+    Implement a class that keeps always-on latency histograms of the mixing
+    engine thread.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "Driver.h"
+#include "Device.h"
+#include "Public.h"
+#include "Common.h"
+#include "LatencyStatistics.h"
+
+#ifndef __INTELLISENSE__
+#include "LatencyStatistics.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LatencyStatistics *
+LatencyStatistics::Create()
+{
+    PAGED_CODE();
+
+    return new (POOL_FLAG_NON_PAGED, DRIVER_TAG) LatencyStatistics();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LatencyStatistics::LatencyStatistics()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LatencyStatistics::~LatencyStatistics()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG
+LatencyStatistics::GetBucketIndex(
+    ULONG valueUs
+)
+{
+    const ULONG subBuckets = 1UL << UAC_LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+
+    if (valueUs < subBuckets)
+    {
+        return valueUs;
+    }
+
+    unsigned long msb = 0;
+    _BitScanReverse(&msb, valueUs);
+
+    ULONG index = (msb - UAC_LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * subBuckets + ((valueUs >> (msb - UAC_LATENCY_HISTOGRAM_SUB_BUCKET_BITS)) & (subBuckets - 1));
+    return min(index, (ULONG)(UAC_LATENCY_HISTOGRAM_BUCKETS - 1));
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void LatencyStatistics::Record(
+    UACLatencyHistogram histogram,
+    LONG                valueUs
+)
+{
+    ULONG value = (valueUs > 0) ? (ULONG)valueUs : 0;
+
+    ASSERT(toULong(histogram) < toULong(UACLatencyHistogram::Count));
+
+    UAC_LATENCY_HISTOGRAM & entry = m_histogram[toULong(histogram)];
+
+    ++entry.Buckets[GetBucketIndex(value)];
+    entry.SumUs += value;
+    if (value > entry.MaxUs)
+    {
+        entry.MaxUs = value;
+    }
+    ++entry.Count;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void LatencyStatistics::GetStatistics(
+    UAC_STATISTICS & statistics
+) const
+{
+    PAGED_CODE();
+
+    RtlZeroMemory(&statistics, sizeof(statistics));
+    statistics.Length = sizeof(UAC_STATISTICS);
+    statistics.SubBucketBits = UAC_LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    statistics.Buckets = UAC_LATENCY_HISTOGRAM_BUCKETS;
+    statistics.Histograms = toULong(UACLatencyHistogram::Count);
+
+    for (ULONG histogram = 0; histogram < toULong(UACLatencyHistogram::Count); ++histogram)
+    {
+        const UAC_LATENCY_HISTOGRAM & entry = m_histogram[histogram];
+
+        statistics.Histogram[histogram].Count = ReadULong64NoFence(&entry.Count);
+        statistics.Histogram[histogram].SumUs = ReadULong64NoFence(&entry.SumUs);
+        statistics.Histogram[histogram].MaxUs = ReadULongNoFence(&entry.MaxUs);
+        for (ULONG bucket = 0; bucket < UAC_LATENCY_HISTOGRAM_BUCKETS; ++bucket)
+        {
+            statistics.Histogram[histogram].Buckets[bucket] = ReadULongNoFence(&entry.Buckets[bucket]);
+        }
+    }
+}
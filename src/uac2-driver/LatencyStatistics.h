@@ -0,0 +1,75 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    LatencyStatistics.h
+
+Abstract:
+
+    Define a class that keeps always-on latency histograms of the mixing
+    engine thread.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _LATENCY_STATISTICS_H_
+#define _LATENCY_STATISTICS_H_
+
+#include <acx.h>
+#include "UAC_User.h"
+
+//
+// Record() is called only from the mixing engine thread, so the counters are
+// updated without interlocked operations. GetStatistics() may run concurrently
+// and copies each aligned counter atomically, so a histogram may be one sample
+// behind its Count, but no counter is torn.
+//
+class LatencyStatistics
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LatencyStatistics();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual ~LatencyStatistics();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Record(
+        _In_ UACLatencyHistogram histogram,
+        _In_ LONG                valueUs
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void GetStatistics(
+        _Out_ UAC_STATISTICS & statistics
+    ) const;
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LatencyStatistics * Create();
+
+  private:
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    static ULONG GetBucketIndex(
+        _In_ ULONG valueUs
+    );
+
+    UAC_LATENCY_HISTOGRAM m_histogram[toULong(UACLatencyHistogram::Count)]{};
+};
+
+#endif
@@ -0,0 +1,192 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    MixBus.cpp
+
+Abstract:
+
+    Implement the tiled mix of the render devices into a USB packet.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "MixBus.h"
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "MixBus.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void MixBus::Mix(
+    MIX_BUS_LANE *             lanes,
+    ULONG                      numOfLanes,
+    MIX_KERNEL                 mixKernel,
+    const FLOAT_MIX_BUS_INFO * floatMixBus,
+    FLOAT_BUS_DITHER *         dither,
+    PUCHAR                     tile,
+    PUCHAR                     buffer,
+    ULONG                      length,
+    ULONG                      totalProcessedBytesSoFar,
+    ULONG                      usbBytesPerSample,
+    ULONG                      usbChannels,
+    ULONG                      srcBytesPerSample
+)
+/*++
+
+Routine Description:
+
+    Instead of walking the whole packet once per device, the packet is
+    processed in tiles of c_tileBytes. Each tile is read from the USB buffer
+    once, every device is mixed into it while it is in the cache, and it is
+    written back once.
+    With the float mix bus, the tile holds float samples. The devices are
+    accumulated without clamping and the tile is quantized to the USB format
+    when it is written back.
+
+Arguments:
+
+    dither - The dither state passed to floatMixBus->Store, or nullptr.
+
+    totalProcessedBytesSoFar - Bytes of the URB that precede this packet.
+
+    srcBytesPerSample - The number of bytes per sample in Acx Audio.
+
+--*/
+{
+    PAGED_CODE();
+
+    ULONG dstFrameBytes = usbBytesPerSample * usbChannels;
+    ULONG tileBytesPerSample = (floatMixBus != nullptr) ? sizeof(float) : usbBytesPerSample;
+    ULONG tileFrameBytes = tileBytesPerSample * usbChannels;
+
+    ASSERT((dstFrameBytes != 0) && (tileFrameBytes <= c_tileBytes));
+
+    ULONG framesPerTile = c_tileBytes / tileFrameBytes;
+    ULONG framesRemaining = length / dstFrameBytes;
+    ULONG processedDstBytes = 0;
+
+    while (framesRemaining != 0)
+    {
+        ULONG frames = MIN(framesRemaining, framesPerTile);
+        ULONG dstBytes = frames * dstFrameBytes;
+
+        if (floatMixBus != nullptr)
+        {
+            floatMixBus->Load((float *)tile, buffer + processedDstBytes, frames * usbChannels);
+        }
+        else
+        {
+            RtlCopyMemory(tile, buffer + processedDstBytes, dstBytes);
+        }
+        for (ULONG laneIndex = 0; laneIndex < numOfLanes; laneIndex++)
+        {
+            MixLane(lanes[laneIndex], mixKernel, (floatMixBus != nullptr) ? floatMixBus->Accumulate : nullptr, tile, tileFrameBytes, tileBytesPerSample, dstFrameBytes, frames, usbBytesPerSample, srcBytesPerSample, totalProcessedBytesSoFar + processedDstBytes);
+        }
+        if (floatMixBus != nullptr)
+        {
+            floatMixBus->Store(buffer + processedDstBytes, (const float *)tile, frames * usbChannels, dither);
+        }
+        else
+        {
+            RtlCopyMemory(buffer + processedDstBytes, tile, dstBytes);
+        }
+
+        framesRemaining -= frames;
+        processedDstBytes += dstBytes;
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void MixBus::MixLane(
+    MIX_BUS_LANE &       lane,
+    MIX_KERNEL           mixKernel,
+    FLOAT_BUS_ACCUMULATE accumulate,
+    PUCHAR               tile,
+    ULONG                tileFrameBytes,
+    ULONG                tileBytesPerSample,
+    ULONG                dstFrameBytes,
+    ULONG                frames,
+    ULONG                usbBytesPerSample,
+    ULONG                srcBytesPerSample,
+    ULONG                processedDstBytes
+)
+/*++
+
+Routine Description:
+
+    Mixes the next frames of one render device into a tile, in runs that end
+    at the RtPacket boundary.
+
+Arguments:
+
+    accumulate - The float mix bus kernel, or nullptr when the tile is in the
+    USB format and mixKernel is used.
+
+    tileFrameBytes - Stride between the frames of the tile.
+
+    dstFrameBytes - Size of a USB frame, used for the position of the RtPacket boundary.
+
+    processedDstBytes - Bytes of the URB that precede the tile.
+
+--*/
+{
+    PUCHAR dstData = tile + lane.UsbChannel * tileBytesPerSample;
+    ULONG  bytesCopiedDstData = 0;
+
+    PAGED_CODE();
+
+    while (frames != 0)
+    {
+        ULONG framesToBoundary = (lane.RtPacketSize - lane.SrcIndexInRtPacket + lane.SrcFrameBytes - 1) / lane.SrcFrameBytes;
+        ULONG run = MIN(frames, framesToBoundary);
+
+        if (accumulate != nullptr)
+        {
+            accumulate((float *)dstData, tileFrameBytes / sizeof(float), lane.SrcData + lane.SrcIndexInRtPacket, lane.SrcFrameBytes, lane.Channels, run);
+        }
+        else if (mixKernel != nullptr)
+        {
+            if (usbBytesPerSample == srcBytesPerSample)
+            {
+                mixKernel(dstData, tileFrameBytes, lane.SrcData + lane.SrcIndexInRtPacket, lane.SrcFrameBytes, lane.Channels, run);
+            }
+            else
+            {
+                for (ULONG acxCh = 0; acxCh < lane.Channels; acxCh++)
+                {
+                    mixKernel(dstData + acxCh * usbBytesPerSample, tileFrameBytes, lane.SrcData + lane.SrcIndexInRtPacket + acxCh * srcBytesPerSample, lane.SrcFrameBytes, 1, run);
+                }
+            }
+        }
+
+        frames -= run;
+        dstData += run * tileFrameBytes;
+        bytesCopiedDstData += run * dstFrameBytes;
+        lane.SrcIndexInRtPacket += run * lane.SrcFrameBytes;
+        lane.BytesCopiedSrcData += run * lane.SrcFrameBytes;
+        if (lane.SrcIndexInRtPacket >= lane.RtPacketSize)
+        {
+            lane.BytesCopiedUpToBoundary = processedDstBytes + bytesCopiedDstData;
+            lane.BytesCopiedSrcDataUpToBoundary = lane.BytesCopiedSrcData;
+            lane.FedRtPacket = true;
+            lane.SrcIndexInRtPacket = 0;
+            lane.RtPacketIndex++;
+            lane.RtPacketIndex %= lane.RtPacketsCount;
+            lane.SrcData = ((PBYTE)lane.RtPackets[lane.RtPacketIndex]);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    MixBus.h
+
+Abstract:
+
+    Define the tiled mix of the RtPackets of several render devices into one
+    USB packet, separated from the RtPacketObject that owns the RtPackets.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _MIXBUS_H_
+#define _MIXBUS_H_
+
+#include "MixKernels.h"
+#include "FloatMixBus.h"
+
+//
+// The state of one render device while the mix bus walks a USB packet.
+// The fields up to SrcFrameBytes describe the device and are set by the
+// caller; the others are its position and are updated by MixBus::Mix().
+//
+typedef struct _MIX_BUS_LANE
+{
+    ULONG   DeviceIndex;
+    PVOID * RtPackets;
+    ULONG   RtPacketsCount;
+    ULONG   RtPacketSize;
+    ULONG   Channels;      // Number of channels of the device.
+    ULONG   UsbChannel;    // First channel of the device in a USB frame.
+    ULONG   SrcFrameBytes;
+    ULONG   RtPacketIndex;
+    ULONG   SrcIndexInRtPacket;
+    PBYTE   SrcData;
+    ULONG   BytesCopiedSrcData;
+    ULONG   BytesCopiedSrcDataUpToBoundary;
+    ULONG   BytesCopiedUpToBoundary; // Bytes of the URB up to the end of the last RtPacket that was fed.
+    bool    FedRtPacket;
+} MIX_BUS_LANE;
+
+class MixBus
+{
+  public:
+    static const ULONG c_tileBytes = 4096; // USB frames are mixed in tiles of this size, which stay in the L1 cache.
+
+    //
+    // Mixes the lanes into a USB packet that already contains the ASIO output.
+    // floatMixBus is nullptr when the tile holds samples in the USB format and
+    // mixKernel is used. A frame of the tile must fit in c_tileBytes.
+    //
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Mix(
+        _Inout_updates_(numOfLanes) MIX_BUS_LANE * lanes,
+        _In_ ULONG                                 numOfLanes,
+        _In_ MIX_KERNEL                            mixKernel,
+        _In_opt_ const FLOAT_MIX_BUS_INFO *        floatMixBus,
+        _Inout_opt_ FLOAT_BUS_DITHER *             dither,
+        _Inout_ PUCHAR                             tile,
+        _Inout_ PUCHAR                             buffer,
+        _In_ ULONG                                 length,
+        _In_ ULONG                                 totalProcessedBytesSoFar,
+        _In_ ULONG                                 usbBytesPerSample,
+        _In_ ULONG                                 usbChannels,
+        _In_ ULONG                                 srcBytesPerSample
+    );
+
+  private:
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void MixLane(
+        _Inout_ MIX_BUS_LANE &        lane,
+        _In_ MIX_KERNEL               mixKernel,
+        _In_opt_ FLOAT_BUS_ACCUMULATE accumulate,
+        _Inout_ PUCHAR                tile,
+        _In_ ULONG                    tileFrameBytes,
+        _In_ ULONG                    tileBytesPerSample,
+        _In_ ULONG                    dstFrameBytes,
+        _In_ ULONG                    frames,
+        _In_ ULONG                    usbBytesPerSample,
+        _In_ ULONG                    srcBytesPerSample,
+        _In_ ULONG                    processedDstBytes
+    );
+};
+
+#endif
@@ -0,0 +1,628 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    MixKernels.cpp
+
+Abstract:
+
+    Implement the saturating mix kernels used to add Acx Audio samples into
+    the USB isochronous buffer.
+    Each sample width has a scalar kernel, and vectorized kernels for
+    SSE4.1 / AVX2 (x64) and NEON (ARM64). The kernel is selected once when
+    the data format is set.
+    The input direction uses copy kernels with the same signature, specialized
+    for each sample width.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "MixKernels.h"
+
+#if defined(_M_X64)
+#include <immintrin.h>
+#elif defined(_M_ARM64)
+#include <arm64_neon.h>
+#endif
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "MixKernels.tmh"
+#endif
+
+#if !defined(PF_SSE4_1_INSTRUCTIONS_AVAILABLE)
+#define PF_SSE4_1_INSTRUCTIONS_AVAILABLE 37
+#endif
+
+#if !defined(PF_AVX2_INSTRUCTIONS_AVAILABLE)
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE 40
+#endif
+
+//
+// Adds 'samples' contiguous samples from src into dst.
+//
+typedef void (*MIX_SAMPLES)(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+);
+
+//
+// Scalar kernels
+//
+
+NONPAGED_CODE_SEG
+static void MixSamples16Scalar(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    PSHORT       outSample = (PSHORT)dst;
+    const SHORT * wdmSample = (const SHORT *)src;
+
+    for (ULONG i = 0; i < samples; i++)
+    {
+        LONG thisSample = (LONG)outSample[i] + (LONG)wdmSample[i];
+        if (thisSample > 0x7fff)
+        {
+            thisSample = 0x7fff;
+        }
+        else if (thisSample < -0x8000)
+        {
+            thisSample = -0x8000;
+        }
+        outSample[i] = (SHORT)thisSample;
+    }
+}
+
+NONPAGED_CODE_SEG
+static void MixSamples24Scalar(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    for (ULONG i = 0; i < samples; i++)
+    {
+        PUCHAR        outSample = dst + i * 3;
+        const UCHAR * wdmSample = src + i * 3;
+        LONG          thisSample = (LONG)((ULONG)outSample[0] + ((ULONG)outSample[1] << 8)) + ((LONG)((PCHAR)outSample)[2] << 16) + (LONG)((ULONG)wdmSample[0] + ((ULONG)wdmSample[1] << 8)) + ((LONG)((const CHAR *)wdmSample)[2] << 16);
+        if (thisSample > 0x7fffff)
+        {
+            thisSample = 0x7fffff;
+        }
+        else if (thisSample < -0x800000)
+        {
+            thisSample = -0x800000;
+        }
+        outSample[0] = (UCHAR)(thisSample);
+        outSample[1] = (UCHAR)(thisSample >> 8);
+        outSample[2] = (UCHAR)(thisSample >> 16);
+    }
+}
+
+NONPAGED_CODE_SEG
+static void MixSamples32Scalar(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    PLONG        outSample = (PLONG)dst;
+    const LONG * wdmSample = (const LONG *)src;
+
+    for (ULONG i = 0; i < samples; i++)
+    {
+        LONGLONG thisSample = (LONGLONG)outSample[i] + (LONGLONG)wdmSample[i];
+        if (thisSample > 0x7fffffffLL)
+        {
+            thisSample = 0x7fffffffLL;
+        }
+        else if (thisSample < -0x80000000LL)
+        {
+            thisSample = -0x80000000LL;
+        }
+        outSample[i] = (LONG)thisSample;
+    }
+}
+
+NONPAGED_CODE_SEG
+static void MixSamplesFloatScalar(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    float *       outSample = (float *)dst;
+    const float * wdmSample = (const float *)src;
+
+    for (ULONG i = 0; i < samples; i++)
+    {
+        outSample[i] = outSample[i] + wdmSample[i];
+    }
+}
+
+#if defined(_M_X64)
+//
+// SSE4.1 kernels
+//
+
+NONPAGED_CODE_SEG
+static void MixSamples16Sse41(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    ULONG i = 0;
+
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m128i outSamples = _mm_loadu_si128((const __m128i *)(dst + i * 2));
+        __m128i wdmSamples = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_adds_epi16(outSamples, wdmSamples));
+    }
+    MixSamples16Scalar(dst + i * 2, src + i * 2, samples - i);
+}
+
+NONPAGED_CODE_SEG
+static void MixSamples24Sse41(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    // Expands four packed 24-bit samples into the upper three bytes of each 32-bit lane,
+    // so that an arithmetic shift sign-extends them.
+    const __m128i expand = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m128i maxSample = _mm_set1_epi32(0x7fffff);
+    const __m128i minSample = _mm_set1_epi32(-0x800000);
+    ULONG         i = 0;
+
+    // Each iteration reads 16 bytes but consumes 12, so keep two samples in reserve.
+    for (; i + 6 <= samples; i += 4)
+    {
+        __m128i outSamples = _mm_srai_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(dst + i * 3)), expand), 8);
+        __m128i wdmSamples = _mm_srai_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i * 3)), expand), 8);
+        __m128i thisSamples = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(outSamples, wdmSamples), minSample), maxSample);
+        __m128i packed = _mm_shuffle_epi8(thisSamples, pack);
+        _mm_storel_epi64((__m128i *)(dst + i * 3), packed);
+        *(UNALIGNED LONG *)(dst + i * 3 + 8) = _mm_extract_epi32(packed, 2);
+    }
+    MixSamples24Scalar(dst + i * 3, src + i * 3, samples - i);
+}
+
+NONPAGED_CODE_SEG
+static void MixSamples32Sse41(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    const __m128i maxSample = _mm_set1_epi32(0x7fffffff);
+    ULONG         i = 0;
+
+    for (; i + 4 <= samples; i += 4)
+    {
+        __m128i outSamples = _mm_loadu_si128((const __m128i *)(dst + i * 4));
+        __m128i wdmSamples = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        __m128i thisSamples = _mm_add_epi32(outSamples, wdmSamples);
+        // The sum overflowed when its sign differs from the signs of both addends.
+        __m128i overflow = _mm_and_si128(_mm_xor_si128(outSamples, thisSamples), _mm_xor_si128(wdmSamples, thisSamples));
+        __m128i saturated = _mm_xor_si128(_mm_srai_epi32(outSamples, 31), maxSample);
+        thisSamples = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(thisSamples), _mm_castsi128_ps(saturated), _mm_castsi128_ps(overflow)));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), thisSamples);
+    }
+    MixSamples32Scalar(dst + i * 4, src + i * 4, samples - i);
+}
+
+NONPAGED_CODE_SEG
+static void MixSamplesFloatSse41(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    ULONG i = 0;
+
+    for (; i + 4 <= samples; i += 4)
+    {
+        __m128 outSamples = _mm_loadu_ps((const float *)(dst + i * 4));
+        __m128 wdmSamples = _mm_loadu_ps((const float *)(src + i * 4));
+        _mm_storeu_ps((float *)(dst + i * 4), _mm_add_ps(outSamples, wdmSamples));
+    }
+    MixSamplesFloatScalar(dst + i * 4, src + i * 4, samples - i);
+}
+
+//
+// AVX2 kernels
+// The caller must save the extended processor state before calling these (see MixKernels::Begin).
+// 24-bit samples use the SSE4.1 kernel because the packed layout does not map onto 256-bit lanes.
+//
+
+NONPAGED_CODE_SEG
+static void MixSamples16Avx2(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    ULONG i = 0;
+
+    for (; i + 16 <= samples; i += 16)
+    {
+        __m256i outSamples = _mm256_loadu_si256((const __m256i *)(dst + i * 2));
+        __m256i wdmSamples = _mm256_loadu_si256((const __m256i *)(src + i * 2));
+        _mm256_storeu_si256((__m256i *)(dst + i * 2), _mm256_adds_epi16(outSamples, wdmSamples));
+    }
+    _mm256_zeroupper();
+    MixSamples16Sse41(dst + i * 2, src + i * 2, samples - i);
+}
+
+NONPAGED_CODE_SEG
+static void MixSamples32Avx2(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    const __m256i maxSample = _mm256_set1_epi32(0x7fffffff);
+    ULONG         i = 0;
+
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m256i outSamples = _mm256_loadu_si256((const __m256i *)(dst + i * 4));
+        __m256i wdmSamples = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+        __m256i thisSamples = _mm256_add_epi32(outSamples, wdmSamples);
+        __m256i overflow = _mm256_and_si256(_mm256_xor_si256(outSamples, thisSamples), _mm256_xor_si256(wdmSamples, thisSamples));
+        __m256i saturated = _mm256_xor_si256(_mm256_srai_epi32(outSamples, 31), maxSample);
+        thisSamples = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(thisSamples), _mm256_castsi256_ps(saturated), _mm256_castsi256_ps(overflow)));
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), thisSamples);
+    }
+    _mm256_zeroupper();
+    MixSamples32Sse41(dst + i * 4, src + i * 4, samples - i);
+}
+
+NONPAGED_CODE_SEG
+static void MixSamplesFloatAvx2(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    ULONG i = 0;
+
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m256 outSamples = _mm256_loadu_ps((const float *)(dst + i * 4));
+        __m256 wdmSamples = _mm256_loadu_ps((const float *)(src + i * 4));
+        _mm256_storeu_ps((float *)(dst + i * 4), _mm256_add_ps(outSamples, wdmSamples));
+    }
+    _mm256_zeroupper();
+    MixSamplesFloatSse41(dst + i * 4, src + i * 4, samples - i);
+}
+#endif
+
+#if defined(_M_ARM64)
+//
+// NEON kernels
+//
+
+NONPAGED_CODE_SEG
+static void MixSamples16Neon(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    ULONG i = 0;
+
+    for (; i + 8 <= samples; i += 8)
+    {
+        int16x8_t outSamples = vld1q_s16((const int16_t *)(dst + i * 2));
+        int16x8_t wdmSamples = vld1q_s16((const int16_t *)(src + i * 2));
+        vst1q_s16((int16_t *)(dst + i * 2), vqaddq_s16(outSamples, wdmSamples));
+    }
+    MixSamples16Scalar(dst + i * 2, src + i * 2, samples - i);
+}
+
+NONPAGED_CODE_SEG
+static void MixSamples32Neon(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    ULONG i = 0;
+
+    for (; i + 4 <= samples; i += 4)
+    {
+        int32x4_t outSamples = vld1q_s32((const int32_t *)(dst + i * 4));
+        int32x4_t wdmSamples = vld1q_s32((const int32_t *)(src + i * 4));
+        vst1q_s32((int32_t *)(dst + i * 4), vqaddq_s32(outSamples, wdmSamples));
+    }
+    MixSamples32Scalar(dst + i * 4, src + i * 4, samples - i);
+}
+
+NONPAGED_CODE_SEG
+static void MixSamplesFloatNeon(
+    _Inout_ PUCHAR     dst,
+    _In_ const UCHAR * src,
+    _In_ ULONG         samples
+)
+{
+    ULONG i = 0;
+
+    for (; i + 4 <= samples; i += 4)
+    {
+        float32x4_t outSamples = vld1q_f32((const float *)(dst + i * 4));
+        float32x4_t wdmSamples = vld1q_f32((const float *)(src + i * 4));
+        vst1q_f32((float *)(dst + i * 4), vaddq_f32(outSamples, wdmSamples));
+    }
+    MixSamplesFloatScalar(dst + i * 4, src + i * 4, samples - i);
+}
+#endif
+
+//
+// Frame adapter
+// When both buffers hold exactly 'channels' samples per frame the whole run is contiguous
+// and is mixed in one call, otherwise each frame is mixed separately.
+//
+
+template <MIX_SAMPLES mixSamples, ULONG bytesPerSample>
+NONPAGED_CODE_SEG
+static void MixFrames(
+    _Inout_ PUCHAR     dst,
+    _In_ ULONG         dstFrameBytes,
+    _In_ const UCHAR * src,
+    _In_ ULONG         srcFrameBytes,
+    _In_ ULONG         channels,
+    _In_ ULONG         frames
+)
+{
+    ULONG runBytes = channels * bytesPerSample;
+
+    if ((dstFrameBytes == runBytes) && (srcFrameBytes == runBytes))
+    {
+        mixSamples(dst, src, channels * frames);
+    }
+    else
+    {
+        for (ULONG frame = 0; frame < frames; frame++)
+        {
+            mixSamples(dst, src, channels);
+            dst += dstFrameBytes;
+            src += srcFrameBytes;
+        }
+    }
+}
+
+//
+// Copy kernel
+// Used for the input direction, where the samples are copied instead of mixed.
+// There is one instance per sample width, so that SelectCopy() returns a kernel with
+// the MIX_KERNEL signature. The length of each copy still depends on the channel count.
+//
+
+template <ULONG bytesPerSample>
+NONPAGED_CODE_SEG
+static void CopyFrames(
+    _Inout_ PUCHAR     dst,
+    _In_ ULONG         dstFrameBytes,
+    _In_ const UCHAR * src,
+    _In_ ULONG         srcFrameBytes,
+    _In_ ULONG         channels,
+    _In_ ULONG         frames
+)
+{
+    ULONG runBytes = channels * bytesPerSample;
+
+    if ((dstFrameBytes == runBytes) && (srcFrameBytes == runBytes))
+    {
+        RtlCopyMemory(dst, src, runBytes * frames);
+    }
+    else
+    {
+        for (ULONG frame = 0; frame < frames; frame++)
+        {
+            RtlCopyMemory(dst, src, runBytes);
+            dst += dstFrameBytes;
+            src += srcFrameBytes;
+        }
+    }
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+MixKernels::Select(
+    bool              isFloat,
+    ULONG             bytesPerSample,
+    MIX_KERNEL_INFO & kernelInfo
+)
+{
+    PAGED_CODE();
+
+    kernelInfo = MIX_KERNEL_INFO{};
+
+    if (isFloat)
+    {
+        RETURN_NTSTATUS_IF_TRUE(bytesPerSample != sizeof(float), STATUS_NOT_SUPPORTED);
+        kernelInfo.Kernel = MixFrames<MixSamplesFloatScalar, 4>;
+    }
+    else
+    {
+        switch (bytesPerSample)
+        {
+        case 2:
+            kernelInfo.Kernel = MixFrames<MixSamples16Scalar, 2>;
+            break;
+        case 3:
+            kernelInfo.Kernel = MixFrames<MixSamples24Scalar, 3>;
+            break;
+        case 4:
+            kernelInfo.Kernel = MixFrames<MixSamples32Scalar, 4>;
+            break;
+        default:
+            return STATUS_NOT_SUPPORTED;
+        }
+    }
+    kernelInfo.FallbackKernel = kernelInfo.Kernel;
+    kernelInfo.Type = MixKernelType::Scalar;
+
+#if defined(_M_X64)
+    if (ExIsProcessorFeaturePresent(PF_SSE4_1_INSTRUCTIONS_AVAILABLE))
+    {
+        if (isFloat)
+        {
+            kernelInfo.Kernel = MixFrames<MixSamplesFloatSse41, 4>;
+        }
+        else if (bytesPerSample == 2)
+        {
+            kernelInfo.Kernel = MixFrames<MixSamples16Sse41, 2>;
+        }
+        else if (bytesPerSample == 3)
+        {
+            kernelInfo.Kernel = MixFrames<MixSamples24Sse41, 3>;
+        }
+        else
+        {
+            kernelInfo.Kernel = MixFrames<MixSamples32Sse41, 4>;
+        }
+        kernelInfo.FallbackKernel = kernelInfo.Kernel;
+        kernelInfo.Type = MixKernelType::Sse41;
+
+        if (ExIsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE) && (bytesPerSample != 3))
+        {
+            if (isFloat)
+            {
+                kernelInfo.Kernel = MixFrames<MixSamplesFloatAvx2, 4>;
+            }
+            else if (bytesPerSample == 2)
+            {
+                kernelInfo.Kernel = MixFrames<MixSamples16Avx2, 2>;
+            }
+            else
+            {
+                kernelInfo.Kernel = MixFrames<MixSamples32Avx2, 4>;
+            }
+            kernelInfo.Type = MixKernelType::Avx2;
+            kernelInfo.RequiresExtendedState = true;
+        }
+    }
+#elif defined(_M_ARM64)
+    if (isFloat)
+    {
+        kernelInfo.Kernel = MixFrames<MixSamplesFloatNeon, 4>;
+        kernelInfo.Type = MixKernelType::Neon;
+    }
+    else if (bytesPerSample == 2)
+    {
+        kernelInfo.Kernel = MixFrames<MixSamples16Neon, 2>;
+        kernelInfo.Type = MixKernelType::Neon;
+    }
+    else if (bytesPerSample == 4)
+    {
+        kernelInfo.Kernel = MixFrames<MixSamples32Neon, 4>;
+        kernelInfo.Type = MixKernelType::Neon;
+    }
+    kernelInfo.FallbackKernel = kernelInfo.Kernel;
+#endif
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - mix kernel, isFloat %!bool!, bytesPerSample %u, type %u", isFloat, bytesPerSample, static_cast<ULONG>(kernelInfo.Type));
+
+    return STATUS_SUCCESS;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+MixKernels::SelectCopy(
+    ULONG             bytesPerSample,
+    MIX_KERNEL_INFO & kernelInfo
+)
+{
+    PAGED_CODE();
+
+    kernelInfo = MIX_KERNEL_INFO{};
+
+    switch (bytesPerSample)
+    {
+    case 1:
+        kernelInfo.Kernel = CopyFrames<1>;
+        break;
+    case 2:
+        kernelInfo.Kernel = CopyFrames<2>;
+        break;
+    case 3:
+        kernelInfo.Kernel = CopyFrames<3>;
+        break;
+    case 4:
+        kernelInfo.Kernel = CopyFrames<4>;
+        break;
+    default:
+        return STATUS_NOT_SUPPORTED;
+    }
+    kernelInfo.FallbackKernel = kernelInfo.Kernel;
+    kernelInfo.Type = MixKernelType::Scalar;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " - copy kernel, bytesPerSample %u", bytesPerSample);
+
+    return STATUS_SUCCESS;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+MIX_KERNEL
+MixKernels::Begin(
+    const MIX_KERNEL_INFO & kernelInfo,
+    MIX_KERNEL_STATE &      kernelState
+)
+{
+    kernelState.Kernel = kernelInfo.Kernel;
+
+#if defined(_M_X64)
+    kernelState.ExtendedStateSaved = false;
+    if (kernelInfo.RequiresExtendedState)
+    {
+        if (NT_SUCCESS(KeSaveExtendedProcessorState(XSTATE_MASK_AVX, &kernelState.XStateSave)))
+        {
+            kernelState.ExtendedStateSaved = true;
+        }
+        else
+        {
+            kernelState.Kernel = kernelInfo.FallbackKernel;
+        }
+    }
+#endif
+
+    return kernelState.Kernel;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void MixKernels::End(
+    MIX_KERNEL_STATE & kernelState
+)
+{
+#if defined(_M_X64)
+    if (kernelState.ExtendedStateSaved)
+    {
+        KeRestoreExtendedProcessorState(&kernelState.XStateSave);
+        kernelState.ExtendedStateSaved = false;
+    }
+#endif
+    kernelState.Kernel = nullptr;
+}
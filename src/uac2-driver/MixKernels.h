@@ -0,0 +1,104 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    MixKernels.h
+
+Abstract:
+
+    Define the saturating mix kernels used to add Acx Audio samples into
+    the USB isochronous buffer.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _MIXKERNELS_H_
+#define _MIXKERNELS_H_
+
+//
+// Adds 'frames' frames of 'channels' contiguous samples from src into dst,
+// saturating to the range of the sample type.
+// dstFrameBytes and srcFrameBytes are the strides between frames.
+//
+typedef void (*MIX_KERNEL)(
+    _Inout_ PUCHAR     dst,
+    _In_ ULONG         dstFrameBytes,
+    _In_ const UCHAR * src,
+    _In_ ULONG         srcFrameBytes,
+    _In_ ULONG         channels,
+    _In_ ULONG         frames
+);
+
+enum class MixKernelType
+{
+    None = 0,
+    Scalar,
+    Sse41,
+    Avx2,
+    Neon,
+    Sse2
+};
+
+typedef struct _MIX_KERNEL_INFO
+{
+    MIX_KERNEL    Kernel{nullptr};
+    MIX_KERNEL    FallbackKernel{nullptr}; // Used when the extended processor state cannot be saved.
+    MixKernelType Type{MixKernelType::None};
+    bool          RequiresExtendedState{false}; // The kernel uses the upper half of the YMM registers.
+} MIX_KERNEL_INFO;
+
+typedef struct _MIX_KERNEL_STATE
+{
+    MIX_KERNEL Kernel{nullptr};
+#if defined(_M_X64)
+    XSTATE_SAVE XStateSave;
+    bool        ExtendedStateSaved{false};
+#endif
+} MIX_KERNEL_STATE;
+
+class MixKernels
+{
+  public:
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS
+    Select(
+        _In_ bool               isFloat,
+        _In_ ULONG              bytesPerSample,
+        _Out_ MIX_KERNEL_INFO & kernelInfo
+    );
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS
+    SelectCopy(
+        _In_ ULONG              bytesPerSample,
+        _Out_ MIX_KERNEL_INFO & kernelInfo
+    );
+
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    MIX_KERNEL
+    Begin(
+        _In_ const MIX_KERNEL_INFO & kernelInfo,
+        _Out_ MIX_KERNEL_STATE &     kernelState
+    );
+
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void End(
+        _Inout_ MIX_KERNEL_STATE & kernelState
+    );
+};
+
+#endif
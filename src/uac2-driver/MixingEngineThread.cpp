@@ -81,7 +81,7 @@ MixingEngineThread::~MixingEngineThread()
 _Use_decl_annotations_
 PAGED_CODE_SEG
 NTSTATUS
-MixingEngineThread::CreateThread(MIXING_ENGINE_THREAD_FUNCTION mixingEngineThreadFunction, KPRIORITY priority, LONG wakeUpIntervalUs)
+MixingEngineThread::CreateThread(MIXING_ENGINE_THREAD_FUNCTION mixingEngineThreadFunction, KPRIORITY priority, LONG wakeUpIntervalUs, WakeUpMode wakeUpMode)
 {
     NTSTATUS status = STATUS_SUCCESS;
     HANDLE   thread = nullptr;
@@ -92,6 +92,7 @@ MixingEngineThread::CreateThread(MIXING_ENGINE_THREAD_FUNCTION mixingEngineThrea
 
     m_mixingEngineThreadFunction = mixingEngineThreadFunction;
     m_wakeUpIntervalUs = wakeUpIntervalUs;
+    m_wakeUpMode = wakeUpMode;
 
     status = PsCreateSystemThread(&thread, THREAD_ALL_ACCESS, nullptr, nullptr, nullptr, ThreadRoutine, this);
     IF_FAILED_JUMP(status, CreateThread_Exit);
@@ -147,6 +148,35 @@ void MixingEngineThread::WakeUp()
     KeSetEvent(&(m_threadWakeUpEvent), IO_SOUND_INCREMENT, FALSE);
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void MixingEngineThread::SetWakeUpDeadline(
+    ULONG dueTimeUs
+)
+/*++
+
+Routine Description:
+
+    Re-arms the one-shot timer of WakeUpMode::Deadline. Only the thread
+    itself calls this, between two waits.
+
+--*/
+{
+    EXT_SET_PARAMETERS setParameters;
+
+    PAGED_CODE();
+
+    if ((m_wakeUpMode != WakeUpMode::Deadline) || (m_exTimer == nullptr))
+    {
+        return;
+    }
+
+    ExInitializeSetTimerParameters(&setParameters);
+    setParameters.NoWakeTolerance = 10LL * 10LL;
+
+    ExSetTimer(m_exTimer, 0LL - (LONGLONG)dueTimeUs * 10LL, 0LL, &setParameters);
+}
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 void MixingEngineThread::ThreadRoutine(
@@ -185,7 +215,9 @@ void MixingEngineThread::ThreadMain()
         }
     });
 
-    if (m_newTimerResolution < defaultTimerResolution)
+    // A high resolution timer raises the clock rate only while it is pending, so the
+    // resolution is left to the system unless the timer is periodic.
+    if ((m_wakeUpMode == WakeUpMode::Periodic) && (m_newTimerResolution < defaultTimerResolution))
     {
         m_currentTimerResolution = m_newTimerResolution;
         ExSetTimerResolution(m_currentTimerResolution, TRUE);
@@ -196,9 +228,14 @@ void MixingEngineThread::ThreadMain()
         m_currentTimerResolution = defaultTimerResolution;
     }
 
-    PEX_TIMER exTimer = ExAllocateTimer(nullptr, nullptr, EX_TIMER_HIGH_RESOLUTION);
+    PEX_TIMER exTimer = nullptr;
+    if (m_wakeUpMode != WakeUpMode::Event)
+    {
+        exTimer = ExAllocateTimer(nullptr, nullptr, EX_TIMER_HIGH_RESOLUTION);
+    }
+    m_exTimer = exTimer;
     m_waitEvents[toInt(WaitEventsNumber::TimerEvent)] = exTimer;
-    m_waitEnvetsCount = toInt(WaitEventsNumber::NumOfWaitEventsWithoutOutputReady);
+    m_waitEnvetsCount = (exTimer != nullptr) ? toInt(WaitEventsNumber::NumOfWaitEventsWithoutOutputReady) : toInt(WaitEventsNumber::NumOfWaitEventsWithoutTimer);
 
 #if 0
 	if ((deviceExtension->AsioBufferObject != nullptr) && (deviceExtension->AsioBufferObject->OutputReadyEvent != nullptr))
@@ -226,19 +263,27 @@ void MixingEngineThread::ThreadMain()
     ExInitializeSetTimerParameters(&setParameters);
     setParameters.NoWakeTolerance = 10LL * 10LL;
 
-    ExSetTimer(exTimer, duetime.QuadPart, 100LL * 10LL, &setParameters);
+    if (exTimer != nullptr)
+    {
+        // The first wakeup of WakeUpMode::Deadline is the same as the periodic timer, later ones are armed by the thread function.
+        ExSetTimer(exTimer, duetime.QuadPart, (m_wakeUpMode == WakeUpMode::Periodic) ? 100LL * 10LL : 0LL, &setParameters);
+    }
 
     // ======================================================================
     ASSERT(m_mixingEngineThreadFunction != nullptr);
     m_mixingEngineThreadFunction(m_deviceContext);
 
-    EXT_DELETE_PARAMETERS deleteParameters;
+    if (exTimer != nullptr)
+    {
+        EXT_DELETE_PARAMETERS deleteParameters;
 
-    ExInitializeDeleteTimerParameters(&deleteParameters);
-    deleteParameters.DeleteCallback = nullptr;
-    deleteParameters.DeleteContext = nullptr;
+        ExInitializeDeleteTimerParameters(&deleteParameters);
+        deleteParameters.DeleteCallback = nullptr;
+        deleteParameters.DeleteContext = nullptr;
 
-    ExDeleteTimer(exTimer, FALSE, FALSE, &deleteParameters);
+        m_exTimer = nullptr;
+        ExDeleteTimer(exTimer, FALSE, FALSE, &deleteParameters);
+    }
 
 ThreadMain_Exit:
 
@@ -36,6 +36,7 @@ enum class WaitEventsNumber
     OutputReadyEvent,
     NumOfWaitEvents = 4,
     NumOfWaitEventsWithoutOutputReady = 3,
+    NumOfWaitEventsWithoutTimer = 2,
     NumOfStartEvents = 2,
     NumOfThreadEvents = 2
 };
@@ -45,6 +46,13 @@ constexpr int toInt(WaitEventsNumber eventsNumber)
     return static_cast<int>(eventsNumber);
 }
 
+enum class WakeUpMode
+{
+    Periodic = 0, // A periodic timer with the system timer resolution raised while the thread runs.
+    Deadline,     // A one-shot timer armed by SetWakeUpDeadline() after every wakeup.
+    Event         // No timer, the thread is only woken up by WakeUp().
+};
+
 class MixingEngineThread
 {
   public:
@@ -65,7 +73,8 @@ class MixingEngineThread
     CreateThread(
         _In_ MIXING_ENGINE_THREAD_FUNCTION mixingEngineThreadFunction,
         _In_ KPRIORITY                     priority,
-        _In_ LONG                          wakeUpIntervalUs
+        _In_ LONG                          wakeUpIntervalUs,
+        _In_ WakeUpMode                    wakeUpMode
     );
 
     __drv_maxIRQL(PASSIVE_LEVEL)
@@ -76,6 +85,12 @@ class MixingEngineThread
     NONPAGED_CODE_SEG
     void WakeUp();
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void SetWakeUpDeadline(
+        _In_ ULONG dueTimeUs
+    );
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     void ClearWakeUpCount();
@@ -127,6 +142,8 @@ class MixingEngineThread
     KEVENT                m_threadWakeUpEvent{0};
     PKTHREAD              m_thread{nullptr};
     LONG                  m_wakeUpIntervalUs{0};
+    WakeUpMode            m_wakeUpMode{WakeUpMode::Periodic};
+    PEX_TIMER             m_exTimer{nullptr};
 
     PVOID m_startEvents[toInt(WaitEventsNumber::NumOfStartEvents)] = {
         (PVOID)&m_threadKillEvent,
@@ -0,0 +1,198 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    OffsetTuner.cpp
+
+Abstract:
+
+    Implement a class that adjusts the input and output buffer operation
+    offsets from the latencies measured by the mixing engine thread.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "Driver.h"
+#include "Device.h"
+#include "Public.h"
+#include "Common.h"
+#include "OffsetTuner.h"
+
+#ifndef __INTELLISENSE__
+#include "OffsetTuner.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+OffsetTuner *
+OffsetTuner::Create()
+{
+    PAGED_CODE();
+
+    return new (POOL_FLAG_NON_PAGED, DRIVER_TAG) OffsetTuner();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+OffsetTuner::OffsetTuner()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+OffsetTuner::~OffsetTuner()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void OffsetTuner::Start(
+    ULONG framesPerMs,
+    ULONG inputOffsetFrame,
+    ULONG outputOffsetFrame,
+    ULONG minOutputOffsetFrame,
+    ULONG maxOffsetFrame
+)
+/*++
+
+Routine Description:
+
+    Begins the measurements of a stream that runs with the given offsets.
+    The healthy-window count, and with it a hold after a growth, is kept
+    from the previous streams.
+
+--*/
+{
+    PAGED_CODE();
+
+    m_framesPerMs = max(framesPerMs, 1UL);
+    m_maxOffsetFrame = maxOffsetFrame;
+    m_minOutputOffsetFrame = min(minOutputOffsetFrame, maxOffsetFrame);
+    m_inputOffsetFrame = min(inputOffsetFrame, maxOffsetFrame);
+    m_outputOffsetFrame = min(max(outputOffsetFrame, m_minOutputOffsetFrame), maxOffsetFrame);
+    m_windowStartUs = 0ULL;
+    m_maxDpcToThreadUs = 0;
+    m_dpcDropout = false;
+    m_safetyMarginValid = false;
+    m_minSafetyMargin = 0;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool OffsetTuner::Update(
+    ULONGLONG currentTimeUs,
+    LONG      dpcToThreadUs,
+    bool      dpcDropout,
+    bool      safetyMarginValid,
+    LONG      safetyMargin
+)
+/*++
+
+Routine Description:
+
+    Records the measurements of one wakeup and re-evaluates the offsets at
+    the end of a window.
+
+Return Value:
+
+    true if an offset has changed.
+
+--*/
+{
+    PAGED_CODE();
+
+    if (m_windowStartUs == 0ULL)
+    {
+        m_windowStartUs = currentTimeUs;
+    }
+
+    m_maxDpcToThreadUs = max(m_maxDpcToThreadUs, dpcToThreadUs);
+    m_dpcDropout = m_dpcDropout || dpcDropout;
+    if (safetyMarginValid)
+    {
+        m_minSafetyMargin = m_safetyMarginValid ? min(m_minSafetyMargin, safetyMargin) : safetyMargin;
+        m_safetyMarginValid = true;
+    }
+
+    if ((currentTimeUs - m_windowStartUs) < c_windowUs)
+    {
+        return false;
+    }
+
+    const ULONG inputOffsetFrame = m_inputOffsetFrame;
+    const ULONG outputOffsetFrame = m_outputOffsetFrame;
+
+    // Packets the thread may run behind the completion, rounded up.
+    LONG  requiredInputPackets = (LONG)(((ULONGLONG)max(m_maxDpcToThreadUs, 0L) * m_framesPerMs + 999ULL) / 1000ULL);
+    bool  inputNearMiss = m_dpcDropout || (requiredInputPackets >= (LONG)m_inputOffsetFrame);
+    bool  outputNearMiss = m_safetyMarginValid && (m_minSafetyMargin <= c_nearMissPackets);
+    ULONG growFrames = m_framesPerMs;
+
+    if (inputNearMiss)
+    {
+        m_inputOffsetFrame = min(max(m_inputOffsetFrame + growFrames, (ULONG)requiredInputPackets + c_headroomPackets), m_maxOffsetFrame);
+    }
+    if (outputNearMiss)
+    {
+        m_outputOffsetFrame = min(m_outputOffsetFrame + growFrames, m_maxOffsetFrame);
+    }
+
+    if (inputNearMiss || outputNearMiss)
+    {
+        m_healthyWindows = -c_holdWindows;
+    }
+    else if (++m_healthyWindows >= c_healthyWindows)
+    {
+        m_healthyWindows = 0;
+        if ((LONG)m_inputOffsetFrame > requiredInputPackets + c_headroomPackets)
+        {
+            --m_inputOffsetFrame;
+        }
+        if (m_safetyMarginValid && (m_minSafetyMargin > c_headroomPackets) && (m_outputOffsetFrame > m_minOutputOffsetFrame))
+        {
+            --m_outputOffsetFrame;
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - offset tuner: max dpc to thread %dus, dpc dropout %!bool!, min safety margin %d, in offset %u -> %u, out offset %u -> %u", m_maxDpcToThreadUs, m_dpcDropout, m_safetyMarginValid ? m_minSafetyMargin : 0, inputOffsetFrame, m_inputOffsetFrame, outputOffsetFrame, m_outputOffsetFrame);
+
+    m_windowStartUs = currentTimeUs;
+    m_maxDpcToThreadUs = 0;
+    m_dpcDropout = false;
+    m_safetyMarginValid = false;
+    m_minSafetyMargin = 0;
+
+    return (m_inputOffsetFrame != inputOffsetFrame) || (m_outputOffsetFrame != outputOffsetFrame);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG
+OffsetTuner::GetInputOffsetFrame()
+{
+    PAGED_CODE();
+
+    return m_inputOffsetFrame;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG
+OffsetTuner::GetOutputOffsetFrame()
+{
+    PAGED_CODE();
+
+    return m_outputOffsetFrame;
+}
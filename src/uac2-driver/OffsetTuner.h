@@ -0,0 +1,109 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    OffsetTuner.h
+
+Abstract:
+
+    Define a class that adjusts the input and output buffer operation offsets
+    from the latencies measured by the mixing engine thread.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _OFFSETTUNER_H_
+#define _OFFSETTUNER_H_
+
+//
+// The measurements of each wakeup are collected over a window of c_windowUs.
+// At the end of a window:
+// - The input offset grows by one millisecond if the longest DPC-to-thread
+//   latency did not fit in it, or a dropout was detected after the DPC.
+// - The output offset grows by one millisecond if the smallest safety margin
+//   was c_nearMissPackets or less.
+// - After c_healthyWindows windows in a row without growth, each offset
+//   shrinks by one packet, as long as it keeps the headroom above the
+//   measured values.
+// A growth holds any shrink for c_holdWindows windows so that the offsets do
+// not oscillate. The offsets stay within the bounds passed to Start.
+// The tuner belongs to the device context, so that the hold carries over
+// the stream restarts that apply the offsets it has chosen.
+//
+class OffsetTuner
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    OffsetTuner();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual ~OffsetTuner();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Start(
+        _In_ ULONG framesPerMs,
+        _In_ ULONG inputOffsetFrame,
+        _In_ ULONG outputOffsetFrame,
+        _In_ ULONG minOutputOffsetFrame,
+        _In_ ULONG maxOffsetFrame
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool
+    Update(
+        _In_ ULONGLONG currentTimeUs,
+        _In_ LONG      dpcToThreadUs,
+        _In_ bool      dpcDropout,
+        _In_ bool      safetyMarginValid,
+        _In_ LONG      safetyMargin
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG
+    GetInputOffsetFrame();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG
+    GetOutputOffsetFrame();
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    OffsetTuner * Create();
+
+  protected:
+    static const ULONG c_windowUs = 1000 * 1000;
+    static const LONG  c_healthyWindows = 30;
+    static const LONG  c_holdWindows = 60;
+    static const LONG  c_nearMissPackets = 1;
+    static const LONG  c_headroomPackets = 2;
+
+    ULONG     m_framesPerMs{1};
+    ULONG     m_inputOffsetFrame{0};
+    ULONG     m_outputOffsetFrame{0};
+    ULONG     m_minOutputOffsetFrame{0};
+    ULONG     m_maxOffsetFrame{0};
+    ULONGLONG m_windowStartUs{0ULL};
+    LONG      m_maxDpcToThreadUs{0};
+    bool      m_dpcDropout{false};
+    bool      m_safetyMarginValid{false};
+    LONG      m_minSafetyMargin{0};
+    LONG      m_healthyWindows{0};
+};
+
+#endif
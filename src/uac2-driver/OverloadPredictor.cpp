@@ -0,0 +1,150 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    OverloadPredictor.cpp
+
+Abstract:
+
+    Implement a class that predicts an overload from the trend of the client
+    processing time and the DPC lateness.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "OverloadPredictor.h"
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "OverloadPredictor.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+OverloadPredictor *
+OverloadPredictor::Create()
+{
+    PAGED_CODE();
+
+    return new (POOL_FLAG_NON_PAGED, DRIVER_TAG) OverloadPredictor();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+OverloadPredictor::OverloadPredictor()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+OverloadPredictor::~OverloadPredictor()
+{
+    PAGED_CODE();
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool OverloadPredictor::Update(
+    UACOverloadSignal signal,
+    LONG              valueUs,
+    LONG              budgetUs
+)
+/*++
+
+Routine Description:
+
+    Adds a sample of the signal and re-evaluates the prediction.
+
+Return Value:
+
+    true if the prediction has just crossed into the warning band.
+
+--*/
+{
+    PAGED_CODE();
+
+    ASSERT(toULong(signal) < toULong(UACOverloadSignal::Count));
+
+    SIGNAL_STATE & state = m_state[toULong(signal)];
+    LONGLONG       valueQ8 = (LONGLONG)max(valueUs, 0L) << c_fractionBits;
+
+    if (state.Samples == 0)
+    {
+        state.AverageQ8 = valueQ8;
+        state.DeviationQ8 = 0;
+        state.TailQ8 = valueQ8;
+    }
+    else
+    {
+        state.AverageQ8 += (valueQ8 - state.AverageQ8) >> c_ewmaShift;
+        LONGLONG deviationQ8 = (valueQ8 > state.AverageQ8) ? (valueQ8 - state.AverageQ8) : (state.AverageQ8 - valueQ8);
+        state.DeviationQ8 += (deviationQ8 - state.DeviationQ8) >> c_ewmaShift;
+
+        LONGLONG stepQ8 = max(state.DeviationQ8, 1LL << c_fractionBits);
+        if (valueQ8 > state.TailQ8)
+        {
+            state.TailQ8 += stepQ8;
+        }
+        else
+        {
+            state.TailQ8 = max(state.TailQ8 - stepQ8 / c_tailRatio, 0LL);
+        }
+    }
+    state.BudgetUs = budgetUs;
+    ++state.Samples;
+
+    LONGLONG predictedQ8 = max(state.TailQ8, state.AverageQ8 + state.DeviationQ8 * c_deviationFactor);
+    LONGLONG budgetQ8 = (LONGLONG)max(budgetUs, 0L) << c_fractionBits;
+
+    if (state.Warning)
+    {
+        if (predictedQ8 * 100 < budgetQ8 * c_clearPercent)
+        {
+            state.Warning = false;
+        }
+        return false;
+    }
+
+    if ((state.Samples >= c_minSamples) && (predictedQ8 * 100 > budgetQ8 * c_warnPercent))
+    {
+        state.Warning = true;
+        ++state.Warnings;
+        TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "overload predicted. signal %u, average %lldus, deviation %lldus, tail %lldus, budget %dus", toULong(signal), state.AverageQ8 >> c_fractionBits, state.DeviationQ8 >> c_fractionBits, state.TailQ8 >> c_fractionBits, budgetUs);
+        return true;
+    }
+
+    return false;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void OverloadPredictor::GetStatistics(
+    UAC_STATISTICS & statistics
+) const
+{
+    PAGED_CODE();
+
+    for (ULONG signal = 0; signal < toULong(UACOverloadSignal::Count); ++signal)
+    {
+        const SIGNAL_STATE & state = m_state[signal];
+
+        statistics.Prediction[signal].Samples = ReadULong64NoFence(&state.Samples);
+        statistics.Prediction[signal].Warnings = ReadULong64NoFence(&state.Warnings);
+        statistics.Prediction[signal].AverageUs = (LONG)(ReadNoFence64(&state.AverageQ8) >> c_fractionBits);
+        statistics.Prediction[signal].DeviationUs = (LONG)(ReadNoFence64(&state.DeviationQ8) >> c_fractionBits);
+        statistics.Prediction[signal].TailUs = (LONG)(ReadNoFence64(&state.TailQ8) >> c_fractionBits);
+        statistics.Prediction[signal].BudgetUs = ReadNoFence(&state.BudgetUs);
+        statistics.Prediction[signal].Warning = state.Warning ? 1 : 0;
+    }
+}
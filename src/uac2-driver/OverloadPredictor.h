@@ -0,0 +1,92 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    OverloadPredictor.h
+
+Abstract:
+
+    Define a class that predicts an overload from the trend of the client
+    processing time and the DPC lateness.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _OVERLOAD_PREDICTOR_H_
+#define _OVERLOAD_PREDICTOR_H_
+
+#include "UAC_User.h"
+
+//
+// For each signal, an exponentially weighted average and mean absolute
+// deviation, and a streaming estimate of the 98th percentile are updated with
+// every sample. The percentile estimate moves up by one deviation when a
+// sample is above it, and down by 1/c_tailRatio of it otherwise, so it settles
+// where 1 / (c_tailRatio + 1) of the samples are above it.
+// Update() is called only from the mixing engine thread. GetStatistics() may
+// run concurrently, like LatencyStatistics::GetStatistics(). The
+// implementation only reaches the platform through StreamPlatform.h.
+//
+class OverloadPredictor
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    OverloadPredictor();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual ~OverloadPredictor();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool Update(
+        _In_ UACOverloadSignal signal,
+        _In_ LONG              valueUs,
+        _In_ LONG              budgetUs
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void GetStatistics(
+        _Inout_ UAC_STATISTICS & statistics
+    ) const;
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    OverloadPredictor * Create();
+
+  private:
+    static const ULONG     c_fractionBits = 8;
+    static const ULONG     c_ewmaShift = 3; // Weight of a new sample is 1/8.
+    static const LONGLONG  c_tailRatio = 49;
+    static const LONGLONG  c_deviationFactor = 3;
+    static const ULONGLONG c_minSamples = 32;
+    static const LONG      c_warnPercent = 85;
+    static const LONG      c_clearPercent = 70;
+
+    typedef struct SIGNAL_STATE_
+    {
+        LONGLONG  AverageQ8;
+        LONGLONG  DeviationQ8;
+        LONGLONG  TailQ8;
+        ULONGLONG Samples;
+        ULONGLONG Warnings;
+        LONG      BudgetUs;
+        bool      Warning;
+    } SIGNAL_STATE;
+
+    SIGNAL_STATE m_state[toULong(UACOverloadSignal::Count)]{};
+};
+
+#endif
@@ -0,0 +1,275 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    PacketScheduler.cpp
+
+Abstract:
+
+    Implement a class that decides which isochronous packets the mixing engine
+    thread processes on each wake-up.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "PacketScheduler.h"
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "PacketScheduler.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG
+PacketScheduler::EstimateUsbBusTime(
+    bool   isFirstWakeUp,
+    ULONG  usbBusTimeCurrent,
+    ULONG  wakeupDiffPCUs,
+    ULONG  classicFramesPerIrp,
+    bool & isIllegalBusTime
+)
+{
+    ULONG usbBusTimeDiff = 0;
+
+    PAGED_CODE();
+
+    isIllegalBusTime = false;
+
+    if (isFirstWakeUp)
+    {
+        // First loop
+        usbBusTimeDiff = 0;
+        m_usbBusTimeEstimated = 0;
+        m_usbBusTimePrev = usbBusTimeCurrent;
+    }
+    else if (m_usbBusTimeEstimated != 0)
+    {
+        // If an estimated value was used last time, measure the difference between the estimated value and the current value.
+        if ((usbBusTimeCurrent < m_usbBusTimeEstimated) || ((usbBusTimeCurrent - m_usbBusTimeEstimated) > classicFramesPerIrp))
+        {
+            // If the guessed value is wrong, erase it as a fixed value.
+            usbBusTimeDiff = 0;
+        }
+        else
+        {
+            usbBusTimeDiff = usbBusTimeCurrent - m_usbBusTimeEstimated;
+        }
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "USB bus time recovered, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
+        m_usbBusTimePrev = usbBusTimeCurrent;
+        m_usbBusTimeEstimated = 0;
+    }
+    else if ((usbBusTimeCurrent < m_usbBusTimePrev) || ((usbBusTimeCurrent - m_usbBusTimePrev) > classicFramesPerIrp))
+    {
+        // When an abnormal value is detected in BusTime,the elapsed time is estimated from Performance Counter.
+        usbBusTimeDiff = (wakeupDiffPCUs + 500) / 1000;
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "USB bus time error, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
+        isIllegalBusTime = true;
+        m_usbBusTimeEstimated = m_usbBusTimePrev + usbBusTimeDiff;
+    }
+    else
+    {
+        usbBusTimeDiff = usbBusTimeCurrent - m_usbBusTimePrev;
+        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "USB bus time is normal, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
+        m_usbBusTimePrev = usbBusTimeCurrent;
+    }
+
+    return usbBusTimeDiff;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void PacketScheduler::DeterminePacket(
+    LONGLONG inCompletedPacket,
+    ULONG    usbBusTimeDiff,
+    ULONG    packetsPerIrp,
+    ULONG    framesPerMs,
+    bool     overrideIgnoreEstimation
+)
+{
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, %llu, %u, %u", inCompletedPacket, usbBusTimeDiff, packetsPerIrp);
+
+    if (overrideIgnoreEstimation)
+    {
+        // Ignore callback time calculations entirely and process all INs as soon as they are recognized
+        m_inputSyncPacket = m_inputEstimatedPacket = inCompletedPacket;
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
+    }
+    else if (m_inputSyncPacket == inCompletedPacket)
+    {
+        // If the number of INs completed has not changed since the previous loop,
+        // predict the position of the packet to be currently processed according to the USB bus time elapsed since the previous loop.
+        LONG packetRoom = (LONG)(m_inputSyncPacket - m_inputEstimatedPacket);
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  packetRoom %u, In sync packet %llu,  estimated packet %llu", packetRoom, m_inputSyncPacket, m_inputEstimatedPacket);
+        if (packetRoom > 0)
+        {
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  packetRoom %u, usb bus time diff %u, frames per ms %u", packetRoom, usbBusTimeDiff, framesPerMs);
+            if (packetRoom > (LONG)(usbBusTimeDiff * framesPerMs))
+            {
+                m_inputEstimatedPacket += usbBusTimeDiff * framesPerMs;
+            }
+            else
+            {
+                m_inputEstimatedPacket += packetRoom;
+            }
+        }
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
+    }
+    else
+    {
+        // If an IN is found for the first time in this loop
+        m_inputSyncPacket = inCompletedPacket;
+        m_inputEstimatedPacket = m_inputSyncPacket - packetsPerIrp;
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
+    }
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool PacketScheduler::IsInputPacketAtEstimatedPosition(
+    ULONG inOffset
+)
+{
+    PAGED_CODE();
+
+    // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - In processed packet %llu, offset %u, estimated packet %llu", m_inputProcessedPacket, inOffset, m_inputEstimatedPacket);
+
+    return (m_inputProcessedPacket + inOffset) >= m_inputEstimatedPacket;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool PacketScheduler::IsOutputPacketOverlapWithEstimatePosition(
+    ULONG outLimit
+)
+{
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Out processed packet %llu, estimated packet %llu, out limit %u", m_outputProcessedPacket, m_inputEstimatedPacket, outLimit);
+
+    // Use Input m_inputEstimatedPacket
+    return m_outputProcessedPacket >= (m_inputEstimatedPacket + outLimit);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool PacketScheduler::IsOutputPacketAtEstimatedPosition()
+{
+    PAGED_CODE();
+
+    // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Out processed packet %llu, estimated packet %llu, sync packet %llu, result %!bool!", m_outputProcessedPacket, m_inputEstimatedPacket, m_inputSyncPacket, m_outputProcessedPacket >= m_inputEstimatedPacket);
+    return m_outputProcessedPacket >= m_inputEstimatedPacket;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void PacketScheduler::IncrementInputProcessedPacket()
+{
+    PAGED_CODE();
+
+    m_inputProcessedPacket++;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void PacketScheduler::IncrementOutputProcessedPacket()
+{
+    PAGED_CODE();
+
+    m_outputProcessedPacket++;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONGLONG
+PacketScheduler::GetInputProcessedPacket()
+{
+    PAGED_CODE();
+
+    return m_inputProcessedPacket;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONGLONG
+PacketScheduler::GetOutputProcessedPacket()
+{
+    PAGED_CODE();
+
+    return m_outputProcessedPacket;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONGLONG
+PacketScheduler::GetInputEstimatedPacket()
+{
+    PAGED_CODE();
+
+    return m_inputEstimatedPacket;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG
+PacketScheduler::GetInputPacketRoom()
+{
+    PAGED_CODE();
+
+    // Completed packets that the estimated position has not reached yet.
+    return (LONG)(m_inputSyncPacket - m_inputEstimatedPacket);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+LONG
+PacketScheduler::CalculateSafetyOffset(
+    ULONG inputOffsetFrame,
+    ULONG dpcOffset
+)
+{
+    PAGED_CODE();
+
+    // Number of packets by which OUT processing leads IN processing, excluding the IN offset and the DPC period.
+    return (LONG)(m_outputProcessedPacket - m_inputProcessedPacket) - (LONG)inputOffsetFrame - (LONG)(dpcOffset);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool PacketScheduler::SplitAtAsioBoundary(
+    BUFFER_PROPERTY & buffer,
+    BUFFER_PROPERTY & remainder,
+    LONG              asioRemainBytes
+)
+{
+    PAGED_CODE();
+
+    if (asioRemainBytes < (LONG)buffer.Length)
+    {
+        // ASIO buffer boundary reached. The rest of the packet is processed the next time the thread wakes up.
+        remainder.Irp = buffer.Irp;
+        remainder.Packet = buffer.Packet;
+        remainder.PacketId = buffer.PacketId;
+        remainder.Length = buffer.Length - asioRemainBytes;
+        remainder.Buffer = buffer.Buffer;
+        remainder.TransferObject = buffer.TransferObject;
+        remainder.Offset = asioRemainBytes;
+        buffer.Length = asioRemainBytes;
+        return true;
+    }
+
+    remainder.Buffer = nullptr;
+    return false;
+}
@@ -0,0 +1,149 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    PacketScheduler.h
+
+Abstract:
+
+    Define a class that decides which isochronous packets the mixing engine
+    thread processes on each wake-up.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _PACKETSCHEDULER_H_
+#define _PACKETSCHEDULER_H_
+
+class TransferObject;
+
+typedef struct BUFFER_PROPERTY_
+{
+    ULONG Irp;
+    ULONG Packet;
+    ULONG PacketId;
+    // PUCHAR Header;
+    PUCHAR Buffer;
+    // bool   Completed;
+    ULONG            Offset; // Usually 0, but when an ASIO buffer boundary is reached, the number of bytes up to the boundary is filled in.
+    ULONG            Length;
+    ULONG            TotalProcessedBytesSoFar;
+    class TransferObject * TransferObject;
+} BUFFER_PROPERTY, *PBUFFER_PROPERTY;
+
+//
+// PacketScheduler holds the packet counters of the mixing engine thread and
+// the arithmetic that decides how far the thread may process. The caller
+// passes in the completed packet counts, the USB bus time and the
+// configuration values, and the implementation only reaches the platform
+// through StreamPlatform.h, so it also builds in user mode.
+//
+class PacketScheduler
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG
+    EstimateUsbBusTime(
+        _In_ bool    isFirstWakeUp,
+        _In_ ULONG   usbBusTimeCurrent,
+        _In_ ULONG   wakeupDiffPCUs,
+        _In_ ULONG   classicFramesPerIrp,
+        _Out_ bool & isIllegalBusTime
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void DeterminePacket(
+        _In_ LONGLONG inCompletedPacket,
+        _In_ ULONG    usbBusTimeDiff,
+        _In_ ULONG    packetsPerIrp,
+        _In_ ULONG    framesPerMs,
+        _In_ bool     overrideIgnoreEstimation
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool
+    IsInputPacketAtEstimatedPosition(
+        _In_ ULONG inOffset
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool
+    IsOutputPacketOverlapWithEstimatePosition(
+        _In_ ULONG outLimit
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool
+    IsOutputPacketAtEstimatedPosition();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void IncrementInputProcessedPacket();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void IncrementOutputProcessedPacket();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONGLONG
+    GetInputProcessedPacket();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONGLONG
+    GetOutputProcessedPacket();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONGLONG
+    GetInputEstimatedPacket();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONG
+    GetInputPacketRoom();
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    LONG
+    CalculateSafetyOffset(
+        _In_ ULONG inputOffsetFrame,
+        _In_ ULONG dpcOffset
+    );
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool
+    SplitAtAsioBoundary(
+        _Inout_ BUFFER_PROPERTY & buffer,
+        _Inout_ BUFFER_PROPERTY & remainder,
+        _In_ LONG                 asioRemainBytes
+    );
+
+  protected:
+    LONGLONG m_inputSyncPacket{0LL};
+    LONGLONG m_inputEstimatedPacket{0LL};
+    LONGLONG m_inputProcessedPacket{0LL};
+    LONGLONG m_outputProcessedPacket{0LL};
+
+    ULONG m_usbBusTimeEstimated{0};
+    ULONG m_usbBusTimePrev{0};
+};
+
+#endif
@@ -0,0 +1,177 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    RateEstimator.cpp
+
+Abstract:
+
+    Implement a fixed-point rate estimator that smooths the device sample rate
+    reported by the feedback endpoint or by the input packets, and sizes the
+    output packets from it.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "RateEstimator.h"
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "RateEstimator.tmh"
+#endif
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void RateEstimator::Reset(
+    bool  enabled,
+    ULONG sampleRate,
+    ULONG packetsPerSec,
+    ULONG packetsPerUpdate
+)
+{
+    m_enabled = enabled;
+    m_packetsPerUpdate = (packetsPerUpdate != 0) ? packetsPerUpdate : 1;
+    m_rateQ16 = (packetsPerSec != 0) ? (LONGLONG)((((ULONGLONG)sampleRate) << c_fractionBits) / packetsPerSec) : 0LL;
+    m_fillErrorQ16 = 0LL;
+    m_measuredSamplesQ16 = 0ULL;
+    m_measuredPackets = 0;
+    m_stableUpdates = 0;
+    m_started = false;
+    m_hasFeedback = false;
+    m_locked = false;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! %!bool!, nominal rate %lld / 65536 samples per packet, %u packets per update", enabled, m_rateQ16, m_packetsPerUpdate);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void RateEstimator::Update(
+    ULONGLONG measuredSamplesQ16,
+    ULONG     packets,
+    bool      isFeedback
+)
+{
+    if (!m_enabled || (packets == 0))
+    {
+        return;
+    }
+
+    // When the device has a feedback endpoint, it is the only source of the rate.
+    if (isFeedback)
+    {
+        m_hasFeedback = true;
+    }
+    else if (m_hasFeedback)
+    {
+        return;
+    }
+
+    if (!m_started)
+    {
+        // The samples sent before the first measurement are not known to the estimator,
+        // so the phase starts from zero here.
+        m_started = true;
+        m_fillErrorQ16 = 0LL;
+    }
+    else
+    {
+        m_fillErrorQ16 += (LONGLONG)measuredSamplesQ16;
+    }
+
+    m_measuredSamplesQ16 += measuredSamplesQ16;
+    m_measuredPackets += packets;
+    if (m_measuredPackets < m_packetsPerUpdate)
+    {
+        return;
+    }
+
+    LONGLONG measuredRateQ16 = (LONGLONG)(m_measuredSamplesQ16 / m_measuredPackets);
+    LONGLONG rateError = measuredRateQ16 - m_rateQ16;
+
+    m_measuredSamplesQ16 = 0ULL;
+    m_measuredPackets = 0;
+    m_rateQ16 += rateError / (1LL << c_rateShift);
+
+    if ((rateError < c_lockThreshold) && (rateError > -c_lockThreshold))
+    {
+        if (!m_locked && (++m_stableUpdates >= c_lockUpdates))
+        {
+            m_locked = true;
+            TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "rate estimator locked, %lld / 65536 samples per packet, fill error %lld / 65536 samples", m_rateQ16, m_fillErrorQ16);
+        }
+    }
+    else
+    {
+        if (m_locked)
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "rate estimator unlocked, measured %lld / 65536, estimated %lld / 65536 samples per packet", measuredRateQ16, m_rateQ16);
+        }
+        m_locked = false;
+        m_stableUpdates = 0;
+    }
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool RateEstimator::IsActive()
+{
+    return m_enabled && m_started;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool RateEstimator::IsLocked()
+{
+    return m_locked;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG
+RateEstimator::EstimateSamples(
+    ULONG packets
+)
+{
+    // The phase correction is limited to one sample per packet.
+    LONGLONG correction = m_fillErrorQ16 / (1LL << c_phaseShift);
+    LONGLONG limit = ((LONGLONG)packets) << c_fractionBits;
+
+    if (correction > limit)
+    {
+        correction = limit;
+    }
+    else if (correction < -limit)
+    {
+        correction = -limit;
+    }
+
+    LONGLONG targetQ16 = m_rateQ16 * (LONGLONG)packets + correction;
+    if (targetQ16 < 0)
+    {
+        targetQ16 = 0;
+    }
+
+    return (ULONG)((targetQ16 + (1LL << (c_fractionBits - 1))) >> c_fractionBits);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void RateEstimator::CommitSamples(
+    ULONG samples
+)
+{
+    if (IsActive())
+    {
+        m_fillErrorQ16 -= ((LONGLONG)samples) << c_fractionBits;
+    }
+}
@@ -0,0 +1,98 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    RateEstimator.h
+
+Abstract:
+
+    Define a fixed-point rate estimator that smooths the device sample rate
+    reported by the feedback endpoint or by the input packets, and sizes the
+    output packets from it.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _RATEESTIMATOR_H_
+#define _RATEESTIMATOR_H_
+
+//
+// The estimator is a second-order loop in Q16.16 fixed point.
+// - The rate state is the estimated number of samples per packet. It follows the
+//   measured rate with an integral gain of 1 / 2^c_rateShift per update.
+// - The phase state is the difference between the samples the device consumed
+//   and the samples that were sent. A proportional gain of 1 / 2^c_phaseShift
+//   of it is added to every IRP, so the buffer fill of the device returns to
+//   its initial value instead of drifting.
+//
+class RateEstimator
+{
+  public:
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Reset(
+        _In_ bool  enabled,
+        _In_ ULONG sampleRate,
+        _In_ ULONG packetsPerSec,
+        _In_ ULONG packetsPerUpdate
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Update(
+        _In_ ULONGLONG measuredSamplesQ16,
+        _In_ ULONG     packets,
+        _In_ bool      isFeedback
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    bool IsActive();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    bool IsLocked();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG
+    EstimateSamples(
+        _In_ ULONG packets
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void CommitSamples(
+        _In_ ULONG samples
+    );
+
+  protected:
+    static const ULONG c_fractionBits = 16;
+    static const ULONG c_rateShift = 3;
+    static const ULONG c_phaseShift = 2;
+    static const LONG  c_lockThreshold = 1 << (c_fractionBits - 4); // 1/16 sample per packet
+    static const ULONG c_lockUpdates = 8;
+
+    bool      m_enabled{false};
+    ULONG     m_packetsPerUpdate{0};
+    LONGLONG  m_rateQ16{0LL};      // samples per packet
+    LONGLONG  m_fillErrorQ16{0LL}; // samples consumed by the device - samples sent
+    ULONGLONG m_measuredSamplesQ16{0ULL};
+    ULONG     m_measuredPackets{0};
+    ULONG     m_stableUpdates{0};
+    bool      m_started{false};
+    bool      m_hasFeedback{false};
+    bool      m_locked{false};
+};
+
+#endif
@@ -173,6 +173,24 @@ static ACX_PROPERTY_ITEM s_PropertyItems[] = {
         0,                                                // PVOID Reserved;
         0,                                                // ULONG ControlCb;
         0,                                                // ULONG ValueCb;
+    },
+    {
+        &KSPROPSETID_LowLatencyAudio,                     // const GUID * Set;
+        toInt(KsPropertyUACLowLatencyAudio::GetStatistics),
+        ACX_PROPERTY_ITEM_FLAG_GET,                       // ULONG Flags;
+        EvtUSBAudioAcxDriverGetStatistics,                // PFN_ACX_OBJECT_PROCESS_REQUEST EvtAcxObjectProcessRequest;
+        0,                                                // PVOID Reserved;
+        0,                                                // ULONG ControlCb;
+        sizeof(UAC_STATISTICS),                           // ULONG ValueCb;
+    },
+    {
+        &KSPROPSETID_LowLatencyAudio,                     // const GUID * Set;
+        toInt(KsPropertyUACLowLatencyAudio::GetEventTrace),
+        ACX_PROPERTY_ITEM_FLAG_GET,                       // ULONG Flags;
+        EvtUSBAudioAcxDriverGetEventTrace,                // PFN_ACX_OBJECT_PROCESS_REQUEST EvtAcxObjectProcessRequest;
+        0,                                                // PVOID Reserved;
+        0,                                                // ULONG ControlCb;
+        sizeof(UAC_EVENT_TRACE),                          // ULONG ValueCb;
     }
 };
 
@@ -30,6 +30,7 @@ Environment:
 #include "ContiguousMemory.h"
 #include "TransferObject.h"
 #include "StreamEngine.h"
+#include "EventTrace.h"
 
 #ifndef __INTELLISENSE__
 #include "RtPacketObject.tmh"
@@ -63,6 +64,8 @@ RtPacketObject::RtPacketObject(
     PAGED_CODE();
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
+    FloatMixBus::InitializeDither(m_floatMixBusDither);
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
@@ -98,6 +101,20 @@ RtPacketObject::~RtPacketObject()
     }
     m_inputRtPacketInfo = m_outputRtPacketInfo = nullptr;
 
+    if (m_mixBusLanesMemory != nullptr)
+    {
+        WdfObjectDelete(m_mixBusLanesMemory);
+        m_mixBusLanesMemory = nullptr;
+    }
+
+    if (m_mixBusTileMemory != nullptr)
+    {
+        WdfObjectDelete(m_mixBusTileMemory);
+        m_mixBusTileMemory = nullptr;
+    }
+    m_mixBusLanes = nullptr;
+    m_mixBusTile = nullptr;
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
@@ -149,11 +166,27 @@ RtPacketObject::SetDataFormat(
     {
         m_inputBytesPerSample = bytesPerSample;
         m_inputAvgBytesPerSec = avgBytesPerSec;
+
+        // Select the copy kernel once per format change, not per sample.
+        NTSTATUS kernelStatus = MixKernels::SelectCopy(bytesPerSample, m_inputCopyKernel);
+        if (!NT_SUCCESS(kernelStatus))
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, " - no copy kernel for bytesPerSample %u, %!STATUS!", bytesPerSample, kernelStatus);
+        }
     }
     else
     {
         m_outputBytesPerSample = bytesPerSample;
         m_outputAvgBytesPerSec = avgBytesPerSec;
+        m_outputIsFloat = IsEqualGUID(subFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+        m_floatMixBusSelected = false;
+
+        // Select the mix kernel once per format change, not per sample.
+        NTSTATUS kernelStatus = MixKernels::Select(m_outputIsFloat, bytesPerSample, m_outputMixKernel);
+        if (!NT_SUCCESS(kernelStatus))
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, " - no mix kernel for bytesPerSample %u, %!STATUS!", bytesPerSample, kernelStatus);
+        }
     }
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - waveFormatEx = %p, waveFormatExtensible = %p, waveFormatExtensibleIEC61937 = %p", waveFormatEx, waveFormatExtensible, waveFormatExtensibleIEC61937);
@@ -422,9 +455,6 @@ RtPacketObject::CopyFromRtPacketToOutputData(
 
     RT_PACKET_INFO * rtPacketInfo = &(m_outputRtPacketInfo[deviceIndex]);
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - TransferredBytesInThisIrp = %u", transferObject->GetTransferredBytesInThisIrp());
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - m_outputRtPacketInfo[deviceIndex].rtPacketSize = %u", m_outputRtPacketInfo[deviceIndex].RtPacketSize);
-
     IF_TRUE_ACTION_JUMP(buffer == nullptr, status = STATUS_INVALID_PARAMETER, CopyFromRtPacketToOutputData_Exit);
     IF_TRUE_ACTION_JUMP(length == 0, status = STATUS_INVALID_PARAMETER, CopyFromRtPacketToOutputData_Exit);
     IF_TRUE_ACTION_JUMP(transferObject == nullptr, status = STATUS_INVALID_PARAMETER, CopyFromRtPacketToOutputData_Exit);
@@ -437,155 +467,73 @@ RtPacketObject::CopyFromRtPacketToOutputData(
 
     switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
     {
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM: {
-        for (ULONG acxCh = 0; acxCh < rtPacketInfo->channels; acxCh++)
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM:
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
+        // The channels of one frame are contiguous in both buffers, so the data is mixed frame by frame
+        // in runs that end at the RtPacket boundary.
+        ULONG            dstFrameBytes = usbBytesPerSample * usbChannels;
+        ULONG            srcFrameBytes = m_outputBytesPerSample * rtPacketInfo->channels;
+        ULONG            rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
+        ULONG            srcIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize;
+        ULONG            dstIndex = rtPacketInfo->usbChannel * usbBytesPerSample;
+        PBYTE            srcData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
+        PBYTE            dstData = (PBYTE)buffer;
+        MIX_KERNEL_STATE mixKernelState;
+        MIX_KERNEL       mixKernel = nullptr;
+
+        IF_TRUE_JUMP((dstFrameBytes == 0) || (srcFrameBytes == 0), CopyFromRtPacketToOutputData_Exit);
+
+        ULONG framesRemaining = length / dstFrameBytes;
+
+        if (m_deviceContext->EventTrace != nullptr)
         {
-            ULONG rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
-            ULONG srcIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize + acxCh * m_outputBytesPerSample;
-            PBYTE srcData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
-            PBYTE dstData = (PBYTE)buffer;
+            m_deviceContext->EventTrace->Log(UACEventId::RtPacketCopy, deviceIndex, rtPacketIndex, srcIndexInRtPacket, framesRemaining);
+        }
 
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, srcIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, srcIndexInRtPacket);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstData, buffer, length = %p, %p, %u", dstData, buffer, length);
+        mixKernel = MixKernels::Begin(m_outputMixKernel, mixKernelState);
 
-            for (ULONG dstIndex = (acxCh + rtPacketInfo->usbChannel) * usbBytesPerSample; dstIndex < length;)
-            {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcIndexInRtPacket, dstIndex = %u, %u", srcIndexInRtPacket, dstIndex);
-
-                // To accommodate differing specifications between the bytesPerSample of the device and ACX audio, the following code modifications are necessary.
-                if (m_outputBytesPerSample == 2)
-                {
-                    PSHORT outSample = (PSHORT)(dstData + dstIndex);
-                    LONG   thisSample = (LONG)(*outSample) + *(PSHORT)(srcData + srcIndexInRtPacket);
-                    if (thisSample > 0x7fff)
-                    {
-                        *outSample = 0x7fff;
-                    }
-                    else if (thisSample < -0x8000)
-                    {
-                        *outSample = -0x8000;
-                    }
+        while (framesRemaining != 0)
+        {
+            ULONG framesToBoundary = (rtPacketInfo->RtPacketSize - srcIndexInRtPacket + srcFrameBytes - 1) / srcFrameBytes;
+            ULONG frames = MIN(framesRemaining, framesToBoundary);
 
-                    {
-                        *outSample = (SHORT)thisSample;
-                    }
-                }
-                else if (m_outputBytesPerSample == 3)
+            if (mixKernel != nullptr)
+            {
+                if (usbBytesPerSample == m_outputBytesPerSample)
                 {
-                    PUCHAR          outSample = (PUCHAR)(dstData + dstIndex);
-                    volatile BYTE * wdmSample = (volatile BYTE *)(srcData + srcIndexInRtPacket);
-                    LONG            thisSample = (LONG)((ULONG)outSample[0] + ((ULONG)outSample[1] << 8)) + ((LONG)((PCHAR)outSample)[2] << 16) + (LONG)((ULONG)wdmSample[0] + ((ULONG)wdmSample[1] << 8)) + ((LONG)((PCHAR)wdmSample)[2] << 16);
-                    if (thisSample > 0x7fffff)
-                    {
-                        outSample[0] = 0xff;
-                        outSample[1] = 0xff;
-                        outSample[2] = 0x7f;
-                    }
-                    else if (thisSample < -0x800000)
-                    {
-                        outSample[0] = 0x00;
-                        outSample[1] = 0x00;
-                        outSample[2] = 0x80;
-                    }
-                    else
-                    {
-                        outSample[0] = ((PUCHAR)(&thisSample))[0];
-                        outSample[1] = ((PUCHAR)(&thisSample))[1];
-                        outSample[2] = ((PUCHAR)(&thisSample))[2];
-                    }
+                    mixKernel(dstData + dstIndex, dstFrameBytes, srcData + srcIndexInRtPacket, srcFrameBytes, rtPacketInfo->channels, frames);
                 }
-                else if (m_outputBytesPerSample == 4)
+                else
                 {
-                    PUCHAR          outSample = (PUCHAR)(dstData + dstIndex);
-                    volatile BYTE * wdmSample = (volatile BYTE *)(srcData + srcIndexInRtPacket);
-                    LONGLONG        thisSample = (LONGLONG) * ((LONG *)outSample) + (LONGLONG) * ((LONG *)wdmSample);
-
-                    if (thisSample > 0x7fffffffLL)
-                    {
-                        outSample[0] = 0xff;
-                        outSample[1] = 0xff;
-                        outSample[2] = 0xff;
-                        outSample[3] = 0x7f;
-                    }
-                    else if (thisSample < -0x80000000LL)
+                    for (ULONG acxCh = 0; acxCh < rtPacketInfo->channels; acxCh++)
                     {
-                        outSample[0] = 0x00;
-                        outSample[1] = 0x00;
-                        outSample[2] = 0x00;
-                        outSample[3] = 0x80;
+                        mixKernel(dstData + dstIndex + acxCh * usbBytesPerSample, dstFrameBytes, srcData + srcIndexInRtPacket + acxCh * m_outputBytesPerSample, srcFrameBytes, 1, frames);
                     }
-                    else
-                    {
-                        outSample[0] = ((PUCHAR)(&thisSample))[0];
-                        outSample[1] = ((PUCHAR)(&thisSample))[1];
-                        outSample[2] = ((PUCHAR)(&thisSample))[2];
-                        outSample[3] = ((PUCHAR)(&thisSample))[3];
-                    }
-                }
-                dstIndex += (usbBytesPerSample * usbChannels);
-                srcIndexInRtPacket += m_outputBytesPerSample * rtPacketInfo->channels;
-                bytesCopiedDstData += m_outputBytesPerSample;
-                bytesCopiedSrcData += m_outputBytesPerSample;
-                if (srcIndexInRtPacket >= rtPacketInfo->RtPacketSize)
-                {
-                    // {
-                    // 	CHAR outputString[100] = "";
-                    // 	sprintf_s(outputString, sizeof(outputString), "DumpByteArray rtPackets[%d]", rtPacketIndex);
-                    // 	DumpByteArray(outputString, (UCHAR*)rtPacketInfo->RtPackets[rtPacketIndex], rtPacketInfo->RtPacketSize);
-                    // }
-                    bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedDstData;
-                    bytesCopiedSrcDataUpToBoundary = bytesCopiedSrcData;
-                    fedRtPacket = true;
-                    srcIndexInRtPacket = acxCh * m_outputBytesPerSample;
-                    rtPacketIndex++;
-                    rtPacketIndex %= rtPacketInfo->RtPacketsCount;
-                    srcData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, srcIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, srcIndexInRtPacket);
                 }
             }
-        }
-    }
-    break;
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
-        for (ULONG acxCh = 0; acxCh < rtPacketInfo->channels; acxCh++)
-        {
-            ULONG rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
-            ULONG srcIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize + acxCh * m_outputBytesPerSample;
-            PBYTE srcData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
-            PBYTE dstData = (PBYTE)buffer;
-
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, srcIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, srcIndexInRtPacket);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstData, buffer, length = %p, %p, %u", dstData, buffer, length);
 
-            for (ULONG dstIndex = (acxCh + rtPacketInfo->usbChannel) * usbBytesPerSample; dstIndex < length;)
+            framesRemaining -= frames;
+            dstIndex += frames * dstFrameBytes;
+            srcIndexInRtPacket += frames * srcFrameBytes;
+            bytesCopiedDstData += frames * dstFrameBytes;
+            bytesCopiedSrcData += frames * srcFrameBytes;
+            if (srcIndexInRtPacket >= rtPacketInfo->RtPacketSize)
             {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcIndexInRtPacket, dstIndex = %u, %u", srcIndexInRtPacket, dstIndex);
-
-                float * outSample = (float *)(dstData + dstIndex);
-                *outSample = *outSample + *(float *)(srcData + srcIndexInRtPacket);
-
-                dstIndex += (usbBytesPerSample * usbChannels);
-                srcIndexInRtPacket += m_outputBytesPerSample * rtPacketInfo->channels;
-                bytesCopiedDstData += m_outputBytesPerSample;
-                bytesCopiedSrcData += m_outputBytesPerSample;
-                if (srcIndexInRtPacket >= rtPacketInfo->RtPacketSize)
+                bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedDstData;
+                bytesCopiedSrcDataUpToBoundary = bytesCopiedSrcData;
+                fedRtPacket = true;
+                srcIndexInRtPacket = 0;
+                rtPacketIndex++;
+                rtPacketIndex %= rtPacketInfo->RtPacketsCount;
+                srcData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
+                if (m_deviceContext->EventTrace != nullptr)
                 {
-                    // {
-                    // 	CHAR outputString[100] = "";
-                    // 	sprintf_s(outputString, sizeof(outputString), "DumpByteArray rtPackets[%d]", rtPacketIndex);
-                    // 	DumpByteArray(outputString, (UCHAR*)rtPacketInfo->RtPackets[rtPacketIndex], rtPacketInfo->RtPacketSize);
-                    // }
-                    bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedDstData;
-                    bytesCopiedSrcDataUpToBoundary = bytesCopiedSrcData;
-                    fedRtPacket = true;
-                    srcIndexInRtPacket = acxCh * m_outputBytesPerSample;
-                    rtPacketIndex++;
-                    rtPacketIndex %= rtPacketInfo->RtPacketsCount;
-                    srcData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, srcIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, srcIndexInRtPacket);
+                    m_deviceContext->EventTrace->Log(UACEventId::RtPacketNext, deviceIndex, rtPacketIndex);
                 }
             }
         }
+
+        MixKernels::End(mixKernelState);
     }
     break;
     case UACSampleFormat::UAC_SAMPLE_FORMAT_IEC61937_AC_3:
@@ -640,6 +588,224 @@ RtPacketObject::CopyFromRtPacketToOutputData(
         break;
     }
 
+    CompleteOutputRtPacket(deviceIndex, transferObject, fedRtPacket, bytesCopiedSrcData, bytesCopiedSrcDataUpToBoundary, bytesCopiedUpToBoundary);
+
+CopyFromRtPacketToOutputData_Exit:
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit, RtPacketPosition, bytesCopiedSrcData, bytesCopiedUpToBoundary = %llu, %u, %u", rtPacketInfo->RtPacketPosition, bytesCopiedSrcData, bytesCopiedUpToBoundary);
+
+    return status;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS
+RtPacketObject::MixRtPacketsToOutputData(
+    PUCHAR           buffer,
+    ULONG            length,
+    ULONG            totalProcessedBytesSoFar,
+    TransferObject * transferObject,
+    ULONG            usbBytesPerSample,
+    ULONG            usbValidBitsPerSample,
+    ULONG            usbChannels
+)
+/*++
+
+Routine Description:
+
+    Mixes the RtPackets of all the active render devices into one USB packet
+    with MixBus::Mix().
+
+Arguments:
+
+    buffer - USB packet, which already contains the ASIO output.
+
+    length - Length of the USB packet in bytes.
+
+    totalProcessedBytesSoFar - Bytes of the URB that precede this packet.
+
+    transferObject - Transfer object of the URB.
+
+    usbBytesPerSample -
+
+    usbValidBitsPerSample -
+
+    usbChannels -
+
+Return Value:
+
+    NTSTATUS - NT status value
+
+--*/
+{
+    NTSTATUS         status = STATUS_SUCCESS;
+    ULONG            numOfLanes = 0;
+    MIX_KERNEL_STATE mixKernelState;
+    MIX_KERNEL       mixKernel = nullptr;
+
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, length = %u", length);
+
+    ASSERT(m_deviceContext != nullptr);
+
+    RETURN_NTSTATUS_IF_TRUE(buffer == nullptr, STATUS_INVALID_PARAMETER);
+    RETURN_NTSTATUS_IF_TRUE(length == 0, STATUS_INVALID_PARAMETER);
+    RETURN_NTSTATUS_IF_TRUE(transferObject == nullptr, STATUS_INVALID_PARAMETER);
+    RETURN_NTSTATUS_IF_TRUE(m_deviceContext->RenderStreamEngine == nullptr, STATUS_UNSUCCESSFUL);
+    RETURN_NTSTATUS_IF_TRUE(transferObject->GetTransferredBytesInThisIrp() == 0, STATUS_UNSUCCESSFUL);
+
+    ULONG dstFrameBytes = usbBytesPerSample * usbChannels;
+    bool  pcmFormat = (m_deviceContext->AudioProperty.CurrentSampleFormat == UACSampleFormat::UAC_SAMPLE_FORMAT_PCM) || (m_deviceContext->AudioProperty.CurrentSampleFormat == UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT);
+    bool  floatBus = pcmFormat && PrepareFloatMixBus(usbBytesPerSample);
+    ULONG tileBytesPerSample = floatBus ? sizeof(float) : usbBytesPerSample;
+    ULONG tileFrameBytes = tileBytesPerSample * usbChannels;
+
+    if (!pcmFormat || (m_mixBusLanes == nullptr) || (m_mixBusTile == nullptr) || (dstFrameBytes == 0) || (tileFrameBytes > MixBus::c_tileBytes))
+    {
+        // The encoded formats are copied as they are, one device at a time.
+        for (ULONG deviceIndex = 0; deviceIndex < m_numOfOutputDevices; deviceIndex++)
+        {
+            if ((m_deviceContext->RenderStreamEngine[deviceIndex] != nullptr) && (m_outputRtPacketInfo[deviceIndex].RtPacketSize != 0))
+            {
+                status = CopyFromRtPacketToOutputData(deviceIndex, buffer, length, totalProcessedBytesSoFar, transferObject, usbBytesPerSample, usbValidBitsPerSample, usbChannels);
+            }
+        }
+        return status;
+    }
+
+    //
+    // Build the lane table. The channel offset of each device in a USB frame
+    // and the position in its RtPackets are resolved once per packet.
+    //
+    for (ULONG deviceIndex = 0; deviceIndex < m_numOfOutputDevices; deviceIndex++)
+    {
+        RT_PACKET_INFO * rtPacketInfo = &(m_outputRtPacketInfo[deviceIndex]);
+
+        if ((m_deviceContext->RenderStreamEngine[deviceIndex] == nullptr) || (rtPacketInfo->RtPackets == nullptr) || (rtPacketInfo->RtPacketSize == 0) || (rtPacketInfo->RtPacketsCount == 0))
+        {
+            continue;
+        }
+
+        MIX_BUS_LANE & lane = m_mixBusLanes[numOfLanes];
+        RtlZeroMemory(&lane, sizeof(lane));
+        lane.DeviceIndex = deviceIndex;
+        lane.RtPackets = rtPacketInfo->RtPackets;
+        lane.RtPacketsCount = rtPacketInfo->RtPacketsCount;
+        lane.RtPacketSize = rtPacketInfo->RtPacketSize;
+        lane.Channels = rtPacketInfo->channels;
+        lane.UsbChannel = rtPacketInfo->usbChannel;
+        lane.SrcFrameBytes = m_outputBytesPerSample * rtPacketInfo->channels;
+        lane.RtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
+        lane.SrcIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize;
+        lane.SrcData = (PBYTE)rtPacketInfo->RtPackets[lane.RtPacketIndex];
+        if (lane.SrcFrameBytes == 0)
+        {
+            continue;
+        }
+
+        if (m_deviceContext->EventTrace != nullptr)
+        {
+            m_deviceContext->EventTrace->Log(UACEventId::RtPacketCopy, deviceIndex, lane.RtPacketIndex, lane.SrcIndexInRtPacket, length / dstFrameBytes);
+        }
+        numOfLanes++;
+    }
+
+    if (numOfLanes == 0)
+    {
+        return status;
+    }
+
+    mixKernel = MixKernels::Begin(m_outputMixKernel, mixKernelState);
+
+    MixBus::Mix(m_mixBusLanes, numOfLanes, mixKernel, floatBus ? &m_floatMixBus : nullptr, (floatBus && m_floatMixBus.Dither) ? &m_floatMixBusDither : nullptr, m_mixBusTile, buffer, length, totalProcessedBytesSoFar, usbBytesPerSample, usbChannels, m_outputBytesPerSample);
+
+    MixKernels::End(mixKernelState);
+
+    for (ULONG laneIndex = 0; laneIndex < numOfLanes; laneIndex++)
+    {
+        MIX_BUS_LANE & lane = m_mixBusLanes[laneIndex];
+        if (lane.FedRtPacket && (m_deviceContext->EventTrace != nullptr))
+        {
+            m_deviceContext->EventTrace->Log(UACEventId::RtPacketNext, lane.DeviceIndex, lane.RtPacketIndex);
+        }
+        CompleteOutputRtPacket(lane.DeviceIndex, transferObject, lane.FedRtPacket, lane.BytesCopiedSrcData, lane.BytesCopiedSrcDataUpToBoundary, lane.BytesCopiedUpToBoundary);
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit, lanes = %u, tiles of %u frames, float bus %!bool!", numOfLanes, MixBus::c_tileBytes / tileFrameBytes, floatBus);
+
+    return status;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+bool RtPacketObject::PrepareFloatMixBus(
+    ULONG usbBytesPerSample
+)
+/*++
+
+Routine Description:
+
+    Selects the float mix bus kernels when the mix bus type or either sample
+    format has changed since the last packet.
+
+Return Value:
+
+    true if the packet is mixed on the float mix bus.
+
+--*/
+{
+    PAGED_CODE();
+
+    MixBusType mixBusType = m_deviceContext->SupportedControl.MixBus;
+    bool       targetIsFloat = (m_deviceContext->AudioProperty.CurrentSampleFormat == UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT);
+
+    if (mixBusType == MixBusType::Native)
+    {
+        return false;
+    }
+
+    if (!m_floatMixBusSelected || (m_floatMixBusType != mixBusType) || (m_floatMixBusTargetIsFloat != targetIsFloat) || (m_floatMixBusTargetBytesPerSample != usbBytesPerSample))
+    {
+        m_floatMixBusSelected = true;
+        m_floatMixBusType = mixBusType;
+        m_floatMixBusTargetIsFloat = targetIsFloat;
+        m_floatMixBusTargetBytesPerSample = usbBytesPerSample;
+
+        NTSTATUS status = FloatMixBus::Select(m_outputIsFloat, m_outputBytesPerSample, targetIsFloat, usbBytesPerSample, mixBusType == MixBusType::FloatDither, m_floatMixBus);
+        if (!NT_SUCCESS(status))
+        {
+            // The packets are mixed in the USB format instead.
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, " - no float mix bus for bytesPerSample %u / %u, %!STATUS!", m_outputBytesPerSample, usbBytesPerSample, status);
+        }
+    }
+
+    return (m_floatMixBus.Load != nullptr) && (m_floatMixBus.Accumulate != nullptr) && (m_floatMixBus.Store != nullptr);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void RtPacketObject::CompleteOutputRtPacket(
+    ULONG            deviceIndex,
+    TransferObject * transferObject,
+    bool             fedRtPacket,
+    ULONG            bytesCopiedSrcData,
+    ULONG            bytesCopiedSrcDataUpToBoundary,
+    ULONG            bytesCopiedUpToBoundary
+)
+/*++
+
+Routine Description:
+
+    Advances the RtPacket position of a render device after its data has
+    been mixed into a USB packet, and notifies ACX when an RtPacket has been
+    consumed.
+
+--*/
+{
+    RT_PACKET_INFO * rtPacketInfo = &(m_outputRtPacketInfo[deviceIndex]);
+
+    PAGED_CODE();
+
     if (rtPacketInfo->LastPacketStartQpcPosition == 0)
     {
         ULONGLONG estimatedQPCPosition = transferObject->CalculateEstimatedQPCPosition(0);
@@ -667,11 +833,6 @@ RtPacketObject::CopyFromRtPacketToOutputData(
         }
     }
     InterlockedAdd64((LONG64 *)&(rtPacketInfo->RtPacketPosition), bytesCopiedSrcData);
-
-CopyFromRtPacketToOutputData_Exit:
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit, RtPacketPosition, bytesCopiedSrcData, bytesCopiedUpToBoundary = %llu, %u, %u", rtPacketInfo->RtPacketPosition, bytesCopiedSrcData, bytesCopiedUpToBoundary);
-
-    return status;
 }
 
 _Use_decl_annotations_
@@ -725,87 +886,70 @@ RtPacketObject::CopyToRtPacketFromInputData(
 
     switch (m_deviceContext->AudioProperty.CurrentSampleFormat)
     {
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM: {
-        for (ULONG acxCh = 0; acxCh < rtPacketInfo->channels; acxCh++)
-        {
-            ULONG rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
-            ULONG dstIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize + acxCh * m_inputBytesPerSample;
-            PBYTE srcData = (PBYTE)buffer;
-            PBYTE dstData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_PCM:
+    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
+        // The channels of one frame are contiguous in both buffers, so the data is copied frame by frame
+        // in runs that end at the RtPacket boundary.
+        ULONG            srcFrameBytes = usbBytesPerSample * usbChannels;
+        ULONG            dstFrameBytes = m_inputBytesPerSample * rtPacketInfo->channels;
+        ULONG            rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
+        ULONG            dstIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize;
+        ULONG            srcIndex = rtPacketInfo->usbChannel * usbBytesPerSample;
+        PBYTE            srcData = (PBYTE)buffer;
+        PBYTE            dstData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
+        MIX_KERNEL_STATE copyKernelState;
+        MIX_KERNEL       copyKernel = nullptr;
+
+        IF_TRUE_JUMP((dstFrameBytes == 0) || (srcFrameBytes == 0), CopyToRtPacketFromInputData_Exit);
+
+        ULONG framesRemaining = length / srcFrameBytes;
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - rtPacketIndex, dstIndexInRtPacket, frames, %u, %u, %u", rtPacketIndex, dstIndexInRtPacket, framesRemaining);
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcData, buffer, length = %p, %p, %u", srcData, buffer, length);
 
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, dstIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, dstIndexInRtPacket);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcData, buffer, length = %p, %p, %u", srcData, buffer, length);
+        copyKernel = MixKernels::Begin(m_inputCopyKernel, copyKernelState);
 
-            for (ULONG srcIndex = (acxCh + rtPacketInfo->usbChannel) * usbBytesPerSample; srcIndex < length;)
-            {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstIndexInRtPacket, dstIndex = %u, %u", dstIndexInRtPacket, srcIndex);
+        while (framesRemaining != 0)
+        {
+            ULONG framesToBoundary = (rtPacketInfo->RtPacketSize - dstIndexInRtPacket + dstFrameBytes - 1) / dstFrameBytes;
+            ULONG frames = MIN(framesRemaining, framesToBoundary);
 
-                // To accommodate differing specifications between the bytesPerSample of the device and ACX audio, the following code modifications are necessary.
-                if (m_inputBytesPerSample == 2)
-                {
-                    *(PSHORT)(dstData + dstIndexInRtPacket) = *(PSHORT)(srcData + srcIndex);
-                }
-                else if (m_inputBytesPerSample == 3)
-                {
-                    *(dstData + dstIndexInRtPacket) = *(srcData + srcIndex);
-                    *(dstData + dstIndexInRtPacket + 1) = *(srcData + srcIndex + 1);
-                    *(dstData + dstIndexInRtPacket + 2) = *(srcData + srcIndex + 2);
-                }
-                else if (m_inputBytesPerSample == 4)
+            if (copyKernel != nullptr)
+            {
+                if (usbBytesPerSample == m_inputBytesPerSample)
                 {
-                    *((LONG *)(dstData + dstIndexInRtPacket)) = *((LONG *)(srcData + srcIndex));
+                    copyKernel(dstData + dstIndexInRtPacket, dstFrameBytes, srcData + srcIndex, srcFrameBytes, rtPacketInfo->channels, frames);
                 }
-                srcIndex += (usbBytesPerSample * usbChannels);
-                dstIndexInRtPacket += m_inputBytesPerSample * rtPacketInfo->channels;
-                bytesCopiedDstData += m_inputBytesPerSample;
-                bytesCopiedSrcData += m_inputBytesPerSample;
-                if (dstIndexInRtPacket >= rtPacketInfo->RtPacketSize)
+                else
                 {
-                    bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedSrcData;
-                    bytesCopiedDstDataUpToBoundary = bytesCopiedDstData;
-                    filledRtPacket = true;
-                    dstIndexInRtPacket = acxCh * m_inputBytesPerSample;
-                    rtPacketIndex++;
-                    rtPacketIndex %= rtPacketInfo->RtPacketsCount;
-                    dstData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, dstIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, dstIndexInRtPacket);
+                    // To accommodate differing specifications between the bytesPerSample of the device and ACX audio,
+                    // each channel is copied separately.
+                    for (ULONG acxCh = 0; acxCh < rtPacketInfo->channels; acxCh++)
+                    {
+                        copyKernel(dstData + dstIndexInRtPacket + acxCh * m_inputBytesPerSample, dstFrameBytes, srcData + srcIndex + acxCh * usbBytesPerSample, srcFrameBytes, 1, frames);
+                    }
                 }
             }
-        }
-    }
-    break;
-    case UACSampleFormat::UAC_SAMPLE_FORMAT_IEEE_FLOAT: {
-        for (ULONG acxCh = 0; acxCh < rtPacketInfo->channels; acxCh++)
-        {
-            ULONG rtPacketIndex = (rtPacketInfo->RtPacketPosition / rtPacketInfo->RtPacketSize) % rtPacketInfo->RtPacketsCount;
-            ULONG dstIndexInRtPacket = rtPacketInfo->RtPacketPosition % rtPacketInfo->RtPacketSize + acxCh * m_inputBytesPerSample;
-            PBYTE srcData = (PBYTE)buffer;
-            PBYTE dstData = (PBYTE)rtPacketInfo->RtPackets[rtPacketIndex];
-
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, dstIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, dstIndexInRtPacket);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - srcData, buffer, length = %p, %p, %u", srcData, buffer, length);
-            for (ULONG srcIndex = (acxCh + rtPacketInfo->usbChannel) * usbBytesPerSample; srcIndex < length;)
+
+            framesRemaining -= frames;
+            srcIndex += frames * srcFrameBytes;
+            dstIndexInRtPacket += frames * dstFrameBytes;
+            bytesCopiedSrcData += frames * srcFrameBytes;
+            bytesCopiedDstData += frames * dstFrameBytes;
+            if (dstIndexInRtPacket >= rtPacketInfo->RtPacketSize)
             {
-                // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - dstIndexInRtPacket, dstIndex = %u, %u", dstIndexInRtPacket, srcIndex);
-
-                *((float *)(dstData + dstIndexInRtPacket)) = *((float *)(srcData + srcIndex));
-                srcIndex += (usbBytesPerSample * usbChannels);
-                dstIndexInRtPacket += m_inputBytesPerSample * rtPacketInfo->channels;
-                bytesCopiedDstData += m_inputBytesPerSample;
-                bytesCopiedSrcData += m_inputBytesPerSample;
-                if (dstIndexInRtPacket >= rtPacketInfo->RtPacketSize)
-                {
-                    bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedSrcData;
-                    bytesCopiedDstDataUpToBoundary = bytesCopiedDstData;
-                    filledRtPacket = true;
-                    dstIndexInRtPacket = acxCh * m_inputBytesPerSample;
-                    rtPacketIndex++;
-                    rtPacketIndex %= rtPacketInfo->RtPacketsCount;
-                    dstData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - acxCh, rtPacketIndex, dstIndexInRtPacket, %u, %u, %u", acxCh, rtPacketIndex, dstIndexInRtPacket);
-                }
+                bytesCopiedUpToBoundary = totalProcessedBytesSoFar + bytesCopiedSrcData;
+                bytesCopiedDstDataUpToBoundary = bytesCopiedDstData;
+                filledRtPacket = true;
+                dstIndexInRtPacket = 0;
+                rtPacketIndex++;
+                rtPacketIndex %= rtPacketInfo->RtPacketsCount;
+                dstData = ((PBYTE)rtPacketInfo->RtPackets[rtPacketIndex]);
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - rtPacketIndex, dstIndexInRtPacket, %u, %u", rtPacketIndex, dstIndexInRtPacket);
             }
         }
+
+        MixKernels::End(copyKernelState);
     }
     break;
     case UACSampleFormat::UAC_SAMPLE_FORMAT_IEC61937_AC_3:
@@ -1092,6 +1236,10 @@ RtPacketObject::AssignDevices(
     RT_PACKET_INFO *      outputRtPacketInfo = nullptr;
     WDFMEMORY             inputRtPacketInfoMemory = nullptr;
     WDFMEMORY             outputRtPacketInfoMemory = nullptr;
+    MIX_BUS_LANE *        mixBusLanes = nullptr;
+    PUCHAR                mixBusTile = nullptr;
+    WDFMEMORY             mixBusLanesMemory = nullptr;
+    WDFMEMORY             mixBusTileMemory = nullptr;
     WDF_OBJECT_ATTRIBUTES attributes;
 
     PAGED_CODE();
@@ -1112,6 +1260,20 @@ RtPacketObject::AssignDevices(
             outputRtPacketInfoMemory = nullptr;
             outputRtPacketInfo = nullptr;
         }
+
+        if (mixBusLanesMemory != nullptr)
+        {
+            WdfObjectDelete(mixBusLanesMemory);
+            mixBusLanesMemory = nullptr;
+            mixBusLanes = nullptr;
+        }
+
+        if (mixBusTileMemory != nullptr)
+        {
+            WdfObjectDelete(mixBusTileMemory);
+            mixBusTileMemory = nullptr;
+            mixBusTile = nullptr;
+        }
     });
 
     if (numOfInputDevices != 0)
@@ -1130,6 +1292,18 @@ RtPacketObject::AssignDevices(
 
         RETURN_NTSTATUS_IF_FAILED(WdfMemoryCreate(&attributes, NonPagedPoolNx, DRIVER_TAG, sizeof(RT_PACKET_INFO) * numOfOutputDevices, &outputRtPacketInfoMemory, (PVOID *)&outputRtPacketInfo));
         RtlZeroMemory(outputRtPacketInfo, sizeof(RT_PACKET_INFO) * numOfOutputDevices);
+
+        WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+        attributes.ParentObject = m_deviceContext->Device;
+
+        RETURN_NTSTATUS_IF_FAILED(WdfMemoryCreate(&attributes, NonPagedPoolNx, DRIVER_TAG, sizeof(MIX_BUS_LANE) * numOfOutputDevices, &mixBusLanesMemory, (PVOID *)&mixBusLanes));
+        RtlZeroMemory(mixBusLanes, sizeof(MIX_BUS_LANE) * numOfOutputDevices);
+
+        WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+        attributes.ParentObject = m_deviceContext->Device;
+
+        RETURN_NTSTATUS_IF_FAILED(WdfMemoryCreate(&attributes, NonPagedPoolNx, DRIVER_TAG, MixBus::c_tileBytes, &mixBusTileMemory, (PVOID *)&mixBusTile));
+        RtlZeroMemory(mixBusTile, MixBus::c_tileBytes);
     }
 
     m_inputRtPacketInfo = inputRtPacketInfo;
@@ -1141,6 +1315,26 @@ RtPacketObject::AssignDevices(
     inputRtPacketInfo = outputRtPacketInfo = nullptr;
     inputRtPacketInfoMemory = outputRtPacketInfoMemory = nullptr;
 
+    if (mixBusLanesMemory != nullptr)
+    {
+        if (m_mixBusLanesMemory != nullptr)
+        {
+            WdfObjectDelete(m_mixBusLanesMemory);
+        }
+        if (m_mixBusTileMemory != nullptr)
+        {
+            WdfObjectDelete(m_mixBusTileMemory);
+        }
+        m_mixBusLanes = mixBusLanes;
+        m_mixBusTile = mixBusTile;
+        m_mixBusLanesMemory = mixBusLanesMemory;
+        m_mixBusTileMemory = mixBusTileMemory;
+
+        mixBusLanes = nullptr;
+        mixBusTile = nullptr;
+        mixBusLanesMemory = mixBusTileMemory = nullptr;
+    }
+
     if ((m_numOfInputDevices == 0) && (numOfInputDevices != 0))
     {
         m_numOfInputDevices = numOfInputDevices;
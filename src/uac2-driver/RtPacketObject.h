@@ -25,6 +25,9 @@ Environment:
 #define _RTPACKETOBJECT_H_
 
 #include <acx.h>
+#include "MixKernels.h"
+#include "FloatMixBus.h"
+#include "MixBus.h"
 
 class ContiguousMemory;
 class TransferObject;
@@ -111,6 +114,19 @@ class RtPacketObject
         _In_ ULONG                           usbChannels
     );
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS
+    MixRtPacketsToOutputData(
+        _Inout_updates_bytes_(length) PUCHAR buffer,
+        _In_ ULONG                           length,
+        _In_ ULONG                           totalProcessedBytesSoFar,
+        _In_ TransferObject *                transferObject,
+        _In_ ULONG                           usbBytesPerSample,
+        _In_ ULONG                           usbValidBitsPerSample,
+        _In_ ULONG                           usbChannels
+    );
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     NTSTATUS
@@ -192,6 +208,23 @@ class RtPacketObject
         ULONG       channels{0};   // Number of channels in Acx Audio
     } RT_PACKET_INFO;
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    bool PrepareFloatMixBus(
+        _In_ ULONG usbBytesPerSample
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void CompleteOutputRtPacket(
+        _In_ ULONG            deviceIndex,
+        _In_ TransferObject * transferObject,
+        _In_ bool             fedRtPacket,
+        _In_ ULONG            bytesCopiedSrcData,
+        _In_ ULONG            bytesCopiedSrcDataUpToBoundary,
+        _In_ ULONG            bytesCopiedUpToBoundary
+    );
+
     const PDEVICE_CONTEXT m_deviceContext;
     RT_PACKET_INFO *      m_inputRtPacketInfo{nullptr};
     RT_PACKET_INFO *      m_outputRtPacketInfo{nullptr};
@@ -199,6 +232,10 @@ class RtPacketObject
     ULONG                 m_numOfOutputDevices{0};
     WDFMEMORY             m_inputRtPacketInfoMemory{nullptr};
     WDFMEMORY             m_outputRtPacketInfoMemory{nullptr};
+    MIX_BUS_LANE *        m_mixBusLanes{nullptr}; // One lane per output device.
+    PUCHAR                m_mixBusTile{nullptr};
+    WDFMEMORY             m_mixBusLanesMemory{nullptr};
+    WDFMEMORY             m_mixBusTileMemory{nullptr};
 
     PWAVEFORMATEX m_inputWaveFormat{nullptr};  // The origin of WAVEFORMATEX used by Acx Audio
     PWAVEFORMATEX m_outputWaveFormat{nullptr}; // The origin of WAVEFORMATEX used by Acx Audio
@@ -208,6 +245,17 @@ class RtPacketObject
     ULONG         m_outputPaddingBytes{0};
     DWORD         m_inputAvgBytesPerSec{0};
     DWORD         m_outputAvgBytesPerSec{0};
+
+    MIX_KERNEL_INFO m_inputCopyKernel{}; // Selected in SetDataFormat() for the input data format.
+    MIX_KERNEL_INFO m_outputMixKernel{}; // Selected in SetDataFormat() for the output data format.
+    bool            m_outputIsFloat{false};
+
+    FLOAT_MIX_BUS_INFO m_floatMixBus{};                     // Selected on the first packet after a format change.
+    bool               m_floatMixBusSelected{false};
+    MixBusType         m_floatMixBusType{MixBusType::Native};
+    bool               m_floatMixBusTargetIsFloat{false};
+    ULONG              m_floatMixBusTargetBytesPerSample{0};
+    FLOAT_BUS_DITHER   m_floatMixBusDither{};
 };
 
 #endif
@@ -0,0 +1,112 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    SampleRateMeter.cpp
+
+Abstract:
+
+    Implement a lock-free sliding-window meter that measures the sample rate
+    of an isochronous stream from the completed packet lengths.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "SampleRateMeter.h"
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "SampleRateMeter.tmh"
+#endif
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+void SampleRateMeter::Reset(
+    ULONG windowMs,
+    ULONG packetsPerMs,
+    ULONG bytesPerBlock
+)
+{
+    m_windowMs = min(max(windowMs, c_minWindowMs), c_maxWindowMs);
+    m_packetsPerMs = (packetsPerMs != 0) ? packetsPerMs : 1;
+    m_bytesPerBlock = bytesPerBlock;
+    m_history[0] = 0LL;
+    InterlockedExchange64(&m_totalBytes, 0LL);
+    InterlockedExchange64(&m_totalPackets, 0LL);
+    InterlockedExchange64(&m_sampleRateQ16, 0LL);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! window %u ms, %u packets per ms, %u bytes per block", m_windowMs, m_packetsPerMs, m_bytesPerBlock);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool SampleRateMeter::Update(
+    ULONG length
+)
+{
+    LONGLONG totalBytes = InterlockedExchangeAdd64(&m_totalBytes, (LONG64)length) + length;
+    LONGLONG totalPackets = InterlockedIncrement64(&m_totalPackets);
+
+    if ((totalPackets % m_packetsPerMs) != 0 || m_bytesPerBlock == 0)
+    {
+        return false;
+    }
+
+    //
+    // Only the completion that reaches the 1 ms boundary writes the entry, and the entry
+    // is not read again until the window has moved past it.
+    //
+    ULONGLONG elapsedMs = (ULONGLONG)(totalPackets / m_packetsPerMs);
+    m_history[elapsedMs % (c_maxWindowMs + 1)] = totalBytes;
+    if (elapsedMs < c_minWindowMs)
+    {
+        return false;
+    }
+
+    ULONG    windowMs = (ULONG)min(elapsedMs, (ULONGLONG)m_windowMs);
+    LONGLONG windowBytes = totalBytes - m_history[(elapsedMs - windowMs) % (c_maxWindowMs + 1)];
+    if (windowBytes < 0)
+    {
+        return false;
+    }
+
+    // At 768 kHz, 64 channels, 4 bytes per sample, windowBytes << 16 * 1000 is below 2^63.
+    LONGLONG sampleRateQ16 = (LONGLONG)((((ULONGLONG)windowBytes << c_fractionBits) * 1000ULL) / ((ULONGLONG)windowMs * m_bytesPerBlock));
+    InterlockedExchange64(&m_sampleRateQ16, sampleRateQ16);
+    return true;
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONGLONG
+SampleRateMeter::GetSampleRateQ16()
+{
+    return (ULONGLONG)InterlockedCompareExchange64(&m_sampleRateQ16, 0LL, 0LL);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONG
+SampleRateMeter::GetSampleRate()
+{
+    return (ULONG)((GetSampleRateQ16() + (1ULL << (c_fractionBits - 1))) >> c_fractionBits);
+}
+
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+bool SampleRateMeter::IsWindowFilled()
+{
+    LONGLONG totalPackets = InterlockedCompareExchange64(&m_totalPackets, 0LL, 0LL);
+
+    return ((ULONGLONG)totalPackets / m_packetsPerMs) >= m_windowMs;
+}
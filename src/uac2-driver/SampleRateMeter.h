@@ -0,0 +1,84 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    SampleRateMeter.h
+
+Abstract:
+
+    Define a lock-free sliding-window meter that measures the sample rate
+    of an isochronous stream from the completed packet lengths.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _SAMPLERATEMETER_H_
+#define _SAMPLERATEMETER_H_
+
+//
+// The meter keeps the total number of bytes transferred at every 1 ms boundary
+// in a ring, so the rate over the window is the difference between the newest
+// and the oldest entry. The result is in Q16.16 Hz and is refreshed every 1 ms.
+// Until the window is filled, the elapsed time since Reset() is used as the
+// window, so the first result is available c_minWindowMs after the stream starts.
+// Update() may be called concurrently from several completion routines.
+//
+class SampleRateMeter
+{
+  public:
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    void Reset(
+        _In_ ULONG windowMs,
+        _In_ ULONG packetsPerMs,
+        _In_ ULONG bytesPerBlock
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    _Success_(return == true)
+    bool Update(
+        _In_ ULONG length
+    );
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONGLONG
+    GetSampleRateQ16();
+
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONG
+    GetSampleRate();
+
+    // true once a full window has been measured since Reset().
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    bool
+    IsWindowFilled();
+
+    static const ULONG c_fractionBits = 16;
+    static const ULONG c_minWindowMs = UAC_MIN_SAMPLE_RATE_WINDOW_MS;
+    static const ULONG c_maxWindowMs = UAC_MAX_SAMPLE_RATE_WINDOW_MS;
+
+  protected:
+    volatile LONG64 m_totalBytes{0LL};
+    volatile LONG64 m_totalPackets{0LL};
+    volatile LONG64 m_sampleRateQ16{0LL};
+    ULONG           m_windowMs{c_maxWindowMs};
+    ULONG           m_packetsPerMs{1};
+    ULONG           m_bytesPerBlock{0};
+    LONGLONG        m_history[c_maxWindowMs + 1]{}; // total bytes at each 1 ms boundary
+};
+
+#endif
@@ -31,9 +31,14 @@ Environment:
 #include "USBAudioConfiguration.h"
 #include "StreamObject.h"
 #include "ErrorStatistics.h"
+#include "LatencyStatistics.h"
+#include "OverloadPredictor.h"
+#include "OffsetTuner.h"
+#include "EventTrace.h"
 #include "TransferObject.h"
 #include "RtPacketObject.h"
 #include "AsioBufferObject.h"
+#include "ContiguousMemory.h"
 
 #ifndef __INTELLISENSE__
 #include "StreamObject.tmh"
@@ -76,6 +81,8 @@ StreamObject::StreamObject(
     attributes.ParentObject = deviceContext->Device;
     WdfSpinLockCreate(&attributes, &m_packetSpinLock);
 
+    StreamPlatform::InitializeEvent(m_renderDoneEvent);
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
@@ -101,12 +108,11 @@ void StreamObject::ResetNextMeasureFrames(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    m_inputProcessedFrames = 0;
-    m_inputBytesLastOneSec = 0;
-    m_outputProcessedFrames = 0;
-    m_outputBytesLastOneSec = 0;
+    m_inputSampleRateMeter.Reset(m_deviceContext->Params.SampleRateWindowMs, measureFrames / 1000, m_deviceContext->AudioProperty.InputBytesPerBlock);
+    m_outputSampleRateMeter.Reset(m_deviceContext->Params.SampleRateWindowMs, measureFrames / 1000, m_deviceContext->AudioProperty.OutputBytesPerBlock);
 
-    m_inputNextMeasureFrames = m_outputNextMeasureFrames = measureFrames;
+    // The stream is restarted on every sample rate change, so the estimator starts again from the nominal rate.
+    m_rateEstimator.Reset(m_deviceContext->SupportedControl.RateEstimator == RateEstimatorType::Pll, m_deviceContext->AudioProperty.SampleRate, m_deviceContext->AudioProperty.PacketsPerSec, m_deviceContext->ClassicFramesPerIrp * m_deviceContext->FramesPerMs);
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
@@ -120,7 +126,7 @@ void StreamObject::SetStartIsoFrame(
 {
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
     m_inputNextIsoFrame = m_outputNextIsoFrame = m_feedbackNextIsoFrame = m_startIsoFrame = currentFrame;
 
     if (outputFrameDelay >= 0)
@@ -132,7 +138,7 @@ void StreamObject::SetStartIsoFrame(
         m_inputNextIsoFrame += (ULONG)(0 - outputFrameDelay);
     }
 
-    WdfSpinLockRelease(m_positionSpinLock);
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
@@ -145,12 +151,12 @@ void StreamObject::SetIsoFrameDelay(
 {
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
     m_inputIsoFrameDelay =
         m_outputIsoFrameDelay =
             m_feedbackIsoFrameDelay = firstPacketLatency;
 
-    WdfSpinLockRelease(m_positionSpinLock);
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
@@ -252,7 +258,7 @@ StreamObject::GetStartFrame(
     ULONG startFrame = 0;
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
 
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
 
     switch (direction)
     {
@@ -278,7 +284,7 @@ StreamObject::GetStartFrame(
         break;
     }
 
-    WdfSpinLockRelease(m_positionSpinLock);
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 
@@ -432,44 +438,30 @@ _Use_decl_annotations_
 NONPAGED_CODE_SEG
 bool StreamObject::CalculateSampleRate(
     const bool       input,
-    const ULONG      bytesPerBlock,
-    const ULONG      packetsPerSec,
     const ULONG      length,
     volatile ULONG & measuredSampleRate
 )
 {
-    volatile LONG * processedFrames = 0;
-    volatile LONG * bytesLastOneSec = nullptr;
-    LONG *          nextMeasureFrames = nullptr;
-    bool            updated = false;
+    SampleRateMeter & sampleRateMeter = input ? m_inputSampleRateMeter : m_outputSampleRateMeter;
 
-    if (input)
+    bool updated = sampleRateMeter.Update(length);
+    if (updated)
     {
-        processedFrames = &m_inputProcessedFrames;
-        bytesLastOneSec = &m_inputBytesLastOneSec;
-        nextMeasureFrames = &m_inputNextMeasureFrames;
-    }
-    else
-    {
-        processedFrames = &m_outputProcessedFrames;
-        bytesLastOneSec = &m_outputBytesLastOneSec;
-        nextMeasureFrames = &m_outputNextMeasureFrames;
-    }
-
-    InterlockedIncrement(processedFrames);
-    InterlockedExchangeAdd(bytesLastOneSec, (LONG)length);
-
-    ASSERT(bytesPerBlock != 0);
-    if (*processedFrames >= *nextMeasureFrames)
-    {
-        updated = true;
-        InterlockedExchangeAdd(nextMeasureFrames, packetsPerSec);
-        LONG bytesOneSec = InterlockedExchange(bytesLastOneSec, 0);
-        measuredSampleRate = bytesOneSec / bytesPerBlock;
+        measuredSampleRate = sampleRateMeter.GetSampleRate();
     }
     return updated;
 }
 
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+ULONGLONG
+StreamObject::GetMeasuredSampleRateQ16(
+    const bool input
+)
+{
+    return input ? m_inputSampleRateMeter.GetSampleRateQ16() : m_outputSampleRateMeter.GetSampleRateQ16();
+}
+
 _Use_decl_annotations_
 NONPAGED_CODE_SEG
 ULONG
@@ -515,7 +507,8 @@ StreamObject::CalculateTransferSizeAndSetURB(
 
         LONG  remainder = m_deviceContext->AudioProperty.SampleRate % m_deviceContext->AudioProperty.PacketsPerSec;
         ULONG rounded = m_deviceContext->AudioProperty.SamplesPerPacket * m_deviceContext->AudioProperty.PacketsPerSec;
-        if ((m_streamStatus & toInt(c_ioStable)) == (ULONG)toInt(c_ioStable) && m_deviceContext->AudioProperty.InputMeasuredSampleRate != 0)
+        // A rate from a partially filled window is too noisy for the drift correction.
+        if ((m_streamStatus & toInt(c_ioStable)) == (ULONG)toInt(c_ioStable) && m_deviceContext->AudioProperty.InputMeasuredSampleRate != 0 && m_inputSampleRateMeter.IsWindowFilled())
         {
             remainder = ((LONG)m_deviceContext->AudioProperty.InputMeasuredSampleRate - (LONG)rounded) % (LONG)m_deviceContext->AudioProperty.PacketsPerSec;
         }
@@ -532,7 +525,10 @@ StreamObject::CalculateTransferSizeAndSetURB(
                 {
                     ++m_compensateSamples;
                     --samples;
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "Frame %u Packet %u: compensating sample -1, %u samples.", startFrame, i, samples);
+                    if (m_deviceContext->EventTrace != nullptr)
+                    {
+                        m_deviceContext->EventTrace->Log(UACEventId::OutCompensated, startFrame, i, samples, -1);
+                    }
                 }
             }
             else if (m_outputRemainder + (LONG)m_deviceContext->AudioProperty.PacketsPerSec <= 0)
@@ -547,7 +543,10 @@ StreamObject::CalculateTransferSizeAndSetURB(
                 {
                     --m_compensateSamples;
                     ++samples;
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "Frame %u Packet %u: compensating sample +1, %u samples.", startFrame, i, samples);
+                    if (m_deviceContext->EventTrace != nullptr)
+                    {
+                        m_deviceContext->EventTrace->Log(UACEventId::OutCompensated, startFrame, i, samples, 1);
+                    }
                 }
             }
 
@@ -590,19 +589,39 @@ StreamObject::CalculateTransferSizeAndSetURB(
 
         ULONG remainSamples = static_cast<ULONG>(requiredSamples);
 
+        StreamPlatform::AcquireLock(m_positionSpinLock);
+        bool useRateEstimator = m_rateEstimator.IsActive();
+        if (useRateEstimator)
+        {
+            // The estimator tracks every sample sent, including the ones sent before the feedback was stable,
+            // so the compensation below is not needed.
+            remainSamples = m_rateEstimator.EstimateSamples(numPackets);
+            m_compensateSamples = 0;
+        }
+        StreamPlatform::ReleaseLock(m_positionSpinLock);
+
         if (m_compensateSamples != 0)
         {
             remainSamples = (ULONG)((LONG)remainSamples + m_compensateSamples);
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "compensating %d samples ", m_compensateSamples);
+            if (m_deviceContext->EventTrace != nullptr)
+            {
+                m_deviceContext->EventTrace->Log(UACEventId::OutCompensateTotal, m_compensateSamples);
+            }
             m_compensateSamples = 0;
         }
 
         ULONG limitSamplesPerPacket = min((m_deviceContext->AudioProperty.OutputMaxSamplesPerPacket), (m_deviceContext->AudioProperty.SamplesPerPacket + 1));
         if (remainSamples > limitSamplesPerPacket * numPackets)
         {
-            m_compensateSamples = remainSamples - (limitSamplesPerPacket * numPackets);
+            if (!useRateEstimator)
+            {
+                m_compensateSamples = remainSamples - (limitSamplesPerPacket * numPackets);
+            }
             // Packet size is limited so that packets larger than MaximumPacketSize are not sent.
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "transfer size (%d) exceeds limit (%d).", remainSamples, limitSamplesPerPacket * numPackets);
+            if (m_deviceContext->EventTrace != nullptr)
+            {
+                m_deviceContext->EventTrace->Log(UACEventId::OutTransferLimited, remainSamples, limitSamplesPerPacket * numPackets);
+            }
             remainSamples = limitSamplesPerPacket * numPackets;
         }
         transferSamples = remainSamples;
@@ -622,11 +641,17 @@ StreamObject::CalculateTransferSizeAndSetURB(
             ULONG packetSize = samples * m_deviceContext->AudioProperty.OutputBytesPerBlock;
             if ((samples < m_deviceContext->AudioProperty.SamplesPerPacket - 1) || (samples > m_deviceContext->AudioProperty.SamplesPerPacket + 1))
             {
-                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "Abnormal output packet size, %d samples, frame %u, iso packet %u.", samples, startFrame, i);
+                if (m_deviceContext->EventTrace != nullptr)
+                {
+                    m_deviceContext->EventTrace->Log(UACEventId::OutAbnormalPacket, startFrame, i, samples);
+                }
             }
             if (transferSize + packetSize > m_deviceContext->OutputInterfaceAndPipe.MaximumTransferSize)
             {
-                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "Transfer size exceeds limit, size %u bytes, limit %u bytes, frame %u, iso packet %u.", transferSize + packetSize, m_deviceContext->OutputInterfaceAndPipe.MaximumTransferSize, startFrame, i);
+                if (m_deviceContext->EventTrace != nullptr)
+                {
+                    m_deviceContext->EventTrace->Log(UACEventId::OutPacketDropped, startFrame, i, transferSize + packetSize, m_deviceContext->OutputInterfaceAndPipe.MaximumTransferSize);
+                }
                 packetSize = 0;
             }
             urb->UrbIsochronousTransfer.IsoPacket[i].Offset = transferSize;
@@ -635,22 +660,27 @@ StreamObject::CalculateTransferSizeAndSetURB(
             LONG packetsCount = InterlockedIncrement(syncPacketsCount);
             if (packetsCount == 1)
             {
-                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "output state changed from async to sync, frame %d.", startFrame);
+                if (m_deviceContext->EventTrace != nullptr)
+                {
+                    m_deviceContext->EventTrace->Log(UACEventId::OutSyncStarted, startFrame);
+                }
             }
         }
         m_outputSyncPosition += transferSize;
     }
-    if (m_deviceContext->UsbAudioConfiguration->hasInputIsochronousInterface())
+    if (m_deviceContext->AudioProperty.OutputBytesPerBlock != 0)
     {
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "initialized OUT URB. in sample %I64d, out sample %I64d, startFrame %d, %u bytes", inPosition / m_deviceContext->AudioProperty.InputBytesPerBlock, readPosition / m_deviceContext->AudioProperty.OutputBytesPerBlock, startFrame, transferSize);
+        // Samples that were actually sent, including clamped and zero length packets, are removed from the estimator's fill error.
+        StreamPlatform::AcquireLock(m_positionSpinLock);
+        m_rateEstimator.CommitSamples(transferSize / m_deviceContext->AudioProperty.OutputBytesPerBlock);
+        StreamPlatform::ReleaseLock(m_positionSpinLock);
     }
-    else
+    if (m_deviceContext->EventTrace != nullptr)
     {
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "initialized OUT URB. out sample %I64d, startFrame %d, %u bytes", readPosition / m_deviceContext->AudioProperty.OutputBytesPerBlock, startFrame, transferSize);
+        m_deviceContext->EventTrace->Log(UACEventId::OutUrbInitialized, startFrame, transferSize, numPackets, (LONG)(readPosition / m_deviceContext->AudioProperty.OutputBytesPerBlock));
     }
     m_outputReadPosition += transferSize;
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "transferSize = %u, read position = %llu", transferSize, m_outputReadPosition);
     return transferSize;
 }
 
@@ -667,12 +697,23 @@ StreamObject::CreateMixingEngineThread(
     PAGED_CODE();
 
     ASSERT(m_deviceContext != nullptr);
+
+    // The render thread is running before the mixing engine thread hands off the first packet.
+    if ((m_renderThread == nullptr) && m_deviceContext->SupportedControl.SplitRenderThread && m_deviceContext->UsbAudioConfiguration->hasOutputIsochronousInterface())
+    {
+        m_renderThread = new (POOL_FLAG_NON_PAGED, DRIVER_TAG) MixingEngineThread(m_deviceContext, 1000);
+        IF_TRUE_ACTION_JUMP(m_renderThread == nullptr, status = STATUS_INSUFFICIENT_RESOURCES, CreateMixingEngineThread_Exit);
+
+        status = m_renderThread->CreateThread(RenderThreadFunction, priority, wakeUpIntervalUs, WakeUpMode::Event);
+        IF_FAILED_JUMP(status, CreateMixingEngineThread_Exit);
+    }
+
     if (m_mixingEngineThread == nullptr)
     {
         m_mixingEngineThread = new (POOL_FLAG_NON_PAGED, DRIVER_TAG) MixingEngineThread(m_deviceContext, 1000);
         IF_TRUE_ACTION_JUMP(m_mixingEngineThread == nullptr, status = STATUS_INSUFFICIENT_RESOURCES, CreateMixingEngineThread_Exit);
 
-        status = m_mixingEngineThread->CreateThread(MixingEngineThreadFunction, priority, wakeUpIntervalUs);
+        status = m_mixingEngineThread->CreateThread(MixingEngineThreadFunction, priority, wakeUpIntervalUs, m_deviceContext->SupportedControl.DeadlineWakeUp ? WakeUpMode::Deadline : WakeUpMode::Periodic);
     }
 
 CreateMixingEngineThread_Exit:
@@ -695,6 +736,14 @@ void StreamObject::TerminateMixingEngineThread()
         m_mixingEngineThread = nullptr;
     }
 
+    // The mixing engine thread may wait for the render thread, so it is terminated first.
+    if (m_renderThread != nullptr)
+    {
+        m_renderThread->Terminate();
+        delete m_renderThread;
+        m_renderThread = nullptr;
+    }
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
 
@@ -705,7 +754,7 @@ void StreamObject::WakeupMixingEngineThread()
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
     if (m_mixingEngineThread != nullptr)
     {
-        m_mixingEngineThread->WakeUp();
+        StreamPlatform::WakeUp(m_mixingEngineThread);
     }
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
 }
@@ -721,7 +770,7 @@ NTSTATUS StreamObject::Wait()
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
     if (m_mixingEngineThread != nullptr)
     {
-        status = m_mixingEngineThread->Wait();
+        status = StreamPlatform::WaitForWakeUp(m_mixingEngineThread);
     }
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit %!STATUS!", status);
     return status;
@@ -733,7 +782,7 @@ StreamStatuses StreamObject::GetStreamStatuses(bool & isProcessIo)
 {
     StreamStatuses status;
 
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
 
     status = static_cast<StreamStatuses>(m_streamStatus);
     if (m_deviceContext->UsbAudioConfiguration->hasInputAndOutputIsochronousInterfaces())
@@ -745,7 +794,7 @@ StreamStatuses StreamObject::GetStreamStatuses(bool & isProcessIo)
         isProcessIo = true;
     }
 
-    WdfSpinLockRelease(m_positionSpinLock);
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 
     return status;
 }
@@ -756,11 +805,11 @@ StreamStatuses StreamObject::GetStreamStatuses()
 {
     StreamStatuses status;
 
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
 
     status = static_cast<StreamStatuses>(m_streamStatus);
 
-    WdfSpinLockRelease(m_positionSpinLock);
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 
     return status;
 }
@@ -800,7 +849,7 @@ void StreamObject::SaveStartPCUs()
 
     PAGED_CODE();
 
-    m_startPCUs = USBAudioAcxDriverStreamGetCurrentTimeUs(m_deviceContext, &currentTimePC);
+    m_startPCUs = StreamPlatform::QueryTimeUs(m_deviceContext, &currentTimePC);
     m_elapsedPCUs = 0ULL;
     m_wakeUpDiffPCUs = 0ULL;
     m_lastWakePCUs = 0ULL;
@@ -838,46 +887,15 @@ StreamObject::EstimateUSBBusTime(
     ULONG wakeupDiffPCUs
 )
 {
+    bool  isIllegalBusTime = false;
     ULONG usbBusTimeDiff = 0;
 
     PAGED_CODE();
 
-    if (IsFirstWakeUp())
-    {
-        // First loop
-        usbBusTimeDiff = 0;
-        m_usbBusTimeEstimated = 0;
-        m_usbBusTimePrev = usbBusTimeCurrent;
-    }
-    else if (m_usbBusTimeEstimated != 0)
+    usbBusTimeDiff = m_packetScheduler.EstimateUsbBusTime(IsFirstWakeUp(), usbBusTimeCurrent, wakeupDiffPCUs, m_deviceContext->ClassicFramesPerIrp, isIllegalBusTime);
+    if (isIllegalBusTime)
     {
-        // If an estimated value was used last time, measure the difference between the estimated value and the current value.
-        if ((usbBusTimeCurrent < m_usbBusTimeEstimated) || ((usbBusTimeCurrent - m_usbBusTimeEstimated) > m_deviceContext->ClassicFramesPerIrp))
-        {
-            // If the guessed value is wrong, erase it as a fixed value.
-            usbBusTimeDiff = 0;
-        }
-        else
-        {
-            usbBusTimeDiff = usbBusTimeCurrent - m_usbBusTimeEstimated;
-        }
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "USB bus time recovered, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
-        m_usbBusTimePrev = usbBusTimeCurrent;
-        m_usbBusTimeEstimated = 0;
-    }
-    else if ((usbBusTimeCurrent < m_usbBusTimePrev) || ((usbBusTimeCurrent - m_usbBusTimePrev) > m_deviceContext->ClassicFramesPerIrp))
-    {
-        // When an abnormal value is detected in BusTime,the elapsed time is estimated from Performance Counter.
-        usbBusTimeDiff = (wakeupDiffPCUs + 500) / 1000;
-        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "USB bus time error, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
         m_deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::IllegalBusTime, 0);
-        m_usbBusTimeEstimated = m_usbBusTimePrev + usbBusTimeDiff;
-    }
-    else
-    {
-        usbBusTimeDiff = usbBusTimeCurrent - m_usbBusTimePrev;
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "USB bus time is normal, current %x prev %x, assuming Tdiff %u", usbBusTimeCurrent, m_usbBusTimePrev, usbBusTimeDiff);
-        m_usbBusTimePrev = usbBusTimeCurrent;
     }
 
     return usbBusTimeDiff;
@@ -917,10 +935,10 @@ void StreamObject::GetCompletedPacket(
     LONGLONG & outCompletedPacket
 )
 {
-    WdfSpinLockAcquire(m_packetSpinLock);
+    StreamPlatform::AcquireLock(m_packetSpinLock);
     inCompletedPacket = m_inputCompletedPacket;
     outCompletedPacket = m_outputCompletedPacket;
-    WdfSpinLockRelease(m_packetSpinLock);
+    StreamPlatform::ReleaseLock(m_packetSpinLock);
 }
 
 _Use_decl_annotations_
@@ -935,7 +953,7 @@ void StreamObject::UpdateCompletedPacket(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, %s, %u, %u", isInput ? "Input" : "Output", numberOfPackets, index);
 
-    WdfSpinLockAcquire(m_packetSpinLock);
+    StreamPlatform::AcquireLock(m_packetSpinLock);
     if (isInput)
     {
         currentPacketNumber = (ULONG)((m_inputCompletedPacket / numberOfPackets) % m_deviceContext->Params.MaxIrpNumber);
@@ -950,7 +968,7 @@ void StreamObject::UpdateCompletedPacket(
             m_inputCompletedPacket = m_outputCompletedPacket;
         }
     }
-    WdfSpinLockRelease(m_packetSpinLock);
+    StreamPlatform::ReleaseLock(m_packetSpinLock);
 
     if (currentPacketNumber != index)
     {
@@ -969,42 +987,8 @@ void StreamObject::DeterminePacket(
 )
 {
     PAGED_CODE();
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, %llu, %u, %u", inCompletedPacket, usbBusTimeDiff, packetsPerIrp);
 
-    if (IsOverrideIgnoreEstimation())
-    {
-        // Ignore callback time calculations entirely and process all INs as soon as they are recognized
-        m_inputSyncPacket = m_inputEstimatedPacket = inCompletedPacket;
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
-    }
-    else if (m_inputSyncPacket == inCompletedPacket)
-    {
-        // If the number of INs completed has not changed since the previous loop,
-        // predict the position of the packet to be currently processed according to the USB bus time elapsed since the previous loop.
-        LONG packetRoom = (LONG)(m_inputSyncPacket - m_inputEstimatedPacket);
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  packetRoom %u, In sync packet %llu,  estimated packet %llu", packetRoom, m_inputSyncPacket, m_inputEstimatedPacket);
-        if (packetRoom > 0)
-        {
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  packetRoom %u, usb bus time diff %u, frames per ms %u", packetRoom, usbBusTimeDiff, m_deviceContext->FramesPerMs);
-            if (packetRoom > (LONG)(usbBusTimeDiff * m_deviceContext->FramesPerMs))
-            {
-                m_inputEstimatedPacket += usbBusTimeDiff * m_deviceContext->FramesPerMs;
-            }
-            else
-            {
-                m_inputEstimatedPacket += packetRoom;
-            }
-        }
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
-    }
-    else
-    {
-        // If an IN is found for the first time in this loop
-        m_inputSyncPacket = inCompletedPacket;
-        m_inputEstimatedPacket = m_inputSyncPacket - packetsPerIrp;
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " -  In sync packet %llu, estimated packet %llu, completed packet %llu", m_inputSyncPacket, m_inputEstimatedPacket, inCompletedPacket);
-    }
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+    m_packetScheduler.DeterminePacket(inCompletedPacket, usbBusTimeDiff, packetsPerIrp, m_deviceContext->FramesPerMs, IsOverrideIgnoreEstimation());
 }
 
 _Use_decl_annotations_
@@ -1016,9 +1000,10 @@ bool StreamObject::CreateCompletedInputPacketList(
     const ULONG      numIrp
 )
 {
-    bool  inProcessRemainder = false;
-    ULONG evaluatedPacketsCount = 0;
-    ULONG obtainedBuffersCount = 0;
+    bool           inProcessRemainder = false;
+    ULONG          evaluatedPacketsCount = 0;
+    ULONG          obtainedBuffersCount = 0;
+    const LONGLONG inputProcessedPacket = m_packetScheduler.GetInputProcessedPacket();
 
     PAGED_CODE();
     // TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
@@ -1037,8 +1022,8 @@ bool StreamObject::CreateCompletedInputPacketList(
         }
         else
         {
-            ULONG            irp = (ULONG)(((m_inputProcessedPacket + evaluatedPacketsCount) / packetsPerIrp) % numIrp);
-            ULONG            packet = (ULONG)((m_inputProcessedPacket + evaluatedPacketsCount) % packetsPerIrp);
+            ULONG            irp = (ULONG)(((inputProcessedPacket + evaluatedPacketsCount) / packetsPerIrp) % numIrp);
+            ULONG            packet = (ULONG)((inputProcessedPacket + evaluatedPacketsCount) % packetsPerIrp);
             TransferObject * transferObject = m_inputTransferObject[irp];
             // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - irp %u, transfer object %p", irp, transferObject);
             if (transferObject != nullptr)
@@ -1091,8 +1076,9 @@ bool StreamObject::CreateCompletedOutputPacketList(
         }
         else
         {
-            ULONG            irp = (ULONG)((m_outputProcessedPacket / packetsPerIrp) % numIrp);
-            ULONG            packet = (ULONG)(m_outputProcessedPacket % packetsPerIrp);
+            const LONGLONG   outputProcessedPacket = m_packetScheduler.GetOutputProcessedPacket();
+            ULONG            irp = (ULONG)((outputProcessedPacket / packetsPerIrp) % numIrp);
+            ULONG            packet = (ULONG)(outputProcessedPacket % packetsPerIrp);
             TransferObject * transferObject = m_outputTransferObject[irp];
             // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - irp %u, transfer object %p, index %d", irp, transferObject, (transferObject != nullptr)? transferObject->GetIndex(): -1);
             if (transferObject != nullptr)
@@ -1116,62 +1102,6 @@ bool StreamObject::CreateCompletedOutputPacketList(
     return outProcessRemainder;
 }
 
-_Use_decl_annotations_
-PAGED_CODE_SEG
-bool StreamObject::IsInputPacketAtEstimatedPosition(
-    _In_ ULONG inOffset
-)
-{
-    PAGED_CODE();
-
-    // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - In processed packet %llu, offset %u, estimated packet %llu", m_inputProcessedPacket, inOffset, m_inputEstimatedPacket);
-
-    return (m_inputProcessedPacket + inOffset) >= m_inputEstimatedPacket;
-}
-
-_Use_decl_annotations_
-PAGED_CODE_SEG
-bool StreamObject::IsOutputPacketOverlapWithEstimatePosition(
-    _In_ ULONG outLimit
-)
-{
-    PAGED_CODE();
-
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Out processed packet %llu, estimated packet %llu, out limit %u", m_outputProcessedPacket, m_inputEstimatedPacket, outLimit);
-
-    // Use Input m_inputEstimatedPacket
-    return m_outputProcessedPacket >= (m_inputEstimatedPacket + outLimit);
-}
-
-_Use_decl_annotations_
-PAGED_CODE_SEG
-bool StreamObject::IsOutputPacketAtEstimatedPosition()
-{
-    PAGED_CODE();
-
-    // TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Out processed packet %llu, estimated packet %llu, sync packet %llu, result %!bool!", m_outputProcessedPacket, m_inputEstimatedPacket, m_inputSyncPacket, m_outputProcessedPacket >= m_inputEstimatedPacket);
-    return m_outputProcessedPacket >= m_inputEstimatedPacket;
-}
-
-_Use_decl_annotations_
-PAGED_CODE_SEG
-void StreamObject::IncrementInputProcessedPacket(
-)
-{
-    PAGED_CODE();
-
-    m_inputProcessedPacket++;
-}
-
-_Use_decl_annotations_
-PAGED_CODE_SEG
-void StreamObject::IncrementOutputProcessedPacket()
-{
-    PAGED_CODE();
-
-    m_outputProcessedPacket++;
-}
-
 _Use_decl_annotations_
 NONPAGED_CODE_SEG
 bool StreamObject::CheckInputStability(
@@ -1184,7 +1114,7 @@ bool StreamObject::CheckInputStability(
 {
     ULONG transferredSamplesInThisIrp = transferredBytesInThisIrp / m_deviceContext->AudioProperty.InputBytesPerBlock;
 
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
     m_inputLastProcessedIrpIndex = index;
     m_inputCompletedPosition += transferredSamplesInThisIrp;
 
@@ -1196,13 +1126,13 @@ bool StreamObject::CheckInputStability(
             InterlockedOr(reinterpret_cast<volatile LONG *>(&m_streamStatus), toInt(StreamStatuses::InputStable));
             if ((m_streamStatus & toInt(StreamStatuses::OutputStable)) != 0)
             {
-                WdfSpinLockRelease(m_positionSpinLock);
+                StreamPlatform::ReleaseLock(m_positionSpinLock);
                 return false;
             }
         }
         else
         {
-            WdfSpinLockRelease(m_positionSpinLock);
+            StreamPlatform::ReleaseLock(m_positionSpinLock);
             return false;
         }
     }
@@ -1213,12 +1143,12 @@ bool StreamObject::CheckInputStability(
         if (((m_deviceContext->DeviceClass == USB_AUDIO_CLASS) || (m_deviceContext->DeviceProtocol == NS_USBAudio0200::AF_VERSION_02_00)) &&
             (transferredSamplesInThisIrp < numberOfPacketsInThisIrp))
         {
-            WdfSpinLockRelease(m_positionSpinLock);
+            StreamPlatform::ReleaseLock(m_positionSpinLock);
             // return STATUS_UNSUCCESSFUL;
             return false;
         }
     }
-    WdfSpinLockRelease(m_positionSpinLock);
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 
     return true;
 }
@@ -1227,11 +1157,15 @@ _Use_decl_annotations_
 NONPAGED_CODE_SEG
 void StreamObject::UpdatePositionsIn(ULONG length)
 {
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
     m_inputWritePosition += length;
     m_inputSyncPosition += length;
     ++m_inputValidPackets;
-    WdfSpinLockRelease(m_positionSpinLock);
+    if (m_deviceContext->AudioProperty.InputBytesPerBlock != 0)
+    {
+        m_rateEstimator.Update(((ULONGLONG)(length / m_deviceContext->AudioProperty.InputBytesPerBlock)) << 16, 1, false);
+    }
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 }
 
 _Use_decl_annotations_
@@ -1241,6 +1175,19 @@ ULONG StreamObject::UpdatePositionsFeedback(
     ULONG validFeedback
 )
 {
+    if (validFeedback != 0)
+    {
+        // Pass the raw feedback to the rate estimator in 16.16 format, before the integer part is taken.
+        ULONGLONG feedbackSumQ16 = ((ULONGLONG)feedbackSum) << (m_deviceContext->FeedbackProperty.FeedbackInterval - 1);
+        if (!((m_deviceContext->IsDeviceSuperSpeed && m_deviceContext->SuperSpeedCompatible) || (m_deviceContext->IsDeviceHighSpeed)))
+        {
+            feedbackSumQ16 <<= 2;
+        }
+        StreamPlatform::AcquireLock(m_positionSpinLock);
+        m_rateEstimator.Update(feedbackSumQ16, validFeedback << (m_deviceContext->FeedbackProperty.FeedbackInterval - 1), true);
+        StreamPlatform::ReleaseLock(m_positionSpinLock);
+    }
+
     feedbackSum <<= (m_deviceContext->FeedbackProperty.FeedbackInterval - 1);
     feedbackSum += m_feedbackRemainder;
     m_feedbackRemainder = 0;
@@ -1314,9 +1261,9 @@ void StreamObject::SetOutputStreaming(
             InterlockedOr(reinterpret_cast<volatile LONG *>(&m_streamStatus), toInt(StreamStatuses::OutputStreaming));
         }
     }
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
     m_outputLastProcessedIrpIndex = Index;
-    WdfSpinLockRelease(m_positionSpinLock);
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 }
 
 _Use_decl_annotations_
@@ -1325,11 +1272,11 @@ bool StreamObject::IsIoSteady()
 {
     bool isIoSteady = false;
 
-    WdfSpinLockAcquire(m_positionSpinLock);
+    StreamPlatform::AcquireLock(m_positionSpinLock);
 
     isIoSteady = (m_streamStatus == (ULONG)toInt(c_ioSteady));
 
-    WdfSpinLockRelease(m_positionSpinLock);
+    StreamPlatform::ReleaseLock(m_positionSpinLock);
 
     return isIoSteady;
 }
@@ -1501,40 +1448,71 @@ void StreamObject::MixingEngineThreadMain(
     LONGLONG      asioNotifyCount = 0LL;
     const bool    hasInputIsochronousInterface = m_deviceContext->UsbAudioConfiguration->hasInputIsochronousInterface();
     const bool    hasOutputIsochronousInterface = m_deviceContext->UsbAudioConfiguration->hasOutputIsochronousInterface();
+    const bool    deadlineWakeUp = m_deviceContext->SupportedControl.DeadlineWakeUp;
+    const bool    autoTuneOffsets = m_deviceContext->SupportedControl.AutoTuneOffsets && (m_deviceContext->OffsetTuner != nullptr);
+    const bool    predictOverload = m_deviceContext->SupportedControl.PredictOverload;
+    bool          renderPending = false; // The render thread has not completed the last handoff in time.
 
     PAGED_CODE();
 
+    m_wakeupScheduler.Reset(deviceContext->ClassicFramesPerIrp * 1000);
+    if (autoTuneOffsets)
+    {
+        deviceContext->OffsetTuner->Start(deviceContext->FramesPerMs, deviceContext->UsbLatency.InputOffsetFrame, deviceContext->UsbLatency.OutputOffsetFrame, deviceContext->UsbLatency.OutputMinOffsetFrame, (deviceContext->ClassicFramesPerIrp * (numIrp - 2) * deviceContext->FramesPerMs) - 1);
+    }
+
     for (;;)
     {
         NTSTATUS wakeupReason = STATUS_SUCCESS;
         bool     isProcessIo = false;
         wakeupReason = Wait();
 
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "MaxingEngineThreadMain() WakeUp reason = %d", static_cast<int>(wakeupReason));
-
         // If the wakeup result is an error, exit.
         if (!NT_SUCCESS(wakeupReason) || (wakeupReason == STATUS_WAIT_0) || IsTerminateStream())
         {
             break;
         }
 
+        // After a render timeout the render thread still owns m_outputBuffers, so
+        // the periods are skipped until it completes instead of stopping the stream.
+        if (renderPending)
+        {
+            if (!NT_SUCCESS(WaitForRenderThread(0)))
+            {
+                continue;
+            }
+            renderPending = false;
+            if ((m_renderHandoff.OutBuffersCount != 0) && (deviceContext->LatencyStatistics != nullptr))
+            {
+                deviceContext->LatencyStatistics->Record(UACLatencyHistogram::RenderProcessing, (LONG)m_renderHandoff.ProcessingTimeUs);
+            }
+        }
+
         // Get the current status of stream.
         StreamStatuses streamStatus = GetStreamStatuses(isProcessIo);
 
-        TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "GetStreamStatuses() %s, %d", isProcessIo ? "true" : "false", static_cast<int>(streamStatus));
+        if (deviceContext->EventTrace != nullptr)
+        {
+            deviceContext->EventTrace->Log(UACEventId::MixingEngineWakeUp, wakeupReason, isProcessIo ? 1 : 0, static_cast<LONG>(streamStatus));
+        }
 
         // Updated valid wake-up count.
         // Since timerExpired and ThreadWakeup are initialized and updated at the same time, they will be made common.
         IncrementWakeUpCount();
 
         // Gets highly accurate current time based on KeQueryPerformanceCounter.
-        currentTimePCUs = USBAudioAcxDriverStreamGetCurrentTimeUs(deviceContext, &currentTimePC);
+        currentTimePCUs = StreamPlatform::QueryTimeUs(deviceContext, &currentTimePC);
 
         SaveWakeUpTimePCUs(currentTimePCUs);
 
         ULONG pcDiffUs = static_cast<ULONG>(GetWakeUpDiffPCUs());
+        if (!IsFirstWakeUp() && (deviceContext->LatencyStatistics != nullptr))
+        {
+            deviceContext->LatencyStatistics->Record(UACLatencyHistogram::WakeupInterval, (LONG)pcDiffUs);
+        }
 
         LONG inElapsedTimeAfterDpc = 0;
+        bool dpcDropout = false;
 
         if (hasInputIsochronousInterface)
         {
@@ -1544,10 +1522,19 @@ void StreamObject::MixingEngineThreadMain(
         {
             inElapsedTimeAfterDpc = (LONG)((LONGLONG)currentTimePCUs - m_outputIsoRequestCompletionTime.LastTimeUs);
         }
+        if (deviceContext->LatencyStatistics != nullptr)
+        {
+            deviceContext->LatencyStatistics->Record(UACLatencyHistogram::DpcToThread, inElapsedTimeAfterDpc);
+        }
 
         if ((m_deviceContext->AsioBufferObject != nullptr) && m_deviceContext->AsioBufferObject->IsRecBufferReady() && m_deviceContext->AsioBufferObject->IsRecHeaderRegistered() && (asioNotifyCount > 1))
         {
             ULONG thresholdUs = CalculateDropoutThresholdTime();
+            // A prediction is only reported to the client. OffsetTuner grows the offsets on measured near-misses and dropouts only.
+            if (predictOverload && m_deviceContext->OverloadPredictor->Update(UACOverloadSignal::DpcLateness, inElapsedTimeAfterDpc, (LONG)thresholdUs))
+            {
+                m_deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadPredicted);
+            }
             if (inElapsedTimeAfterDpc > (LONG)thresholdUs)
             {
 #ifdef BUFFER_THREAD_STATISTICS
@@ -1557,11 +1544,12 @@ void StreamObject::MixingEngineThreadMain(
 #endif
                 m_deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
                 m_deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedInDPC, (ULONG)(inElapsedTimeAfterDpc - thresholdUs));
+                dpcDropout = true;
             }
         }
         // Use WdfUsbTargetDeviceRetrieveCurrentFrameNumber() instead of USB_BUS_INTERFACE_USBDI_V1::QueryBusTime().
         // Use USB bus time for control
-        ULONG usbBusTimeCurrent = GetCurrentFrame(deviceContext);
+        ULONG usbBusTimeCurrent = StreamPlatform::QueryUsbFrame(deviceContext);
 
         // Guess USB bus time so that you can respond even if the obtained USB bus time is an abnormal value.
         ULONG usbBusTimeDiff = EstimateUSBBusTime(usbBusTimeCurrent, pcDiffUs);
@@ -1588,7 +1576,15 @@ void StreamObject::MixingEngineThreadMain(
                     outputReadyInThisPeriod = true;
                     prevClientProcessingTimeUs = curClientProcessingTimeUs;
                     curClientProcessingTimeUs = m_asioElapsedTimeUs;
+                    if (deviceContext->LatencyStatistics != nullptr)
+                    {
+                        deviceContext->LatencyStatistics->Record(UACLatencyHistogram::ClientProcessing, curClientProcessingTimeUs);
+                    }
                     LONG thresholdUs = (LONG)((deviceContext->AsioBufferObject->GetBufferPeriod()) * 1000000 / deviceContext->AudioProperty.SampleRate) + 1500;
+                    if (predictOverload && deviceContext->OverloadPredictor->Update(UACOverloadSignal::ClientProcessing, curClientProcessingTimeUs, thresholdUs))
+                    {
+                        deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadPredicted);
+                    }
                     if (curClientProcessingTimeUs > thresholdUs)
                     {
                         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "dropout detected. long client processing time %d us, threshold %d us", curClientProcessingTimeUs, thresholdUs);
@@ -1604,7 +1600,7 @@ void StreamObject::MixingEngineThreadMain(
         }
 
         // Analyze and decide which packets to use.
-        // The determined packet will be recorded in StreamObject::m_inputEstimatedPacket.
+        // The determined packet will be recorded in PacketScheduler::m_inputEstimatedPacket.
         DeterminePacket(inCompletedPacket, usbBusTimeDiff, packetsPerIrp);
 
         // Counts packets for which isochronous IN processing has been completed and creates a list.
@@ -1623,7 +1619,7 @@ void StreamObject::MixingEngineThreadMain(
             {
                 ULONG inOffset = deviceContext->UsbLatency.InputOffsetFrame;
 
-                if (IsInputPacketAtEstimatedPosition(inOffset))
+                if (m_packetScheduler.IsInputPacketAtEstimatedPosition(inOffset))
                 {
                     // Processing position reaches current position prediction
                     inLoopExitReason = PacketLoopReason::ExitLoopPacketEstimateReached;
@@ -1642,28 +1638,14 @@ void StreamObject::MixingEngineThreadMain(
                         inLoopExitReason = PacketLoopReason::ExitLoopNoMoreAsioBuffers;
                         break;
                     }
-                    if (asioRemainBytes < (LONG)m_inputBuffers[inBuffersCount].Length)
-                    {
-                        // ASIO buffer boundary reached
-                        inRemainder.Irp = m_inputBuffers[inBuffersCount].Irp;
-                        inRemainder.Packet = m_inputBuffers[inBuffersCount].Packet;
-                        inRemainder.PacketId = m_inputBuffers[inBuffersCount].PacketId;
-                        inRemainder.Length = m_inputBuffers[inBuffersCount].Length - asioRemainBytes;
-                        inRemainder.Buffer = m_inputBuffers[inBuffersCount].Buffer;
-                        inRemainder.TransferObject = m_inputBuffers[inBuffersCount].TransferObject;
-                        inRemainder.Offset = asioRemainBytes;
-                        m_inputBuffers[inBuffersCount].Length = asioRemainBytes;
-                    }
-                    else
-                    {
-                        inRemainder.Buffer = nullptr;
-                    }
+                    // If the ASIO buffer boundary is reached, the rest of the packet is recorded in inRemainder.
+                    (void)PacketScheduler::SplitAtAsioBoundary(m_inputBuffers[inBuffersCount], inRemainder, asioRemainBytes);
                     m_inputAsioBufferedPosition += m_inputBuffers[inBuffersCount].Length / deviceContext->AudioProperty.InputBytesPerBlock;
                 }
 
                 if (inBuffersCount != 0 || !inProcessRemainder)
                 {
-                    IncrementInputProcessedPacket();
+                    m_packetScheduler.IncrementInputProcessedPacket();
                 }
 
                 if (m_inputBuffers[inBuffersCount].Length > (deviceContext->AudioProperty.InputMaxSamplesPerPacket * deviceContext->AudioProperty.InputBytesPerBlock))
@@ -1716,7 +1698,7 @@ void StreamObject::MixingEngineThreadMain(
                 {
                     // input enable
                     ULONG outLimit = (((deviceContext->Params.MaxIrpNumber - 1) * deviceContext->ClassicFramesPerIrp) * deviceContext->FramesPerMs);
-                    if (IsOutputPacketOverlapWithEstimatePosition(outLimit))
+                    if (m_packetScheduler.IsOutputPacketOverlapWithEstimatePosition(outLimit))
                     {
                         // Prevents OUT processing from going around once the buffer and reaching the currently processed position
                         outLoopExitReason = PacketLoopReason::ExitLoopToPreventOutOverlap;
@@ -1726,7 +1708,7 @@ void StreamObject::MixingEngineThreadMain(
                 else
                 {
                     // input disable
-                    if (IsOutputPacketAtEstimatedPosition())
+                    if (m_packetScheduler.IsOutputPacketAtEstimatedPosition())
                     {
                         // Processing position reaches current position prediction
                         outLoopExitReason = PacketLoopReason::ExitLoopPacketEstimateReached;
@@ -1738,36 +1720,20 @@ void StreamObject::MixingEngineThreadMain(
                 if (handleAsioBuffer && hasOutputIsochronousInterface)
                 {
                     LONG asioRemain = (LONG)((playReadyPosition - m_outputAsioBufferedPosition) * deviceContext->AudioProperty.OutputBytesPerBlock);
+                    if (asioRemain <= 0)
                     {
-                        if (asioRemain <= 0)
-                        {
-                            // No more ASIO buffers to process
-                            outLoopExitReason = PacketLoopReason::ExitLoopNoMoreAsioBuffers;
-                            break;
-                        }
-                        if (asioRemain < (LONG)m_outputBuffers[outBuffersCount].Length)
-                        {
-                            // ASIO buffer boundary reached
-                            outRemainder.Irp = m_outputBuffers[outBuffersCount].Irp;
-                            outRemainder.Packet = m_outputBuffers[outBuffersCount].Packet;
-                            outRemainder.PacketId = m_outputBuffers[outBuffersCount].PacketId;
-                            outRemainder.Length = m_outputBuffers[outBuffersCount].Length - asioRemain;
-                            outRemainder.Buffer = m_outputBuffers[outBuffersCount].Buffer;
-                            outRemainder.TransferObject = m_outputBuffers[outBuffersCount].TransferObject;
-                            outRemainder.Offset = asioRemain;
-                            m_outputBuffers[outBuffersCount].Length = asioRemain;
-                        }
-                        else
-                        {
-                            outRemainder.Buffer = nullptr;
-                        }
+                        // No more ASIO buffers to process
+                        outLoopExitReason = PacketLoopReason::ExitLoopNoMoreAsioBuffers;
+                        break;
                     }
+                    // If the ASIO buffer boundary is reached, the rest of the packet is recorded in outRemainder.
+                    (void)PacketScheduler::SplitAtAsioBoundary(m_outputBuffers[outBuffersCount], outRemainder, asioRemain);
                     m_outputAsioBufferedPosition += m_outputBuffers[outBuffersCount].Length / deviceContext->AudioProperty.OutputBytesPerBlock;
                 }
 
                 if (outBuffersCount != 0 || !outProcessRemainder)
                 {
-                    IncrementOutputProcessedPacket();
+                    m_packetScheduler.IncrementOutputProcessedPacket();
                 }
 
                 ++outBuffersCount;
@@ -1812,7 +1778,7 @@ void StreamObject::MixingEngineThreadMain(
         }
 
         ULONG dpcOffset = deviceContext->ClassicFramesPerIrp * deviceContext->FramesPerMs;
-        LONG  safetyOffset = (LONG)(m_outputProcessedPacket - m_inputProcessedPacket) - (LONG)deviceContext->UsbLatency.InputOffsetFrame - (LONG)(dpcOffset);
+        LONG  safetyOffset = m_packetScheduler.CalculateSafetyOffset(deviceContext->UsbLatency.InputOffsetFrame, dpcOffset);
         if (safetyOffset < (LONG)(outMinOffsetFrame) &&
             deviceContext->AsioBufferObject != nullptr && deviceContext->AsioBufferObject->IsRecHeaderRegistered() &&
             (hasOutputIsochronousInterface && hasInputIsochronousInterface))
@@ -1822,6 +1788,25 @@ void StreamObject::MixingEngineThreadMain(
             deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedSafetyOffset, 0);
         }
 
+        if (autoTuneOffsets && isProcessIo && (streamStatus == c_ioSteady))
+        {
+            if (deviceContext->OffsetTuner->Update(currentTimePCUs, inElapsedTimeAfterDpc, dpcDropout, hasOutputIsochronousInterface && hasInputIsochronousInterface, safetyOffset - (LONG)outMinOffsetFrame))
+            {
+                // The running stream keeps its offsets. StartIsoStream applies the new ones at the next stream start.
+                UpdateTunedOffsets(deviceContext, deviceContext->OffsetTuner->GetInputOffsetFrame(), deviceContext->OffsetTuner->GetOutputOffsetFrame());
+            }
+        }
+
+        // In the split mode, the render thread writes the output packets while this thread processes the input packets.
+        bool renderHandedOff = false;
+        if (hasOutputIsochronousInterface && (m_renderThread != nullptr) && (outBuffersCount != 0))
+        {
+            HandOffOutputBuffers(outBuffersCount, streamStatus, handleAsioBuffer);
+            renderHandedOff = true;
+        }
+
+        ULONGLONG captureStartPCUs = StreamPlatform::QueryTimeUs(deviceContext, nullptr);
+
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - In buffers count %u, ioStable 0x%x, inLoopExitReason %u", inBuffersCount, static_cast<ULONG>(streamStatus), static_cast<ULONG>(inLoopExitReason));
         if ((streamStatus == c_ioSteady) && hasInputIsochronousInterface)
         {
@@ -1860,64 +1845,52 @@ void StreamObject::MixingEngineThreadMain(
                 }
             }
         }
-        ULONG bytesPerBlock = deviceContext->AudioProperty.OutputBytesPerBlock;
+        if ((inBuffersCount != 0) && (deviceContext->LatencyStatistics != nullptr))
+        {
+            deviceContext->LatencyStatistics->Record(UACLatencyHistogram::CaptureProcessing, (LONG)(StreamPlatform::QueryTimeUs(deviceContext, nullptr) - captureStartPCUs));
+        }
 
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - Out buffers count %u, ioStable 0x%x, outLoopExitReason %u", outBuffersCount, static_cast<int>(streamStatus), static_cast<ULONG>(outLoopExitReason));
 
         if (hasOutputIsochronousInterface)
         {
-            for (ULONG bufIndex = 0; bufIndex < outBuffersCount; ++bufIndex)
+            if (renderHandedOff)
             {
-                ULONG  transferSize = m_outputBuffers[bufIndex].Length;
-                PUCHAR outBufferStart = m_outputBuffers[bufIndex].Buffer + m_outputBuffers[bufIndex].Offset;
-                ULONG  outChannels = deviceContext->OutputUsbChannels;
-                ULONG  samples = transferSize / bytesPerBlock;
-
-                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - outputBuffers[%u] Irp, Packet, PacketID, TransferObject, Index, %u, %u, %u, %p, %u, %llu, %lld", bufIndex, m_outputBuffers[bufIndex].Irp, m_outputBuffers[bufIndex].Packet, m_outputBuffers[bufIndex].PacketId, m_outputBuffers[bufIndex].TransferObject, m_outputBuffers[bufIndex].TransferObject->GetIndex(), m_outputBuffers[bufIndex].TransferObject->GetQPCPosition(), (bufIndex == 0) ? 0LL : (LONGLONG)(m_outputBuffers[bufIndex].TransferObject->GetQPCPosition()) - (LONGLONG)(m_outputBuffers[bufIndex - 1].TransferObject->GetQPCPosition()));
-
-                StreamObject::ClearOutputBuffer(deviceContext->AudioProperty.CurrentSampleFormat, outBufferStart, outChannels, bytesPerBlock, samples);
-                if (streamStatus == c_ioSteady)
+                // The output of this period must be read from the ASIO buffer before the notification below.
+                if (!NT_SUCCESS(WaitForRenderThread(c_renderThreadTimeoutUs)))
                 {
-                    if (handleAsioBuffer)
-                    {
-                        if (!NT_SUCCESS(deviceContext->AsioBufferObject->CopyFromAsioToOutputData(
-                                outBufferStart,
-                                transferSize,
-                                bytesPerBlock,
-                                deviceContext->AudioProperty.OutputBytesPerSample
-                            )))
-                        {
-                            StreamObject::ClearOutputBuffer(deviceContext->AudioProperty.CurrentSampleFormat, outBufferStart, outChannels, bytesPerBlock, samples);
-                        }
-                    }
-
-                    if (deviceContext->RtPacketObject != nullptr)
+                    TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE, "render thread did not complete %u out buffers within %uus.", outBuffersCount, c_renderThreadTimeoutUs);
+                    if (deviceContext->AsioBufferObject != nullptr)
                     {
-                        for (ULONG deviceIndex = 0; deviceIndex < deviceContext->NumOfOutputDevices; deviceIndex++)
-                        {
-                            if (deviceContext->RenderStreamEngine[deviceIndex] != nullptr)
-                            {
-                                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - buffer index %u, transfer object %p", bufIndex, m_outputBuffers[bufIndex].TransferObject);
-                                deviceContext->RtPacketObject->CopyFromRtPacketToOutputData(
-                                    deviceIndex,
-                                    outBufferStart,
-                                    transferSize,
-                                    m_outputBuffers[bufIndex].TotalProcessedBytesSoFar,
-                                    m_outputBuffers[bufIndex].TransferObject,
-                                    deviceContext->AudioProperty.OutputBytesPerSample /* ex: 3 */,
-                                    deviceContext->AudioProperty.OutputValidBitsPerSample /* ex: 24*/,
-                                    deviceContext->OutputUsbChannels
-                                );
-                            }
-                        }
+                        deviceContext->AsioBufferObject->SetRecDeviceStatus(DeviceStatuses::OverloadDetected);
                     }
+                    deviceContext->ErrorStatistics->LogErrorOccurrence(ErrorStatus::DropoutDetectedElapsedTime, c_renderThreadTimeoutUs);
+                    renderPending = true;
+                }
+                else if (deviceContext->LatencyStatistics != nullptr)
+                {
+                    deviceContext->LatencyStatistics->Record(UACLatencyHistogram::RenderProcessing, (LONG)m_renderHandoff.ProcessingTimeUs);
+                }
+            }
+            else
+            {
+                ULONG renderProcessingTimeUs = RenderOutputBuffers(deviceContext, outBuffersCount, streamStatus, handleAsioBuffer);
+                if ((outBuffersCount != 0) && (deviceContext->LatencyStatistics != nullptr))
+                {
+                    deviceContext->LatencyStatistics->Record(UACLatencyHistogram::RenderProcessing, (LONG)renderProcessingTimeUs);
                 }
             }
         }
-        if (deviceContext->AsioBufferObject != nullptr && deviceContext->AsioBufferObject->IsRecBufferReady())
+        // The ASIO client is not notified while the output of this period may still be read from its buffer.
+        if (!renderPending && (deviceContext->AsioBufferObject != nullptr) && deviceContext->AsioBufferObject->IsRecBufferReady())
         {
+            deviceContext->AsioBufferObject->SetMeasuredSampleRate(GetMeasuredSampleRateQ16(true), GetMeasuredSampleRateQ16(false));
             if (deviceContext->AsioBufferObject->EvaluatePositionAndNotifyIfNeeded(currentTimePCUs, lastAsioNotifyPCUs, asioNotifyCount, prevAsioMeasuredPeriodUs, curClientProcessingTimeUs, curAsioMeasuredPeriodUs, hasInputIsochronousInterface, hasOutputIsochronousInterface))
             {
+                if ((asioNotifyCount != 0) && (deviceContext->LatencyStatistics != nullptr))
+                {
+                    deviceContext->LatencyStatistics->Record(UACLatencyHistogram::AsioNotifyPeriod, curAsioMeasuredPeriodUs);
+                }
                 m_asioElapsedTimeUs = 0;
                 prevAsioMeasuredPeriodUs = curAsioMeasuredPeriodUs;
                 lastAsioNotifyPCUs = currentTimePCUs;
@@ -1934,7 +1907,198 @@ void StreamObject::MixingEngineThreadMain(
             }
         }
         // LastBusTime = usbBusTimeCurrent;
+
+        m_wakeupScheduler.RecordWakeUp(currentTimePCUs, usbBusTimeCurrent, (inBuffersCount != 0) || (outBuffersCount != 0));
+        if (deadlineWakeUp)
+        {
+            // Sleep until the next packet can be processed or the ASIO buffer boundary is reached.
+            LONG asioRemainSamples = 0;
+            if (handleAsioBuffer)
+            {
+                asioRemainSamples = (LONG)((m_asioReadyPosition + deviceContext->AsioBufferObject->GetBufferPeriod()) - (hasInputIsochronousInterface ? m_inputAsioBufferedPosition : m_outputAsioBufferedPosition));
+            }
+            ULONGLONG lastCompletionTimeUs = hasInputIsochronousInterface ? m_inputIsoRequestCompletionTime.LastTimeUs : m_outputIsoRequestCompletionTime.LastTimeUs;
+            ULONG     dueTimeUs = m_wakeupScheduler.CalculateNextWakeUp(StreamPlatform::QueryTimeUs(deviceContext, nullptr), lastCompletionTimeUs, m_packetScheduler.GetInputPacketRoom() > 0, asioRemainSamples, deviceContext->AudioProperty.SampleRate);
+            StreamPlatform::ArmWakeUp(m_mixingEngineThread, dueTimeUs);
+        }
     }
+    m_wakeupScheduler.Report();
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
     return;
 }
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::RenderThreadFunction(
+    _In_ PDEVICE_CONTEXT deviceContext
+)
+{
+    StreamObject * streamObject = deviceContext->StreamObject;
+
+    PAGED_CODE();
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry");
+
+    ASSERT(streamObject != nullptr);
+    ASSERT(streamObject->m_deviceContext == deviceContext);
+
+    streamObject->RenderThreadMain(deviceContext);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::RenderThreadMain(
+    _In_ PDEVICE_CONTEXT deviceContext
+)
+/*++
+
+Routine Description:
+
+    Writes the output packets handed off by the mixing engine thread.
+    The thread is only woken up by the handoff and its own timer, and it
+    never touches the packet scheduler, so the positions of the stream are
+    still owned by the mixing engine thread.
+
+--*/
+{
+    PAGED_CODE();
+
+    for (;;)
+    {
+        NTSTATUS wakeupReason = StreamPlatform::WaitForWakeUp(m_renderThread);
+
+        if (!NT_SUCCESS(wakeupReason) || (wakeupReason == STATUS_WAIT_0))
+        {
+            break;
+        }
+
+        // Nothing to do when the thread is woken up by its timer.
+        LONG requestSequence = ReadAcquire(&m_renderHandoff.RequestSequence);
+        if (requestSequence == ReadNoFence(&m_renderHandoff.DoneSequence))
+        {
+            continue;
+        }
+
+        m_renderHandoff.ProcessingTimeUs = RenderOutputBuffers(deviceContext, m_renderHandoff.OutBuffersCount, m_renderHandoff.StreamStatus, m_renderHandoff.HandleAsioBuffer);
+
+        // The release store keeps the writes to the packets and the processing time before the sequence.
+        WriteRelease(&m_renderHandoff.DoneSequence, requestSequence);
+        StreamPlatform::SignalEvent(m_renderDoneEvent);
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Exit");
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void StreamObject::HandOffOutputBuffers(
+    ULONG          outBuffersCount,
+    StreamStatuses streamStatus,
+    bool           handleAsioBuffer
+)
+{
+    PAGED_CODE();
+
+    ASSERT(m_renderThread != nullptr);
+    ASSERT(ReadNoFence(&m_renderHandoff.RequestSequence) == ReadNoFence(&m_renderHandoff.DoneSequence));
+
+    m_renderHandoff.OutBuffersCount = outBuffersCount;
+    m_renderHandoff.StreamStatus = streamStatus;
+    m_renderHandoff.HandleAsioBuffer = handleAsioBuffer;
+
+    // InterlockedIncrement is a full barrier, so the render thread sees m_outputBuffers
+    // and the fields above once it sees the new sequence.
+    InterlockedIncrement(&m_renderHandoff.RequestSequence);
+    StreamPlatform::WakeUp(m_renderThread);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS StreamObject::WaitForRenderThread(
+    ULONG timeoutUs
+)
+{
+    const LONG requestSequence = ReadNoFence(&m_renderHandoff.RequestSequence);
+
+    PAGED_CODE();
+
+    // The event may still be signaled by an earlier handoff, so the sequence decides.
+    while (ReadAcquire(&m_renderHandoff.DoneSequence) != requestSequence)
+    {
+        if (StreamPlatform::WaitForEvent(m_renderDoneEvent, timeoutUs) == STATUS_TIMEOUT)
+        {
+            return STATUS_IO_TIMEOUT;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG StreamObject::RenderOutputBuffers(
+    PDEVICE_CONTEXT deviceContext,
+    ULONG           outBuffersCount,
+    StreamStatuses  streamStatus,
+    bool            handleAsioBuffer
+)
+{
+    ULONG     bytesPerBlock = deviceContext->AudioProperty.OutputBytesPerBlock;
+    ULONGLONG renderStartPCUs = StreamPlatform::QueryTimeUs(deviceContext, nullptr);
+
+    PAGED_CODE();
+
+    for (ULONG bufIndex = 0; bufIndex < outBuffersCount; ++bufIndex)
+    {
+        ULONG  transferSize = m_outputBuffers[bufIndex].Length;
+        PUCHAR outBufferStart = m_outputBuffers[bufIndex].Buffer + m_outputBuffers[bufIndex].Offset;
+        ULONG  outChannels = deviceContext->OutputUsbChannels;
+        ULONG  samples = transferSize / bytesPerBlock;
+
+        // When the iso buffer is write-combined, the packet is mixed in a cached
+        // staging buffer and published to the iso buffer at the end.
+        PUCHAR stagingBuffer = (deviceContext->ContiguousMemory != nullptr) ? deviceContext->ContiguousMemory->GetStagingBuffer(transferSize) : nullptr;
+        PUCHAR mixBuffer = (stagingBuffer != nullptr) ? stagingBuffer : outBufferStart;
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - outputBuffers[%u] Irp, Packet, PacketID, TransferObject, Index, %u, %u, %u, %p, %u, %llu, %lld", bufIndex, m_outputBuffers[bufIndex].Irp, m_outputBuffers[bufIndex].Packet, m_outputBuffers[bufIndex].PacketId, m_outputBuffers[bufIndex].TransferObject, m_outputBuffers[bufIndex].TransferObject->GetIndex(), m_outputBuffers[bufIndex].TransferObject->GetQPCPosition(), (bufIndex == 0) ? 0LL : (LONGLONG)(m_outputBuffers[bufIndex].TransferObject->GetQPCPosition()) - (LONGLONG)(m_outputBuffers[bufIndex - 1].TransferObject->GetQPCPosition()));
+
+        StreamObject::ClearOutputBuffer(deviceContext->AudioProperty.CurrentSampleFormat, mixBuffer, outChannels, bytesPerBlock, samples);
+        if (streamStatus == c_ioSteady)
+        {
+            if (handleAsioBuffer)
+            {
+                if (!NT_SUCCESS(deviceContext->AsioBufferObject->CopyFromAsioToOutputData(
+                        mixBuffer,
+                        transferSize,
+                        bytesPerBlock,
+                        deviceContext->AudioProperty.OutputBytesPerSample
+                    )))
+                {
+                    StreamObject::ClearOutputBuffer(deviceContext->AudioProperty.CurrentSampleFormat, mixBuffer, outChannels, bytesPerBlock, samples);
+                }
+            }
+
+            if (deviceContext->RtPacketObject != nullptr)
+            {
+                // All the render devices are mixed in a single pass over the packet.
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - buffer index %u, transfer object %p", bufIndex, m_outputBuffers[bufIndex].TransferObject);
+                deviceContext->RtPacketObject->MixRtPacketsToOutputData(
+                    mixBuffer,
+                    transferSize,
+                    m_outputBuffers[bufIndex].TotalProcessedBytesSoFar,
+                    m_outputBuffers[bufIndex].TransferObject,
+                    deviceContext->AudioProperty.OutputBytesPerSample /* ex: 3 */,
+                    deviceContext->AudioProperty.OutputValidBitsPerSample /* ex: 24*/,
+                    deviceContext->OutputUsbChannels
+                );
+            }
+        }
+        if (stagingBuffer != nullptr)
+        {
+            IsoBufferSlab::Publish(outBufferStart, stagingBuffer, transferSize);
+        }
+    }
+
+    return (ULONG)(StreamPlatform::QueryTimeUs(deviceContext, nullptr) - renderStartPCUs);
+}
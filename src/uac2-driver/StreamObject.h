@@ -27,6 +27,11 @@ Environment:
 #define _STREAMOBJECT_H_
 
 #include "MixingEngineThread.h"
+#include "StreamPlatform.h"
+#include "PacketScheduler.h"
+#include "WakeupScheduler.h"
+#include "RateEstimator.h"
+#include "SampleRateMeter.h"
 
 enum class StreamStatuses
 {
@@ -58,19 +63,24 @@ enum class PacketLoopReason
     ExitLoopToPreventOutOverlap,    // Prevents OUT processing from going around once the buffer and reaching the currently processed position
 };
 
-typedef struct BUFFER_PROPERTY_
+//
+// Output packets handed from the mixing engine thread to the render thread.
+// The mixing engine thread fills the fields and m_outputBuffers, then
+// increments RequestSequence. The render thread stores the same value to
+// DoneSequence once the packets are written, which is the only
+// synchronization between the two threads. ProcessingTimeUs is written by
+// the render thread before DoneSequence, and read by the mixing engine
+// thread after it.
+//
+typedef struct RENDER_HANDOFF_
 {
-    ULONG Irp;
-    ULONG Packet;
-    ULONG PacketId;
-    // PUCHAR Header;
-    PUCHAR Buffer;
-    // bool   Completed;
-    ULONG            Offset; // Usually 0, but when an ASIO buffer boundary is reached, the number of bytes up to the boundary is filled in.
-    ULONG            Length;
-    ULONG            TotalProcessedBytesSoFar;
-    TransferObject * TransferObject;
-} BUFFER_PROPERTY, *PBUFFER_PROPERTY;
+    volatile LONG  RequestSequence;
+    volatile LONG  DoneSequence;
+    ULONG          OutBuffersCount;
+    StreamStatuses StreamStatus;
+    bool           HandleAsioBuffer;
+    ULONG          ProcessingTimeUs;
+} RENDER_HANDOFF;
 
 typedef struct UAC_STREAM_STATISTICS_
 {
@@ -209,12 +219,17 @@ class StreamObject
     _Success_(return == TRUE)
     bool CalculateSampleRate(
         _In_ const bool        isInput,
-        _In_ const ULONG       bytesPerBlock,
-        _In_ const ULONG       packetsPerSec,
         _In_ const ULONG       length,
         _Out_ volatile ULONG & measuredSampleRate
     );
 
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    ULONGLONG
+    GetMeasuredSampleRateQ16(
+        _In_ const bool isInput
+    );
+
     __drv_maxIRQL(DISPATCH_LEVEL)
     NONPAGED_CODE_SEG
     ULONG
@@ -432,33 +447,6 @@ class StreamObject
         _In_ const ULONG                                                                      numIrp
     );
 
-    __drv_maxIRQL(PASSIVE_LEVEL)
-    PAGED_CODE_SEG
-    bool
-    IsInputPacketAtEstimatedPosition(
-        _In_ ULONG inOffset
-    );
-
-    __drv_maxIRQL(PASSIVE_LEVEL)
-    PAGED_CODE_SEG
-    bool
-    IsOutputPacketOverlapWithEstimatePosition(
-        _In_ ULONG inOffset
-    );
-
-    __drv_maxIRQL(PASSIVE_LEVEL)
-    PAGED_CODE_SEG
-    bool
-    IsOutputPacketAtEstimatedPosition();
-
-    __drv_maxIRQL(PASSIVE_LEVEL)
-    PAGED_CODE_SEG
-    void IncrementInputProcessedPacket();
-
-    __drv_maxIRQL(PASSIVE_LEVEL)
-    PAGED_CODE_SEG
-    void IncrementOutputProcessedPacket();
-
     __drv_maxIRQL(DISPATCH_LEVEL)
     NONPAGED_CODE_SEG
     ULONG CalculateDropoutThresholdTime();
@@ -492,12 +480,54 @@ class StreamObject
         _In_ PDEVICE_CONTEXT deviceContext
     );
 
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void RenderThreadFunction(
+        _In_ PDEVICE_CONTEXT deviceContext
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void RenderThreadMain(
+        _In_ PDEVICE_CONTEXT deviceContext
+    );
+
+    // Returns the time spent in microseconds. The caller records it, so that
+    // LatencyStatistics is only written by the mixing engine thread.
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG RenderOutputBuffers(
+        _In_ PDEVICE_CONTEXT deviceContext,
+        _In_ ULONG           outBuffersCount,
+        _In_ StreamStatuses  streamStatus,
+        _In_ bool            handleAsioBuffer
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void HandOffOutputBuffers(
+        _In_ ULONG          outBuffersCount,
+        _In_ StreamStatuses streamStatus,
+        _In_ bool           handleAsioBuffer
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS WaitForRenderThread(
+        _In_ ULONG timeoutUs
+    );
+
     const PDEVICE_CONTEXT m_deviceContext;
 
     TransferObject *     m_inputTransferObject[UAC_MAX_IRP_NUMBER]{};
     TransferObject *     m_outputTransferObject[UAC_MAX_IRP_NUMBER]{};
     TransferObject *     m_transferObjectFeedback[UAC_MAX_IRP_NUMBER]{};
     MixingEngineThread * m_mixingEngineThread{nullptr};
+    MixingEngineThread * m_renderThread{nullptr}; // Writes the output packets when SplitRenderThread is set.
+
+    static const ULONG    c_renderThreadTimeoutUs = 100 * 1000;
+    RENDER_HANDOFF        m_renderHandoff{};
+    STREAM_PLATFORM_EVENT m_renderDoneEvent{};
 
     LONG   m_pendingIrps{0};
     KEVENT m_noPendingIrpEvent{0};
@@ -530,17 +560,15 @@ class StreamObject
     ULONG    m_feedbackNextIsoFrame{0};
     ULONG    m_feedbackIsoFrameDelay{0};
 
-    ULONG m_startIsoFrame{0};
+    // Smoothed device rate used to size the output packets, protected by m_positionSpinLock.
+    RateEstimator m_rateEstimator;
 
-    WDFSPINLOCK m_positionSpinLock{nullptr};
+    ULONG m_startIsoFrame{0};
 
-    LONG m_inputBytesLastOneSec{0};
-    LONG m_inputProcessedFrames{0};
-    LONG m_inputNextMeasureFrames{0};
+    STREAM_PLATFORM_LOCK m_positionSpinLock{nullptr};
 
-    LONG m_outputBytesLastOneSec{0};
-    LONG m_outputProcessedFrames{0};
-    LONG m_outputNextMeasureFrames{0};
+    SampleRateMeter m_inputSampleRateMeter;
+    SampleRateMeter m_outputSampleRateMeter;
 
     LONG m_outputRequireZeroFill{0};
 
@@ -549,16 +577,18 @@ class StreamObject
 
     // m_xxCompletedPacket is protected by SpinLock because it is operated within the DPC.
 
-    WDFSPINLOCK m_packetSpinLock{nullptr};
+    STREAM_PLATFORM_LOCK m_packetSpinLock{nullptr};
 
     LONGLONG m_inputCompletedPacket{0LL};
-    LONGLONG m_inputSyncPacket{0LL};
-    LONGLONG m_inputEstimatedPacket{0LL};
-    LONGLONG m_inputProcessedPacket{0LL};
 
     LONGLONG m_outputCompletedPacket{0LL};
     LONGLONG m_outputSyncPacket{0LL};
-    LONGLONG m_outputProcessedPacket{0LL};
+
+    // Packet counters and the processing-range decision of the mixing engine thread.
+    PacketScheduler m_packetScheduler;
+
+    // Next wakeup of the mixing engine thread in WakeUpMode::Deadline, and the wakeup counters.
+    WakeupScheduler m_wakeupScheduler;
 
     LONGLONG m_asioReadyPosition{0LL};
     LONGLONG m_threadWakeUpCount{0LL};
@@ -586,9 +616,6 @@ class StreamObject
     ULONGLONG m_wakeUpDiffPCUs{0ULL};
     ULONGLONG m_lastWakePCUs{0ULL};
 
-    ULONG m_usbBusTimeEstimated{0};
-    ULONG m_usbBusTimePrev{0};
-
     ULONG m_syncElapsedTimeUs{0};
     ULONG m_asioElapsedTimeUs{0};
 
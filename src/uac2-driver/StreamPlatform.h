@@ -0,0 +1,555 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    StreamPlatform.h
+
+Abstract:
+
+    Define the platform services used by the mixing engine thread: the clock,
+    the USB frame counter, the wake-up event and timer, the render handoff
+    event and the spin locks.
+    The packet selection logic and the sample kernels only reach the platform
+    through this header, which also supplies the types, annotations and
+    tracing they use. When
+    STREAM_PLATFORM_HOST is defined, they are replaced with user-mode
+    definitions, and the clock, the USB frame counter and the wake-ups come
+    from a StreamPlatformBackend, so that PacketScheduler and WakeupScheduler
+    build and run on a host against a simulated bus (see host/CMakeLists.txt).
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _STREAMPLATFORM_H_
+#define _STREAMPLATFORM_H_
+
+#if defined(STREAM_PLATFORM_HOST)
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+
+typedef uint8_t  UCHAR, *PUCHAR, BYTE, *PBYTE, BOOLEAN;
+typedef int8_t   CHAR, *PCHAR;
+typedef int16_t  SHORT, *PSHORT;
+typedef uint16_t USHORT, *PUSHORT;
+typedef int32_t  LONG, *PLONG;
+typedef uint32_t ULONG, *PULONG;
+typedef int64_t  LONGLONG, LONG64;
+typedef uint64_t ULONGLONG, ULONG64, *PULONGLONG;
+typedef int32_t  BOOL;
+typedef char16_t WCHAR;
+typedef void *   PVOID, *HANDLE;
+typedef size_t   SIZE_T, ULONG_PTR;
+typedef LONG     NTSTATUS;
+
+#define VOID void
+
+// __declspec(align(n)) is the only declaration specifier of the shared headers.
+#define __declspec(specifier)              STREAM_PLATFORM_DECLSPEC_##specifier
+#define STREAM_PLATFORM_DECLSPEC_align(n) alignas(n)
+#define POINTER_32
+
+typedef struct _GUID
+{
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t  Data4[8];
+} GUID;
+
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _Inout_opt_
+#define _Inout_updates_(count)
+#define _In_reads_(count)
+#define _In_reads_bytes_(size)
+#define _Out_writes_bytes_(size)
+#define _Success_(expression)
+#define _Use_decl_annotations_
+#define __drv_maxIRQL(irql)
+#define PAGED_CODE_SEG
+#define NONPAGED_CODE_SEG
+#define PAGED_CODE()
+
+#define STATUS_SUCCESS               ((NTSTATUS)0x00000000L)
+#define STATUS_WAIT_0                ((NTSTATUS)0x00000000L)
+#define STATUS_WAIT_1                ((NTSTATUS)0x00000001L)
+#define STATUS_WAIT_2                ((NTSTATUS)0x00000002L)
+#define STATUS_TIMEOUT               ((NTSTATUS)0x00000102L)
+#define STATUS_DEVICE_BUSY           ((NTSTATUS)0x80000011L)
+#define STATUS_UNSUCCESSFUL          ((NTSTATUS)0xC0000001L)
+#define STATUS_INVALID_PARAMETER     ((NTSTATUS)0xC000000DL)
+#define STATUS_NO_SUCH_DEVICE        ((NTSTATUS)0xC000000EL)
+#define STATUS_BUFFER_TOO_SMALL      ((NTSTATUS)0xC0000023L)
+#define STATUS_IO_TIMEOUT            ((NTSTATUS)0xC00000B5L)
+#define STATUS_NOT_SUPPORTED         ((NTSTATUS)0xC00000BBL)
+#define STATUS_DEVICE_DOES_NOT_EXIST ((NTSTATUS)0xC00000C0L)
+#define NT_SUCCESS(status)           (((NTSTATUS)(status)) >= 0)
+
+#define RETURN_NTSTATUS_IF_TRUE(condition, status) \
+    if (condition)                                 \
+    {                                              \
+        return status;                             \
+    }
+
+#define FORCEINLINE                       inline
+#define UNALIGNED
+#define ASSERT(expression)                assert(expression)
+#define ARRAYSIZE(array)                  (sizeof(array) / sizeof((array)[0]))
+#define UNREFERENCED_PARAMETER(parameter) (void)(parameter)
+#define RtlCopyMemory(dst, src, length)   memcpy((dst), (src), (length))
+#define RtlZeroMemory(dst, length)        memset((dst), 0, (length))
+#define RtlFillMemory(dst, length, fill)  memset((dst), (fill), (length))
+
+#define SYSTEM_CACHE_ALIGNMENT_SIZE 64
+#define ALIGN_UP_BY(length, alignment) \
+    ((((ULONG_PTR)(length)) + (alignment) - 1) & ~((ULONG_PTR)(alignment) - 1))
+
+//
+// The pool allocations of NewDelete.h come from the heap, and return nullptr
+// on failure as they do in the kernel.
+//
+typedef ULONG64 POOL_FLAGS;
+
+#define POOL_FLAG_NON_PAGED 0x0000000000000040ULL
+#define DRIVER_TAG          ((ULONG)0x55416144) // 'DaAU'
+
+inline PVOID operator new(
+    size_t size,
+    POOL_FLAGS,
+    ULONG
+)
+{
+    return ::operator new(size, std::nothrow);
+}
+
+//
+// The vectorized kernels are built for x64 when the host compiler targets
+// SSE4.1 and AVX2 (STREAM_PLATFORM_HOST_X64, see host/CMakeLists.txt).
+// ExIsProcessorFeaturePresent() reports the features of the host processor
+// that StreamPlatform::SetProcessorFeatures() has not masked, so that a test
+// can select each kernel in turn.
+//
+#if defined(STREAM_PLATFORM_HOST_X64) && !defined(_M_X64)
+#define _M_X64 1
+#endif
+
+#define PF_XMMI64_INSTRUCTIONS_AVAILABLE 10
+#define PF_SSE4_1_INSTRUCTIONS_AVAILABLE 37
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE   40
+
+BOOLEAN ExIsProcessorFeaturePresent(
+    _In_ ULONG processorFeature
+);
+
+#define XSTATE_MASK_AVX (1ULL << 2)
+
+typedef struct _XSTATE_SAVE
+{
+    ULONGLONG Mask;
+} XSTATE_SAVE, *PXSTATE_SAVE;
+
+// The host saves the extended state on every context switch.
+inline NTSTATUS KeSaveExtendedProcessorState(
+    _In_ ULONGLONG     mask,
+    _Out_ PXSTATE_SAVE xStateSave
+)
+{
+    xStateSave->Mask = mask;
+    return STATUS_SUCCESS;
+}
+
+inline void KeRestoreExtendedProcessorState(
+    _In_ PXSTATE_SAVE xStateSave
+)
+{
+    xStateSave->Mask = 0;
+}
+
+// The WPP traces are discarded, but their arguments are still evaluated.
+inline void StreamPlatformHostTrace(
+    const char *,
+    ...
+)
+{
+}
+#define TraceEvents(level, flags, ...) StreamPlatformHostTrace(__VA_ARGS__)
+
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#define MIN(a, b) ((a) > (b) ? (b) : (a))
+
+//
+// The interlocked operations and the acquire/release accesses map to the
+// atomic builtins of GCC and Clang, with the same ordering as the kernel ones.
+//
+inline LONG InterlockedExchange(volatile LONG * target, LONG value) { return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedCompareExchange(volatile LONG * target, LONG exchange, LONG comparand)
+{
+    __atomic_compare_exchange_n(target, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+inline LONG InterlockedOr(volatile LONG * target, LONG value) { return __atomic_fetch_or(target, value, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedIncrement(volatile LONG * target) { return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedExchange64(volatile LONG64 * target, LONG64 value) { return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedCompareExchange64(volatile LONG64 * target, LONG64 exchange, LONG64 comparand)
+{
+    __atomic_compare_exchange_n(target, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+inline LONG64 InterlockedExchangeAdd64(volatile LONG64 * target, LONG64 value) { return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedIncrement64(volatile LONG64 * target) { return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST); }
+inline LONG ReadAcquire(const volatile LONG * source) { return __atomic_load_n(source, __ATOMIC_ACQUIRE); }
+inline LONG ReadNoFence(const volatile LONG * source) { return __atomic_load_n(source, __ATOMIC_RELAXED); }
+inline LONG64 ReadAcquire64(const volatile LONG64 * source) { return __atomic_load_n(source, __ATOMIC_ACQUIRE); }
+inline LONG64 ReadNoFence64(const volatile LONG64 * source) { return __atomic_load_n(source, __ATOMIC_RELAXED); }
+inline ULONG64 ReadULong64NoFence(const volatile ULONG64 * source) { return __atomic_load_n(source, __ATOMIC_RELAXED); }
+inline void WriteRelease64(volatile LONG64 * destination, LONG64 value) { __atomic_store_n(destination, value, __ATOMIC_RELEASE); }
+inline void WriteNoFence64(volatile LONG64 * destination, LONG64 value) { __atomic_store_n(destination, value, __ATOMIC_RELAXED); }
+#define KeMemoryBarrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+// The definitions shared with the ASIO driver, as Device.h includes them in the kernel.
+#include "UAC_User.h"
+
+typedef struct _DEVICE_CONTEXT * PDEVICE_CONTEXT;
+class MixingEngineThread;
+
+typedef std::mutex * STREAM_PLATFORM_LOCK;
+
+// A synchronization event: a successful wait resets it.
+typedef struct _STREAM_PLATFORM_EVENT
+{
+    std::mutex              Mutex;
+    std::condition_variable Condition;
+    bool                    Signaled{false};
+} STREAM_PLATFORM_EVENT;
+
+//
+// The clock, the USB frame counter and the wake-ups of the mixing engine
+// thread come from a backend, so that a simulation can run them on a virtual
+// clock. StreamPlatformSteadyClock (host/StreamPlatformHost.cpp) is used until
+// StreamPlatform::SetBackend() installs another one.
+//
+class StreamPlatformBackend
+{
+  public:
+    virtual ~StreamPlatformBackend() = default;
+
+    virtual ULONGLONG QueryTimeUs() = 0;
+
+    virtual ULONG QueryUsbFrame() = 0;
+
+    virtual NTSTATUS WaitForWakeUp(
+        _In_ MixingEngineThread * thread
+    ) = 0;
+
+    virtual void WakeUp(
+        _In_ MixingEngineThread * thread
+    ) = 0;
+
+    virtual void ArmWakeUp(
+        _In_ MixingEngineThread * thread,
+        _In_ ULONG                dueTimeUs
+    ) = 0;
+};
+
+//
+// The wall clock of the host. The USB frame advances every millisecond.
+// WaitForWakeUp() returns STATUS_WAIT_1 for WakeUp(), STATUS_WAIT_2 for an
+// armed deadline and STATUS_TIMEOUT after 100ms, like MixingEngineThread::Wait().
+//
+class StreamPlatformSteadyClock : public StreamPlatformBackend
+{
+  public:
+    ULONGLONG QueryTimeUs() override;
+
+    ULONG QueryUsbFrame() override;
+
+    NTSTATUS WaitForWakeUp(
+        _In_ MixingEngineThread * thread
+    ) override;
+
+    void WakeUp(
+        _In_ MixingEngineThread * thread
+    ) override;
+
+    void ArmWakeUp(
+        _In_ MixingEngineThread * thread,
+        _In_ ULONG                dueTimeUs
+    ) override;
+
+  private:
+    const std::chrono::steady_clock::time_point m_origin{std::chrono::steady_clock::now()};
+    std::mutex                                  m_mutex;
+    std::condition_variable                     m_condition;
+    bool                                        m_wakeUp{false};
+    std::chrono::steady_clock::time_point       m_deadline{(std::chrono::steady_clock::time_point::max)()};
+};
+
+class StreamPlatform
+{
+  public:
+    // Installs the backend, or restores StreamPlatformSteadyClock when nullptr.
+    static void SetBackend(
+        _In_opt_ StreamPlatformBackend * backend
+    );
+
+    // Limits ExIsProcessorFeaturePresent() to the PF_* features whose bits are set.
+    static void SetProcessorFeatures(
+        _In_ ULONGLONG processorFeatureMask
+    );
+
+    static ULONGLONG
+    QueryTimeUs(
+        _In_opt_ PDEVICE_CONTEXT deviceContext,
+        _Out_opt_ PULONGLONG     qpcPosition
+    )
+    {
+        (void)deviceContext;
+        ULONGLONG timeUs = Backend()->QueryTimeUs();
+        if (qpcPosition != nullptr)
+        {
+            *qpcPosition = timeUs * 10ULL;
+        }
+        return timeUs;
+    }
+
+    static ULONG
+    QueryUsbFrame(
+        _In_opt_ PDEVICE_CONTEXT deviceContext
+    )
+    {
+        (void)deviceContext;
+        return Backend()->QueryUsbFrame();
+    }
+
+    static NTSTATUS
+    WaitForWakeUp(
+        _In_ MixingEngineThread * thread
+    )
+    {
+        return Backend()->WaitForWakeUp(thread);
+    }
+
+    static void WakeUp(
+        _In_ MixingEngineThread * thread
+    )
+    {
+        Backend()->WakeUp(thread);
+    }
+
+    static void ArmWakeUp(
+        _In_ MixingEngineThread * thread,
+        _In_ ULONG                dueTimeUs
+    )
+    {
+        Backend()->ArmWakeUp(thread, dueTimeUs);
+    }
+
+    static void InitializeEvent(
+        _Out_ STREAM_PLATFORM_EVENT & event
+    )
+    {
+        std::lock_guard<std::mutex> guard(event.Mutex);
+        event.Signaled = false;
+    }
+
+    static void SignalEvent(
+        _Inout_ STREAM_PLATFORM_EVENT & event
+    )
+    {
+        {
+            std::lock_guard<std::mutex> guard(event.Mutex);
+            event.Signaled = true;
+        }
+        event.Condition.notify_one();
+    }
+
+    static NTSTATUS
+    WaitForEvent(
+        _Inout_ STREAM_PLATFORM_EVENT & event,
+        _In_ ULONG                      timeoutUs
+    )
+    {
+        std::unique_lock<std::mutex> guard(event.Mutex);
+        if (!event.Condition.wait_for(guard, std::chrono::microseconds(timeoutUs), [&event] { return event.Signaled; }))
+        {
+            return STATUS_TIMEOUT;
+        }
+        event.Signaled = false;
+        return STATUS_SUCCESS;
+    }
+
+    static void AcquireLock(
+        _In_ STREAM_PLATFORM_LOCK lock
+    )
+    {
+        lock->lock();
+    }
+
+    static void ReleaseLock(
+        _In_ STREAM_PLATFORM_LOCK lock
+    )
+    {
+        lock->unlock();
+    }
+
+  private:
+    static StreamPlatformBackend * Backend();
+};
+
+#else
+
+#include "Driver.h"
+#include "Device.h"
+#include "Public.h"
+#include "Common.h"
+#include "MixingEngineThread.h"
+
+typedef WDFSPINLOCK STREAM_PLATFORM_LOCK;
+typedef KEVENT      STREAM_PLATFORM_EVENT;
+
+class StreamPlatform
+{
+  public:
+    // Current time in microseconds, based on KeQueryPerformanceCounter.
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    FORCEINLINE
+    ULONGLONG
+    QueryTimeUs(
+        _In_ PDEVICE_CONTEXT deviceContext,
+        _Out_opt_ PULONGLONG qpcPosition
+    )
+    {
+        return USBAudioAcxDriverStreamGetCurrentTimeUs(deviceContext, qpcPosition);
+    }
+
+    // Current USB frame number.
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    FORCEINLINE
+    ULONG
+    QueryUsbFrame(
+        _In_ PDEVICE_CONTEXT deviceContext
+    )
+    {
+        return GetCurrentFrame(deviceContext);
+    }
+
+    // Blocks until the mixing engine thread is woken up by the timer, a completion or termination.
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    FORCEINLINE
+    NTSTATUS
+    WaitForWakeUp(
+        _In_ MixingEngineThread * thread
+    )
+    {
+        return thread->Wait();
+    }
+
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    FORCEINLINE
+    void WakeUp(
+        _In_ MixingEngineThread * thread
+    )
+    {
+        thread->WakeUp();
+    }
+
+    // Wakes the mixing engine thread up after dueTimeUs, in WakeUpMode::Deadline.
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    FORCEINLINE
+    void ArmWakeUp(
+        _In_ MixingEngineThread * thread,
+        _In_ ULONG                dueTimeUs
+    )
+    {
+        thread->SetWakeUpDeadline(dueTimeUs);
+    }
+
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    FORCEINLINE
+    void InitializeEvent(
+        _Out_ STREAM_PLATFORM_EVENT & event
+    )
+    {
+        KeInitializeEvent(&event, SynchronizationEvent, FALSE);
+    }
+
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    FORCEINLINE
+    void SignalEvent(
+        _Inout_ STREAM_PLATFORM_EVENT & event
+    )
+    {
+        KeSetEvent(&event, IO_SOUND_INCREMENT, FALSE);
+    }
+
+    // Blocks until the event is signaled or timeoutUs has elapsed, STATUS_TIMEOUT in the latter case.
+    static __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    FORCEINLINE
+    NTSTATUS
+    WaitForEvent(
+        _Inout_ STREAM_PLATFORM_EVENT & event,
+        _In_ ULONG                      timeoutUs
+    )
+    {
+        LARGE_INTEGER timeout;
+        timeout.QuadPart = -(LONGLONG)timeoutUs * 10LL;
+
+        return KeWaitForSingleObject(&event, Executive, KernelMode, FALSE, &timeout);
+    }
+
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    FORCEINLINE
+    void AcquireLock(
+        _In_ STREAM_PLATFORM_LOCK lock
+    )
+    {
+        WdfSpinLockAcquire(lock);
+    }
+
+    static __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    FORCEINLINE
+    void ReleaseLock(
+        _In_ STREAM_PLATFORM_LOCK lock
+    )
+    {
+        WdfSpinLockRelease(lock);
+    }
+};
+
+#endif // defined(STREAM_PLATFORM_HOST)
+
+#endif
@@ -28,6 +28,8 @@ Environment:
 #include "USBAudio.h"
 #include "TransferObject.h"
 #include "StreamObject.h"
+#include "IsoRequestPool.h"
+#include "EventTrace.h"
 
 #ifndef __INTELLISENSE__
 #include "TransferObject.tmh"
@@ -137,6 +139,28 @@ void TransferObject::Free()
         m_urbMemory = nullptr;
         m_urb = nullptr;
     }
+
+    // A pooled request that has not been released by the completion routine,
+    // such as the last one of a stopped stream, is returned to the pool.
+    // A request that may still be pending is never returned, so that the
+    // pool does not re-arm it; it is left to its parent device.
+    if ((m_request != nullptr) && m_requestPooled)
+    {
+        if (m_deviceContext->IsoRequestPool != nullptr)
+        {
+            if (m_cancelTimedOut)
+            {
+                m_deviceContext->IsoRequestPool->Abandon(m_direction, m_index);
+            }
+            else
+            {
+                m_deviceContext->IsoRequestPool->Release(m_direction, m_index);
+            }
+        }
+        m_requestPooled = false;
+        m_request = nullptr;
+    }
+    m_cancelTimedOut = false;
     m_dataBuffer = nullptr;
     WdfSpinLockRelease(m_spinLock);
 
@@ -193,16 +217,9 @@ TransferObject::SetUrbIsochronousParametersInput(
 
         if (!NT_SUCCESS(status))
         {
-            WdfSpinLockAcquire(m_spinLock);
-
             // Since WdfRequestCreate is used to create the request within this function, the following call is unnecessary.
             // WdfRequestCompleteWithInformation(request, status, 0);
-            if (m_request != nullptr)
-            {
-                WdfObjectDelete(m_request);
-                m_request = nullptr;
-            }
-            WdfSpinLockRelease(m_spinLock);
+            FreeRequest();
         }
     });
 
@@ -223,10 +240,10 @@ TransferObject::SetUrbIsochronousParametersInput(
     // a BSOD with DRIVER_IRQL_NOT_LESS_OR_EQUAL (d1) will occur in FxRequest::GetMdl within WdfRequestRetrieveInputWdmMdl().
     {
         WdfSpinLockAcquire(m_spinLock);
-        status = WdfRequestCreate(&attributes, WdfUsbTargetPipeGetIoTarget(pipe), &m_request);
+        status = AcquireRequest(pipe, &attributes);
         WdfSpinLockRelease(m_spinLock);
     }
-    RETURN_NTSTATUS_IF_FAILED_MSG(status, "WdfRequestCreate failed");
+    RETURN_NTSTATUS_IF_FAILED_MSG(status, "AcquireRequest failed");
 
     {
         WdfSpinLockAcquire(m_spinLock);
@@ -380,16 +397,9 @@ TransferObject::SetUrbIsochronousParametersOutput(
 
         if (!NT_SUCCESS(status))
         {
-            WdfSpinLockAcquire(m_spinLock);
-
             // Since the request is created using WdfRequestCreate inside this function, the following call is unnecessary.
             // WdfRequestCompleteWithInformation(request, status, 0);
-            if (m_request != nullptr)
-            {
-                WdfObjectDelete(m_request);
-                m_request = nullptr;
-            }
-            WdfSpinLockRelease(m_spinLock);
+            FreeRequest();
         }
     });
 
@@ -408,10 +418,10 @@ TransferObject::SetUrbIsochronousParametersOutput(
     // If WDF_OBJECT_ATTRIBUTES::ParentObject is set to nullptr in WdfRequestCreate(), a DRIVER_IRQL_NOT_LESS_OR_EQUAL (d1) BSOD occurs in FxRequest::GetMdl within WdfRequestRetrieveInputWdmMdl().
     {
         WdfSpinLockAcquire(m_spinLock);
-        status = WdfRequestCreate(&attributes, WdfUsbTargetPipeGetIoTarget(pipe), &m_request);
+        status = AcquireRequest(pipe, &attributes);
         WdfSpinLockRelease(m_spinLock);
     }
-    RETURN_NTSTATUS_IF_FAILED_MSG(status, "WdfRequestCreate failed");
+    RETURN_NTSTATUS_IF_FAILED_MSG(status, "AcquireRequest failed");
 
     {
         WdfSpinLockAcquire(m_spinLock);
@@ -570,16 +580,9 @@ TransferObject::SetUrbIsochronousParametersFeedback(
 
         if (!NT_SUCCESS(status))
         {
-            WdfSpinLockAcquire(m_spinLock);
-
             // Since the request is created using WdfRequestCreate inside this function, the following call is unnecessary.
             // WdfRequestCompleteWithInformation(request, status, 0);
-            if (m_request != nullptr)
-            {
-                WdfObjectDelete(m_request);
-                m_request = nullptr;
-            }
-            WdfSpinLockRelease(m_spinLock);
+            FreeRequest();
         }
     });
 
@@ -598,10 +601,10 @@ TransferObject::SetUrbIsochronousParametersFeedback(
     // If WDF_OBJECT_ATTRIBUTES::ParentObject is set to nullptr in WdfRequestCreate(), a DRIVER_IRQL_NOT_LESS_OR_EQUAL (d1) BSOD occurs in FxRequest::GetMdl within WdfRequestRetrieveInputWdmMdl().
     {
         WdfSpinLockAcquire(m_spinLock);
-        status = WdfRequestCreate(&attributes, WdfUsbTargetPipeGetIoTarget(pipe), &m_request);
+        status = AcquireRequest(pipe, &attributes);
         WdfSpinLockRelease(m_spinLock);
     }
-    RETURN_NTSTATUS_IF_FAILED_MSG(status, "WdfRequestCreate failed");
+    RETURN_NTSTATUS_IF_FAILED_MSG(status, "AcquireRequest failed");
 
     {
         WdfSpinLockAcquire(m_spinLock);
@@ -724,6 +727,44 @@ TransferObject::SetUrbIsochronousParametersFeedback(
     return status;
 }
 
+_Use_decl_annotations_
+NONPAGED_CODE_SEG
+NTSTATUS
+TransferObject::AcquireRequest(
+    WDFUSBPIPE             pipe,
+    PWDF_OBJECT_ATTRIBUTES requestAttributes
+)
+/*++
+
+Routine Description:
+
+    Takes the request and the URB of this transfer from the pool of the
+    device. A request is created only when the pool cannot provide one.
+    The caller holds m_spinLock.
+
+--*/
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    m_requestPooled = false;
+    m_cancelTimedOut = false;
+    if (m_deviceContext->IsoRequestPool != nullptr)
+    {
+        m_requestPooled = NT_SUCCESS(m_deviceContext->IsoRequestPool->Acquire(m_direction, m_index, pipe, m_numIsoPackets, m_request, m_urbMemory, m_urb));
+    }
+
+    if (!m_requestPooled)
+    {
+        status = WdfRequestCreate(requestAttributes, WdfUsbTargetPipeGetIoTarget(pipe), &m_request);
+        if (NT_SUCCESS(status) && (m_deviceContext->IsoRequestPool != nullptr))
+        {
+            m_deviceContext->IsoRequestPool->CountAllocation();
+        }
+    }
+
+    return status;
+}
+
 _Use_decl_annotations_
 NONPAGED_CODE_SEG
 NTSTATUS
@@ -734,7 +775,33 @@ TransferObject::FreeRequest()
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Entry, m_index = %u", m_index);
 
     WdfSpinLockAcquire(m_spinLock);
-    if (m_request != nullptr)
+    if ((m_request != nullptr) && m_requestPooled)
+    {
+        // The pooled request and its URB are re-armed by the next transfer instead of being deleted.
+        // A request that may still be pending is taken out of the pool instead.
+        if (m_deviceContext->IsoRequestPool != nullptr)
+        {
+            if (m_cancelTimedOut)
+            {
+                m_deviceContext->IsoRequestPool->Abandon(m_direction, m_index);
+            }
+            else
+            {
+                m_deviceContext->IsoRequestPool->Release(m_direction, m_index);
+            }
+        }
+        m_requestPooled = false;
+        m_request = nullptr;
+        m_urbMemory = nullptr;
+        m_urb = nullptr;
+    }
+    else if ((m_request != nullptr) && m_cancelTimedOut)
+    {
+        // Deleting a request that may still be pending is not allowed; it is deleted together with its parent device.
+        TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "request %p may still be pending, left to the device", m_request);
+        m_request = nullptr;
+    }
+    else if (m_request != nullptr)
     {
         // Don't call WdfRequestComplete() on a Request created with WdfRequestCreate(); instead, call WdfObjectDelete().
         // https://learn.microsoft.com/ja-jp/windows-hardware/drivers/ddi/wdfrequest/nf-wdfrequest-wdfrequestcreate
@@ -745,6 +812,7 @@ TransferObject::FreeRequest()
         WdfObjectDelete(m_request);
         m_request = nullptr;
     }
+    m_cancelTimedOut = false;
 
     WdfSpinLockRelease(m_spinLock);
 
@@ -908,6 +976,14 @@ TransferObject::CancelRequest()
 
         WdfRequestCancelSentRequest(m_request);
         status = KeWaitForSingleObject(&m_requestCompletedEvent, Executive, KernelMode, FALSE, &timeout);
+        if (status == STATUS_TIMEOUT)
+        {
+            WdfSpinLockAcquire(m_spinLock);
+            // CompleteRequest() may have run between the wait and the lock.
+            m_cancelTimedOut = (KeReadStateEvent(&m_requestCompletedEvent) == 0);
+            WdfSpinLockRelease(m_spinLock);
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DEVICE, "m_index = %u, cancel timed out", m_index);
+        }
     }
     else
     {
@@ -937,6 +1013,7 @@ void TransferObject::CompleteRequest(
     m_periodUs = periodUs;
     m_qpcPosition = qpcPosition;
     m_periodQPCPosition = periodQPCPosition;
+    m_cancelTimedOut = false;
     KeSetEvent(&m_requestCompletedEvent, 1, FALSE);
 
     WdfSpinLockRelease(m_spinLock);
@@ -1053,7 +1130,7 @@ TransferObject::UpdateTransferredBytesInThisIrp(ULONG & transferredBytesInThisIr
                         }
                     }
                     // detecting sampling rate
-                    bool updated = m_streamObject->CalculateSampleRate(TRUE, m_deviceContext->AudioProperty.InputBytesPerBlock, m_deviceContext->AudioProperty.PacketsPerSec, length, m_deviceContext->AudioProperty.InputMeasuredSampleRate);
+                    bool updated = m_streamObject->CalculateSampleRate(TRUE, length, m_deviceContext->AudioProperty.InputMeasuredSampleRate);
                     if (updated)
                     {
                         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - InputMeasuredSampleRate = %d", m_deviceContext->AudioProperty.InputMeasuredSampleRate);
@@ -1085,7 +1162,7 @@ TransferObject::UpdateTransferredBytesInThisIrp(ULONG & transferredBytesInThisIr
 
                     // detecting sampling rate
                     ULONG length = m_urb->UrbIsochronousTransfer.IsoPacket[i].Length;
-                    bool  updated = m_streamObject->CalculateSampleRate(FALSE, m_deviceContext->AudioProperty.OutputBytesPerBlock, m_deviceContext->AudioProperty.PacketsPerSec, length, m_deviceContext->AudioProperty.OutputMeasuredSampleRate);
+                    bool  updated = m_streamObject->CalculateSampleRate(FALSE, length, m_deviceContext->AudioProperty.OutputMeasuredSampleRate);
                     if (updated)
                     {
                         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, " - OutputMeasuredSampleRate = %d", m_deviceContext->AudioProperty.OutputMeasuredSampleRate);
@@ -1173,7 +1250,10 @@ ULONG TransferObject::GetFeedbackSum(ULONG & validFeedback)
         }
         if (m_lockDelayCount != 0)
         {
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "feedback frame %u, value %08x, LOCK DELAY ENABLED.", m_urb->UrbIsochronousTransfer.StartFrame, feedbackValue);
+            if (m_deviceContext->EventTrace != nullptr)
+            {
+                m_deviceContext->EventTrace->Log(UACEventId::FeedbackLockDelay, m_urb->UrbIsochronousTransfer.StartFrame, i, feedbackValue);
+            }
         }
         else
         {
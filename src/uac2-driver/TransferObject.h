@@ -300,6 +300,14 @@ class TransferObject
     );
 
   private:
+    __drv_maxIRQL(DISPATCH_LEVEL)
+    NONPAGED_CODE_SEG
+    NTSTATUS
+    AcquireRequest(
+        _In_ WDFUSBPIPE             pipe,
+        _In_ PWDF_OBJECT_ATTRIBUTES requestAttributes
+    );
+
     const PDEVICE_CONTEXT m_deviceContext;
     StreamObject *        m_streamObject{nullptr};
     const LONG            m_index;
@@ -308,6 +316,8 @@ class TransferObject
     PURB                  m_urb{nullptr};
     WDFMEMORY             m_urbMemory{nullptr};
     WDFREQUEST            m_request{nullptr};
+    bool                  m_requestPooled{false}; // m_request and m_urbMemory belong to the IsoRequestPool of the device.
+    bool                  m_cancelTimedOut{false}; // m_request may still be pending after CancelRequest() gave up waiting.
     bool                  m_isRequested{false};
     PMDL                  m_dataBufferMdl{nullptr};
     PUCHAR                m_dataBuffer{nullptr};
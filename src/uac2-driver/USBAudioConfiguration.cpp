@@ -28,6 +28,7 @@ Environment:
 #include "Common.h"
 #include "DeviceControl.h"
 #include "ErrorStatistics.h"
+#include "CapabilityCache.h"
 #include "USBAudioConfiguration.h"
 
 #ifndef __INTELLISENSE__
@@ -955,11 +956,48 @@ NTSTATUS USBAudioControlInterface::
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - bDescriptorSubtype = 0x%02x", descriptor->bDescriptorSubtype);
     status = m_genericAudioDescriptorInfo.Append(m_parentObject, descriptor);
 
+    //
+    // In every terminal, unit and clock entity descriptor the ID immediately follows bDescriptorSubtype,
+    // so a single table indexed by that ID replaces the list walks when the topology is traced.
+    //
+    if (NT_SUCCESS(status) && (descriptor->bDescriptorSubtype >= NS_USBAudio0200::INPUT_TERMINAL) && (descriptor->bDescriptorSubtype <= NS_USBAudio0200::SAMPLE_RATE_CONVERTER) && (descriptor->bLength > sizeof(NS_USBAudio::CS_GENERIC_AUDIO_DESCRIPTOR)))
+    {
+        UCHAR entityID = ((PUCHAR)descriptor)[sizeof(NS_USBAudio::CS_GENERIC_AUDIO_DESCRIPTOR)];
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - entity ID          = 0x%02x", entityID);
+        if (m_entityDescriptors[entityID] == nullptr)
+        {
+            m_entityDescriptors[entityID] = descriptor;
+        }
+        else
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, TRACE_DESCRIPTOR, " - duplicate entity ID 0x%02x, the first descriptor is used.", entityID);
+        }
+    }
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DESCRIPTOR, "%!FUNC! Exit %!STATUS!", status);
 
     return status;
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NS_USBAudio::PCS_GENERIC_AUDIO_DESCRIPTOR USBAudioControlInterface::GetEntityDescriptor(
+    UCHAR entityID,
+    UCHAR descriptorSubtype
+) const
+{
+    PAGED_CODE();
+
+    NS_USBAudio::PCS_GENERIC_AUDIO_DESCRIPTOR descriptor = m_entityDescriptors[entityID];
+
+    if ((descriptor == nullptr) || (descriptor->bDescriptorSubtype != descriptorSubtype))
+    {
+        return nullptr;
+    }
+
+    return descriptor;
+}
+
 // ======================================================================
 // ======================================================================
 
@@ -1214,6 +1252,15 @@ NTSTATUS USBAudio1ControlInterface::SearchInputTerminalFromOutputTerminal(
     return STATUS_NOT_SUPPORTED;
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS USBAudio1ControlInterface::BuildTopologyPaths()
+{
+    PAGED_CODE();
+
+    return STATUS_SUCCESS;
+}
+
 _Use_decl_annotations_
 PAGED_CODE_SEG
 NTSTATUS USBAudio1ControlInterface::SetCurrentSampleFrequency(
@@ -1856,19 +1903,10 @@ NTSTATUS USBAudio2ControlInterface::QuerySampleFrequencyControls(
 
     controls = 0;
 
-    ULONG numOfAcClockSourceInfo = m_acClockSourceInfo.GetNumOfArray();
-
-    for (ULONG index = 0; index < numOfAcClockSourceInfo; index++)
+    NS_USBAudio0200::PCS_AC_CLOCK_SOURCE_DESCRIPTOR clockSourceDescriptor = (NS_USBAudio0200::PCS_AC_CLOCK_SOURCE_DESCRIPTOR)GetEntityDescriptor(clockSourceID, NS_USBAudio0200::CLOCK_SOURCE);
+    if (clockSourceDescriptor != nullptr)
     {
-        NS_USBAudio0200::PCS_AC_CLOCK_SOURCE_DESCRIPTOR clockSourceDescriptor = nullptr;
-        if (NT_SUCCESS(m_acClockSourceInfo.Get(index, clockSourceDescriptor)))
-        {
-            if (clockSourceDescriptor->bClockID == clockSourceID)
-            {
-                controls = clockSourceDescriptor->bmControls;
-                return status;
-            }
-        }
+        controls = clockSourceDescriptor->bmControls;
     }
 
     return status;
@@ -2086,6 +2124,15 @@ NTSTATUS USBAudio2ControlInterface::GetCurrentSupportedSampleFrequency(
         RETURN_NTSTATUS_IF_FAILED(GetCurrentSampleFrequency(deviceContext, sampleRate));
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - interface %u, clock id %u, sample frequency control is read only. sample frequency %u", GetInterfaceNumber(), clockSourceID, sampleRate);
     }
+    else if ((deviceContext->CapabilityCache != nullptr) && deviceContext->CapabilityCache->GetSupportedSampleRate(clockSourceID, supportedSampleRate))
+    {
+        //
+        // The result of a read-only clock depends on the current sample rate, so only
+        // programmable clocks are answered from the capability snapshot.
+        //
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - interface %u, clock id %u, supported sample rate 0x%x from the capability snapshot", GetInterfaceNumber(), clockSourceID, supportedSampleRate);
+        return status;
+    }
 
     status = ControlRequestGetSampleFrequencyRange(deviceContext, GetInterfaceNumber(), clockSourceID, memory, parameterBlock);
     if (NT_SUCCESS(status))
@@ -2107,6 +2154,11 @@ NTSTATUS USBAudio2ControlInterface::GetCurrentSupportedSampleFrequency(
             }
         }
         WdfObjectDelete(memory);
+
+        if (((clockFrequencyControl & NS_USBAudio0200::CLOCK_FREQUENCY_CONTROL_MASK) != NS_USBAudio0200::CLOCK_FREQUENCY_CONTROL_READ) && (deviceContext->CapabilityCache != nullptr))
+        {
+            deviceContext->CapabilityCache->SetSupportedSampleRate(clockSourceID, supportedSampleRate);
+        }
     }
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DESCRIPTOR, "%!FUNC! Exit %!STATUS!", status);
@@ -2251,6 +2303,16 @@ NTSTATUS USBAudio2ControlInterface::GetRangeFeatureUnit(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DESCRIPTOR, "%!FUNC! Entry");
 
+    //
+    // The volume ranges are only traced, so the requests are skipped while the
+    // capability snapshot of this device is valid.
+    //
+    if ((deviceContext->CapabilityCache != nullptr) && deviceContext->CapabilityCache->IsValid())
+    {
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - volume range requests are skipped, the capability snapshot is valid.");
+        return status;
+    }
+
     ULONG numOfAcFeatureUnitInfo = m_acFeatureUnitInfo.GetNumOfArray();
 
     // FU_VOLUME_CONTROL ranges
@@ -2377,38 +2439,20 @@ NTSTATUS USBAudio2ControlInterface::GetCurrentClockSourceID(
     {
         if (isInput)
         {
-            ULONG numOfAcOutputTerminalInfo = m_acOutputTerminalInfo.GetNumOfArray();
-
-            for (ULONG index = 0; index < numOfAcOutputTerminalInfo; index++)
+            NS_USBAudio0200::PCS_AC_OUTPUT_TERMINAL_DESCRIPTOR outputTerminalDescriptor = (NS_USBAudio0200::PCS_AC_OUTPUT_TERMINAL_DESCRIPTOR)GetEntityDescriptor(terminalLink, NS_USBAudio0200::OUTPUT_TERMINAL);
+            if ((outputTerminalDescriptor != nullptr) && (outputTerminalDescriptor->bLength >= sizeof(NS_USBAudio0200::CS_AC_OUTPUT_TERMINAL_DESCRIPTOR)))
             {
-                NS_USBAudio0200::PCS_AC_OUTPUT_TERMINAL_DESCRIPTOR outputTerminalDescriptor = nullptr;
-                if (NT_SUCCESS(m_acOutputTerminalInfo.Get(index, outputTerminalDescriptor)))
-                {
-                    if (outputTerminalDescriptor->bTerminalID == terminalLink)
-                    {
-                        clockSourceID = outputTerminalDescriptor->bCSourceID;
-                        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - output terminal id %u, terminal type %u, bCSourceID %u", outputTerminalDescriptor->bTerminalID, outputTerminalDescriptor->wTerminalType, clockSourceID);
-                        break;
-                    }
-                }
+                clockSourceID = outputTerminalDescriptor->bCSourceID;
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - output terminal id %u, terminal type %u, bCSourceID %u", outputTerminalDescriptor->bTerminalID, outputTerminalDescriptor->wTerminalType, clockSourceID);
             }
         }
         else
         {
-            ULONG numOfAcInputTerminalInfo = m_acInputTerminalInfo.GetNumOfArray();
-
-            for (ULONG index = 0; index < numOfAcInputTerminalInfo; index++)
+            NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR inputTerminalDescriptor = (NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)GetEntityDescriptor(terminalLink, NS_USBAudio0200::INPUT_TERMINAL);
+            if ((inputTerminalDescriptor != nullptr) && (inputTerminalDescriptor->bLength >= sizeof(NS_USBAudio0200::CS_AC_INPUT_TERMINAL_DESCRIPTOR)))
             {
-                NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR inputTerminalDescriptor = nullptr;
-                if (NT_SUCCESS(m_acInputTerminalInfo.Get(index, inputTerminalDescriptor)))
-                {
-                    if (inputTerminalDescriptor->bTerminalID == terminalLink)
-                    {
-                        clockSourceID = inputTerminalDescriptor->bCSourceID;
-                        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - input terminal id %u, terminal type %u, bCSourceID %u", inputTerminalDescriptor->bTerminalID, inputTerminalDescriptor->wTerminalType, clockSourceID);
-                        break;
-                    }
-                }
+                clockSourceID = inputTerminalDescriptor->bCSourceID;
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - input terminal id %u, terminal type %u, bCSourceID %u", inputTerminalDescriptor->bTerminalID, inputTerminalDescriptor->wTerminalType, clockSourceID);
             }
         }
     }
@@ -2766,7 +2810,7 @@ NTSTATUS USBAudio2ControlInterface::SearchOutputTerminal(
 
 _Use_decl_annotations_
 PAGED_CODE_SEG
-NTSTATUS USBAudio2ControlInterface::SearchOutputTerminalFromInputTerminal(
+NTSTATUS USBAudio2ControlInterface::TraceOutputTerminalFromInputTerminal(
     UCHAR    terminalLink,
     UCHAR &  numOfChannels,
     USHORT & terminalType,
@@ -2782,7 +2826,6 @@ NTSTATUS USBAudio2ControlInterface::SearchOutputTerminalFromInputTerminal(
 
     PAGED_CODE();
 
-    ULONG numOfAcInputTerminalInfo = m_acInputTerminalInfo.GetNumOfArray();
     UCHAR sourceID = USBAudioConfiguration::InvalidID;
 
     numOfChannels = 0;
@@ -2790,21 +2833,12 @@ NTSTATUS USBAudio2ControlInterface::SearchOutputTerminalFromInputTerminal(
     volumeUnitID = USBAudioConfiguration::InvalidID;
     muteUnitID = USBAudioConfiguration::InvalidID;
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - num of ac input terminal info %u", numOfAcInputTerminalInfo);
-    for (ULONG index = 0; index < numOfAcInputTerminalInfo; index++)
+    NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR inputTerminalDescriptor = (NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)GetEntityDescriptor(terminalLink, NS_USBAudio0200::INPUT_TERMINAL);
+    if ((inputTerminalDescriptor != nullptr) && (inputTerminalDescriptor->bLength >= sizeof(NS_USBAudio0200::CS_AC_INPUT_TERMINAL_DESCRIPTOR)))
     {
-        NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR inputTerminalDescriptor = nullptr;
-        if (NT_SUCCESS(m_acInputTerminalInfo.Get(index, inputTerminalDescriptor)))
-        {
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - terminal id %u, terminal link %u", inputTerminalDescriptor->bTerminalID, terminalLink);
-            if (inputTerminalDescriptor->bTerminalID == terminalLink)
-            {
-                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - terminal id %u, channels %u", inputTerminalDescriptor->bTerminalID, inputTerminalDescriptor->bNrChannels);
-                sourceID = inputTerminalDescriptor->bTerminalID;
-                numOfChannels = inputTerminalDescriptor->bNrChannels;
-                break;
-            }
-        }
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - terminal id %u, channels %u", inputTerminalDescriptor->bTerminalID, inputTerminalDescriptor->bNrChannels);
+        sourceID = inputTerminalDescriptor->bTerminalID;
+        numOfChannels = inputTerminalDescriptor->bNrChannels;
     }
 
     for (ULONG units = 0; units < MAX_OF_UNITS; units++)
@@ -2832,7 +2866,7 @@ NTSTATUS USBAudio2ControlInterface::SearchOutputTerminalFromInputTerminal(
 
 _Use_decl_annotations_
 PAGED_CODE_SEG
-NTSTATUS USBAudio2ControlInterface::SearchInputTerminalFromOutputTerminal(
+NTSTATUS USBAudio2ControlInterface::TraceInputTerminalFromOutputTerminal(
     UCHAR    terminalLink,
     UCHAR &  numOfChannels,
     USHORT & terminalType,
@@ -2841,14 +2875,9 @@ NTSTATUS USBAudio2ControlInterface::SearchInputTerminalFromOutputTerminal(
 )
 {
     NTSTATUS status = STATUS_UNSUCCESSFUL;
-    enum
-    {
-        MAX_OF_UNITS = 10
-    };
 
     PAGED_CODE();
 
-    ULONG numOfAcOutputTerminalInfo = m_acOutputTerminalInfo.GetNumOfArray();
     UCHAR sourceID = USBAudioConfiguration::InvalidID;
 
     numOfChannels = 0;
@@ -2856,82 +2885,64 @@ NTSTATUS USBAudio2ControlInterface::SearchInputTerminalFromOutputTerminal(
     volumeUnitID = USBAudioConfiguration::InvalidID;
     muteUnitID = USBAudioConfiguration::InvalidID;
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - num of ac output terminal info %u", numOfAcOutputTerminalInfo);
-    for (ULONG index = 0; index < numOfAcOutputTerminalInfo; index++)
+    NS_USBAudio0200::PCS_AC_OUTPUT_TERMINAL_DESCRIPTOR outputTerminalDescriptor = (NS_USBAudio0200::PCS_AC_OUTPUT_TERMINAL_DESCRIPTOR)GetEntityDescriptor(terminalLink, NS_USBAudio0200::OUTPUT_TERMINAL);
+    if ((outputTerminalDescriptor != nullptr) && (outputTerminalDescriptor->bLength >= sizeof(NS_USBAudio0200::CS_AC_OUTPUT_TERMINAL_DESCRIPTOR)))
     {
-        NS_USBAudio0200::PCS_AC_OUTPUT_TERMINAL_DESCRIPTOR outputTerminalDescriptor = nullptr;
-        if (NT_SUCCESS(m_acOutputTerminalInfo.Get(index, outputTerminalDescriptor)))
-        {
-            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - terminal id %u, terminal link %u", outputTerminalDescriptor->bTerminalID, terminalLink);
-            if (outputTerminalDescriptor->bTerminalID == terminalLink)
-            {
-                sourceID = outputTerminalDescriptor->bSourceID;
-                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - bSourceID %u", outputTerminalDescriptor->bSourceID);
-                break;
-            }
-        }
+        sourceID = outputTerminalDescriptor->bSourceID;
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - bSourceID %u", outputTerminalDescriptor->bSourceID);
     }
 
-    for (ULONG units = 0; units < MAX_OF_UNITS; units++)
+    //
+    // Each step follows bSourceID to the upstream entity. An acyclic chain visits every descriptor at most once,
+    // so MAX_AUDIO_DESCRIPTOR bounds the walk even if the descriptors describe a loop.
+    //
+    for (ULONG units = 0; units < MAX_AUDIO_DESCRIPTOR; units++)
     {
-        ULONG numOfGenericAudioDescriptorInfo = m_genericAudioDescriptorInfo.GetNumOfArray();
-        UCHAR sourceIDBackup = sourceID;
+        NS_USBAudio::PCS_GENERIC_AUDIO_DESCRIPTOR genericAudioDescriptor = m_entityDescriptors[sourceID];
+        UCHAR                                     sourceIDBackup = sourceID;
 
         TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - souceID id %u", sourceID);
-        for (ULONG index = 0; index < numOfGenericAudioDescriptorInfo; index++)
+        if (genericAudioDescriptor != nullptr)
         {
-            NS_USBAudio::PCS_GENERIC_AUDIO_DESCRIPTOR genericAudioDescriptor = nullptr;
-            if (NT_SUCCESS(m_genericAudioDescriptorInfo.Get(index, genericAudioDescriptor)))
+            switch (genericAudioDescriptor->bDescriptorSubtype)
             {
-                switch (genericAudioDescriptor->bDescriptorSubtype)
+            case NS_USBAudio0200::INPUT_TERMINAL:
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - input terminal bTerminalID %u, bCSSourceID %u", ((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->bTerminalID, ((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->bCSourceID);
+                numOfChannels = ((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->bNrChannels;
+                terminalType = ((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->wTerminalType;
+                return STATUS_SUCCESS;
+            case NS_USBAudio0200::FEATURE_UNIT: {
+                NS_USBAudio0200::PCS_AC_FEATURE_UNIT_DESCRIPTOR featureUnitDescriptor = (NS_USBAudio0200::PCS_AC_FEATURE_UNIT_DESCRIPTOR)genericAudioDescriptor;
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - feature unit unit id %u", featureUnitDescriptor->bUnitID);
+                UCHAR size = 4; // CS_AC_FEATURE_UNIT_DESCRIPTOR::bmaControls
+                UCHAR channels = (featureUnitDescriptor->bLength - offsetof(NS_USBAudio0200::CS_AC_FEATURE_UNIT_DESCRIPTOR, ch)) / size;
+                for (UCHAR ch = 0; ch < channels; ++ch)
                 {
-                case NS_USBAudio0200::INPUT_TERMINAL:
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - input terminal bTerminalID %u, bCSSourceID %u", ((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->bTerminalID, ((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->bCSourceID);
-                    if (((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->bTerminalID == sourceID)
+                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - feature unit ch[%u] bmaControls %02x %02x %02x %02x", ch, featureUnitDescriptor->ch[ch].bmaControls[3], featureUnitDescriptor->ch[ch].bmaControls[2], featureUnitDescriptor->ch[ch].bmaControls[1], featureUnitDescriptor->ch[ch].bmaControls[0]);
+                    if (featureUnitDescriptor->ch[ch].bmaControls[0] & NS_USBAudio0200::FEATURE_UNIT_BMA_MUTE_CONTROL_MASK)
                     {
-                        numOfChannels = ((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->bNrChannels;
-                        terminalType = ((NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR)genericAudioDescriptor)->wTerminalType;
-                        return STATUS_SUCCESS;
+                        muteUnitID = featureUnitDescriptor->bUnitID;
                     }
-                    break;
-                    break;
-                case NS_USBAudio0200::FEATURE_UNIT: {
-                    NS_USBAudio0200::PCS_AC_FEATURE_UNIT_DESCRIPTOR featureUnitDescriptor = (NS_USBAudio0200::PCS_AC_FEATURE_UNIT_DESCRIPTOR)genericAudioDescriptor;
-                    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - feature unit unit id %u", featureUnitDescriptor->bUnitID);
-                    if (featureUnitDescriptor->bUnitID == sourceID)
+                    if (featureUnitDescriptor->ch[ch].bmaControls[0] & NS_USBAudio0200::FEATURE_UNIT_BMA_VOLUME_CONTROL_MASK)
                     {
-                        UCHAR size = 4; // CS_AC_FEATURE_UNIT_DESCRIPTOR::bmaControls
-                        UCHAR channels = (featureUnitDescriptor->bLength - offsetof(NS_USBAudio0200::CS_AC_FEATURE_UNIT_DESCRIPTOR, ch)) / size;
-                        for (UCHAR ch = 0; ch < channels; ++ch)
-                        {
-                            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - feature unit ch[%u] bmaControls %02x %02x %02x %02x", ch, featureUnitDescriptor->ch[ch].bmaControls[3], featureUnitDescriptor->ch[ch].bmaControls[2], featureUnitDescriptor->ch[ch].bmaControls[1], featureUnitDescriptor->ch[ch].bmaControls[0]);
-                            if (featureUnitDescriptor->ch[ch].bmaControls[0] & NS_USBAudio0200::FEATURE_UNIT_BMA_MUTE_CONTROL_MASK)
-                            {
-                                muteUnitID = featureUnitDescriptor->bUnitID;
-                            }
-                            if (featureUnitDescriptor->ch[ch].bmaControls[0] & NS_USBAudio0200::FEATURE_UNIT_BMA_VOLUME_CONTROL_MASK)
-                            {
-                                volumeUnitID = featureUnitDescriptor->bUnitID;
-                            }
-                        }
-                        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - feature unit source id %u", featureUnitDescriptor->bSourceID);
-                        sourceID = featureUnitDescriptor->bSourceID;
-                        break;
+                        volumeUnitID = featureUnitDescriptor->bUnitID;
                     }
                 }
+                TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - feature unit source id %u", featureUnitDescriptor->bSourceID);
+                sourceID = featureUnitDescriptor->bSourceID;
+            }
+            break;
+            default:
+            case NS_USBAudio0200::CLOCK_MULTIPLIER:
+            case NS_USBAudio0200::CLOCK_SELECTOR:
+            case NS_USBAudio0200::CLOCK_SOURCE:
+            case NS_USBAudio0200::EXTENSION_UNIT:
+            case NS_USBAudio0200::MIXER_UNIT:
+            case NS_USBAudio0200::OUTPUT_TERMINAL:
+            case NS_USBAudio0200::PROCESSING_UNIT:
+            case NS_USBAudio0200::SAMPLE_RATE_CONVERTER:
+            case NS_USBAudio0200::SELECTOR_UNIT:
                 break;
-                default:
-                case NS_USBAudio0200::CLOCK_MULTIPLIER:
-                case NS_USBAudio0200::CLOCK_SELECTOR:
-                case NS_USBAudio0200::CLOCK_SOURCE:
-                case NS_USBAudio0200::EXTENSION_UNIT:
-                case NS_USBAudio0200::MIXER_UNIT:
-                case NS_USBAudio0200::OUTPUT_TERMINAL:
-                case NS_USBAudio0200::PROCESSING_UNIT:
-                case NS_USBAudio0200::SAMPLE_RATE_CONVERTER:
-                case NS_USBAudio0200::SELECTOR_UNIT:
-                    break;
-                }
             }
         }
         if (sourceIDBackup == sourceID)
@@ -2944,6 +2955,110 @@ NTSTATUS USBAudio2ControlInterface::SearchInputTerminalFromOutputTerminal(
     return status;
 }
 
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS USBAudio2ControlInterface::BuildTopologyPaths()
+{
+    NTSTATUS status = STATUS_SUCCESS;
+
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DESCRIPTOR, "%!FUNC! Entry");
+
+    //
+    // The descriptors do not change after they are parsed, so the path from every terminal is traced once here
+    // and SearchOutputTerminalFromInputTerminal / SearchInputTerminalFromOutputTerminal return the stored result.
+    //
+    RtlZeroMemory(m_topologyPathIndex, sizeof(m_topologyPathIndex));
+    m_numOfTopologyPaths = 0;
+
+    ULONG numOfAcInputTerminalInfo = m_acInputTerminalInfo.GetNumOfArray();
+    for (ULONG index = 0; (index < numOfAcInputTerminalInfo) && (m_numOfTopologyPaths < ARRAYSIZE(m_topologyPaths)); index++)
+    {
+        NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR inputTerminalDescriptor = nullptr;
+        if (NT_SUCCESS(m_acInputTerminalInfo.Get(index, inputTerminalDescriptor)) && (m_topologyPathIndex[inputTerminalDescriptor->bTerminalID] == 0))
+        {
+            AC_TOPOLOGY_PATH & path = m_topologyPaths[m_numOfTopologyPaths];
+            path.IsInputTerminal = true;
+            path.Status = TraceOutputTerminalFromInputTerminal(inputTerminalDescriptor->bTerminalID, path.NumOfChannels, path.TerminalType, path.VolumeUnitID, path.MuteUnitID);
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - input terminal %u, channels %u, terminal type 0x%04x, volume unit %u, mute unit %u, %!STATUS!", inputTerminalDescriptor->bTerminalID, path.NumOfChannels, path.TerminalType, path.VolumeUnitID, path.MuteUnitID, path.Status);
+            m_topologyPathIndex[inputTerminalDescriptor->bTerminalID] = (UCHAR)(++m_numOfTopologyPaths);
+        }
+    }
+
+    ULONG numOfAcOutputTerminalInfo = m_acOutputTerminalInfo.GetNumOfArray();
+    for (ULONG index = 0; (index < numOfAcOutputTerminalInfo) && (m_numOfTopologyPaths < ARRAYSIZE(m_topologyPaths)); index++)
+    {
+        NS_USBAudio0200::PCS_AC_OUTPUT_TERMINAL_DESCRIPTOR outputTerminalDescriptor = nullptr;
+        if (NT_SUCCESS(m_acOutputTerminalInfo.Get(index, outputTerminalDescriptor)) && (m_topologyPathIndex[outputTerminalDescriptor->bTerminalID] == 0))
+        {
+            AC_TOPOLOGY_PATH & path = m_topologyPaths[m_numOfTopologyPaths];
+            path.IsInputTerminal = false;
+            path.Status = TraceInputTerminalFromOutputTerminal(outputTerminalDescriptor->bTerminalID, path.NumOfChannels, path.TerminalType, path.VolumeUnitID, path.MuteUnitID);
+            TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DESCRIPTOR, " - output terminal %u, channels %u, terminal type 0x%04x, volume unit %u, mute unit %u, %!STATUS!", outputTerminalDescriptor->bTerminalID, path.NumOfChannels, path.TerminalType, path.VolumeUnitID, path.MuteUnitID, path.Status);
+            m_topologyPathIndex[outputTerminalDescriptor->bTerminalID] = (UCHAR)(++m_numOfTopologyPaths);
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DESCRIPTOR, "%!FUNC! Exit %!STATUS!", status);
+
+    return status;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS USBAudio2ControlInterface::SearchOutputTerminalFromInputTerminal(
+    UCHAR    terminalLink,
+    UCHAR &  numOfChannels,
+    USHORT & terminalType,
+    UCHAR &  volumeUnitID,
+    UCHAR &  muteUnitID
+)
+{
+    PAGED_CODE();
+
+    UCHAR pathIndex = m_topologyPathIndex[terminalLink];
+
+    if ((pathIndex != 0) && m_topologyPaths[pathIndex - 1].IsInputTerminal)
+    {
+        const AC_TOPOLOGY_PATH & path = m_topologyPaths[pathIndex - 1];
+        numOfChannels = path.NumOfChannels;
+        terminalType = path.TerminalType;
+        volumeUnitID = path.VolumeUnitID;
+        muteUnitID = path.MuteUnitID;
+        return path.Status;
+    }
+
+    return TraceOutputTerminalFromInputTerminal(terminalLink, numOfChannels, terminalType, volumeUnitID, muteUnitID);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+NTSTATUS USBAudio2ControlInterface::SearchInputTerminalFromOutputTerminal(
+    UCHAR    terminalLink,
+    UCHAR &  numOfChannels,
+    USHORT & terminalType,
+    UCHAR &  volumeUnitID,
+    UCHAR &  muteUnitID
+)
+{
+    PAGED_CODE();
+
+    UCHAR pathIndex = m_topologyPathIndex[terminalLink];
+
+    if ((pathIndex != 0) && !m_topologyPaths[pathIndex - 1].IsInputTerminal)
+    {
+        const AC_TOPOLOGY_PATH & path = m_topologyPaths[pathIndex - 1];
+        numOfChannels = path.NumOfChannels;
+        terminalType = path.TerminalType;
+        volumeUnitID = path.VolumeUnitID;
+        muteUnitID = path.MuteUnitID;
+        return path.Status;
+    }
+
+    return TraceInputTerminalFromOutputTerminal(terminalLink, numOfChannels, terminalType, volumeUnitID, muteUnitID);
+}
+
 // ======================================================================
 
 _Use_decl_annotations_
@@ -4435,6 +4550,21 @@ NTSTATUS USBAudioInterfaceInfo::SearchInputTerminalFromOutputTerminal(
     return status;
 }
 
+PAGED_CODE_SEG
+_Use_decl_annotations_
+NTSTATUS USBAudioInterfaceInfo::BuildTopologyPaths()
+{
+    NTSTATUS            status = STATUS_SUCCESS;
+    USBAudioInterface * usbAudioInterface = nullptr;
+
+    PAGED_CODE();
+
+    RETURN_NTSTATUS_IF_FAILED(m_usbAudioAlternateInterfaces.Get(0, usbAudioInterface));
+    status = ((USBAudioControlInterface *)usbAudioInterface)->BuildTopologyPaths();
+
+    return status;
+}
+
 // ======================================================================
 _Use_decl_annotations_
 PAGED_CODE_SEG
@@ -5158,6 +5288,18 @@ USBAudioConfiguration::ParseDescriptors(PUSB_CONFIGURATION_DESCRIPTOR usbConfigu
         status = STATUS_DEVICE_CONFIGURATION_ERROR;
     }
 
+    if (NT_SUCCESS(status))
+    {
+        for (ULONG index = 0; index < m_numOfUsbAudioInterfaceInfo; index++)
+        {
+            if ((m_usbAudioInterfaceInfoes[index] != nullptr) && m_usbAudioInterfaceInfoes[index]->IsControlInterface())
+            {
+                status = m_usbAudioInterfaceInfoes[index]->BuildTopologyPaths();
+                break;
+            }
+        }
+    }
+
     if (NT_SUCCESS(status))
     {
         if (hasInputAndOutputIsochronousInterfaces())
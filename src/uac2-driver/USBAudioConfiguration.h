@@ -456,6 +456,8 @@ class USBAudioControlInterface : public USBAudioInterface
         _Out_ UCHAR &  muteUnitID
     ) = 0;
 
+    virtual NTSTATUS BuildTopologyPaths() = 0;
+
     virtual NTSTATUS SetCurrentSampleFrequency(
         _In_ PDEVICE_CONTEXT deviceContext,
         _In_ ULONG           desiredSampleRate
@@ -476,9 +478,17 @@ class USBAudioControlInterface : public USBAudioInterface
     ) = 0;
 
   protected:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NS_USBAudio::PCS_GENERIC_AUDIO_DESCRIPTOR GetEntityDescriptor(
+        _In_ UCHAR entityID,
+        _In_ UCHAR descriptorSubtype
+    ) const;
+
     enum
     {
-        MAX_AUDIO_DESCRIPTOR = 30
+        MAX_AUDIO_DESCRIPTOR = 30,
+        MAX_ENTITY_ID = 0x100
     };
 
     ULONG                                                                          m_inputCurrentSampleRate{0};
@@ -488,6 +498,7 @@ class USBAudioControlInterface : public USBAudioInterface
     ULONG                                                                          m_outputSupportedSampleRate{0};
     UCHAR                                                                          m_outputSampleFrequencyControls{0};
     VariableArray<NS_USBAudio::PCS_GENERIC_AUDIO_DESCRIPTOR, MAX_AUDIO_DESCRIPTOR> m_genericAudioDescriptorInfo;
+    NS_USBAudio::PCS_GENERIC_AUDIO_DESCRIPTOR                                      m_entityDescriptors[MAX_ENTITY_ID]{}; // Terminals, units and clock entities indexed by their ID.
 };
 
 class USBAudioStreamInterface : public USBAudioInterface
@@ -692,6 +703,10 @@ class USBAudio1ControlInterface : public USBAudioControlInterface
         _Out_ UCHAR &  muteUnitID
     );
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual NTSTATUS BuildTopologyPaths();
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     virtual NTSTATUS SetCurrentSampleFrequency(
@@ -861,6 +876,20 @@ class USBAudio1StreamInterface : public USBAudioStreamInterface
     NS_USBAudio0100::PCS_AS_ISOCHRONOUS_AUDIO_DATA_ENDPOINT_DESCRIPTOR m_isochronousAudioDataEndpointDescriptor{nullptr};
 };
 
+//
+// The result of tracing the unit graph from a terminal to the terminal at the other end of the path.
+// IsInputTerminal identifies the terminal the path starts from.
+//
+typedef struct _AC_TOPOLOGY_PATH
+{
+    NTSTATUS Status;
+    bool     IsInputTerminal;
+    UCHAR    NumOfChannels;
+    USHORT   TerminalType;
+    UCHAR    VolumeUnitID;
+    UCHAR    MuteUnitID;
+} AC_TOPOLOGY_PATH;
+
 class USBAudio2ControlInterface : public USBAudioControlInterface
 {
   public:
@@ -973,6 +1002,10 @@ class USBAudio2ControlInterface : public USBAudioControlInterface
         _Out_ UCHAR &  muteUnitID
     );
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual NTSTATUS BuildTopologyPaths();
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     virtual NTSTATUS SetCurrentSampleFrequency(
@@ -1083,6 +1116,26 @@ class USBAudio2ControlInterface : public USBAudioControlInterface
         _In_ PDEVICE_CONTEXT deviceContext
     );
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS TraceOutputTerminalFromInputTerminal(
+        _In_ UCHAR     terminalLink,
+        _Out_ UCHAR &  numOfChannels,
+        _Out_ USHORT & terminalType,
+        _Out_ UCHAR &  volumeUnitID,
+        _Out_ UCHAR &  muteUnitID
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    NTSTATUS TraceInputTerminalFromOutputTerminal(
+        _In_ UCHAR     terminalLink,
+        _Out_ UCHAR &  numOfChannels,
+        _Out_ USHORT & terminalType,
+        _Out_ UCHAR &  volumeUnitID,
+        _Out_ UCHAR &  muteUnitID
+    );
+
     __drv_maxIRQL(PASSIVE_LEVEL)
     PAGED_CODE_SEG
     NTSTATUS USBAudio2ControlInterface::SearchOutputTerminal(
@@ -1106,6 +1159,9 @@ class USBAudio2ControlInterface : public USBAudioControlInterface
     VariableArray<NS_USBAudio0200::PCS_AC_OUTPUT_TERMINAL_DESCRIPTOR, MAX_TERMINAL>      m_acOutputTerminalInfo;
     VariableArray<NS_USBAudio0200::PCS_AC_INPUT_TERMINAL_DESCRIPTOR, MAX_TERMINAL>       m_acInputTerminalInfo;
     VariableArray<NS_USBAudio0200::PCS_AC_FEATURE_UNIT_DESCRIPTOR, MAX_FEATURE_UNIT>     m_acFeatureUnitInfo;
+    AC_TOPOLOGY_PATH                                                                     m_topologyPaths[MAX_TERMINAL * 2]{};
+    ULONG                                                                                m_numOfTopologyPaths{0};
+    UCHAR                                                                                m_topologyPathIndex[MAX_ENTITY_ID]{}; // 1 origin, 0 if the terminal has no path.
 };
 
 class USBAudio2StreamInterface : public USBAudioStreamInterface
@@ -1427,6 +1483,10 @@ class USBAudioInterfaceInfo
         _Out_ UCHAR &  muteUnitID
     );
 
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    virtual NTSTATUS BuildTopologyPaths();
+
   protected:
     WDFOBJECT                                                                m_parentObject{nullptr};
     VariableArray<USBAudioInterface *, DEFAULT_SIZE_OF_ALTERNATE_INTERFACES> m_usbAudioAlternateInterfaces;
@@ -0,0 +1,137 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    WakeupScheduler.cpp
+
+Abstract:
+
+    Implement a class that decides when the mixing engine thread wakes up
+    next in WakeUpMode::Deadline.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "StreamPlatform.h"
+#include "WakeupScheduler.h"
+
+#if !defined(__INTELLISENSE__) && !defined(STREAM_PLATFORM_HOST)
+#include "WakeupScheduler.tmh"
+#endif
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void WakeupScheduler::Reset(
+    ULONG irpPeriodUs
+)
+{
+    PAGED_CODE();
+
+    m_irpPeriodUs = max(irpPeriodUs, c_minIntervalUs);
+    m_lastWakeUpUs = 0ULL;
+    m_lastUsbBusTime = 0;
+    m_frameStartUs = 0ULL;
+    m_usefulWakeUps = 0;
+    m_idleWakeUps = 0;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void WakeupScheduler::RecordWakeUp(
+    ULONGLONG currentTimeUs,
+    ULONG     usbBusTime,
+    bool      useful
+)
+{
+    PAGED_CODE();
+
+    if (useful)
+    {
+        ++m_usefulWakeUps;
+    }
+    else
+    {
+        ++m_idleWakeUps;
+    }
+
+    if ((m_lastWakeUpUs != 0ULL) && (usbBusTime != m_lastUsbBusTime))
+    {
+        // The USB frame started between the previous wakeup and this one. If the
+        // predicted start is outside of that window, move it to the middle of it.
+        ULONGLONG predictedStartUs = 0ULL;
+        if ((m_frameStartUs != 0ULL) && (currentTimeUs >= m_frameStartUs))
+        {
+            predictedStartUs = m_frameStartUs + ((currentTimeUs - m_frameStartUs) / c_usbFrameUs) * c_usbFrameUs;
+        }
+        if ((predictedStartUs <= m_lastWakeUpUs) || (predictedStartUs > currentTimeUs))
+        {
+            m_frameStartUs = m_lastWakeUpUs + (currentTimeUs - m_lastWakeUpUs) / 2;
+        }
+    }
+
+    m_lastWakeUpUs = currentTimeUs;
+    m_lastUsbBusTime = usbBusTime;
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+ULONG
+WakeupScheduler::CalculateNextWakeUp(
+    ULONGLONG currentTimeUs,
+    ULONGLONG lastCompletionTimeUs,
+    bool      packetsPending,
+    LONG      asioRemainSamples,
+    ULONG     sampleRate
+)
+{
+    ULONG dueTimeUs = m_irpPeriodUs;
+
+    PAGED_CODE();
+
+    if (lastCompletionTimeUs != 0ULL)
+    {
+        // The completion routine wakes the thread up, this only covers a late completion.
+        ULONGLONG nextCompletionUs = lastCompletionTimeUs + m_irpPeriodUs;
+        dueTimeUs = (nextCompletionUs > currentTimeUs) ? (ULONG)(nextCompletionUs - currentTimeUs) + c_frameGuardUs : c_usbFrameUs;
+    }
+
+    if (packetsPending && (m_frameStartUs != 0ULL) && (currentTimeUs >= m_frameStartUs))
+    {
+        ULONG nextFrameUs = c_usbFrameUs - (ULONG)((currentTimeUs - m_frameStartUs) % c_usbFrameUs) + c_frameGuardUs;
+        dueTimeUs = min(dueTimeUs, nextFrameUs);
+    }
+    else if (packetsPending)
+    {
+        // The phase of the USB frame is not known yet.
+        dueTimeUs = min(dueTimeUs, c_minIntervalUs);
+    }
+
+    if ((asioRemainSamples > 0) && (sampleRate != 0))
+    {
+        ULONG asioBoundaryUs = (ULONG)min((ULONGLONG)asioRemainSamples * 1000000ULL / sampleRate, (ULONGLONG)m_irpPeriodUs);
+        dueTimeUs = min(dueTimeUs, asioBoundaryUs);
+    }
+
+    return min(max(dueTimeUs, c_minIntervalUs), m_irpPeriodUs);
+}
+
+_Use_decl_annotations_
+PAGED_CODE_SEG
+void WakeupScheduler::Report()
+{
+    ULONG wakeUps = m_usefulWakeUps + m_idleWakeUps;
+
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, " WakeupScheduler wakeups %u, useful %u, idle %u, useful ratio %u%%", wakeUps, m_usefulWakeUps, m_idleWakeUps, (wakeUps != 0) ? (ULONG)((ULONGLONG)m_usefulWakeUps * 100ULL / wakeUps) : 0);
+}
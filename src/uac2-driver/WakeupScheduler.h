@@ -0,0 +1,86 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    WakeupScheduler.h
+
+Abstract:
+
+    Define a class that decides when the mixing engine thread wakes up next
+    in WakeUpMode::Deadline, and counts the wakeups that found work.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#ifndef _WAKEUPSCHEDULER_H_
+#define _WAKEUPSCHEDULER_H_
+
+//
+// The estimated input position only advances when the USB frame number does,
+// and the completion routines wake the thread up on every IRP. So the thread
+// has nothing to do between those events, except for reaching the ASIO
+// boundary. WakeupScheduler tracks the phase of the USB frame from the frame
+// numbers seen at each wakeup, and returns the time to the earliest of
+// - the start of the next USB frame, while completed packets are waiting for
+//   the estimated position,
+// - the ASIO buffer boundary,
+// - the next IRP completion, as a fallback for a late completion.
+// All the times are passed in by the caller, and like PacketScheduler, the
+// implementation only reaches the platform through StreamPlatform.h.
+//
+class WakeupScheduler
+{
+  public:
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Reset(
+        _In_ ULONG irpPeriodUs
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void RecordWakeUp(
+        _In_ ULONGLONG currentTimeUs,
+        _In_ ULONG     usbBusTime,
+        _In_ bool      useful
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    ULONG
+    CalculateNextWakeUp(
+        _In_ ULONGLONG currentTimeUs,
+        _In_ ULONGLONG lastCompletionTimeUs,
+        _In_ bool      packetsPending,
+        _In_ LONG      asioRemainSamples,
+        _In_ ULONG     sampleRate
+    );
+
+    __drv_maxIRQL(PASSIVE_LEVEL)
+    PAGED_CODE_SEG
+    void Report();
+
+  protected:
+    static const ULONG c_usbFrameUs = 1000;
+    static const ULONG c_frameGuardUs = 50;   // Margin after the predicted start of a USB frame.
+    static const ULONG c_minIntervalUs = 100; // Period of WakeUpMode::Periodic.
+
+    ULONG     m_irpPeriodUs{0};
+    ULONGLONG m_lastWakeUpUs{0ULL};
+    ULONG     m_lastUsbBusTime{0};
+    ULONGLONG m_frameStartUs{0ULL}; // Predicted start of a USB frame, 0 until a frame change is seen.
+    ULONG     m_usefulWakeUps{0};
+    ULONG     m_idleWakeUps{0};
+};
+
+#endif
@@ -0,0 +1,150 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    AsioPositionTest.cpp
+
+Abstract:
+
+    Stress the hand-off of the ASIO buffer between two threads through two
+    AsioPosition instances, as between the ASIO client, which fills the ring,
+    and the render thread, which reads it and publishes the read position.
+    Every sample read must be the one written for its position, and no
+    position may be read torn or going backwards.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <thread>
+#include <vector>
+
+#include "StreamPlatform.h"
+#include "AsioPosition.h"
+#include "HostTest.h"
+
+static const ULONG    c_ringFrames = 96;
+static const ULONG    c_maxFramesPerRead = 48;
+static const LONGLONG c_totalFrames = 20000000;
+
+// The positions start below 2^32, so that a torn read of the high half shows.
+static const LONGLONG c_startPosition = 0xffffff00LL;
+
+typedef struct _HANDOFF
+{
+    AsioPosition          WritePosition; // advanced by the client
+    AsioPosition          ReadPosition;  // advanced by the render thread
+    std::vector<LONGLONG> Ring;
+    ULONG                 ClientErrors;
+    ULONG                 RenderErrors;
+    ULONG                 SampleErrors;
+} HANDOFF;
+
+//
+// The client writes the position of each frame into its slot, up to one ring
+// ahead of the read position, and publishes the frames it wrote.
+//
+static void ClientThread(
+    HANDOFF & handoff
+)
+{
+    LONGLONG written = handoff.WritePosition.Current();
+    LONGLONG lastRead = c_startPosition;
+
+    while (written < c_startPosition + c_totalFrames + c_ringFrames)
+    {
+        LONGLONG read = handoff.ReadPosition.Acquire();
+        if ((read < lastRead) || (read > written))
+        {
+            ++handoff.ClientErrors;
+        }
+        lastRead = read;
+
+        if (written == read + c_ringFrames)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        while (written < read + c_ringFrames)
+        {
+            handoff.Ring[(ULONGLONG)written % c_ringFrames] = written;
+            ++written;
+        }
+        handoff.WritePosition.Publish(written);
+    }
+}
+
+//
+// The render thread reads a varying number of frames from what the client
+// published, checks them, and publishes its read position after the copy.
+//
+static void RenderThread(
+    HANDOFF & handoff
+)
+{
+    LONGLONG read = handoff.ReadPosition.Current();
+    LONGLONG lastWritten = c_startPosition;
+    ULONG    random = 1;
+
+    while (read < c_startPosition + c_totalFrames)
+    {
+        LONGLONG written = handoff.WritePosition.Acquire();
+        if ((written < lastWritten) || (written < read) || (written > read + c_ringFrames))
+        {
+            ++handoff.RenderErrors;
+        }
+        lastWritten = written;
+
+        random = random * 1103515245 + 12345;
+        LONGLONG frames = 1 + (LONGLONG)((random >> 16) % c_maxFramesPerRead);
+        frames = (frames < written - read) ? frames : written - read;
+        frames = (frames < c_startPosition + c_totalFrames - read) ? frames : c_startPosition + c_totalFrames - read;
+        if (frames <= 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        for (LONGLONG frame = read; frame < read + frames; ++frame)
+        {
+            if (handoff.Ring[(ULONGLONG)frame % c_ringFrames] != frame)
+            {
+                ++handoff.SampleErrors;
+            }
+        }
+        read += frames;
+        handoff.ReadPosition.Publish(read);
+    }
+}
+
+int main()
+{
+    HANDOFF handoff;
+
+    handoff.Ring.assign(c_ringFrames, -1);
+    handoff.ClientErrors = 0;
+    handoff.RenderErrors = 0;
+    handoff.SampleErrors = 0;
+    handoff.WritePosition.Publish(c_startPosition);
+    handoff.ReadPosition.Publish(c_startPosition);
+
+    std::thread client(ClientThread, std::ref(handoff));
+    std::thread render(RenderThread, std::ref(handoff));
+    client.join();
+    render.join();
+
+    HOST_TEST_EXPECT(handoff.ClientErrors == 0, "%u read positions out of range", handoff.ClientErrors);
+    HOST_TEST_EXPECT(handoff.RenderErrors == 0, "%u write positions out of range", handoff.RenderErrors);
+    HOST_TEST_EXPECT(handoff.SampleErrors == 0, "%u frames read before they were written or after they were overwritten", handoff.SampleErrors);
+    HOST_TEST_EXPECT(handoff.ReadPosition.Current() == c_startPosition + c_totalFrames, "read position %lld", (long long)handoff.ReadPosition.Current());
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,306 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    AsioSharedBufferSimulation.cpp
+
+Abstract:
+
+    Simulate the recording side of the ASIO buffer exchange between the driver
+    and the ASIO client with two processes and a shared mapping laid out as in
+    SetAsioBuffer: the UAC_ASIO_REC_BUFFER_HEADER followed by one ring of two
+    periods per channel. The driver process converts the USB packets straight
+    into the shared rings with the deinterleave kernel, publishes the positions
+    in the header and signals the notification event; the client process
+    checks the half announced by RecBufferPosition and acknowledges it through
+    PlayReadyPosition. This validates the ordering of the single-copy model,
+    and the copy is timed against a staged copy with one more pass over the
+    samples, which is what a separate shared packet buffer would add.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST), POSIX
+
+--*/
+
+#include <chrono>
+#include <vector>
+
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "StreamPlatform.h"
+#include "InterleaveKernels.h"
+#include "HostTest.h"
+
+static const ULONG    c_channels = 6;
+static const ULONG    c_usbBytesPerSample = 3;
+static const ULONG    c_asioBytesPerSample = 4;
+static const ULONG    c_periodFrames = 64;
+static const ULONG    c_bufferFrames = c_periodFrames * 2;
+static const LONGLONG c_totalFrames = 400000;
+
+typedef struct _SHARED_SYNC
+{
+    sem_t NotificationEvent; // KeSetEvent(m_userNotificationEvent) in the driver
+    LONG  Skipped;           // written by the client before it exits
+    LONG  Errors;
+} SHARED_SYNC;
+
+static LONG SampleValue(
+    LONGLONG frame,
+    ULONG    channel
+)
+{
+    return (LONG)(((ULONGLONG)frame * 7 + channel * 131) & 0xffffff);
+}
+
+static PUCHAR ChannelBuffer(
+    PUAC_ASIO_REC_BUFFER_HEADER header,
+    ULONG                       channel
+)
+{
+    return (PUCHAR)header + header->HeaderLength + (c_bufferFrames * c_asioBytesPerSample * channel);
+}
+
+static LONG CheckHalf(
+    PUAC_ASIO_REC_BUFFER_HEADER header,
+    LONGLONG                    bufferPosition
+)
+{
+    ULONG startFrame = (ULONG)(bufferPosition % c_bufferFrames);
+    LONG  errors = 0;
+
+    for (ULONG ch = 0; ch < c_channels; ++ch)
+    {
+        const LONG * samples = (const LONG *)ChannelBuffer(header, ch);
+        for (ULONG frame = 0; frame < c_periodFrames; ++frame)
+        {
+            if (samples[startFrame + frame] != (LONG)((ULONG)SampleValue(bufferPosition + frame, ch) << 8))
+            {
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
+
+//
+// The client waits for the notification, checks the half that RecBufferPosition
+// announces at the start and at the end of its callback, and acknowledges it.
+// A notification that finds a later position than the next half is a late
+// client, and is counted as skipped.
+//
+static void ClientProcess(
+    PUAC_ASIO_REC_BUFFER_HEADER header,
+    SHARED_SYNC *               sync
+)
+{
+    LONGLONG expected = 0;
+
+    while (expected + c_periodFrames <= c_totalFrames)
+    {
+        sem_wait(&sync->NotificationEvent);
+
+        LONGLONG bufferPosition = ReadAcquire64(&header->RecBufferPosition);
+        if (bufferPosition < expected)
+        {
+            continue;
+        }
+        if (bufferPosition > expected)
+        {
+            sync->Skipped += (LONG)((bufferPosition - expected) / c_periodFrames);
+        }
+        if (ReadNoFence64(&header->RecCurrentPosition) < bufferPosition + c_periodFrames)
+        {
+            ++sync->Errors;
+        }
+
+        sync->Errors += CheckHalf(header, bufferPosition);
+        usleep(20);
+        sync->Errors += CheckHalf(header, bufferPosition);
+
+        InterlockedExchange64(&header->PlayReadyPosition, bufferPosition);
+        expected = bufferPosition + c_periodFrames;
+    }
+}
+
+//
+// The driver deinterleaves packets of 6 or 7 frames into the rings, splitting
+// the copy at the end of the ring as CopyToAsioFromInputData does. It does not
+// overwrite the half that the client has not acknowledged yet.
+//
+static void DriverProcess(
+    PUAC_ASIO_REC_BUFFER_HEADER    header,
+    SHARED_SYNC *                  sync,
+    const INTERLEAVE_KERNEL_INFO & kernelInfo
+)
+{
+    std::vector<UCHAR> packet(7 * c_channels * c_usbBytesPerSample);
+    PUCHAR             channelBuffers[c_channels];
+    LONGLONG           position = 0;
+    LONGLONG           notifyPosition = 0;
+    ULONG              random = 1;
+
+    for (ULONG ch = 0; ch < c_channels; ++ch)
+    {
+        channelBuffers[ch] = ChannelBuffer(header, ch);
+    }
+
+    while (position < c_totalFrames)
+    {
+        random = random * 1103515245 + 12345;
+        ULONG frames = (((random >> 16) % 10) == 0) ? 7 : 6;
+
+        // Once the client has acknowledged the half at PlayReadyPosition, the driver may fill it
+        // again, that is write up to three periods past it; the half after it stays with the client.
+        while (position + frames > ReadAcquire64(&header->PlayReadyPosition) + 3 * (LONGLONG)c_periodFrames)
+        {
+            usleep(10);
+        }
+
+        for (ULONG frame = 0; frame < frames; ++frame)
+        {
+            for (ULONG ch = 0; ch < c_channels; ++ch)
+            {
+                LONG   value = SampleValue(position + frame, ch);
+                PUCHAR sample = &packet[(frame * c_channels + ch) * c_usbBytesPerSample];
+                sample[0] = (UCHAR)value;
+                sample[1] = (UCHAR)(value >> 8);
+                sample[2] = (UCHAR)(value >> 16);
+            }
+        }
+
+        ULONG startFrame = (ULONG)(position % c_bufferFrames);
+        ULONG framesFirst = MIN(frames, c_bufferFrames - startFrame);
+        kernelInfo.Deinterleave(packet.data(), c_channels * c_usbBytesPerSample, channelBuffers, startFrame, c_channels, framesFirst);
+        if (frames > framesFirst)
+        {
+            kernelInfo.Deinterleave(packet.data() + framesFirst * c_channels * c_usbBytesPerSample, c_channels * c_usbBytesPerSample, channelBuffers, 0, c_channels, frames - framesFirst);
+        }
+        position += frames;
+        InterlockedExchange64(&header->RecCurrentPosition, position);
+
+        if (position - notifyPosition >= c_periodFrames)
+        {
+            InterlockedExchange64(&header->RecBufferPosition, notifyPosition);
+            notifyPosition += c_periodFrames;
+            sem_post(&sync->NotificationEvent);
+        }
+    }
+    // Releases the client if it is still waiting for a half that is not complete.
+    sem_post(&sync->NotificationEvent);
+}
+
+//
+// Times the deinterleave into the rings against a deinterleave into a staging
+// buffer followed by a copy of it into the rings.
+//
+static void MeasureCopies(
+    const INTERLEAVE_KERNEL_INFO & kernelInfo
+)
+{
+    const ULONG        channels = 32;
+    const ULONG        frames = c_bufferFrames;
+    const ULONG        iterations = 2000;
+    std::vector<UCHAR> usb(frames * channels * c_usbBytesPerSample, 0x5a);
+    std::vector<UCHAR> rings(frames * channels * c_asioBytesPerSample);
+    std::vector<UCHAR> staging(rings.size());
+    PUCHAR             ringBuffers[channels];
+    PUCHAR             stagingBuffers[channels];
+
+    for (ULONG ch = 0; ch < channels; ++ch)
+    {
+        ringBuffers[ch] = rings.data() + frames * c_asioBytesPerSample * ch;
+        stagingBuffers[ch] = staging.data() + frames * c_asioBytesPerSample * ch;
+    }
+
+    std::chrono::steady_clock::duration single{};
+    std::chrono::steady_clock::duration staged{};
+
+    // The two are interleaved in rounds, so that both run on a warm cache and clock.
+    for (ULONG round = 0; round < 10; ++round)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (ULONG i = 0; i < iterations; ++i)
+        {
+            kernelInfo.Deinterleave(usb.data(), channels * c_usbBytesPerSample, ringBuffers, 0, channels, frames);
+        }
+        single += std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (ULONG i = 0; i < iterations; ++i)
+        {
+            kernelInfo.Deinterleave(usb.data(), channels * c_usbBytesPerSample, stagingBuffers, 0, channels, frames);
+            memcpy(rings.data(), staging.data(), rings.size());
+        }
+        staged += std::chrono::steady_clock::now() - start;
+    }
+
+    double megabytes = (double)rings.size() * iterations * 10 / 1e6;
+    printf("%u channels: single copy %.0f MB/s, staged copy %.0f MB/s\n", channels, megabytes / std::chrono::duration<double>(single).count(), megabytes / std::chrono::duration<double>(staged).count());
+}
+
+int main()
+{
+    INTERLEAVE_KERNEL_INFO kernelInfo;
+    HOST_TEST_EXPECT(NT_SUCCESS(InterleaveKernels::Select(c_usbBytesPerSample, c_asioBytesPerSample, InterleaveChannelClass::Sparse, kernelInfo)), "no deinterleave kernel");
+    if (kernelInfo.Deinterleave == nullptr)
+    {
+        return HOST_TEST_RESULT();
+    }
+
+    size_t mappingSize = sizeof(UAC_ASIO_REC_BUFFER_HEADER) + c_channels * c_bufferFrames * c_asioBytesPerSample;
+    PVOID  mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    PVOID  syncMapping = mmap(nullptr, sizeof(SHARED_SYNC), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    HOST_TEST_EXPECT((mapping != MAP_FAILED) && (syncMapping != MAP_FAILED), "mmap failed");
+    if ((mapping == MAP_FAILED) || (syncMapping == MAP_FAILED))
+    {
+        return HOST_TEST_RESULT();
+    }
+
+    PUAC_ASIO_REC_BUFFER_HEADER header = (PUAC_ASIO_REC_BUFFER_HEADER)mapping;
+    SHARED_SYNC *               sync = (SHARED_SYNC *)syncMapping;
+
+    memset(mapping, 0, mappingSize);
+    header->HeaderLength = sizeof(UAC_ASIO_REC_BUFFER_HEADER);
+    header->PlayReadyPosition = -(LONGLONG)c_periodFrames;
+    sync->Skipped = 0;
+    sync->Errors = 0;
+    sem_init(&sync->NotificationEvent, 1, 0);
+
+    pid_t client = fork();
+    if (client == 0)
+    {
+        ClientProcess(header, sync);
+        _exit(0);
+    }
+    HOST_TEST_EXPECT(client > 0, "fork failed");
+    if (client > 0)
+    {
+        int exitStatus = 0;
+
+        DriverProcess(header, sync, kernelInfo);
+        waitpid(client, &exitStatus, 0);
+        HOST_TEST_EXPECT(WIFEXITED(exitStatus) && (WEXITSTATUS(exitStatus) == 0), "the client exited with %d", exitStatus);
+        HOST_TEST_EXPECT(sync->Errors == 0, "%d samples or positions seen by the client before they were published or after they were overwritten", (int)sync->Errors);
+        printf("%lld frames, %d periods skipped by the client\n", (long long)c_totalFrames, (int)sync->Skipped);
+    }
+
+    sem_destroy(&sync->NotificationEvent);
+    munmap(syncMapping, sizeof(SHARED_SYNC));
+    munmap(mapping, mappingSize);
+
+    MeasureCopies(kernelInfo);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,408 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    ControlRequestSequencerTest.cpp
+
+Abstract:
+
+    Test ControlRequestSequencer against a mock device that answers each send
+    with a scripted result. On a simulated clock, the interval between the
+    requests, the babble backoff and the retries must follow the policy, and
+    the lock must be released on every sleep. On the wall clock, a request of
+    another thread must be sent while the first one backs off.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "StreamPlatform.h"
+#include "ControlRequestSequencer.h"
+#include "HostTest.h"
+
+static const LONGLONG c_100nsPerMs = 10000LL;
+
+typedef struct _MOCK_RESULT
+{
+    NTSTATUS             Status;
+    ControlTransferError Error;
+} MOCK_RESULT;
+
+//
+// A device on a simulated clock. Every send takes c_sendTime, and a sleep
+// moves the clock to its due time.
+//
+class MockControlDevice : public ControlRequestTransport
+{
+  public:
+    static const LONGLONG c_sendTime = 1 * c_100nsPerMs;
+
+    MockControlDevice(std::initializer_list<MOCK_RESULT> results)
+        : m_results(results)
+    {
+    }
+
+    NTSTATUS Send(ULONG timeoutMs, ControlTransferError & error) override
+    {
+        HOST_TEST_EXPECT(m_locked, "the request is sent without the lock");
+        m_sendTimes.push_back(m_now);
+        m_sendTimeouts.push_back(timeoutMs);
+        m_now += c_sendTime;
+
+        MOCK_RESULT result = (m_next < m_results.size()) ? m_results[m_next] : MOCK_RESULT{STATUS_SUCCESS, ControlTransferError::None};
+        ++m_next;
+        error = result.Error;
+        return result.Status;
+    }
+
+    LONGLONG QueryTime() override
+    {
+        return m_now;
+    }
+
+    void DelayUntil(LONGLONG time) override
+    {
+        HOST_TEST_EXPECT(!m_locked, "the sequencer sleeps with the lock held");
+        m_delays.push_back(time - m_now);
+        if (time > m_now)
+        {
+            m_now = time;
+        }
+    }
+
+    void Lock() override
+    {
+        HOST_TEST_EXPECT(!m_locked, "the lock is acquired twice");
+        m_locked = true;
+    }
+
+    void Unlock() override
+    {
+        HOST_TEST_EXPECT(m_locked, "the lock is released twice");
+        m_locked = false;
+    }
+
+    void CountFailure() override
+    {
+        ++m_failures;
+    }
+
+    void Advance(LONGLONG time)
+    {
+        m_now += time;
+    }
+
+    std::vector<MOCK_RESULT> m_results;
+    size_t                   m_next{0};
+    LONGLONG                 m_now{1000 * c_100nsPerMs};
+    bool                     m_locked{false};
+    std::vector<LONGLONG>    m_sendTimes;
+    std::vector<ULONG>       m_sendTimeouts;
+    std::vector<LONGLONG>    m_delays;
+    ULONG                    m_failures{0};
+};
+
+static CONTROL_REQUEST_POLICY DefaultPolicy()
+{
+    CONTROL_REQUEST_POLICY policy;
+    policy.RequestIntervalMs = 10;
+    policy.SkipIntervalForGet = false;
+    policy.RequestRetry = 3;
+    policy.RetryBackoffMs = 100;
+    policy.RequestTimeoutMs = 5000;
+    policy.RetryTimeoutMs = 1000;
+    return policy;
+}
+
+// Runs one request with the lock held around it, as ControlRequest() does.
+static NTSTATUS RunLocked(
+    MockControlDevice &            device,
+    const CONTROL_REQUEST_POLICY & policy,
+    bool                           isGet,
+    LONGLONG &                     lastRequestTime
+)
+{
+    device.Lock();
+    NTSTATUS status = ControlRequestSequencer::Run(device, policy, isGet, lastRequestTime);
+    HOST_TEST_EXPECT(device.m_locked, "the lock is not held on return");
+    device.Unlock();
+    return status;
+}
+
+static void TestInterval()
+{
+    CONTROL_REQUEST_POLICY policy = DefaultPolicy();
+    MockControlDevice      device({});
+    LONGLONG               lastRequestTime = 0;
+
+    for (ULONG i = 0; i < 4; ++i)
+    {
+        HOST_TEST_EXPECT(NT_SUCCESS(RunLocked(device, policy, (i % 2) == 0, lastRequestTime)), "request %u", i);
+    }
+    device.Advance(50 * c_100nsPerMs);
+    HOST_TEST_EXPECT(NT_SUCCESS(RunLocked(device, policy, false, lastRequestTime)), "request after idle");
+
+    HOST_TEST_EXPECT(device.m_sendTimes.size() == 5, "%zu sends", device.m_sendTimes.size());
+    for (size_t i = 1; i < device.m_sendTimes.size(); ++i)
+    {
+        LONGLONG interval = device.m_sendTimes[i] - device.m_sendTimes[i - 1];
+        HOST_TEST_EXPECT(interval >= policy.RequestIntervalMs * c_100nsPerMs, "send %zu after %lld00ns", i, (long long)interval);
+    }
+    // Back-to-back requests wait for the rest of the interval, an idle device does not.
+    HOST_TEST_EXPECT(device.m_sendTimes[1] - device.m_sendTimes[0] == policy.RequestIntervalMs * c_100nsPerMs, "the interval is not kept exactly");
+    HOST_TEST_EXPECT(device.m_delays.size() == 3, "%zu sleeps", device.m_delays.size());
+    HOST_TEST_EXPECT(device.m_failures == 0, "%u failures counted", device.m_failures);
+}
+
+static void TestSkipIntervalForGet()
+{
+    CONTROL_REQUEST_POLICY policy = DefaultPolicy();
+    MockControlDevice      device({});
+    LONGLONG               lastRequestTime = 0;
+
+    policy.SkipIntervalForGet = true;
+
+    HOST_TEST_EXPECT(NT_SUCCESS(RunLocked(device, policy, false, lastRequestTime)), "SET");
+    HOST_TEST_EXPECT(NT_SUCCESS(RunLocked(device, policy, true, lastRequestTime)), "GET");
+    HOST_TEST_EXPECT(NT_SUCCESS(RunLocked(device, policy, true, lastRequestTime)), "GET");
+    HOST_TEST_EXPECT(NT_SUCCESS(RunLocked(device, policy, false, lastRequestTime)), "SET");
+
+    HOST_TEST_EXPECT(device.m_sendTimes[1] - device.m_sendTimes[0] == MockControlDevice::c_sendTime, "the GET waited for the interval");
+    HOST_TEST_EXPECT(device.m_sendTimes[2] - device.m_sendTimes[1] == MockControlDevice::c_sendTime, "the GET waited for the interval");
+    // The SET still keeps the interval from the last GET.
+    HOST_TEST_EXPECT(device.m_sendTimes[3] - device.m_sendTimes[2] == policy.RequestIntervalMs * c_100nsPerMs, "the SET did not wait for the interval");
+}
+
+static void TestBabbleRecovers()
+{
+    CONTROL_REQUEST_POLICY policy = DefaultPolicy();
+    LONGLONG               lastRequestTime = 0;
+
+    policy.RequestRetry = 5;
+
+    MockControlDevice device({
+        {STATUS_UNSUCCESSFUL, ControlTransferError::Babble},
+        {STATUS_UNSUCCESSFUL, ControlTransferError::Babble},
+        {STATUS_SUCCESS, ControlTransferError::None},
+        {STATUS_SUCCESS, ControlTransferError::None},
+    });
+
+    NTSTATUS status = RunLocked(device, policy, true, lastRequestTime);
+
+    HOST_TEST_EXPECT(NT_SUCCESS(status), "status %08x", (ULONG)status);
+    // Two babbles, the success that follows them and the request sent again after it.
+    HOST_TEST_EXPECT(device.m_sendTimes.size() == 4, "%zu sends", device.m_sendTimes.size());
+    HOST_TEST_EXPECT(device.m_delays.size() == 3, "%zu sleeps", device.m_delays.size());
+    if (device.m_delays.size() == 3)
+    {
+        HOST_TEST_EXPECT(device.m_delays[0] == 100 * c_100nsPerMs, "first backoff %lld", (long long)device.m_delays[0]);
+        HOST_TEST_EXPECT(device.m_delays[1] == 200 * c_100nsPerMs, "second backoff %lld", (long long)device.m_delays[1]);
+        HOST_TEST_EXPECT(device.m_delays[2] == 100 * c_100nsPerMs, "settle time %lld", (long long)device.m_delays[2]);
+    }
+    HOST_TEST_EXPECT(device.m_failures == 2, "%u failures counted", device.m_failures);
+}
+
+static void TestBabbleBackoffLimit()
+{
+    CONTROL_REQUEST_POLICY policy = DefaultPolicy();
+    LONGLONG               lastRequestTime = 0;
+
+    policy.RequestRetry = 8;
+
+    MockControlDevice device({});
+    for (ULONG i = 0; i < policy.RequestRetry; ++i)
+    {
+        device.m_results.push_back({STATUS_UNSUCCESSFUL, ControlTransferError::Babble});
+    }
+
+    NTSTATUS status = RunLocked(device, policy, false, lastRequestTime);
+
+    HOST_TEST_EXPECT(status == STATUS_BUFFER_TOO_SMALL, "status %08x", (ULONG)status);
+    HOST_TEST_EXPECT(device.m_sendTimes.size() == policy.RequestRetry, "%zu sends", device.m_sendTimes.size());
+    HOST_TEST_EXPECT(device.m_delays.size() == policy.RequestRetry - 1, "%zu sleeps", device.m_delays.size());
+    for (size_t i = 0; i < device.m_delays.size(); ++i)
+    {
+        LONGLONG expected = ((LONGLONG)policy.RetryBackoffMs << ((i < 4) ? i : 4)) * c_100nsPerMs;
+        HOST_TEST_EXPECT(device.m_delays[i] == expected, "backoff %zu is %lld, expected %lld", i, (long long)device.m_delays[i], (long long)expected);
+    }
+}
+
+static void TestFailures()
+{
+    CONTROL_REQUEST_POLICY policy = DefaultPolicy();
+
+    {
+        // A stall is the answer of the device, so it is neither retried nor counted.
+        LONGLONG          lastRequestTime = 0;
+        MockControlDevice device({{STATUS_UNSUCCESSFUL, ControlTransferError::Stall}});
+        NTSTATUS          status = RunLocked(device, policy, true, lastRequestTime);
+        HOST_TEST_EXPECT(status == STATUS_UNSUCCESSFUL, "stall status %08x", (ULONG)status);
+        HOST_TEST_EXPECT(device.m_sendTimes.size() == 1, "stall: %zu sends", device.m_sendTimes.size());
+        HOST_TEST_EXPECT(device.m_failures == 0, "stall: %u failures counted", device.m_failures);
+    }
+    {
+        LONGLONG          lastRequestTime = 0;
+        MockControlDevice device({{STATUS_NO_SUCH_DEVICE, ControlTransferError::Other}});
+        NTSTATUS          status = RunLocked(device, policy, true, lastRequestTime);
+        HOST_TEST_EXPECT(status == STATUS_NO_SUCH_DEVICE, "removed device status %08x", (ULONG)status);
+        HOST_TEST_EXPECT(device.m_sendTimes.size() == 1, "removed device: %zu sends", device.m_sendTimes.size());
+        HOST_TEST_EXPECT(device.m_failures == 1, "removed device: %u failures counted", device.m_failures);
+    }
+    {
+        // Any other failure is retried once, with the retry timeout.
+        LONGLONG          lastRequestTime = 0;
+        MockControlDevice device({
+            {STATUS_IO_TIMEOUT, ControlTransferError::Other},
+            {STATUS_IO_TIMEOUT, ControlTransferError::Other},
+        });
+        NTSTATUS          status = RunLocked(device, policy, false, lastRequestTime);
+        HOST_TEST_EXPECT(status == STATUS_IO_TIMEOUT, "timeout status %08x", (ULONG)status);
+        HOST_TEST_EXPECT(device.m_sendTimes.size() == 2, "timeout: %zu sends", device.m_sendTimes.size());
+        HOST_TEST_EXPECT((device.m_sendTimeouts.size() == 2) && (device.m_sendTimeouts[0] == policy.RequestTimeoutMs) && (device.m_sendTimeouts[1] == policy.RetryTimeoutMs), "timeout: the retry timeout is not used");
+        HOST_TEST_EXPECT(device.m_failures == 2, "timeout: %u failures counted", device.m_failures);
+    }
+    {
+        LONGLONG          lastRequestTime = 0;
+        MockControlDevice device({{STATUS_DEVICE_BUSY, ControlTransferError::Other}});
+        NTSTATUS          status = RunLocked(device, policy, true, lastRequestTime);
+        HOST_TEST_EXPECT(NT_SUCCESS(status), "busy then success status %08x", (ULONG)status);
+        HOST_TEST_EXPECT(device.m_sendTimes.size() == 2, "busy: %zu sends", device.m_sendTimes.size());
+        HOST_TEST_EXPECT(device.m_failures == 0, "busy: %u failures counted", device.m_failures);
+    }
+}
+
+//
+// Two threads share one device, its lock and its last request time on the wall
+// clock. The first request babbles; the second one, issued while the first
+// backs off, must be sent before the retry of the first.
+//
+class SharedControlDevice
+{
+  public:
+    std::mutex            m_lock;
+    LONGLONG              m_lastRequestTime{0};
+    std::vector<int>      m_sendOrder; // written with m_lock held
+    std::vector<LONGLONG> m_sendTimes;
+    std::atomic<bool>     m_firstBackingOff{false};
+};
+
+class ThreadTransport : public ControlRequestTransport
+{
+  public:
+    ThreadTransport(SharedControlDevice & device, int id, bool babbleOnce)
+        : m_device(device), m_id(id), m_babbleOnce(babbleOnce)
+    {
+    }
+
+    NTSTATUS Send(ULONG, ControlTransferError & error) override
+    {
+        m_device.m_sendOrder.push_back(m_id);
+        m_device.m_sendTimes.push_back(QueryTime());
+        if (m_babbleOnce)
+        {
+            m_babbleOnce = false;
+            error = ControlTransferError::Babble;
+            return STATUS_UNSUCCESSFUL;
+        }
+        error = ControlTransferError::None;
+        return STATUS_SUCCESS;
+    }
+
+    LONGLONG QueryTime() override
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() / 100;
+    }
+
+    void DelayUntil(LONGLONG time) override
+    {
+        if (m_id == 0)
+        {
+            m_device.m_firstBackingOff = true;
+        }
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(time * 100))));
+    }
+
+    void Lock() override
+    {
+        m_device.m_lock.lock();
+    }
+
+    void Unlock() override
+    {
+        m_device.m_lock.unlock();
+    }
+
+    void CountFailure() override
+    {
+    }
+
+  private:
+    SharedControlDevice & m_device;
+    int                   m_id;
+    bool                  m_babbleOnce;
+};
+
+static void TestLockReleasedDuringBackoff()
+{
+    CONTROL_REQUEST_POLICY policy = DefaultPolicy();
+    SharedControlDevice    device;
+    NTSTATUS               status[2]{STATUS_UNSUCCESSFUL, STATUS_UNSUCCESSFUL};
+
+    policy.RequestIntervalMs = 2;
+    policy.RetryBackoffMs = 50;
+
+    std::thread first([&] {
+        ThreadTransport transport(device, 0, true);
+        transport.Lock();
+        status[0] = ControlRequestSequencer::Run(transport, policy, false, device.m_lastRequestTime);
+        transport.Unlock();
+    });
+    std::thread second([&] {
+        while (!device.m_firstBackingOff)
+        {
+            std::this_thread::yield();
+        }
+        ThreadTransport transport(device, 1, false);
+        transport.Lock();
+        status[1] = ControlRequestSequencer::Run(transport, policy, false, device.m_lastRequestTime);
+        transport.Unlock();
+    });
+    first.join();
+    second.join();
+
+    HOST_TEST_EXPECT(NT_SUCCESS(status[0]) && NT_SUCCESS(status[1]), "status %08x %08x", (ULONG)status[0], (ULONG)status[1]);
+    // The babble, the second thread, the success of the first and the request it sends again after the babble.
+    HOST_TEST_EXPECT((device.m_sendOrder.size() == 4) && (device.m_sendOrder[0] == 0) && (device.m_sendOrder[1] == 1), "the second request waited for the backoff of the first");
+    for (size_t i = 1; i < device.m_sendTimes.size(); ++i)
+    {
+        LONGLONG interval = device.m_sendTimes[i] - device.m_sendTimes[i - 1];
+        HOST_TEST_EXPECT(interval >= policy.RequestIntervalMs * c_100nsPerMs, "send %zu after %lld00ns", i, (long long)interval);
+    }
+}
+
+int main()
+{
+    TestInterval();
+    TestSkipIntervalForGet();
+    TestBabbleRecovers();
+    TestBabbleBackoffLimit();
+    TestFailures();
+    TestLockReleasedDuringBackoff();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,180 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    ConverterMatrixTest.cpp
+
+Abstract:
+
+    Test the converter selection for every ASIO sample type and USB sample
+    width: the pairs that AsioBufferObject::SelectConverter() can request
+    resolve to an interleave and a deinterleave kernel that round-trip the
+    USB samples, the others are rejected, and the input copy kernels of
+    MixKernels::SelectCopy() copy every sample width.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <vector>
+
+#include "StreamPlatform.h"
+#include "InterleaveKernels.h"
+#include "MixKernels.h"
+#include "HostTest.h"
+
+//
+// The UACSampleType values that the driver reports to ASIO clients, with the
+// ASIO sample size that USBAudioDataFormat::ConverSampleTypeToBytesPerSample()
+// returns for them.
+//
+typedef struct _SAMPLE_TYPE
+{
+    const char * Name;
+    ULONG        AsioBytesPerSample;
+} SAMPLE_TYPE;
+
+static const SAMPLE_TYPE c_sampleTypes[] = {
+    {"UACSTInt16LSB", 2},
+    {"UACSTInt24LSB", 3},
+    {"UACSTInt32LSB", 4},
+    {"UACSTFloat32LSB", 4},
+    {"UACSTInt32LSB16", 4},
+    {"UACSTInt32LSB20", 4},
+    {"UACSTInt32LSB24", 4},
+};
+
+static const ULONG c_channels[] = {1, 3, 4, 6, 8, 11};
+static const ULONG c_frames = 45;
+
+static void TestRoundTrip(
+    const SAMPLE_TYPE &            sampleType,
+    const INTERLEAVE_KERNEL_INFO & kernelInfo,
+    ULONG                          channels
+)
+{
+    const ULONG         usbBytes = kernelInfo.UsbBytesPerSample;
+    const ULONG         asioBytes = kernelInfo.AsioBytesPerSample;
+    const ULONG         bytesPerBlock = channels * usbBytes;
+    std::vector<UCHAR>  usb(bytesPerBlock * c_frames);
+    std::vector<UCHAR>  asio(channels * asioBytes * c_frames, 0xcc);
+    std::vector<UCHAR>  usbOut(usb.size(), 0);
+    std::vector<PUCHAR> asioChannels(channels);
+
+    for (size_t i = 0; i < usb.size(); ++i)
+    {
+        usb[i] = (UCHAR)(i * 7 + 3);
+    }
+    for (ULONG ch = 0; ch < channels; ++ch)
+    {
+        asioChannels[ch] = asio.data() + ch * asioBytes * c_frames;
+    }
+
+    kernelInfo.Deinterleave(usb.data(), bytesPerBlock, asioChannels.data(), 0, channels, c_frames);
+    for (ULONG ch = 0; ch < channels; ++ch)
+    {
+        for (ULONG frame = 0; frame < c_frames; ++frame)
+        {
+            const UCHAR * asioSample = asioChannels[ch] + frame * asioBytes;
+            const UCHAR * usbSample = usb.data() + frame * bytesPerBlock + ch * usbBytes;
+            bool          match = (memcmp(asioSample + asioBytes - usbBytes, usbSample, usbBytes) == 0);
+            for (ULONG byte = 0; byte < asioBytes - usbBytes; ++byte)
+            {
+                match = match && (asioSample[byte] == 0);
+            }
+            HOST_TEST_EXPECT(match, "%s, %u-byte USB samples, %u channels: channel %u frame %u", sampleType.Name, usbBytes, channels, ch, frame);
+        }
+    }
+
+    kernelInfo.Interleave(usbOut.data(), bytesPerBlock, asioChannels.data(), 0, channels, c_frames);
+    HOST_TEST_EXPECT(usbOut == usb, "%s, %u-byte USB samples, %u channels: round trip", sampleType.Name, usbBytes, channels);
+}
+
+static void TestInterleaveMatrix()
+{
+    for (const SAMPLE_TYPE & sampleType : c_sampleTypes)
+    {
+        for (ULONG usbBytes = 1; usbBytes <= 4; ++usbBytes)
+        {
+            for (ULONG channels : c_channels)
+            {
+                // As AsioBufferObject::SelectConverter() classifies a channel map in which every channel is mapped.
+                InterleaveChannelClass channelClass = ((channels % 4) == 0) ? InterleaveChannelClass::Dense : InterleaveChannelClass::Sparse;
+                INTERLEAVE_KERNEL_INFO kernelInfo;
+                NTSTATUS               status = InterleaveKernels::Select(usbBytes, sampleType.AsioBytesPerSample, channelClass, kernelInfo);
+
+                if (usbBytes > sampleType.AsioBytesPerSample)
+                {
+                    // A USB sample is never carried in a narrower ASIO sample.
+                    HOST_TEST_EXPECT(status == STATUS_NOT_SUPPORTED, "%s, %u-byte USB samples: status 0x%x", sampleType.Name, usbBytes, (unsigned)status);
+                    HOST_TEST_EXPECT(kernelInfo.Interleave == nullptr && kernelInfo.Deinterleave == nullptr, "%s: kernels returned on failure", sampleType.Name);
+                    continue;
+                }
+                HOST_TEST_EXPECT(NT_SUCCESS(status), "%s, %u-byte USB samples: status 0x%x", sampleType.Name, usbBytes, (unsigned)status);
+                if (!NT_SUCCESS(status))
+                {
+                    continue;
+                }
+                HOST_TEST_EXPECT(kernelInfo.UsbBytesPerSample == usbBytes && kernelInfo.AsioBytesPerSample == sampleType.AsioBytesPerSample && kernelInfo.ChannelClass == channelClass, "%s: kernel info", sampleType.Name);
+                TestRoundTrip(sampleType, kernelInfo, channels);
+            }
+        }
+    }
+
+    INTERLEAVE_KERNEL_INFO kernelInfo;
+    HOST_TEST_EXPECT(InterleaveKernels::Select(2, 2, InterleaveChannelClass::Count, kernelInfo) == STATUS_INVALID_PARAMETER, "invalid channel class accepted");
+}
+
+static void TestCopyKernels()
+{
+    for (ULONG bytesPerSample = 1; bytesPerSample <= 4; ++bytesPerSample)
+    {
+        MIX_KERNEL_INFO kernelInfo;
+        HOST_TEST_EXPECT(NT_SUCCESS(MixKernels::SelectCopy(bytesPerSample, kernelInfo)), "no copy kernel for %u bytes", bytesPerSample);
+        if (kernelInfo.Kernel == nullptr)
+        {
+            continue;
+        }
+
+        for (ULONG channels : c_channels)
+        {
+            // Copies 'channels' channels out of a USB frame with two more channels, into a packed RtPacket.
+            const ULONG        srcFrameBytes = (channels + 2) * bytesPerSample;
+            const ULONG        dstFrameBytes = channels * bytesPerSample;
+            std::vector<UCHAR> src(srcFrameBytes * c_frames);
+            std::vector<UCHAR> expected(dstFrameBytes * c_frames);
+            std::vector<UCHAR> actual(expected.size(), 0);
+
+            for (size_t i = 0; i < src.size(); ++i)
+            {
+                src[i] = (UCHAR)(i * 13 + 1);
+            }
+            for (ULONG frame = 0; frame < c_frames; ++frame)
+            {
+                memcpy(&expected[frame * dstFrameBytes], &src[frame * srcFrameBytes + bytesPerSample], dstFrameBytes);
+            }
+            kernelInfo.Kernel(actual.data(), dstFrameBytes, src.data() + bytesPerSample, srcFrameBytes, channels, c_frames);
+            HOST_TEST_EXPECT(actual == expected, "copy kernel, %u bytes, %u channels", bytesPerSample, channels);
+        }
+    }
+
+    MIX_KERNEL_INFO kernelInfo;
+    HOST_TEST_EXPECT(MixKernels::SelectCopy(5, kernelInfo) == STATUS_NOT_SUPPORTED, "5-byte copy kernel returned");
+}
+
+int main()
+{
+    TestInterleaveMatrix();
+    TestCopyKernels();
+
+    return HOST_TEST_RESULT();
+}
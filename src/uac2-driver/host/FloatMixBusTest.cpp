@@ -0,0 +1,346 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    FloatMixBusTest.cpp
+
+Abstract:
+
+    Test the kernels of the float mix bus. Without dither, the store kernel
+    that Select() returns for each target must be bit-exact against a scalar
+    clamp and round half away from zero, including exact halves, the full
+    scale and values out of range. With dither, every sample must stay
+    within 1 LSB of the rounded value, and the error must be unbiased TPDF
+    noise. Loading and storing a USB sample must return it unchanged, and
+    the accumulate kernels must add the Acx Audio samples at their stride.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <math.h>
+#include <vector>
+
+#include "StreamPlatform.h"
+#include "FloatMixBus.h"
+#include "HostTest.h"
+
+static ULONG g_random = 1;
+
+static ULONG Random()
+{
+    g_random = g_random * 1664525 + 1013904223;
+    return g_random >> 8;
+}
+
+static LONG ReadTarget(
+    const UCHAR * src,
+    ULONG         bytesPerSample
+)
+{
+    ULONG bits = 0;
+    for (ULONG byte = 0; byte < bytesPerSample; ++byte)
+    {
+        bits |= (ULONG)src[byte] << (byte * 8);
+    }
+    // Sign-extend.
+    return (LONG)(bits << (32 - bytesPerSample * 8)) >> (32 - bytesPerSample * 8);
+}
+
+// The scale of the bus for a target, and the largest sample that the store clamps to.
+static float TargetScale(
+    ULONG bytesPerSample
+)
+{
+    return (float)(1ULL << (bytesPerSample * 8 - 1));
+}
+
+static float TargetMax(
+    ULONG bytesPerSample
+)
+{
+    // 2147483520.0f is the largest float below 2^31.
+    return (bytesPerSample == 4) ? 2147483520.0f : TargetScale(bytesPerSample) - 1.0f;
+}
+
+// Clamps and rounds half away from zero, in float arithmetic.
+static LONG ReferenceQuantize(
+    float value,
+    ULONG bytesPerSample
+)
+{
+    float minValue = -TargetScale(bytesPerSample);
+    float maxValue = TargetMax(bytesPerSample);
+
+    value = (value > maxValue) ? maxValue : ((value < minValue) ? minValue : value);
+    return (LONG)((value >= 0.0f) ? (value + 0.5f) : (value - 0.5f));
+}
+
+//
+// Bus samples that end on exact halves of an LSB after the scaling, just
+// below and above them, at and beyond the full scale, and random ones.
+//
+static std::vector<float> MakeBus(
+    ULONG bytesPerSample,
+    ULONG randomSamples
+)
+{
+    const float        scale = TargetScale(bytesPerSample);
+    std::vector<float> bus;
+
+    for (LONG lsb = -6; lsb <= 6; ++lsb)
+    {
+        float half = (lsb + 0.5f) / scale;
+        bus.push_back(half);
+        bus.push_back(nextafterf(half, 0.0f));
+        bus.push_back(nextafterf(half, (lsb >= 0) ? 1.0f : -1.0f));
+        bus.push_back((float)lsb / scale);
+    }
+    for (LONG lsb = 1000; lsb < 1016; ++lsb)
+    {
+        bus.push_back((lsb + 0.5f) / scale);
+        bus.push_back(-(lsb + 0.5f) / scale);
+    }
+    const float extremes[] = {0.0f, -0.0f, 1.0f, -1.0f, 0.99999994f, -0.99999994f, 1.5f, -1.5f, 1000.0f, -1000.0f, (scale - 0.5f) / scale, -(scale - 0.5f) / scale, (scale + 0.5f) / scale, -(scale + 0.5f) / scale};
+    for (float value : extremes)
+    {
+        bus.push_back(value);
+    }
+    for (ULONG i = 0; i < randomSamples; ++i)
+    {
+        bus.push_back(((LONG)(Random() % 2000001) - 1000000) / 900000.0f);
+    }
+    return bus;
+}
+
+static void TestStoreRounding(
+    ULONG bytesPerSample
+)
+{
+    FLOAT_MIX_BUS_INFO busInfo;
+    NTSTATUS           status = FloatMixBus::Select(false, 2, false, bytesPerSample, false, busInfo);
+    HOST_TEST_EXPECT(NT_SUCCESS(status) && (busInfo.Store != nullptr), "int%u: Select failed, 0x%x", bytesPerSample * 8, (unsigned)status);
+    if (!NT_SUCCESS(status))
+    {
+        return;
+    }
+
+    std::vector<float> bus = MakeBus(bytesPerSample, 4096);
+
+    // Every length up to two vectors of 8 samples, so that the scalar tails are covered too, and the whole bus.
+    std::vector<ULONG> lengths;
+    for (ULONG length = 0; length <= 17; ++length)
+    {
+        lengths.push_back(length);
+    }
+    lengths.push_back((ULONG)bus.size());
+
+    for (ULONG length : lengths)
+    {
+        for (ULONG offset = 0; offset + length <= bus.size(); offset += (length == 0) ? bus.size() : length)
+        {
+            std::vector<UCHAR> dst(length * bytesPerSample + 1, 0xa5);
+            busInfo.Store(dst.data(), bus.data() + offset, length, nullptr);
+
+            ULONG mismatches = 0;
+            for (ULONG i = 0; i < length; ++i)
+            {
+                float value = bus[offset + i] * TargetScale(bytesPerSample);
+                LONG  expected = ReferenceQuantize(value, bytesPerSample);
+                LONG  actual = ReadTarget(dst.data() + i * bytesPerSample, bytesPerSample);
+                if (actual != expected)
+                {
+                    if (mismatches++ == 0)
+                    {
+                        HOST_TEST_EXPECT(actual == expected, "int%u, store type %u: %.9g stored as %d", bytesPerSample * 8, static_cast<ULONG>(busInfo.StoreType), value, actual);
+                    }
+                }
+            }
+            HOST_TEST_EXPECT(mismatches == 0, "int%u, store type %u: %u of %u samples differ from the scalar rounding", bytesPerSample * 8, static_cast<ULONG>(busInfo.StoreType), mismatches, length);
+            HOST_TEST_EXPECT(dst[length * bytesPerSample] == 0xa5, "int%u: the store wrote past %u samples", bytesPerSample * 8, length);
+        }
+    }
+}
+
+static void TestStoreDither(
+    ULONG bytesPerSample
+)
+{
+    FLOAT_MIX_BUS_INFO busInfo;
+    NTSTATUS           status = FloatMixBus::Select(false, 2, false, bytesPerSample, true, busInfo);
+    HOST_TEST_EXPECT(NT_SUCCESS(status) && busInfo.Dither, "int%u: no dither, 0x%x", bytesPerSample * 8, (unsigned)status);
+    if (!NT_SUCCESS(status))
+    {
+        return;
+    }
+
+    FLOAT_BUS_DITHER dither;
+    FloatMixBus::InitializeDither(dither);
+
+    // Values between the LSBs, away from the full scale.
+    const ULONG        samples = 65536 + 5;
+    const float        scale = TargetScale(bytesPerSample);
+    std::vector<float> bus(samples);
+    for (ULONG i = 0; i < samples; ++i)
+    {
+        bus[i] = ((LONG)(Random() % 20001) - 10000 + (Random() % 1000) / 1000.0f) / scale;
+    }
+    std::vector<UCHAR> dst(samples * bytesPerSample);
+
+    // Stored in two calls so that the dither state is carried over.
+    busInfo.Store(dst.data(), bus.data(), samples / 2, &dither);
+    busInfo.Store(dst.data() + (samples / 2) * bytesPerSample, bus.data() + samples / 2, samples - samples / 2, &dither);
+
+    double sum = 0.0;
+    double sumOfSquares = 0.0;
+    ULONG  outOfRange = 0;
+    ULONG  dithered = 0;
+    for (ULONG i = 0; i < samples; ++i)
+    {
+        float value = bus[i] * scale;
+        LONG  actual = ReadTarget(dst.data() + i * bytesPerSample, bytesPerSample);
+        LONG  rounded = ReferenceQuantize(value, bytesPerSample);
+        outOfRange += ((actual < rounded - 1) || (actual > rounded + 1)) ? 1 : 0;
+        dithered += (actual != rounded) ? 1 : 0;
+        double error = (double)actual - (double)value;
+        sum += error;
+        sumOfSquares += error * error;
+    }
+    double mean = sum / samples;
+    double variance = sumOfSquares / samples - mean * mean;
+
+    HOST_TEST_EXPECT(outOfRange == 0, "int%u, store type %u: %u samples are more than 1 LSB from the rounded value", bytesPerSample * 8, static_cast<ULONG>(busInfo.StoreType), outOfRange);
+    HOST_TEST_EXPECT(dithered > samples / 8, "int%u: only %u of %u samples are dithered", bytesPerSample * 8, dithered, samples);
+    HOST_TEST_EXPECT(fabs(mean) < 0.01, "int%u: the dither is biased by %f LSB", bytesPerSample * 8, mean);
+    // TPDF of +/-1 LSB has a variance of 1/6, the rounding adds 1/12.
+    HOST_TEST_EXPECT(fabs(variance - 0.25) < 0.02, "int%u: the error variance is %f LSB^2, expected 0.25", bytesPerSample * 8, variance);
+}
+
+static void TestLoadStore(
+    ULONG bytesPerSample
+)
+{
+    FLOAT_MIX_BUS_INFO busInfo;
+    NTSTATUS           status = FloatMixBus::Select(false, bytesPerSample, false, bytesPerSample, false, busInfo);
+    HOST_TEST_EXPECT(NT_SUCCESS(status), "int%u: Select failed, 0x%x", bytesPerSample * 8, (unsigned)status);
+    if (!NT_SUCCESS(status))
+    {
+        return;
+    }
+
+    // A float holds 24 bits exactly, so the low byte of 32-bit samples is cleared.
+    const ULONG        samples = 1027;
+    std::vector<UCHAR> src(samples * bytesPerSample);
+    for (ULONG i = 0; i < samples; ++i)
+    {
+        ULONG sample = Random() ^ (Random() << 16);
+        if (i < 4)
+        {
+            sample = (i & 1) ? 0x7fffffff : 0x80000000;
+            sample >>= (4 - bytesPerSample) * 8;
+        }
+        if (bytesPerSample == 4)
+        {
+            sample &= 0xffffff00;
+        }
+        for (ULONG byte = 0; byte < bytesPerSample; ++byte)
+        {
+            src[i * bytesPerSample + byte] = (UCHAR)(sample >> (byte * 8));
+        }
+    }
+
+    std::vector<float> bus(samples);
+    std::vector<UCHAR> dst(samples * bytesPerSample);
+    busInfo.Load(bus.data(), src.data(), samples);
+    busInfo.Store(dst.data(), bus.data(), samples, nullptr);
+
+    HOST_TEST_EXPECT(dst == src, "int%u: a sample changed when it was loaded and stored", bytesPerSample * 8);
+}
+
+static void TestAccumulate(
+    bool  sourceIsFloat,
+    ULONG sourceBytesPerSample
+)
+{
+    FLOAT_MIX_BUS_INFO busInfo;
+    NTSTATUS           status = FloatMixBus::Select(sourceIsFloat, sourceBytesPerSample, true, 4, false, busInfo);
+    HOST_TEST_EXPECT(NT_SUCCESS(status), "%s%u: Select failed, 0x%x", sourceIsFloat ? "float" : "int", sourceBytesPerSample * 8, (unsigned)status);
+    if (!NT_SUCCESS(status))
+    {
+        return;
+    }
+
+    // Three source channels into channels 2..4 of a bus frame of 6, from a source frame of 4.
+    const ULONG        frames = 37;
+    const ULONG        busFrameSamples = 6;
+    const ULONG        srcFrameBytes = 4 * sourceBytesPerSample;
+    std::vector<float> bus(frames * busFrameSamples);
+    std::vector<UCHAR> src(frames * srcFrameBytes);
+    for (float & sample : bus)
+    {
+        sample = ((LONG)(Random() % 2001) - 1000) / 1000.0f;
+    }
+    for (UCHAR & byte : src)
+    {
+        byte = (UCHAR)Random();
+    }
+    if (sourceIsFloat)
+    {
+        for (ULONG i = 0; i < frames * 4; ++i)
+        {
+            float sample = ((LONG)(Random() % 2001) - 1000) / 1000.0f;
+            memcpy(&src[i * 4], &sample, sizeof(sample));
+        }
+    }
+
+    std::vector<float> expected = bus;
+    for (ULONG frame = 0; frame < frames; ++frame)
+    {
+        for (ULONG ch = 0; ch < 3; ++ch)
+        {
+            const UCHAR * in = &src[frame * srcFrameBytes + ch * sourceBytesPerSample];
+            float         sample;
+            if (sourceIsFloat)
+            {
+                memcpy(&sample, in, sizeof(sample));
+            }
+            else
+            {
+                sample = (float)ReadTarget(in, sourceBytesPerSample) / TargetScale(sourceBytesPerSample);
+            }
+            expected[frame * busFrameSamples + 2 + ch] += sample;
+        }
+    }
+
+    busInfo.Accumulate(bus.data() + 2, busFrameSamples, src.data(), srcFrameBytes, 3, frames);
+    HOST_TEST_EXPECT(bus == expected, "%s%u: the accumulated bus differs", sourceIsFloat ? "float" : "int", sourceBytesPerSample * 8);
+}
+
+int main()
+{
+    const ULONG targets[] = {2, 3, 4};
+    for (ULONG bytesPerSample : targets)
+    {
+        TestStoreRounding(bytesPerSample);
+        TestLoadStore(bytesPerSample);
+        TestAccumulate(false, bytesPerSample);
+    }
+    TestAccumulate(true, 4);
+    TestStoreDither(2);
+    TestStoreDither(3);
+
+    FLOAT_MIX_BUS_INFO busInfo;
+    HOST_TEST_EXPECT(FloatMixBus::Select(false, 2, true, 8, false, busInfo) == STATUS_NOT_SUPPORTED, "64-bit float target accepted");
+    HOST_TEST_EXPECT(FloatMixBus::Select(false, 5, false, 2, false, busInfo) == STATUS_NOT_SUPPORTED, "40-bit source accepted");
+
+    return HOST_TEST_RESULT();
+}
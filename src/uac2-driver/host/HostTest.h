@@ -0,0 +1,51 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    HostTest.h
+
+Abstract:
+
+    Define the assertion macros of the host tests. Each test is an executable
+    registered with CTest; it exits with a non-zero code when an expectation
+    fails.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#ifndef _HOSTTEST_H_
+#define _HOSTTEST_H_
+
+#include <stdio.h>
+
+inline int & HostTestFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define HOST_TEST_EXPECT(condition, ...)                                              \
+    do                                                                                \
+    {                                                                                 \
+        if (!(condition))                                                             \
+        {                                                                             \
+            fprintf(stderr, "%s(%d): expected %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__);                                             \
+            fprintf(stderr, "\n");                                                    \
+            ++HostTestFailures();                                                     \
+        }                                                                             \
+    } while (0)
+
+#define HOST_TEST_RESULT() ((HostTestFailures() == 0) ? 0 : 1)
+
+#endif
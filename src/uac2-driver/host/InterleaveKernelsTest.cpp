@@ -0,0 +1,239 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    InterleaveKernelsTest.cpp
+
+Abstract:
+
+    Test that the tiled interleave and deinterleave kernels are bit-exact with
+    a per-sample copy, for odd channel counts, unmapped channels, runs that
+    are not a multiple of the tile and copies split at the end of the ASIO
+    ring buffer.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <vector>
+
+#include "StreamPlatform.h"
+#include "InterleaveKernels.h"
+#include "HostTest.h"
+
+static const ULONG c_ringFrames = 96;
+
+typedef struct _LAYOUT
+{
+    ULONG                  Channels;
+    ULONG                  UnmappedEvery; // Every n-th channel is not mapped, 0 if all are mapped
+    InterleaveChannelClass ChannelClass;
+} LAYOUT;
+
+static const LAYOUT c_layouts[] = {
+    {1, 0, InterleaveChannelClass::Sparse},
+    {2, 0, InterleaveChannelClass::Sparse},
+    {3, 0, InterleaveChannelClass::Sparse},
+    {5, 0, InterleaveChannelClass::Sparse},
+    {7, 3, InterleaveChannelClass::Sparse},
+    {8, 0, InterleaveChannelClass::Sparse},
+    {9, 2, InterleaveChannelClass::Sparse},
+    {13, 5, InterleaveChannelClass::Sparse},
+    {4, 0, InterleaveChannelClass::Dense},
+    {8, 0, InterleaveChannelClass::Dense},
+    {12, 0, InterleaveChannelClass::Dense},
+    {32, 0, InterleaveChannelClass::Dense},
+};
+
+// Start frames in the ring and lengths, including runs that wrap and runs longer than a tile.
+static const ULONG c_startFrames[] = {0, 5, 64, 90};
+static const ULONG c_frames[] = {1, 6, 31, 32, 33, 70};
+
+static ULONG g_random = 1;
+
+static void FillRandom(
+    std::vector<UCHAR> & buffer
+)
+{
+    for (UCHAR & byte : buffer)
+    {
+        g_random = g_random * 1664525 + 1013904223;
+        byte = (UCHAR)(g_random >> 24);
+    }
+}
+
+typedef struct _BUFFERS
+{
+    std::vector<UCHAR>  Usb;
+    std::vector<UCHAR>  Asio;
+    std::vector<PUCHAR> Channels;
+} BUFFERS;
+
+static void CreateBuffers(
+    BUFFERS &      buffers,
+    const LAYOUT & layout,
+    ULONG          usbBytes,
+    ULONG          asioBytes,
+    ULONG          frames
+)
+{
+    buffers.Usb.resize(layout.Channels * usbBytes * frames);
+    buffers.Asio.resize(layout.Channels * asioBytes * c_ringFrames);
+    FillRandom(buffers.Usb);
+    FillRandom(buffers.Asio);
+    buffers.Channels.assign(layout.Channels, nullptr);
+    for (ULONG ch = 0; ch < layout.Channels; ++ch)
+    {
+        if ((layout.UnmappedEvery == 0) || ((ch % layout.UnmappedEvery) != layout.UnmappedEvery - 1))
+        {
+            buffers.Channels[ch] = buffers.Asio.data() + ch * asioBytes * c_ringFrames;
+        }
+    }
+}
+
+// Points the channel table of one set of buffers at the ASIO buffer of another.
+static std::vector<PUCHAR> RebaseChannels(
+    const BUFFERS & from,
+    BUFFERS &       to
+)
+{
+    std::vector<PUCHAR> channels(from.Channels.size(), nullptr);
+    for (size_t ch = 0; ch < channels.size(); ++ch)
+    {
+        if (from.Channels[ch] != nullptr)
+        {
+            channels[ch] = to.Asio.data() + (from.Channels[ch] - from.Asio.data());
+        }
+    }
+    return channels;
+}
+
+// The USB sample is the most significant part of the ASIO sample, and the rest of the ASIO sample is zero.
+static void ReferenceInterleave(
+    BUFFERS &      buffers,
+    const LAYOUT & layout,
+    ULONG          usbBytes,
+    ULONG          asioBytes,
+    ULONG          startFrame,
+    ULONG          frames
+)
+{
+    for (ULONG frame = 0; frame < frames; ++frame)
+    {
+        for (ULONG ch = 0; ch < layout.Channels; ++ch)
+        {
+            if (buffers.Channels[ch] != nullptr)
+            {
+                const UCHAR * asioSample = buffers.Channels[ch] + ((startFrame + frame) % c_ringFrames) * asioBytes;
+                memcpy(&buffers.Usb[(frame * layout.Channels + ch) * usbBytes], asioSample + asioBytes - usbBytes, usbBytes);
+            }
+        }
+    }
+}
+
+static void ReferenceDeinterleave(
+    BUFFERS &      buffers,
+    const LAYOUT & layout,
+    ULONG          usbBytes,
+    ULONG          asioBytes,
+    ULONG          startFrame,
+    ULONG          frames
+)
+{
+    for (ULONG frame = 0; frame < frames; ++frame)
+    {
+        for (ULONG ch = 0; ch < layout.Channels; ++ch)
+        {
+            if (buffers.Channels[ch] != nullptr)
+            {
+                PUCHAR asioSample = buffers.Channels[ch] + ((startFrame + frame) % c_ringFrames) * asioBytes;
+                memset(asioSample, 0, asioBytes - usbBytes);
+                memcpy(asioSample + asioBytes - usbBytes, &buffers.Usb[(frame * layout.Channels + ch) * usbBytes], usbBytes);
+            }
+        }
+    }
+}
+
+static void TestKernels(
+    const INTERLEAVE_KERNEL_INFO & kernelInfo,
+    const LAYOUT &                 layout,
+    ULONG                          startFrame,
+    ULONG                          frames
+)
+{
+    const ULONG usbBytes = kernelInfo.UsbBytesPerSample;
+    const ULONG asioBytes = kernelInfo.AsioBytesPerSample;
+    const ULONG bytesPerBlock = layout.Channels * usbBytes;
+    const ULONG framesFirst = MIN(frames, c_ringFrames - startFrame);
+    BUFFERS     expected;
+
+    CreateBuffers(expected, layout, usbBytes, asioBytes, frames);
+
+    // The copy is split at the end of the ring, as AsioBufferObject does.
+    BUFFERS             actual = expected;
+    std::vector<PUCHAR> channels = RebaseChannels(expected, actual);
+    ReferenceInterleave(expected, layout, usbBytes, asioBytes, startFrame, frames);
+    kernelInfo.Interleave(actual.Usb.data(), bytesPerBlock, channels.data(), startFrame, layout.Channels, framesFirst);
+    if (frames > framesFirst)
+    {
+        kernelInfo.Interleave(actual.Usb.data() + framesFirst * bytesPerBlock, bytesPerBlock, channels.data(), 0, layout.Channels, frames - framesFirst);
+    }
+    HOST_TEST_EXPECT(actual.Usb == expected.Usb, "interleave %u/%u, %u channels, unmapped every %u, class %d, %u frames from %u", usbBytes, asioBytes, layout.Channels, layout.UnmappedEvery, toInt(layout.ChannelClass), frames, startFrame);
+    HOST_TEST_EXPECT(actual.Asio == expected.Asio, "interleave %u/%u wrote the ASIO buffer", usbBytes, asioBytes);
+
+    CreateBuffers(expected, layout, usbBytes, asioBytes, frames);
+
+    actual = expected;
+    channels = RebaseChannels(expected, actual);
+    ReferenceDeinterleave(expected, layout, usbBytes, asioBytes, startFrame, frames);
+    kernelInfo.Deinterleave(actual.Usb.data(), bytesPerBlock, channels.data(), startFrame, layout.Channels, framesFirst);
+    if (frames > framesFirst)
+    {
+        kernelInfo.Deinterleave(actual.Usb.data() + framesFirst * bytesPerBlock, bytesPerBlock, channels.data(), 0, layout.Channels, frames - framesFirst);
+    }
+    HOST_TEST_EXPECT(actual.Asio == expected.Asio, "deinterleave %u/%u, %u channels, unmapped every %u, class %d, %u frames from %u", usbBytes, asioBytes, layout.Channels, layout.UnmappedEvery, toInt(layout.ChannelClass), frames, startFrame);
+    HOST_TEST_EXPECT(actual.Usb == expected.Usb, "deinterleave %u/%u wrote the USB buffer", usbBytes, asioBytes);
+}
+
+int main()
+{
+    for (ULONG usbBytes = 1; usbBytes <= 4; ++usbBytes)
+    {
+        for (ULONG asioBytes = 2; asioBytes <= 4; ++asioBytes)
+        {
+            if (usbBytes > asioBytes)
+            {
+                continue;
+            }
+            for (const LAYOUT & layout : c_layouts)
+            {
+                INTERLEAVE_KERNEL_INFO kernelInfo;
+                NTSTATUS               status = InterleaveKernels::Select(usbBytes, asioBytes, layout.ChannelClass, kernelInfo);
+
+                HOST_TEST_EXPECT(NT_SUCCESS(status), "no kernel for %u/%u, class %d", usbBytes, asioBytes, toInt(layout.ChannelClass));
+                if (!NT_SUCCESS(status))
+                {
+                    continue;
+                }
+                for (ULONG startFrame : c_startFrames)
+                {
+                    for (ULONG frames : c_frames)
+                    {
+                        TestKernels(kernelInfo, layout, startFrame, frames);
+                    }
+                }
+            }
+        }
+    }
+
+    return HOST_TEST_RESULT();
+}
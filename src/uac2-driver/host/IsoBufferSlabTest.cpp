@@ -0,0 +1,232 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    IsoBufferSlabTest.cpp
+
+Abstract:
+
+    Test the layout of the slab that ContiguousMemory carves the isochronous
+    transfer buffers from: every buffer must start on a cache line, no two
+    slices may overlap, a full write must leave the guard bytes intact and a
+    one byte overrun must be detected once. Publish() must copy exactly like
+    memcpy for every alignment of the destination.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <random>
+#include <vector>
+
+#include "StreamPlatform.h"
+#include "IsoBufferSlab.h"
+#include "HostTest.h"
+
+static const ULONG c_numOfBuffers = 8;
+
+//
+// A slab allocated on a cache line, as MmAllocateContiguousMemorySpecifyCache() returns it.
+//
+class AlignedSlab
+{
+  public:
+    explicit AlignedSlab(SIZE_T size)
+        : m_storage(size + IsoBufferSlab::c_sliceAlignment, 0xcc)
+    {
+        m_slab = (PUCHAR)ALIGN_UP_BY(m_storage.data(), IsoBufferSlab::c_sliceAlignment);
+    }
+
+    PUCHAR Get()
+    {
+        return m_slab;
+    }
+
+  private:
+    std::vector<UCHAR> m_storage;
+    PUCHAR             m_slab{nullptr};
+};
+
+// In, Out and Feedback buffers as ContiguousMemory sizes them; Out is a multiple of the cache line.
+static void SetTypicalSizes(IsoBufferSlab & layout)
+{
+    layout.Reset();
+    layout.SetBufferSize(0, 1000, c_numOfBuffers);
+    layout.SetBufferSize(1, 4 * IsoBufferSlab::c_sliceAlignment, c_numOfBuffers);
+    layout.SetBufferSize(2, 4, c_numOfBuffers);
+}
+
+static void TestLayout()
+{
+    IsoBufferSlab layout;
+    SetTypicalSizes(layout);
+
+    HOST_TEST_EXPECT(layout.GetStride(0) == 1024 + IsoBufferSlab::c_guardBytes, "stride %u", layout.GetStride(0));
+    HOST_TEST_EXPECT(layout.GetStride(1) == 4 * IsoBufferSlab::c_sliceAlignment + IsoBufferSlab::c_guardBytes, "stride %u", layout.GetStride(1));
+    HOST_TEST_EXPECT(layout.GetStride(2) == IsoBufferSlab::c_sliceAlignment + IsoBufferSlab::c_guardBytes, "stride %u", layout.GetStride(2));
+
+    SIZE_T slabSize = layout.GetSlabSize();
+    HOST_TEST_EXPECT(slabSize == (SIZE_T)(layout.GetStride(0) + layout.GetStride(1) + layout.GetStride(2)) * c_numOfBuffers, "slab size %zu", slabSize);
+
+    AlignedSlab slab(slabSize);
+    layout.Carve(slab.Get());
+
+    const ULONG sizes[] = {1000, 4 * IsoBufferSlab::c_sliceAlignment, 4};
+    PUCHAR      previousEnd = slab.Get();
+    for (ULONG region = 0; region < IsoBufferSlab::c_maxRegions; ++region)
+    {
+        for (ULONG index = 0; index < c_numOfBuffers; ++index)
+        {
+            PUCHAR buffer = layout.GetBuffer(region, index);
+            HOST_TEST_EXPECT(buffer != nullptr, "region %u, buffer %u", region, index);
+            if (buffer == nullptr)
+            {
+                continue;
+            }
+            HOST_TEST_EXPECT(((ULONG_PTR)buffer % IsoBufferSlab::c_sliceAlignment) == 0, "region %u, buffer %u is at %p", region, index, buffer);
+            HOST_TEST_EXPECT(buffer >= previousEnd, "region %u, buffer %u overlaps the previous slice", region, index);
+            HOST_TEST_EXPECT(layout.GetStride(region) - sizes[region] >= IsoBufferSlab::c_guardBytes, "region %u has %u guard bytes", region, layout.GetStride(region) - sizes[region]);
+            previousEnd = buffer + layout.GetStride(region);
+        }
+        HOST_TEST_EXPECT(layout.GetBuffer(region, c_numOfBuffers) == nullptr, "region %u has a buffer past the last one", region);
+    }
+    HOST_TEST_EXPECT(previousEnd <= slab.Get() + slabSize, "the slices end %td bytes past the slab", previousEnd - (slab.Get() + slabSize));
+}
+
+static void TestEmptyRegion()
+{
+    IsoBufferSlab layout;
+    layout.Reset();
+    layout.SetBufferSize(0, 1000, c_numOfBuffers);
+    layout.SetBufferSize(1, 0, c_numOfBuffers);
+    layout.SetBufferSize(2, 4, c_numOfBuffers);
+
+    HOST_TEST_EXPECT(layout.GetStride(1) == 0, "stride %u", layout.GetStride(1));
+    HOST_TEST_EXPECT(layout.GetSlabSize() == (SIZE_T)(layout.GetStride(0) + layout.GetStride(2)) * c_numOfBuffers, "slab size %zu", layout.GetSlabSize());
+
+    AlignedSlab slab(layout.GetSlabSize());
+    layout.Carve(slab.Get());
+    HOST_TEST_EXPECT(layout.GetBuffer(1, 0) == nullptr, "the empty region has a buffer");
+    HOST_TEST_EXPECT(layout.GetBuffer(2, 0) == layout.GetBuffer(0, c_numOfBuffers - 1) + layout.GetStride(0), "the feedback region does not follow the input region");
+    HOST_TEST_EXPECT(layout.VerifyGuardBytes(), "guard bytes corrupted");
+}
+
+static void TestCarveAndFullWrite()
+{
+    IsoBufferSlab layout;
+    SetTypicalSizes(layout);
+    AlignedSlab slab(layout.GetSlabSize());
+    layout.Carve(slab.Get());
+
+    const ULONG sizes[] = {1000, 4 * IsoBufferSlab::c_sliceAlignment, 4};
+    for (ULONG region = 0; region < IsoBufferSlab::c_maxRegions; ++region)
+    {
+        for (ULONG index = 0; index < c_numOfBuffers; ++index)
+        {
+            PUCHAR buffer = layout.GetBuffer(region, index);
+            ULONG  nonZero = 0;
+            ULONG  badGuard = 0;
+            for (ULONG offset = 0; offset < sizes[region]; ++offset)
+            {
+                nonZero += (buffer[offset] != 0) ? 1 : 0;
+            }
+            for (ULONG offset = sizes[region]; offset < layout.GetStride(region); ++offset)
+            {
+                badGuard += (buffer[offset] != IsoBufferSlab::c_guardPattern) ? 1 : 0;
+            }
+            HOST_TEST_EXPECT(nonZero == 0, "region %u, buffer %u has %u bytes that are not cleared", region, index, nonZero);
+            HOST_TEST_EXPECT(badGuard == 0, "region %u, buffer %u has %u guard bytes that are not filled", region, index, badGuard);
+
+            memset(buffer, 0x5a, sizes[region]);
+        }
+    }
+
+    HOST_TEST_EXPECT(layout.VerifyGuardBytes(), "a write of the full buffers corrupted the guard bytes");
+}
+
+static void TestOverrun()
+{
+    IsoBufferSlab layout;
+    SetTypicalSizes(layout);
+    AlignedSlab slab(layout.GetSlabSize());
+    layout.Carve(slab.Get());
+
+    for (ULONG region = 0; region < IsoBufferSlab::c_maxRegions; ++region)
+    {
+        const ULONG sizes[] = {1000, 4 * IsoBufferSlab::c_sliceAlignment, 4};
+        PUCHAR      buffer = layout.GetBuffer(region, 3);
+
+        buffer[sizes[region]] = 0;
+        HOST_TEST_EXPECT(!layout.VerifyGuardBytes(), "a one byte overrun of region %u is not detected", region);
+        HOST_TEST_EXPECT(buffer[sizes[region]] == IsoBufferSlab::c_guardPattern, "the guard bytes of region %u are not repaired", region);
+        HOST_TEST_EXPECT(layout.VerifyGuardBytes(), "the overrun of region %u is reported twice", region);
+
+        // The last guard byte is just before the next slice.
+        buffer[layout.GetStride(region) - 1] = 0;
+        HOST_TEST_EXPECT(!layout.VerifyGuardBytes(), "an overrun into the last guard byte of region %u is not detected", region);
+        HOST_TEST_EXPECT(layout.VerifyGuardBytes(), "the overrun of region %u is reported twice", region);
+    }
+}
+
+static void TestPublish()
+{
+    static const ULONG c_sentinel = 64;
+    static const UCHAR c_sentinelPattern = 0xa5;
+
+    std::mt19937 random(1);
+    ULONG        lengths[] = {0, 1, 15, 16, 17, 31, 32, 33, 48, 63, 64, 65, 100, 127, 128, 129, 192, 576, 1000, 1023, 1024, 6144, 6145};
+
+    std::vector<UCHAR> source(8192 + 16);
+    for (UCHAR & byte : source)
+    {
+        byte = (UCHAR)random();
+    }
+
+    for (ULONG length : lengths)
+    {
+        for (ULONG dstOffset = 0; dstOffset < 16; ++dstOffset)
+        {
+            for (ULONG srcOffset = 0; srcOffset < 16; srcOffset += 5)
+            {
+                AlignedSlab destination(c_sentinel + 16 + length + c_sentinel);
+                PUCHAR      dst = destination.Get() + c_sentinel + dstOffset;
+                memset(destination.Get(), c_sentinelPattern, c_sentinel + 16 + length + c_sentinel);
+
+                IsoBufferSlab::Publish(dst, source.data() + srcOffset, length);
+
+                HOST_TEST_EXPECT(memcmp(dst, source.data() + srcOffset, length) == 0, "length %u, destination offset %u, source offset %u differs from memcpy", length, dstOffset, srcOffset);
+
+                ULONG written = 0;
+                for (PUCHAR byte = destination.Get(); byte < dst; ++byte)
+                {
+                    written += (*byte != c_sentinelPattern) ? 1 : 0;
+                }
+                for (PUCHAR byte = dst + length; byte < destination.Get() + c_sentinel + 16 + length + c_sentinel; ++byte)
+                {
+                    written += (*byte != c_sentinelPattern) ? 1 : 0;
+                }
+                HOST_TEST_EXPECT(written == 0, "length %u, destination offset %u, source offset %u wrote %u bytes outside the destination", length, dstOffset, srcOffset, written);
+            }
+        }
+    }
+}
+
+int main()
+{
+    TestLayout();
+    TestEmptyRegion();
+    TestCarveAndFullWrite();
+    TestOverrun();
+    TestPublish();
+
+    return HOST_TEST_RESULT();
+}
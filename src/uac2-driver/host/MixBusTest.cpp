@@ -0,0 +1,295 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    MixBusTest.cpp
+
+Abstract:
+
+    Test the tiled mix of several render devices into a USB packet against a
+    sequential scalar mix that walks the whole packet once per device. The
+    packets span several tiles, the RtPacket boundaries fall inside and
+    between the tiles, and the devices wrap around their RtPackets. The
+    mixed packet must be bit-exact, and the position of every lane and the
+    bytes copied up to its last RtPacket boundary must match.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <vector>
+
+#include "StreamPlatform.h"
+#include "MixBus.h"
+#include "HostTest.h"
+
+typedef struct _MIX_FORMAT
+{
+    bool  IsFloat;
+    ULONG BytesPerSample;
+} MIX_FORMAT;
+
+static const MIX_FORMAT c_formats[] = {
+    {false, 2},
+    {false, 3},
+    {false, 4},
+    {true, 4},
+};
+
+typedef struct _FEATURE_LEVEL
+{
+    const char * Name;
+    ULONGLONG    ProcessorFeatures;
+} FEATURE_LEVEL;
+
+static const FEATURE_LEVEL c_featureLevels[] = {
+    {"scalar", 0},
+#if defined(_M_X64)
+    {"sse4.1", 1ULL << PF_SSE4_1_INSTRUCTIONS_AVAILABLE},
+    {"avx2", (1ULL << PF_SSE4_1_INSTRUCTIONS_AVAILABLE) | (1ULL << PF_AVX2_INSTRUCTIONS_AVAILABLE)},
+#endif
+};
+
+//
+// A render device: its channels in the USB frame, and a ring of RtPackets
+// that the mix starts to read at StartFrame.
+//
+typedef struct _TEST_DEVICE
+{
+    ULONG Channels;
+    ULONG UsbChannel;
+    ULONG RtPacketFrames;
+    ULONG RtPacketsCount;
+    ULONG StartFrame;
+} TEST_DEVICE;
+
+typedef struct _TEST_CASE
+{
+    const char *             Name;
+    ULONG                    UsbChannels;
+    ULONG                    PacketFrames;
+    std::vector<TEST_DEVICE> Devices;
+} TEST_CASE;
+
+static ULONG g_random = 1;
+
+static ULONG Random()
+{
+    g_random = g_random * 1664525 + 1013904223;
+    return g_random >> 8;
+}
+
+// Fills the buffer with samples, a quarter of them close to full scale so that the mix saturates.
+static void FillSamples(
+    std::vector<UCHAR> & buffer,
+    const MIX_FORMAT &   format
+)
+{
+    for (size_t offset = 0; offset + format.BytesPerSample <= buffer.size(); offset += format.BytesPerSample)
+    {
+        if (format.IsFloat)
+        {
+            float sample = ((LONG)(Random() % 4001) - 2000) / 1000.0f;
+            memcpy(&buffer[offset], &sample, sizeof(sample));
+        }
+        else
+        {
+            ULONG sample = Random() ^ (Random() << 16);
+            if ((Random() % 4) == 0)
+            {
+                sample = ((Random() % 2) == 0) ? (0x7fffffff - (Random() % 0x100000)) : (0x80000000 + (Random() % 0x100000));
+                sample >>= (4 - format.BytesPerSample) * 8;
+            }
+            for (ULONG byte = 0; byte < format.BytesPerSample; ++byte)
+            {
+                buffer[offset + byte] = (UCHAR)(sample >> (byte * 8));
+            }
+        }
+    }
+}
+
+// Adds one sample with saturation, or without it for float samples.
+static void ReferenceMixSample(
+    PUCHAR             out,
+    const UCHAR *      in,
+    const MIX_FORMAT & format
+)
+{
+    if (format.IsFloat)
+    {
+        float outSample;
+        float inSample;
+        memcpy(&outSample, out, sizeof(float));
+        memcpy(&inSample, in, sizeof(float));
+        outSample = outSample + inSample;
+        memcpy(out, &outSample, sizeof(float));
+        return;
+    }
+
+    const ULONG    bits = format.BytesPerSample * 8;
+    const LONGLONG maxSample = (1LL << (bits - 1)) - 1;
+    const LONGLONG minSample = -(1LL << (bits - 1));
+    ULONGLONG      outBits = 0;
+    ULONGLONG      inBits = 0;
+    for (ULONG byte = 0; byte < format.BytesPerSample; ++byte)
+    {
+        outBits |= (ULONGLONG)out[byte] << (byte * 8);
+        inBits |= (ULONGLONG)in[byte] << (byte * 8);
+    }
+    LONGLONG sum = ((LONGLONG)(outBits << (64 - bits)) >> (64 - bits)) + ((LONGLONG)(inBits << (64 - bits)) >> (64 - bits));
+    sum = (sum > maxSample) ? maxSample : ((sum < minSample) ? minSample : sum);
+    for (ULONG byte = 0; byte < format.BytesPerSample; ++byte)
+    {
+        out[byte] = (UCHAR)((ULONGLONG)sum >> (byte * 8));
+    }
+}
+
+static void RunCase(
+    const FEATURE_LEVEL & level,
+    const MIX_FORMAT &    format,
+    MIX_KERNEL            kernel,
+    const TEST_CASE &     testCase
+)
+{
+    const ULONG usbFrameBytes = testCase.UsbChannels * format.BytesPerSample;
+    const ULONG length = testCase.PacketFrames * usbFrameBytes;
+    const ULONG totalProcessedBytesSoFar = 3 * usbFrameBytes;
+
+    std::vector<std::vector<std::vector<UCHAR>>> rtPackets(testCase.Devices.size());
+    std::vector<std::vector<PVOID>>              rtPacketPointers(testCase.Devices.size());
+    std::vector<MIX_BUS_LANE>                    lanes(testCase.Devices.size());
+
+    for (size_t deviceIndex = 0; deviceIndex < testCase.Devices.size(); ++deviceIndex)
+    {
+        const TEST_DEVICE & device = testCase.Devices[deviceIndex];
+        const ULONG         srcFrameBytes = device.Channels * format.BytesPerSample;
+        for (ULONG packet = 0; packet < device.RtPacketsCount; ++packet)
+        {
+            rtPackets[deviceIndex].emplace_back(device.RtPacketFrames * srcFrameBytes);
+            FillSamples(rtPackets[deviceIndex].back(), format);
+            rtPacketPointers[deviceIndex].push_back(rtPackets[deviceIndex].back().data());
+        }
+
+        MIX_BUS_LANE & lane = lanes[deviceIndex];
+        memset(&lane, 0, sizeof(lane));
+        lane.DeviceIndex = (ULONG)deviceIndex;
+        lane.RtPackets = rtPacketPointers[deviceIndex].data();
+        lane.RtPacketsCount = device.RtPacketsCount;
+        lane.RtPacketSize = device.RtPacketFrames * srcFrameBytes;
+        lane.Channels = device.Channels;
+        lane.UsbChannel = device.UsbChannel;
+        lane.SrcFrameBytes = srcFrameBytes;
+        lane.RtPacketIndex = (device.StartFrame / device.RtPacketFrames) % device.RtPacketsCount;
+        lane.SrcIndexInRtPacket = (device.StartFrame % device.RtPacketFrames) * srcFrameBytes;
+        lane.SrcData = (PBYTE)lane.RtPackets[lane.RtPacketIndex];
+    }
+
+    std::vector<UCHAR> packet(length);
+    FillSamples(packet, format);
+
+    //
+    // The sequential mix walks the whole packet once per device, as the
+    // driver did before the mix bus.
+    //
+    std::vector<UCHAR>        expected = packet;
+    std::vector<MIX_BUS_LANE> expectedLanes = lanes;
+    for (size_t deviceIndex = 0; deviceIndex < testCase.Devices.size(); ++deviceIndex)
+    {
+        const TEST_DEVICE & device = testCase.Devices[deviceIndex];
+        MIX_BUS_LANE &      lane = expectedLanes[deviceIndex];
+        ULONG               frameInRing = device.StartFrame % (device.RtPacketFrames * device.RtPacketsCount);
+
+        for (ULONG frame = 0; frame < testCase.PacketFrames; ++frame)
+        {
+            const UCHAR * src = rtPackets[deviceIndex][frameInRing / device.RtPacketFrames].data() + (frameInRing % device.RtPacketFrames) * lane.SrcFrameBytes;
+            PUCHAR        dst = expected.data() + frame * usbFrameBytes + device.UsbChannel * format.BytesPerSample;
+            for (ULONG ch = 0; ch < device.Channels; ++ch)
+            {
+                ReferenceMixSample(dst + ch * format.BytesPerSample, src + ch * format.BytesPerSample, format);
+            }
+
+            lane.BytesCopiedSrcData += lane.SrcFrameBytes;
+            frameInRing = (frameInRing + 1) % (device.RtPacketFrames * device.RtPacketsCount);
+            if ((frameInRing % device.RtPacketFrames) == 0)
+            {
+                lane.FedRtPacket = true;
+                lane.BytesCopiedUpToBoundary = totalProcessedBytesSoFar + (frame + 1) * usbFrameBytes;
+                lane.BytesCopiedSrcDataUpToBoundary = lane.BytesCopiedSrcData;
+            }
+        }
+        lane.RtPacketIndex = frameInRing / device.RtPacketFrames;
+        lane.SrcIndexInRtPacket = (frameInRing % device.RtPacketFrames) * lane.SrcFrameBytes;
+        lane.SrcData = (PBYTE)lane.RtPackets[lane.RtPacketIndex];
+    }
+
+    std::vector<UCHAR> tile(MixBus::c_tileBytes);
+    MixBus::Mix(lanes.data(), (ULONG)lanes.size(), kernel, nullptr, nullptr, tile.data(), packet.data(), length, totalProcessedBytesSoFar, format.BytesPerSample, testCase.UsbChannels, format.BytesPerSample);
+
+    HOST_TEST_EXPECT(packet == expected, "%s, %s%u, %s: the tiled mix differs from the sequential mix", level.Name, format.IsFloat ? "float" : "int", format.BytesPerSample * 8, testCase.Name);
+    for (size_t deviceIndex = 0; deviceIndex < lanes.size(); ++deviceIndex)
+    {
+        const MIX_BUS_LANE & actualLane = lanes[deviceIndex];
+        const MIX_BUS_LANE & expectedLane = expectedLanes[deviceIndex];
+        HOST_TEST_EXPECT((actualLane.RtPacketIndex == expectedLane.RtPacketIndex) && (actualLane.SrcIndexInRtPacket == expectedLane.SrcIndexInRtPacket) && (actualLane.SrcData == expectedLane.SrcData), "%s, %s: device %zu is at RtPacket %u + %u, expected %u + %u", level.Name, testCase.Name, deviceIndex, actualLane.RtPacketIndex, actualLane.SrcIndexInRtPacket, expectedLane.RtPacketIndex, expectedLane.SrcIndexInRtPacket);
+        HOST_TEST_EXPECT(actualLane.BytesCopiedSrcData == expectedLane.BytesCopiedSrcData, "%s, %s: device %zu copied %u bytes, expected %u", level.Name, testCase.Name, deviceIndex, actualLane.BytesCopiedSrcData, expectedLane.BytesCopiedSrcData);
+        HOST_TEST_EXPECT(actualLane.FedRtPacket == expectedLane.FedRtPacket, "%s, %s: device %zu fed an RtPacket %d, expected %d", level.Name, testCase.Name, deviceIndex, actualLane.FedRtPacket, expectedLane.FedRtPacket);
+        HOST_TEST_EXPECT((actualLane.BytesCopiedUpToBoundary == expectedLane.BytesCopiedUpToBoundary) && (actualLane.BytesCopiedSrcDataUpToBoundary == expectedLane.BytesCopiedSrcDataUpToBoundary), "%s, %s: device %zu reached the boundary at %u / %u bytes, expected %u / %u", level.Name, testCase.Name, deviceIndex, actualLane.BytesCopiedUpToBoundary, actualLane.BytesCopiedSrcDataUpToBoundary, expectedLane.BytesCopiedUpToBoundary, expectedLane.BytesCopiedSrcDataUpToBoundary);
+    }
+}
+
+int main()
+{
+    const TEST_CASE testCases[] = {
+        // One stereo device that fills a packet smaller than a tile.
+        {"single device", 2, 48, {{2, 0, 480, 2, 100}}},
+        // Three devices side by side over several tiles; the RtPacket boundaries fall inside the tiles.
+        {"side by side", 10, 400, {{2, 0, 100, 3, 30}, {4, 2, 48, 4, 47}, {4, 6, 7, 3, 0}}},
+        // Two devices on the same channels, so the order of the saturating adds matters.
+        {"overlapping", 8, 300, {{8, 0, 64, 2, 60}, {6, 1, 33, 5, 100}}},
+        // A device that wraps around its RtPackets several times in a packet.
+        {"wrap around", 4, 1100, {{2, 2, 16, 3, 5}, {2, 0, 1100, 2, 0}}},
+        // Frames as large as a tile allows, one frame per tile for int32.
+        {"wide frames", 1024, 5, {{512, 0, 3, 2, 2}, {512, 512, 2, 3, 1}}},
+    };
+
+    for (const FEATURE_LEVEL & level : c_featureLevels)
+    {
+        StreamPlatform::SetProcessorFeatures(level.ProcessorFeatures);
+        if ((level.ProcessorFeatures != 0) && !ExIsProcessorFeaturePresent(PF_SSE4_1_INSTRUCTIONS_AVAILABLE))
+        {
+            printf("%s: not supported by the host processor\n", level.Name);
+            continue;
+        }
+
+        for (const MIX_FORMAT & format : c_formats)
+        {
+            MIX_KERNEL_INFO kernelInfo;
+            NTSTATUS        status = MixKernels::Select(format.IsFloat, format.BytesPerSample, kernelInfo);
+            HOST_TEST_EXPECT(NT_SUCCESS(status), "Select failed, 0x%x", (unsigned)status);
+            if (!NT_SUCCESS(status))
+            {
+                continue;
+            }
+
+            MIX_KERNEL_STATE kernelState;
+            MIX_KERNEL       kernel = MixKernels::Begin(kernelInfo, kernelState);
+            for (const TEST_CASE & testCase : testCases)
+            {
+                RunCase(level, format, kernel, testCase);
+            }
+            MixKernels::End(kernelState);
+        }
+    }
+    StreamPlatform::SetProcessorFeatures(~0ULL);
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,244 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    MixKernelsTest.cpp
+
+Abstract:
+
+    Test that every mix kernel that MixKernels::Select() returns on the host
+    is bit-exact with a scalar saturating mix, for every sample format, odd
+    channel counts, interleaved strides and runs split at a ring boundary.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <vector>
+
+#include "StreamPlatform.h"
+#include "MixKernels.h"
+#include "HostTest.h"
+
+typedef struct _MIX_FORMAT
+{
+    bool  IsFloat;
+    ULONG BytesPerSample;
+} MIX_FORMAT;
+
+static const MIX_FORMAT c_formats[] = {
+    {false, 2},
+    {false, 3},
+    {false, 4},
+    {true, 4},
+};
+
+typedef struct _FEATURE_LEVEL
+{
+    const char *  Name;
+    ULONGLONG     ProcessorFeatures;
+    MixKernelType Type;
+} FEATURE_LEVEL;
+
+static const FEATURE_LEVEL c_featureLevels[] = {
+    {"scalar", 0, MixKernelType::Scalar},
+#if defined(_M_X64)
+    {"sse4.1", 1ULL << PF_SSE4_1_INSTRUCTIONS_AVAILABLE, MixKernelType::Sse41},
+    {"avx2", (1ULL << PF_SSE4_1_INSTRUCTIONS_AVAILABLE) | (1ULL << PF_AVX2_INSTRUCTIONS_AVAILABLE), MixKernelType::Avx2},
+#endif
+};
+
+static const ULONG c_channels[] = {1, 2, 3, 5, 7, 8, 9, 13, 17, 32};
+static const ULONG c_frames[] = {0, 1, 2, 7, 31, 64};
+
+static ULONG g_random = 1;
+
+static ULONG Random()
+{
+    g_random = g_random * 1664525 + 1013904223;
+    return g_random >> 8;
+}
+
+// Fills the buffer with samples, a quarter of them close to full scale so that the mix saturates.
+static void FillSamples(
+    std::vector<UCHAR> & buffer,
+    const MIX_FORMAT &   format
+)
+{
+    for (size_t offset = 0; offset + format.BytesPerSample <= buffer.size(); offset += format.BytesPerSample)
+    {
+        if (format.IsFloat)
+        {
+            float sample = ((LONG)(Random() % 4001) - 2000) / 1000.0f;
+            memcpy(&buffer[offset], &sample, sizeof(sample));
+        }
+        else
+        {
+            ULONG sample = Random() ^ (Random() << 16);
+            if ((Random() % 4) == 0)
+            {
+                // Near positive or negative full scale.
+                sample = ((Random() % 2) == 0) ? (0x7fffffff - (Random() % 0x100000)) : (0x80000000 + (Random() % 0x100000));
+                sample >>= (4 - format.BytesPerSample) * 8;
+            }
+            for (ULONG byte = 0; byte < format.BytesPerSample; ++byte)
+            {
+                buffer[offset + byte] = (UCHAR)(sample >> (byte * 8));
+            }
+        }
+    }
+}
+
+static void ReferenceMix(
+    PUCHAR             dst,
+    ULONG              dstFrameBytes,
+    const UCHAR *      src,
+    ULONG              srcFrameBytes,
+    ULONG              channels,
+    ULONG              frames,
+    const MIX_FORMAT & format
+)
+{
+    const ULONG bits = format.BytesPerSample * 8;
+    const LONGLONG maxSample = (1LL << (bits - 1)) - 1;
+    const LONGLONG minSample = -(1LL << (bits - 1));
+
+    for (ULONG frame = 0; frame < frames; ++frame)
+    {
+        for (ULONG ch = 0; ch < channels; ++ch)
+        {
+            PUCHAR        out = dst + frame * dstFrameBytes + ch * format.BytesPerSample;
+            const UCHAR * in = src + frame * srcFrameBytes + ch * format.BytesPerSample;
+
+            if (format.IsFloat)
+            {
+                float outSample;
+                float inSample;
+                memcpy(&outSample, out, sizeof(float));
+                memcpy(&inSample, in, sizeof(float));
+                outSample = outSample + inSample;
+                memcpy(out, &outSample, sizeof(float));
+                continue;
+            }
+
+            ULONGLONG outBits = 0;
+            ULONGLONG inBits = 0;
+            for (ULONG byte = 0; byte < format.BytesPerSample; ++byte)
+            {
+                outBits |= (ULONGLONG)out[byte] << (byte * 8);
+                inBits |= (ULONGLONG)in[byte] << (byte * 8);
+            }
+            // Sign-extend both samples.
+            LONGLONG sum = ((LONGLONG)(outBits << (64 - bits)) >> (64 - bits)) + ((LONGLONG)(inBits << (64 - bits)) >> (64 - bits));
+            sum = (sum > maxSample) ? maxSample : ((sum < minSample) ? minSample : sum);
+            for (ULONG byte = 0; byte < format.BytesPerSample; ++byte)
+            {
+                out[byte] = (UCHAR)((ULONGLONG)sum >> (byte * 8));
+            }
+        }
+    }
+}
+
+//
+// Mixes 'channels' channels into a USB frame of dstPad more channels, at
+// channel offset dstPad / 2, from a frame of srcPad more channels, as a whole
+// run and split at every ring boundary position in splitAt.
+//
+static void TestLayout(
+    const FEATURE_LEVEL & level,
+    const MIX_FORMAT &    format,
+    MIX_KERNEL            kernel,
+    ULONG                 channels,
+    ULONG                 dstPad,
+    ULONG                 srcPad,
+    ULONG                 frames
+)
+{
+    const ULONG        dstFrameBytes = (channels + dstPad) * format.BytesPerSample;
+    const ULONG        srcFrameBytes = (channels + srcPad) * format.BytesPerSample;
+    const ULONG        dstOffset = (dstPad / 2) * format.BytesPerSample;
+    std::vector<UCHAR> dst(dstFrameBytes * frames + 16);
+    std::vector<UCHAR> src(srcFrameBytes * frames + 16);
+
+    FillSamples(dst, format);
+    FillSamples(src, format);
+
+    std::vector<UCHAR> expected = dst;
+    ReferenceMix(expected.data() + dstOffset, dstFrameBytes, src.data(), srcFrameBytes, channels, frames, format);
+
+    const ULONG splitAt[] = {frames, 1, frames / 2, (frames != 0) ? (frames - 1) : 0};
+    for (ULONG split : splitAt)
+    {
+        if (split > frames)
+        {
+            continue;
+        }
+        std::vector<UCHAR> actual = dst;
+        kernel(actual.data() + dstOffset, dstFrameBytes, src.data(), srcFrameBytes, channels, split);
+        kernel(actual.data() + dstOffset + split * dstFrameBytes, dstFrameBytes, src.data() + split * srcFrameBytes, srcFrameBytes, channels, frames - split);
+
+        HOST_TEST_EXPECT(actual == expected, "%s, %s%u, %u channels, pad %u/%u, %u frames split at %u", level.Name, format.IsFloat ? "float" : "int", format.BytesPerSample * 8, channels, dstPad, srcPad, frames, split);
+    }
+}
+
+int main()
+{
+    for (const FEATURE_LEVEL & level : c_featureLevels)
+    {
+        StreamPlatform::SetProcessorFeatures(level.ProcessorFeatures);
+        if ((level.ProcessorFeatures != 0) && !ExIsProcessorFeaturePresent(PF_SSE4_1_INSTRUCTIONS_AVAILABLE))
+        {
+            printf("%s: not supported by the host processor\n", level.Name);
+            continue;
+        }
+
+        for (const MIX_FORMAT & format : c_formats)
+        {
+            MIX_KERNEL_INFO kernelInfo;
+            NTSTATUS        status = MixKernels::Select(format.IsFloat, format.BytesPerSample, kernelInfo);
+            HOST_TEST_EXPECT(NT_SUCCESS(status), "Select failed, 0x%x", (unsigned)status);
+            if (!NT_SUCCESS(status))
+            {
+                continue;
+            }
+
+            // There is no AVX2 kernel for 24-bit samples.
+            MixKernelType expectedType = ((level.Type == MixKernelType::Avx2) && (format.BytesPerSample == 3)) ? MixKernelType::Sse41 : level.Type;
+            HOST_TEST_EXPECT(kernelInfo.Type == expectedType, "%s, %u bytes: kernel type %d", level.Name, format.BytesPerSample, (int)kernelInfo.Type);
+            HOST_TEST_EXPECT(kernelInfo.RequiresExtendedState == (kernelInfo.Type == MixKernelType::Avx2), "%s: extended state %d", level.Name, (int)kernelInfo.RequiresExtendedState);
+
+            MIX_KERNEL_STATE kernelState;
+            MIX_KERNEL       kernel = MixKernels::Begin(kernelInfo, kernelState);
+            HOST_TEST_EXPECT(kernel == kernelInfo.Kernel, "%s: Begin returned the fallback kernel", level.Name);
+
+            for (ULONG channels : c_channels)
+            {
+                for (ULONG frames : c_frames)
+                {
+                    TestLayout(level, format, kernel, channels, 0, 0, frames);
+                    TestLayout(level, format, kernel, channels, 3, 0, frames);
+                    TestLayout(level, format, kernel, channels, 0, 1, frames);
+                    TestLayout(level, format, kernel, channels, 5, 2, frames);
+                }
+            }
+            MixKernels::End(kernelState);
+            HOST_TEST_EXPECT(kernelState.Kernel == nullptr, "End did not release the kernel");
+        }
+    }
+    StreamPlatform::SetProcessorFeatures(~0ULL);
+
+    MIX_KERNEL_INFO kernelInfo;
+    HOST_TEST_EXPECT(MixKernels::Select(true, 8, kernelInfo) == STATUS_NOT_SUPPORTED, "64-bit float accepted");
+    HOST_TEST_EXPECT(MixKernels::Select(false, 1, kernelInfo) == STATUS_NOT_SUPPORTED, "8-bit PCM accepted");
+
+    return HOST_TEST_RESULT();
+}
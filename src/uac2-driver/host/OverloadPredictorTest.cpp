@@ -0,0 +1,212 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    OverloadPredictorTest.cpp
+
+Abstract:
+
+    Test OverloadPredictor. The streaming tail estimate must settle at the
+    98th percentile of a known distribution, a rare spike that the average
+    hides and a rising trend must be warned about before they reach the
+    budget, and the warning must be raised once, only after the minimum
+    number of samples, and cleared with hysteresis.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <random>
+
+#include "StreamPlatform.h"
+#include "OverloadPredictor.h"
+#include "HostTest.h"
+
+static const LONG c_budgetUs = 1000;
+
+static UAC_OVERLOAD_PREDICTION GetPrediction(
+    const OverloadPredictor & predictor,
+    UACOverloadSignal         signal
+)
+{
+    UAC_STATISTICS statistics{};
+    predictor.GetStatistics(statistics);
+    return statistics.Prediction[toULong(signal)];
+}
+
+// The value that the predictor compares with the budget, as documented in UAC_User.h.
+static LONG PredictedUs(
+    const UAC_OVERLOAD_PREDICTION & prediction
+)
+{
+    return max(prediction.TailUs, prediction.AverageUs + prediction.DeviationUs * 3);
+}
+
+static void TestTailEstimate()
+{
+    OverloadPredictor                  predictor;
+    std::mt19937                       random(1);
+    std::uniform_int_distribution<int> uniform(0, 999);
+    ULONG                              samples = 0;
+    ULONG                              samplesAboveTail = 0;
+    LONGLONG                           averageSumUs = 0;
+    LONGLONG                           deviationSumUs = 0;
+
+    // Uniform over 0..999us, with a mean of 500us and a mean absolute deviation of 250us. The budget is out of reach.
+    for (ULONG i = 0; i < 200000; ++i)
+    {
+        LONG valueUs = uniform(random);
+        if (i >= 10000)
+        {
+            UAC_OVERLOAD_PREDICTION prediction = GetPrediction(predictor, UACOverloadSignal::ClientProcessing);
+            samplesAboveTail += (valueUs > prediction.TailUs) ? 1 : 0;
+            averageSumUs += prediction.AverageUs;
+            deviationSumUs += prediction.DeviationUs;
+            ++samples;
+        }
+        predictor.Update(UACOverloadSignal::ClientProcessing, valueUs, 100000);
+    }
+
+    UAC_OVERLOAD_PREDICTION prediction = GetPrediction(predictor, UACOverloadSignal::ClientProcessing);
+    double                  aboveTailPercent = samplesAboveTail * 100.0 / samples;
+    LONG                    averageUs = (LONG)(averageSumUs / samples);
+    LONG                    deviationUs = (LONG)(deviationSumUs / samples);
+    printf("uniform 0..999us: %.2f%% of the samples above the tail, average %dus, deviation %dus\n", aboveTailPercent, averageUs, deviationUs);
+
+    // The tail settles where 1 / (c_tailRatio + 1) = 2% of the samples are above it.
+    HOST_TEST_EXPECT((aboveTailPercent >= 1.5) && (aboveTailPercent <= 2.5), "%.2f%% of the samples are above the tail estimate, expected 2%%", aboveTailPercent);
+    HOST_TEST_EXPECT((averageUs >= 480) && (averageUs <= 520), "the average is %dus, expected 500us", averageUs);
+    HOST_TEST_EXPECT((deviationUs >= 200) && (deviationUs <= 260), "the deviation is %dus, expected about 250us", deviationUs);
+    HOST_TEST_EXPECT(prediction.Samples == 200000, "%llu samples", (unsigned long long)prediction.Samples);
+    HOST_TEST_EXPECT((prediction.Warnings == 0) && (prediction.Warning == 0), "warned %llu times without a budget in reach", (unsigned long long)prediction.Warnings);
+    HOST_TEST_EXPECT(prediction.BudgetUs == 100000, "budget %dus", prediction.BudgetUs);
+}
+
+static void TestSpikes()
+{
+    OverloadPredictor predictor;
+    ULONG             warnedAt = 0;
+
+    // 400us, with a spike to 950us every 25th sample. The average stays far below the budget.
+    for (ULONG i = 1; (i <= 5000) && (warnedAt == 0); ++i)
+    {
+        LONG valueUs = ((i % 25) == 0) ? 950 : 400;
+        if (predictor.Update(UACOverloadSignal::DpcLateness, valueUs, c_budgetUs))
+        {
+            warnedAt = i;
+        }
+    }
+
+    UAC_OVERLOAD_PREDICTION prediction = GetPrediction(predictor, UACOverloadSignal::DpcLateness);
+    HOST_TEST_EXPECT(warnedAt != 0, "4%% of the samples at 95%% of the budget were not warned about, tail %dus", prediction.TailUs);
+    HOST_TEST_EXPECT(prediction.AverageUs < c_budgetUs / 2, "the average is %dus", prediction.AverageUs);
+    HOST_TEST_EXPECT(GetPrediction(predictor, UACOverloadSignal::ClientProcessing).Samples == 0, "the other signal has samples");
+}
+
+static void TestTrend()
+{
+    OverloadPredictor predictor;
+    LONG              warnedAtUs = 0;
+
+    for (ULONG i = 0; i < 200; ++i)
+    {
+        predictor.Update(UACOverloadSignal::ClientProcessing, 300, c_budgetUs);
+    }
+    HOST_TEST_EXPECT(GetPrediction(predictor, UACOverloadSignal::ClientProcessing).Warning == 0, "warned at 30%% of the budget");
+
+    // The processing time grows by 10us per buffer. The deviation follows the
+    // trend, so the warning comes before the samples reach 85% of the budget.
+    for (LONG valueUs = 300; (valueUs <= 1200) && (warnedAtUs == 0); valueUs += 10)
+    {
+        if (predictor.Update(UACOverloadSignal::ClientProcessing, valueUs, c_budgetUs))
+        {
+            warnedAtUs = valueUs;
+        }
+    }
+
+    printf("rising trend: warned at %dus\n", warnedAtUs);
+    HOST_TEST_EXPECT((warnedAtUs != 0) && (warnedAtUs < c_budgetUs * 80 / 100), "a rising trend was warned about at %dus, expected before 80%% of the budget", warnedAtUs);
+}
+
+static void TestHysteresis()
+{
+    OverloadPredictor predictor;
+
+    // No warning before 32 samples, even above the budget.
+    for (ULONG i = 1; i < 32; ++i)
+    {
+        HOST_TEST_EXPECT(!predictor.Update(UACOverloadSignal::ClientProcessing, 2000, c_budgetUs), "warned after %u samples", i);
+    }
+    HOST_TEST_EXPECT(predictor.Update(UACOverloadSignal::ClientProcessing, 2000, c_budgetUs), "no warning after 32 samples above the budget");
+
+    // A warning is raised once.
+    for (ULONG i = 0; i < 100; ++i)
+    {
+        HOST_TEST_EXPECT(!predictor.Update(UACOverloadSignal::ClientProcessing, 2000, c_budgetUs), "warned again while the warning is set");
+    }
+
+    // Back to 500us +/- 50us. The warning is kept down to 70% of the budget.
+    std::mt19937                       random(2);
+    std::uniform_int_distribution<int> jitter(-50, 50);
+    bool                               cleared = false;
+    for (ULONG i = 0; (i < 20000) && !cleared; ++i)
+    {
+        LONG predictedBeforeUs = PredictedUs(GetPrediction(predictor, UACOverloadSignal::ClientProcessing));
+        HOST_TEST_EXPECT(!predictor.Update(UACOverloadSignal::ClientProcessing, 500 + jitter(random), c_budgetUs), "warned while the load decreases");
+
+        UAC_OVERLOAD_PREDICTION prediction = GetPrediction(predictor, UACOverloadSignal::ClientProcessing);
+        cleared = (prediction.Warning == 0);
+        if (cleared)
+        {
+            HOST_TEST_EXPECT(PredictedUs(prediction) <= c_budgetUs * 70 / 100, "cleared at a prediction of %dus", PredictedUs(prediction));
+            HOST_TEST_EXPECT(predictedBeforeUs >= c_budgetUs * 70 / 100 - 2, "cleared late, the prediction was already %dus", predictedBeforeUs);
+        }
+    }
+    HOST_TEST_EXPECT(cleared, "the warning was not cleared at 50%% of the budget");
+
+    // Between 70% and 85% of the budget, a cleared warning is not raised again.
+    // The load rises slowly so that the prediction does not see a trend.
+    for (ULONG i = 0; i < 5000; ++i)
+    {
+        LONG valueUs = min(500 + (LONG)i / 10, 780L);
+        HOST_TEST_EXPECT(!predictor.Update(UACOverloadSignal::ClientProcessing, valueUs, c_budgetUs), "warned at %dus", valueUs);
+    }
+    HOST_TEST_EXPECT(PredictedUs(GetPrediction(predictor, UACOverloadSignal::ClientProcessing)) > c_budgetUs * 70 / 100, "the prediction is not in the band of the hysteresis");
+
+    bool warned = false;
+    for (ULONG i = 0; (i < 1000) && !warned; ++i)
+    {
+        warned = predictor.Update(UACOverloadSignal::ClientProcessing, 950, c_budgetUs);
+    }
+    UAC_OVERLOAD_PREDICTION prediction = GetPrediction(predictor, UACOverloadSignal::ClientProcessing);
+    HOST_TEST_EXPECT(warned && (prediction.Warnings == 2) && (prediction.Warning != 0), "%llu warnings, expected 2", (unsigned long long)prediction.Warnings);
+
+    // A negative value counts as 0us.
+    OverloadPredictor negative;
+    negative.Update(UACOverloadSignal::DpcLateness, -500, c_budgetUs);
+    prediction = GetPrediction(negative, UACOverloadSignal::DpcLateness);
+    HOST_TEST_EXPECT((prediction.AverageUs == 0) && (prediction.TailUs == 0), "a negative sample gave an average of %dus and a tail of %dus", prediction.AverageUs, prediction.TailUs);
+}
+
+int main()
+{
+    OverloadPredictor * predictor = OverloadPredictor::Create();
+    HOST_TEST_EXPECT(predictor != nullptr, "Create failed");
+    delete predictor;
+
+    TestTailEstimate();
+    TestSpikes();
+    TestTrend();
+    TestHysteresis();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,245 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    PacketSchedulerSimulation.cpp
+
+Abstract:
+
+    Run the packet selection of the mixing engine thread against a simulated
+    USB bus with DPC latency, thread jitter, DPC stalls and bus time errors,
+    and count the output packets the bus transfers before the thread has
+    written them, for the driver settings of each ASIO buffer size.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include "SimulatedUsbBus.h"
+#include "PacketScheduler.h"
+#include "HostTest.h"
+
+//
+// ClassicFramesPerIrp and the output buffer operation offset of
+// g_DriverSettingsTable (Device.cpp) for each ASIO buffer size, with
+// UAC_DEFAULT_MAX_IRP_NUMBER on x64.
+//
+typedef struct _STREAM_SETTINGS
+{
+    ULONG PeriodFrames;
+    ULONG ClassicFramesPerIrp;
+    ULONG OutputOffsetMs;
+    ULONG MaxIrpNumber;
+} STREAM_SETTINGS;
+
+static const STREAM_SETTINGS c_streamSettings[] = {
+    {32, 1, 2, 4},
+    {64, 2, 3, 4},
+    {128, 3, 4, 4},
+    {256, 3, 5, 4},
+    {512, 4, 7, 4},
+    {1024, 4, 8, 4},
+};
+
+typedef struct _SIMULATION_RESULT
+{
+    ULONG WakeUps;
+    ULONG Underruns;        // Output packets transferred before the thread wrote them
+    ULONG DetectedDropouts; // Wake-ups on which the safety offset fell below the minimum offset
+    ULONG IllegalBusTimes;
+    ULONG FrameSkips;
+} SIMULATION_RESULT;
+
+//
+// Follows the IN and OUT loops of StreamObject::MixingEngineThreadMain() for
+// a stream without an ASIO client, in which OUT keeps the safety offset ahead
+// of IN after the first pass.
+//
+static SIMULATION_RESULT Simulate(
+    const SIMULATED_USB_BUS_CONFIG & busConfig,
+    const STREAM_SETTINGS &          settings,
+    ULONG                            durationMs
+)
+{
+    SIMULATION_RESULT result{};
+    SimulatedUsbBus   bus(busConfig);
+    PacketScheduler   scheduler;
+    const ULONG       packetsPerIrp = bus.GetPacketsPerIrp();
+    const ULONG       numIrp = settings.MaxIrpNumber;
+    const ULONG       inputOffsetFrame = 0;
+    const ULONG       outputOffsetFrame = settings.OutputOffsetMs * busConfig.FramesPerMs;
+    const ULONG       outMinOffsetFrame = 1;
+    const ULONG       dpcOffset = packetsPerIrp;
+    bool              isFirstWakeUp = true;
+    bool              safetyOffsetApplied = false;
+    ULONGLONG         prevWakeUpUs = 0;
+    LONGLONG          checkedPacket = -1;
+
+    StreamPlatform::SetBackend(&bus);
+
+    while (StreamPlatform::QueryTimeUs(nullptr, nullptr) < (ULONGLONG)durationMs * 1000ULL)
+    {
+        (void)StreamPlatform::WaitForWakeUp(nullptr);
+        ++result.WakeUps;
+
+        const ULONGLONG currentTimeUs = StreamPlatform::QueryTimeUs(nullptr, nullptr);
+        const LONGLONG  transferredPacket = bus.GetTransferredPacket();
+
+        // Output packets the bus has transferred since the previous wake-up.
+        if (checkedPacket >= 0)
+        {
+            for (LONGLONG packet = checkedPacket; packet < transferredPacket; ++packet)
+            {
+                if (packet >= scheduler.GetOutputProcessedPacket())
+                {
+                    ++result.Underruns;
+                }
+            }
+            checkedPacket = max(checkedPacket, transferredPacket);
+        }
+
+        bool  isIllegalBusTime = false;
+        ULONG usbBusTimeDiff = scheduler.EstimateUsbBusTime(isFirstWakeUp, StreamPlatform::QueryUsbFrame(nullptr), (ULONG)(currentTimeUs - prevWakeUpUs), settings.ClassicFramesPerIrp, isIllegalBusTime);
+        if (isIllegalBusTime)
+        {
+            ++result.IllegalBusTimes;
+        }
+        prevWakeUpUs = currentTimeUs;
+
+        scheduler.DeterminePacket(bus.GetInputCompletedPacket(), usbBusTimeDiff, packetsPerIrp, busConfig.FramesPerMs, false);
+
+        ULONG inBuffersCount = 0;
+        while (inBuffersCount < (packetsPerIrp * numIrp))
+        {
+            if (scheduler.IsInputPacketAtEstimatedPosition(inputOffsetFrame))
+            {
+                break;
+            }
+            scheduler.IncrementInputProcessedPacket();
+            ++inBuffersCount;
+        }
+
+        ULONG outBuffersCount = 0;
+        while (outBuffersCount < ((numIrp - 1) * packetsPerIrp))
+        {
+            if (!safetyOffsetApplied)
+            {
+                if (outBuffersCount >= dpcOffset + inputOffsetFrame + packetsPerIrp + outputOffsetFrame)
+                {
+                    safetyOffsetApplied = true;
+                    break;
+                }
+            }
+            else if (outBuffersCount >= inBuffersCount)
+            {
+                break;
+            }
+            if (scheduler.IsOutputPacketOverlapWithEstimatePosition((numIrp - 1) * packetsPerIrp))
+            {
+                break;
+            }
+            scheduler.IncrementOutputProcessedPacket();
+            ++outBuffersCount;
+        }
+
+        if (checkedPacket < 0)
+        {
+            if (outBuffersCount != 0)
+            {
+                // The packets transferred before the first pass are the silence the stream starts with.
+                checkedPacket = transferredPacket;
+            }
+        }
+        else if (scheduler.CalculateSafetyOffset(inputOffsetFrame, dpcOffset) < (LONG)outMinOffsetFrame)
+        {
+            ++result.DetectedDropouts;
+        }
+        isFirstWakeUp = false;
+    }
+
+    StreamPlatform::SetBackend(nullptr);
+    result.FrameSkips = bus.GetNumOfFrameSkips();
+
+    return result;
+}
+
+static void PrintResult(
+    const char *              name,
+    const STREAM_SETTINGS &   settings,
+    const SIMULATION_RESULT & result
+)
+{
+    printf("%-10s %5u frames, %u ms/IRP, offset %u ms: %6u wake-ups, %5u underrun packets, %5u detected dropouts, %4u illegal bus times\n", name, settings.PeriodFrames, settings.ClassicFramesPerIrp, settings.OutputOffsetMs, result.WakeUps, result.Underruns, result.DetectedDropouts, result.IllegalBusTimes);
+}
+
+int main()
+{
+    const ULONG durationMs = 20000;
+    const ULONG numOfSettings = sizeof(c_streamSettings) / sizeof(c_streamSettings[0]);
+
+    // A quiet system never underruns at any buffer size.
+    for (ULONG i = 0; i < numOfSettings; ++i)
+    {
+        SIMULATED_USB_BUS_CONFIG config;
+        config.ClassicFramesPerIrp = c_streamSettings[i].ClassicFramesPerIrp;
+        config.DpcJitterUs = 50;
+        config.ThreadJitterUs = 100;
+
+        SIMULATION_RESULT result = Simulate(config, c_streamSettings[i], durationMs);
+        PrintResult("quiet", c_streamSettings[i], result);
+        HOST_TEST_EXPECT(result.Underruns == 0, "%u underruns at %u frames", result.Underruns, c_streamSettings[i].PeriodFrames);
+        HOST_TEST_EXPECT(result.DetectedDropouts == 0, "%u dropouts detected at %u frames", result.DetectedDropouts, c_streamSettings[i].PeriodFrames);
+    }
+
+    // Wrong bus times are replaced with the elapsed performance counter time.
+    for (ULONG i = 0; i < numOfSettings; ++i)
+    {
+        SIMULATED_USB_BUS_CONFIG config;
+        config.ClassicFramesPerIrp = c_streamSettings[i].ClassicFramesPerIrp;
+        config.DpcJitterUs = 50;
+        config.ThreadJitterUs = 100;
+        config.FrameSkipPerMille = 20;
+
+        SIMULATION_RESULT result = Simulate(config, c_streamSettings[i], durationMs);
+        PrintResult("skips", c_streamSettings[i], result);
+        HOST_TEST_EXPECT(result.FrameSkips != 0, "no frame skips simulated");
+        HOST_TEST_EXPECT(result.IllegalBusTimes != 0, "no illegal bus time detected for %u frame skips", result.FrameSkips);
+        HOST_TEST_EXPECT(result.Underruns == 0, "%u underruns at %u frames", result.Underruns, c_streamSettings[i].PeriodFrames);
+    }
+
+    // Under load, the underruns decrease as the buffer grows, and the largest buffers absorb them.
+    ULONG prevUnderruns = 0xffffffff;
+    for (ULONG i = 0; i < numOfSettings; ++i)
+    {
+        SIMULATED_USB_BUS_CONFIG config;
+        config.ClassicFramesPerIrp = c_streamSettings[i].ClassicFramesPerIrp;
+        config.DpcJitterUs = 300;
+        config.ThreadJitterUs = 1500;
+        config.StallPerMille = 5;
+        config.StallUs = 6000;
+
+        SIMULATION_RESULT result = Simulate(config, c_streamSettings[i], durationMs);
+        PrintResult("loaded", c_streamSettings[i], result);
+        HOST_TEST_EXPECT(result.Underruns <= prevUnderruns, "%u underruns at %u frames, %u at the smaller buffer", result.Underruns, c_streamSettings[i].PeriodFrames, prevUnderruns);
+        if (i == 0)
+        {
+            HOST_TEST_EXPECT(result.Underruns != 0, "the smallest buffer did not underrun under load");
+        }
+        if (i == numOfSettings - 1)
+        {
+            HOST_TEST_EXPECT(result.Underruns == 0, "%u underruns at the largest buffer", result.Underruns);
+        }
+        prevUnderruns = result.Underruns;
+    }
+
+    return HOST_TEST_RESULT();
+}
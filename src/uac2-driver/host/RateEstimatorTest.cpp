@@ -0,0 +1,230 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    RateEstimatorTest.cpp
+
+Abstract:
+
+    Test RateEstimator against a device that consumes the output at a rate
+    off the nominal one, with and without jitter on the feedback, and with a
+    step in the device rate. The samples sent must follow the samples the
+    device consumed, and the lock state must follow the rate.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <math.h>
+
+#include "StreamPlatform.h"
+#include "RateEstimator.h"
+#include "HostTest.h"
+
+static const ULONG c_sampleRate = 48000;
+static const ULONG c_packetsPerSec = 8000;
+static const ULONG c_packetsPerIrp = 8;
+static const ULONG c_nominalSamplesPerIrp = c_sampleRate / c_packetsPerSec * c_packetsPerIrp;
+
+static ULONG g_random = 1;
+
+static ULONG Random()
+{
+    g_random = g_random * 1103515245 + 12345;
+    return (g_random >> 8) & 0xffff;
+}
+
+typedef struct _RATE_SIMULATION
+{
+    RateEstimator Estimator;
+    double        ConsumedSamples; // by the device, since the first measurement
+    double        SentSamples;     // by the estimator
+    ULONG         MinSamplesPerIrp;
+    ULONG         MaxSamplesPerIrp;
+    double        LastJitter;
+} RATE_SIMULATION;
+
+//
+// One IRP: the output packets are sized by the estimator once it is active,
+// and the feedback of the device is reported afterwards. The feedback jitters
+// by the difference of two uniform values of +-jitterSamples per packet, as a
+// counter of the device clock read at a jittering time does, so that it sums
+// up to the samples the device consumed.
+//
+static void SimulateIrp(
+    RATE_SIMULATION & simulation,
+    double            samplesPerPacket,
+    double            jitterSamples
+)
+{
+    bool  active = simulation.Estimator.IsActive();
+    ULONG samples = c_nominalSamplesPerIrp;
+
+    if (active)
+    {
+        samples = simulation.Estimator.EstimateSamples(c_packetsPerIrp);
+        simulation.Estimator.CommitSamples(samples);
+        simulation.SentSamples += samples;
+        simulation.MinSamplesPerIrp = (samples < simulation.MinSamplesPerIrp) ? samples : simulation.MinSamplesPerIrp;
+        simulation.MaxSamplesPerIrp = (samples > simulation.MaxSamplesPerIrp) ? samples : simulation.MaxSamplesPerIrp;
+    }
+
+    double jitter = ((double)Random() / 32768.0 - 1.0) * jitterSamples;
+    double measured = (samplesPerPacket + jitter - simulation.LastJitter) * c_packetsPerIrp;
+
+    simulation.LastJitter = jitter;
+    simulation.Estimator.Update((ULONGLONG)llround(measured * 65536.0), c_packetsPerIrp, true);
+    if (active)
+    {
+        simulation.ConsumedSamples += samplesPerPacket * c_packetsPerIrp;
+    }
+}
+
+static void ResetSimulation(
+    RATE_SIMULATION & simulation
+)
+{
+    simulation.Estimator.Reset(true, c_sampleRate, c_packetsPerSec, c_packetsPerIrp);
+    simulation.ConsumedSamples = 0.0;
+    simulation.SentSamples = 0.0;
+    simulation.MinSamplesPerIrp = 0xffffffff;
+    simulation.MaxSamplesPerIrp = 0;
+    simulation.LastJitter = 0.0;
+}
+
+static void TestDisabled()
+{
+    RateEstimator estimator;
+
+    estimator.Reset(false, c_sampleRate, c_packetsPerSec, c_packetsPerIrp);
+    for (ULONG irp = 0; irp < 64; ++irp)
+    {
+        estimator.Update(((ULONGLONG)c_nominalSamplesPerIrp + 1) << 16, c_packetsPerIrp, true);
+    }
+    HOST_TEST_EXPECT(!estimator.IsActive(), "the direct estimator is active");
+    HOST_TEST_EXPECT(!estimator.IsLocked(), "the direct estimator is locked");
+}
+
+static void TestNominal()
+{
+    RATE_SIMULATION simulation;
+
+    ResetSimulation(simulation);
+    for (ULONG irp = 0; irp < 1000; ++irp)
+    {
+        SimulateIrp(simulation, (double)c_sampleRate / c_packetsPerSec, 0.0);
+    }
+    HOST_TEST_EXPECT(simulation.Estimator.IsActive(), "the estimator is not active");
+    HOST_TEST_EXPECT(simulation.Estimator.IsLocked(), "the estimator is not locked");
+    HOST_TEST_EXPECT((simulation.MinSamplesPerIrp == c_nominalSamplesPerIrp) && (simulation.MaxSamplesPerIrp == c_nominalSamplesPerIrp), "%u - %u samples per IRP at the nominal rate", simulation.MinSamplesPerIrp, simulation.MaxSamplesPerIrp);
+}
+
+//
+// The device runs ppm off the nominal rate. After the loop settled, the samples
+// sent stay within three samples of the samples consumed, that is the buffer
+// fill of the device does not drift, and no IRP is corrected by more than a
+// sample per packet. The bound is the rounding of the IRP to whole samples
+// divided by the phase gain, plus the jitter.
+//
+static void TestOffset(
+    double ppm,
+    double jitterSamples
+)
+{
+    RATE_SIMULATION simulation;
+    double          samplesPerPacket = (double)c_sampleRate * (1.0 + ppm * 1e-6) / c_packetsPerSec;
+    double          maxFillError = 0.0;
+    ULONG           lockedIrp = 0;
+
+    ResetSimulation(simulation);
+    for (ULONG irp = 0; irp < 20000; ++irp)
+    {
+        SimulateIrp(simulation, samplesPerPacket, jitterSamples);
+        if ((lockedIrp == 0) && simulation.Estimator.IsLocked())
+        {
+            lockedIrp = irp;
+        }
+        if (irp >= 500)
+        {
+            double fillError = fabs(simulation.ConsumedSamples - simulation.SentSamples);
+            maxFillError = (fillError > maxFillError) ? fillError : maxFillError;
+        }
+    }
+
+    HOST_TEST_EXPECT((lockedIrp != 0) && (lockedIrp < 200), "%+.0f ppm, jitter %.2f: locked at IRP %u", ppm, jitterSamples, lockedIrp);
+    HOST_TEST_EXPECT(maxFillError < 3.0, "%+.0f ppm, jitter %.2f: fill error %.3f samples", ppm, jitterSamples, maxFillError);
+    HOST_TEST_EXPECT((simulation.MinSamplesPerIrp + c_packetsPerIrp >= c_nominalSamplesPerIrp) && (simulation.MaxSamplesPerIrp <= c_nominalSamplesPerIrp + c_packetsPerIrp), "%+.0f ppm, jitter %.2f: %u - %u samples per IRP", ppm, jitterSamples, simulation.MinSamplesPerIrp, simulation.MaxSamplesPerIrp);
+}
+
+//
+// A step of the device rate unlocks the estimator, which locks again on the
+// new rate without losing the buffer fill.
+//
+static void TestStep()
+{
+    RATE_SIMULATION simulation;
+    double          samplesPerPacket = (double)c_sampleRate / c_packetsPerSec;
+    bool            unlocked = false;
+
+    ResetSimulation(simulation);
+    for (ULONG irp = 0; irp < 500; ++irp)
+    {
+        SimulateIrp(simulation, samplesPerPacket, 0.0);
+    }
+    HOST_TEST_EXPECT(simulation.Estimator.IsLocked(), "not locked before the step");
+
+    samplesPerPacket = (double)44100 / c_packetsPerSec;
+    for (ULONG irp = 0; irp < 2000; ++irp)
+    {
+        SimulateIrp(simulation, samplesPerPacket, 0.0);
+        unlocked |= !simulation.Estimator.IsLocked();
+    }
+    HOST_TEST_EXPECT(unlocked, "the step did not unlock the estimator");
+    HOST_TEST_EXPECT(simulation.Estimator.IsLocked(), "not locked after the step");
+    HOST_TEST_EXPECT(fabs(simulation.ConsumedSamples - simulation.SentSamples) < 3.0, "fill error %.3f samples after the step", simulation.ConsumedSamples - simulation.SentSamples);
+}
+
+//
+// Once the device has reported feedback, the rate measured from the input
+// packets is ignored.
+//
+static void TestFeedbackPrecedence()
+{
+    RATE_SIMULATION simulation;
+
+    ResetSimulation(simulation);
+    for (ULONG irp = 0; irp < 500; ++irp)
+    {
+        SimulateIrp(simulation, (double)c_sampleRate / c_packetsPerSec, 0.0);
+    }
+    for (ULONG irp = 0; irp < 100; ++irp)
+    {
+        simulation.Estimator.Update(((ULONGLONG)c_nominalSamplesPerIrp * 2) << 16, c_packetsPerIrp, false);
+    }
+    HOST_TEST_EXPECT(simulation.Estimator.IsLocked(), "the input rate unlocked the estimator");
+    HOST_TEST_EXPECT(simulation.Estimator.EstimateSamples(c_packetsPerIrp) == c_nominalSamplesPerIrp, "the input rate changed the estimate to %u", simulation.Estimator.EstimateSamples(c_packetsPerIrp));
+}
+
+int main()
+{
+    TestDisabled();
+    TestNominal();
+    TestOffset(+200.0, 0.0);
+    TestOffset(-300.0, 0.0);
+    TestOffset(+1000.0, 0.02);
+    TestOffset(-1000.0, 0.02);
+    TestOffset(+50.0, 0.03);
+    TestStep();
+    TestFeedbackPrecedence();
+
+    return HOST_TEST_RESULT();
+}
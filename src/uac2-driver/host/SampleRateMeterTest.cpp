@@ -0,0 +1,202 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    SampleRateMeterTest.cpp
+
+Abstract:
+
+    Test SampleRateMeter with synthetic packet series: fractional rates at
+    full and high speed, packets whose length jitters around the rate, a rate
+    change after the history ring has wrapped several times, and the start of
+    the measurement before the window is filled.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <math.h>
+
+#include "StreamPlatform.h"
+#include "SampleRateMeter.h"
+#include "HostTest.h"
+
+static const ULONG c_bytesPerBlock = 8;
+
+static ULONG g_random = 1;
+
+static ULONG Random()
+{
+    g_random = g_random * 1103515245 + 12345;
+    return (g_random >> 8) & 0xffff;
+}
+
+//
+// Generates the packet lengths of a device running at a fractional rate. With
+// jitter, a sample moves to the next packet at random, as when the packets are
+// cut at a jittering time, so the length of a packet is off by one sample but
+// the total stays on the rate.
+//
+typedef struct _PACKET_SERIES
+{
+    double SampleRate;
+    ULONG  PacketsPerMs;
+    bool   Jitter;
+    double Position; // samples, fractional
+    ULONG  Sent;     // samples
+    LONG   Carry;
+} PACKET_SERIES;
+
+static ULONG NextPacket(
+    PACKET_SERIES & series
+)
+{
+    series.Position += series.SampleRate / 1000.0 / series.PacketsPerMs;
+
+    ULONG samples = (ULONG)floor(series.Position) - series.Sent;
+    series.Sent += samples;
+
+    if (series.Jitter)
+    {
+        LONG carry = ((samples != 0) && ((Random() & 3) == 0)) ? 1 : 0;
+        samples = (ULONG)((LONG)samples + series.Carry - carry);
+        series.Carry = carry;
+    }
+    return samples * c_bytesPerBlock;
+}
+
+//
+// Feeds durationMs of packets and checks every result after the first full
+// window against the rate, within two samples per window.
+//
+static void Measure(
+    SampleRateMeter & meter,
+    PACKET_SERIES &   series,
+    ULONG             windowMs,
+    ULONG             durationMs,
+    const char *      name
+)
+{
+    double tolerance = 2.0 * 1000.0 / windowMs + 1.0;
+    double maxError = 0.0;
+    ULONG  results = 0;
+
+    for (ULONG ms = 0; ms < durationMs; ++ms)
+    {
+        for (ULONG packet = 0; packet < series.PacketsPerMs; ++packet)
+        {
+            if (meter.Update(NextPacket(series)) && meter.IsWindowFilled())
+            {
+                double error = fabs((double)meter.GetSampleRateQ16() / 65536.0 - series.SampleRate);
+                maxError = (error > maxError) ? error : maxError;
+                ++results;
+            }
+        }
+    }
+
+    HOST_TEST_EXPECT(results != 0, "%s: no result", name);
+    HOST_TEST_EXPECT(maxError <= tolerance, "%s: error %.3f Hz over a %u ms window", name, maxError, windowMs);
+}
+
+static void TestRate(
+    double      sampleRate,
+    ULONG       packetsPerMs,
+    ULONG       windowMs,
+    bool        jitter,
+    const char * name
+)
+{
+    SampleRateMeter meter;
+    PACKET_SERIES   series{sampleRate, packetsPerMs, jitter, 0.0, 0, 0};
+
+    meter.Reset(windowMs, packetsPerMs, c_bytesPerBlock);
+    Measure(meter, series, windowMs, 3 * SampleRateMeter::c_maxWindowMs + 500, name);
+}
+
+//
+// Until c_minWindowMs has elapsed there is no result. Then the elapsed time is
+// the window, so the first results are already close to the rate, and the
+// window is reported as filled once windowMs has elapsed.
+//
+static void TestStart()
+{
+    SampleRateMeter meter;
+    PACKET_SERIES   series{48000.0, 8, false, 0.0, 0, 0};
+    const ULONG     windowMs = 100;
+
+    meter.Reset(windowMs, series.PacketsPerMs, c_bytesPerBlock);
+    for (ULONG ms = 1; ms <= windowMs; ++ms)
+    {
+        bool updated = false;
+        for (ULONG packet = 0; packet < series.PacketsPerMs; ++packet)
+        {
+            updated = meter.Update(NextPacket(series));
+        }
+        HOST_TEST_EXPECT(updated == (ms >= SampleRateMeter::c_minWindowMs), "%u ms: updated %d", ms, (int)updated);
+        HOST_TEST_EXPECT(meter.IsWindowFilled() == (ms >= windowMs), "%u ms: window filled %d", ms, (int)meter.IsWindowFilled());
+        if (updated)
+        {
+            HOST_TEST_EXPECT(meter.GetSampleRate() == 48000, "%u ms: %u Hz", ms, meter.GetSampleRate());
+        }
+        else
+        {
+            HOST_TEST_EXPECT(meter.GetSampleRateQ16() == 0, "%u ms: a rate before the first result", ms);
+        }
+    }
+
+    // Reset() starts the measurement again.
+    meter.Reset(windowMs, series.PacketsPerMs, c_bytesPerBlock);
+    HOST_TEST_EXPECT(meter.GetSampleRateQ16() == 0, "a rate after Reset()");
+    HOST_TEST_EXPECT(!meter.IsWindowFilled(), "the window is filled after Reset()");
+}
+
+//
+// The rate changes after the ring of c_maxWindowMs + 1 entries has wrapped
+// several times. One window later, the result is the new rate.
+//
+static void TestRateChangeAfterWrap()
+{
+    SampleRateMeter meter;
+    PACKET_SERIES   series{48000.0, 8, true, 0.0, 0, 0};
+    const ULONG     windowMs = SampleRateMeter::c_maxWindowMs;
+
+    meter.Reset(windowMs, series.PacketsPerMs, c_bytesPerBlock);
+    Measure(meter, series, windowMs, 4 * windowMs + 321, "48 kHz before the change");
+
+    series.SampleRate = 48048.0;
+    for (ULONG ms = 0; ms < windowMs; ++ms)
+    {
+        for (ULONG packet = 0; packet < series.PacketsPerMs; ++packet)
+        {
+            meter.Update(NextPacket(series));
+        }
+        double rate = (double)meter.GetSampleRateQ16() / 65536.0;
+        HOST_TEST_EXPECT((rate > 47997.0) && (rate < 48051.0), "%u ms after the change: %.3f Hz", ms, rate);
+    }
+    Measure(meter, series, windowMs, 2 * windowMs, "48048 Hz after the change");
+}
+
+int main()
+{
+    TestRate(48000.0, 8, SampleRateMeter::c_maxWindowMs, false, "48 kHz, high speed");
+    TestRate(44100.0, 8, SampleRateMeter::c_maxWindowMs, false, "44.1 kHz, high speed");
+    TestRate(44100.0, 1, SampleRateMeter::c_maxWindowMs, false, "44.1 kHz, full speed");
+    TestRate(176400.0, 8, 250, false, "176.4 kHz, 250 ms window");
+    TestRate(44100.0, 8, SampleRateMeter::c_minWindowMs, false, "44.1 kHz, shortest window");
+    TestRate(48000.0 * 1.0002, 8, SampleRateMeter::c_maxWindowMs, true, "48 kHz +200 ppm, jitter");
+    TestRate(44100.0 * 0.9997, 1, 500, true, "44.1 kHz -300 ppm, full speed, jitter");
+    TestRate(768000.0, 8, SampleRateMeter::c_minWindowMs, true, "768 kHz, shortest window, jitter");
+    TestStart();
+    TestRateChangeAfterWrap();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,174 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    SimulatedUsbBus.cpp
+
+Abstract:
+
+    Implement a StreamPlatformBackend that runs the mixing engine thread on a
+    virtual clock against a simulated isochronous stream.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include "SimulatedUsbBus.h"
+
+SimulatedUsbBus::SimulatedUsbBus(
+    const SIMULATED_USB_BUS_CONFIG & config
+)
+    : m_config(config), m_irpPeriodUs(config.ClassicFramesPerIrp * 1000), m_random(0x9e3779b97f4a7c15ULL ^ config.Seed), m_nextTimerUs(config.TimerPeriodUs)
+{
+}
+
+ULONGLONG SimulatedUsbBus::QueryTimeUs()
+{
+    return m_nowUs;
+}
+
+ULONG SimulatedUsbBus::QueryUsbFrame()
+{
+    ULONG frame = (ULONG)(m_nowUs / 1000ULL);
+
+    if ((m_config.FrameSkipPerMille != 0) && (Random(1000) < m_config.FrameSkipPerMille))
+    {
+        // A bus time that jumps ahead, as returned by some host controllers after a frame skip.
+        ++m_numOfFrameSkips;
+        frame += 0x80;
+    }
+    return frame;
+}
+
+NTSTATUS SimulatedUsbBus::WaitForWakeUp(
+    MixingEngineThread * thread
+)
+{
+    (void)thread;
+
+    ULONGLONG eventUs = GetDpcTimeUs(m_completedIrps);
+    NTSTATUS  reason = STATUS_WAIT_1;
+
+    if ((m_config.TimerPeriodUs != 0) && (m_nextTimerUs < eventUs))
+    {
+        eventUs = m_nextTimerUs;
+        reason = STATUS_WAIT_2;
+    }
+    if ((m_deadlineUs != 0) && (m_deadlineUs < eventUs))
+    {
+        eventUs = m_deadlineUs;
+        reason = STATUS_WAIT_2;
+    }
+    if (m_wakeUp)
+    {
+        eventUs = m_nowUs;
+        reason = STATUS_WAIT_1;
+        m_wakeUp = false;
+    }
+
+    m_nowUs = max(eventUs + Random(m_config.ThreadJitterUs + 1), m_nowUs);
+
+    // The events that fired while the thread was not running wake it up only once.
+    while ((m_config.TimerPeriodUs != 0) && (m_nextTimerUs <= m_nowUs))
+    {
+        m_nextTimerUs += m_config.TimerPeriodUs;
+    }
+    if (m_deadlineUs <= m_nowUs)
+    {
+        m_deadlineUs = 0;
+    }
+    while (GetDpcTimeUs(m_completedIrps) <= m_nowUs)
+    {
+        ++m_completedIrps;
+    }
+
+    return reason;
+}
+
+void SimulatedUsbBus::WakeUp(
+    MixingEngineThread * thread
+)
+{
+    (void)thread;
+
+    m_wakeUp = true;
+}
+
+void SimulatedUsbBus::ArmWakeUp(
+    MixingEngineThread * thread,
+    ULONG                dueTimeUs
+)
+{
+    (void)thread;
+
+    m_deadlineUs = m_nowUs + dueTimeUs;
+}
+
+LONGLONG SimulatedUsbBus::GetInputCompletedPacket()
+{
+    return (LONGLONG)m_completedIrps * GetPacketsPerIrp();
+}
+
+LONGLONG SimulatedUsbBus::GetTransferredPacket() const
+{
+    return (LONGLONG)(m_nowUs * m_config.FramesPerMs / 1000ULL) + 1;
+}
+
+ULONG SimulatedUsbBus::GetPacketsPerIrp() const
+{
+    return m_config.ClassicFramesPerIrp * m_config.FramesPerMs;
+}
+
+ULONG SimulatedUsbBus::GetNumOfFrameSkips() const
+{
+    return m_numOfFrameSkips;
+}
+
+ULONG SimulatedUsbBus::Random(
+    ULONG range
+)
+{
+    // xorshift64*, so that a seed gives the same run on every host.
+    m_random ^= m_random >> 12;
+    m_random ^= m_random << 25;
+    m_random ^= m_random >> 27;
+    return (range <= 1) ? 0 : (ULONG)(((m_random * 0x2545f4914f6cdd1dULL) >> 32) % range);
+}
+
+ULONGLONG SimulatedUsbBus::GetDpcTimeUs(
+    ULONG irp
+)
+{
+    // Only the DPC times from the last completed IRP on are kept.
+    while ((m_firstDpc + 1 < m_completedIrps) && !m_dpcTimeUs.empty())
+    {
+        m_dpcTimeUs.pop_front();
+        ++m_firstDpc;
+    }
+    while (m_firstDpc + m_dpcTimeUs.size() <= irp)
+    {
+        ULONG     next = m_firstDpc + (ULONG)m_dpcTimeUs.size();
+        ULONGLONG dpcTimeUs = (ULONGLONG)(next + 1) * m_irpPeriodUs + m_config.DpcLatencyUs + Random(m_config.DpcJitterUs + 1);
+
+        if ((m_config.StallPerMille != 0) && (Random(1000) < m_config.StallPerMille))
+        {
+            dpcTimeUs += m_config.StallUs;
+        }
+        // The completions are delivered in order, so a stalled DPC also delays the ones after it.
+        if (!m_dpcTimeUs.empty())
+        {
+            dpcTimeUs = max(dpcTimeUs, m_dpcTimeUs.back());
+        }
+        m_dpcTimeUs.push_back(dpcTimeUs);
+    }
+    return m_dpcTimeUs[irp - m_firstDpc];
+}
@@ -0,0 +1,110 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    SimulatedUsbBus.h
+
+Abstract:
+
+    Define a StreamPlatformBackend that runs the mixing engine thread on a
+    virtual clock against a simulated isochronous stream.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#ifndef _SIMULATEDUSBBUS_H_
+#define _SIMULATEDUSBBUS_H_
+
+#include <deque>
+
+#include "StreamPlatform.h"
+
+typedef struct _SIMULATED_USB_BUS_CONFIG
+{
+    ULONG FramesPerMs{8};          // 8 for high speed, 1 for full speed
+    ULONG ClassicFramesPerIrp{1};  // Each IRP completes every ClassicFramesPerIrp ms
+    ULONG TimerPeriodUs{1000};     // Period of the wake-up timer, 0 to wake up on completions only
+    ULONG DpcLatencyUs{30};        // Delay from the end of an IRP to its completion DPC
+    ULONG DpcJitterUs{0};          // Additional uniform DPC delay, 0 to DpcJitterUs
+    ULONG ThreadJitterUs{0};       // Uniform delay from a wake-up to the thread running, 0 to ThreadJitterUs
+    ULONG StallPerMille{0};        // Probability of a DPC stall per IRP
+    ULONG StallUs{0};              // Length of a DPC stall
+    ULONG FrameSkipPerMille{0};    // Probability that QueryUsbFrame() returns a wrong frame number
+    ULONG Seed{1};
+} SIMULATED_USB_BUS_CONFIG;
+
+//
+// The bus transfers FramesPerMs packets per millisecond in both directions,
+// starting at time 0, so that packet n of the input and of the output stream
+// occupy the same (micro)frame. The input IRPs complete in order, each one
+// DPC latency after its last frame. WaitForWakeUp() advances the virtual clock
+// to the next completion or timer tick, plus the thread latency, and returns
+// STATUS_WAIT_1 or STATUS_WAIT_2 respectively.
+//
+class SimulatedUsbBus : public StreamPlatformBackend
+{
+  public:
+    explicit SimulatedUsbBus(
+        _In_ const SIMULATED_USB_BUS_CONFIG & config
+    );
+
+    ULONGLONG QueryTimeUs() override;
+
+    ULONG QueryUsbFrame() override;
+
+    NTSTATUS WaitForWakeUp(
+        _In_ MixingEngineThread * thread
+    ) override;
+
+    void WakeUp(
+        _In_ MixingEngineThread * thread
+    ) override;
+
+    void ArmWakeUp(
+        _In_ MixingEngineThread * thread,
+        _In_ ULONG                dueTimeUs
+    ) override;
+
+    // Input packets whose completion DPC has run by the current time.
+    LONGLONG GetInputCompletedPacket();
+
+    // Packets the bus has started to transfer by the current time.
+    LONGLONG GetTransferredPacket() const;
+
+    ULONG GetPacketsPerIrp() const;
+
+    ULONG GetNumOfFrameSkips() const;
+
+  private:
+    ULONG Random(
+        _In_ ULONG range
+    );
+
+    ULONGLONG GetDpcTimeUs(
+        _In_ ULONG irp
+    );
+
+    const SIMULATED_USB_BUS_CONFIG m_config;
+    const ULONG                    m_irpPeriodUs;
+    ULONGLONG                      m_random;
+    ULONGLONG                      m_nowUs{0};
+    ULONGLONG                      m_nextTimerUs;
+    ULONGLONG                      m_deadlineUs{0};
+    bool                           m_wakeUp{false};
+    ULONG                          m_firstDpc{0};         // Index of m_dpcTimeUs[0]
+    ULONG                          m_completedIrps{0};    // IRPs whose DPC has run by m_nowUs
+    std::deque<ULONGLONG>          m_dpcTimeUs;
+    ULONG                          m_numOfFrameSkips{0};
+};
+
+#endif
@@ -0,0 +1,143 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    StreamPlatformHost.cpp
+
+Abstract:
+
+    Implement the user-mode platform services of StreamPlatform.h: the backend
+    selection, the wall clock backend and the processor feature query.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include "StreamPlatform.h"
+
+static StreamPlatformSteadyClock g_SteadyClock;
+static StreamPlatformBackend *   g_Backend = &g_SteadyClock;
+static ULONGLONG                 g_ProcessorFeatureMask = ~0ULL;
+
+void StreamPlatform::SetBackend(
+    StreamPlatformBackend * backend
+)
+{
+    g_Backend = (backend != nullptr) ? backend : &g_SteadyClock;
+}
+
+void StreamPlatform::SetProcessorFeatures(
+    ULONGLONG processorFeatureMask
+)
+{
+    g_ProcessorFeatureMask = processorFeatureMask;
+}
+
+BOOLEAN ExIsProcessorFeaturePresent(
+    ULONG processorFeature
+)
+{
+    if ((processorFeature >= 64) || ((g_ProcessorFeatureMask & (1ULL << processorFeature)) == 0))
+    {
+        return false;
+    }
+#if defined(_M_X64) && (defined(__GNUC__) || defined(__clang__))
+    switch (processorFeature)
+    {
+    case PF_XMMI64_INSTRUCTIONS_AVAILABLE:
+        return __builtin_cpu_supports("sse2") != 0;
+    case PF_SSE4_1_INSTRUCTIONS_AVAILABLE:
+        return __builtin_cpu_supports("sse4.1") != 0;
+    case PF_AVX2_INSTRUCTIONS_AVAILABLE:
+        return __builtin_cpu_supports("avx2") != 0;
+    default:
+        return false;
+    }
+#elif defined(_M_X64)
+    // MSVC builds of the host tests run on processors that have AVX2.
+    return (processorFeature == PF_XMMI64_INSTRUCTIONS_AVAILABLE) || (processorFeature == PF_SSE4_1_INSTRUCTIONS_AVAILABLE) || (processorFeature == PF_AVX2_INSTRUCTIONS_AVAILABLE);
+#else
+    return false;
+#endif
+}
+
+StreamPlatformBackend * StreamPlatform::Backend()
+{
+    return g_Backend;
+}
+
+ULONGLONG StreamPlatformSteadyClock::QueryTimeUs()
+{
+    return (ULONGLONG)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_origin).count();
+}
+
+ULONG StreamPlatformSteadyClock::QueryUsbFrame()
+{
+    return (ULONG)(QueryTimeUs() / 1000ULL);
+}
+
+NTSTATUS StreamPlatformSteadyClock::WaitForWakeUp(
+    MixingEngineThread * thread
+)
+{
+    (void)thread;
+
+    std::unique_lock<std::mutex>                guard(m_mutex);
+    const std::chrono::steady_clock::time_point timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+
+    for (;;)
+    {
+        if (m_wakeUp)
+        {
+            m_wakeUp = false;
+            return STATUS_WAIT_1;
+        }
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= m_deadline)
+        {
+            m_deadline = (std::chrono::steady_clock::time_point::max)();
+            return STATUS_WAIT_2;
+        }
+        if (now >= timeout)
+        {
+            return STATUS_TIMEOUT;
+        }
+        m_condition.wait_until(guard, min(m_deadline, timeout));
+    }
+}
+
+void StreamPlatformSteadyClock::WakeUp(
+    MixingEngineThread * thread
+)
+{
+    (void)thread;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_wakeUp = true;
+    }
+    m_condition.notify_one();
+}
+
+void StreamPlatformSteadyClock::ArmWakeUp(
+    MixingEngineThread * thread,
+    ULONG                dueTimeUs
+)
+{
+    (void)thread;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(dueTimeUs);
+    }
+    m_condition.notify_one();
+}
@@ -0,0 +1,112 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    StreamPlatformTest.cpp
+
+Abstract:
+
+    Test the user-mode clock, wake-up, event and lock services of
+    StreamPlatform.h.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <thread>
+
+#include "StreamPlatform.h"
+#include "HostTest.h"
+
+static void TestClock()
+{
+    ULONGLONG qpcPosition = 0;
+    ULONGLONG startUs = StreamPlatform::QueryTimeUs(nullptr, &qpcPosition);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(3));
+
+    ULONGLONG endUs = StreamPlatform::QueryTimeUs(nullptr, nullptr);
+    HOST_TEST_EXPECT(endUs - startUs >= 3000, "%llu us elapsed", (unsigned long long)(endUs - startUs));
+    HOST_TEST_EXPECT(qpcPosition == startUs * 10, "qpc position %llu", (unsigned long long)qpcPosition);
+    HOST_TEST_EXPECT(StreamPlatform::QueryUsbFrame(nullptr) == (ULONG)(StreamPlatform::QueryTimeUs(nullptr, nullptr) / 1000), "USB frame is not the millisecond count");
+}
+
+static void TestWakeUp()
+{
+    StreamPlatform::WakeUp(nullptr);
+    HOST_TEST_EXPECT(StreamPlatform::WaitForWakeUp(nullptr) == STATUS_WAIT_1, "WakeUp() did not wake the thread");
+
+    ULONGLONG startUs = StreamPlatform::QueryTimeUs(nullptr, nullptr);
+    StreamPlatform::ArmWakeUp(nullptr, 2000);
+    HOST_TEST_EXPECT(StreamPlatform::WaitForWakeUp(nullptr) == STATUS_WAIT_2, "the deadline did not wake the thread");
+    HOST_TEST_EXPECT(StreamPlatform::QueryTimeUs(nullptr, nullptr) - startUs >= 2000, "woke up before the deadline");
+
+    std::thread waker([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        StreamPlatform::WakeUp(nullptr);
+    });
+    HOST_TEST_EXPECT(StreamPlatform::WaitForWakeUp(nullptr) == STATUS_WAIT_1, "WakeUp() from another thread did not wake the thread");
+    waker.join();
+}
+
+static void TestEvent()
+{
+    STREAM_PLATFORM_EVENT event;
+    StreamPlatform::InitializeEvent(event);
+
+    HOST_TEST_EXPECT(StreamPlatform::WaitForEvent(event, 1000) == STATUS_TIMEOUT, "an unsignaled event was satisfied");
+
+    StreamPlatform::SignalEvent(event);
+    HOST_TEST_EXPECT(StreamPlatform::WaitForEvent(event, 1000) == STATUS_SUCCESS, "a signaled event timed out");
+    // A synchronization event is reset by the wait that it satisfies.
+    HOST_TEST_EXPECT(StreamPlatform::WaitForEvent(event, 1000) == STATUS_TIMEOUT, "the event was not reset by the wait");
+
+    std::thread signaler([&event] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        StreamPlatform::SignalEvent(event);
+    });
+    HOST_TEST_EXPECT(StreamPlatform::WaitForEvent(event, 1000000) == STATUS_SUCCESS, "the event signaled from another thread timed out");
+    signaler.join();
+}
+
+static void TestLock()
+{
+    std::mutex           mutex;
+    STREAM_PLATFORM_LOCK lock = &mutex;
+    ULONG                counter = 0;
+    const ULONG          increments = 100000;
+
+    auto worker = [&] {
+        for (ULONG i = 0; i < increments; ++i)
+        {
+            StreamPlatform::AcquireLock(lock);
+            ++counter;
+            StreamPlatform::ReleaseLock(lock);
+        }
+    };
+    std::thread first(worker);
+    std::thread second(worker);
+    first.join();
+    second.join();
+
+    HOST_TEST_EXPECT(counter == increments * 2, "counter %u", counter);
+}
+
+int main()
+{
+    TestClock();
+    TestWakeUp();
+    TestEvent();
+    TestLock();
+
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,214 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    WakeupSchedulerTest.cpp
+
+Abstract:
+
+    Test WakeupScheduler. The due times of the late completion fallback, the
+    ASIO boundary and an unknown USB frame phase must follow the limits of
+    the scheduler. On a simulated clock with IRP completions, thread jitter
+    and a USB frame phase that the scheduler has to learn from the frame
+    numbers, the wakeups that it schedules must land just after the start
+    of a USB frame.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#include <random>
+
+#include "StreamPlatform.h"
+#include "WakeupScheduler.h"
+#include "HostTest.h"
+
+//
+// Exposes the limits and the predicted frame start to the test.
+//
+class WakeupSchedulerProbe : public WakeupScheduler
+{
+  public:
+    using WakeupScheduler::c_frameGuardUs;
+    using WakeupScheduler::c_minIntervalUs;
+    using WakeupScheduler::c_usbFrameUs;
+
+    ULONGLONG FrameStartUs() const
+    {
+        return m_frameStartUs;
+    }
+};
+
+static const ULONG c_irpPeriodUs = 4000;
+
+static void TestDueTimes()
+{
+    WakeupSchedulerProbe scheduler;
+    const ULONGLONG      now = 1000000ULL;
+
+    scheduler.Reset(10);
+    HOST_TEST_EXPECT(scheduler.CalculateNextWakeUp(now, 0ULL, false, 0, 48000) == WakeupSchedulerProbe::c_minIntervalUs, "a short IRP period is not raised to the minimum interval");
+
+    scheduler.Reset(c_irpPeriodUs);
+    ULONG dueTimeUs = scheduler.CalculateNextWakeUp(now, 0ULL, false, 0, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == c_irpPeriodUs, "due time %u without any event, expected the IRP period", dueTimeUs);
+
+    // The next completion is expected 1500us from now.
+    dueTimeUs = scheduler.CalculateNextWakeUp(now, now - (c_irpPeriodUs - 1500), false, 0, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == 1500 + WakeupSchedulerProbe::c_frameGuardUs, "due time %u for a completion in 1500us", dueTimeUs);
+
+    // The completion is late.
+    dueTimeUs = scheduler.CalculateNextWakeUp(now, now - c_irpPeriodUs - 200, false, 0, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == WakeupSchedulerProbe::c_usbFrameUs, "due time %u for a late completion, expected a USB frame", dueTimeUs);
+
+    // The USB frame phase is not known yet.
+    dueTimeUs = scheduler.CalculateNextWakeUp(now, 0ULL, true, 0, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == WakeupSchedulerProbe::c_minIntervalUs, "due time %u with pending packets and an unknown frame phase", dueTimeUs);
+
+    // The ASIO boundary, 48 samples away at 48kHz.
+    dueTimeUs = scheduler.CalculateNextWakeUp(now, 0ULL, false, 48, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == 1000, "due time %u for the ASIO boundary in 1000us", dueTimeUs);
+
+    // A boundary closer than the minimum interval, a far one, and a passed one.
+    dueTimeUs = scheduler.CalculateNextWakeUp(now, 0ULL, false, 2, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == WakeupSchedulerProbe::c_minIntervalUs, "due time %u for the ASIO boundary in 41us", dueTimeUs);
+    dueTimeUs = scheduler.CalculateNextWakeUp(now, 0ULL, false, 48000, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == c_irpPeriodUs, "due time %u for the ASIO boundary in 1s", dueTimeUs);
+    dueTimeUs = scheduler.CalculateNextWakeUp(now, 0ULL, false, -16, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == c_irpPeriodUs, "due time %u for a passed ASIO boundary", dueTimeUs);
+    dueTimeUs = scheduler.CalculateNextWakeUp(now, 0ULL, false, 48, 0);
+    HOST_TEST_EXPECT(dueTimeUs == c_irpPeriodUs, "due time %u without a sample rate", dueTimeUs);
+}
+
+static void TestFramePhase()
+{
+    WakeupSchedulerProbe scheduler;
+    scheduler.Reset(c_irpPeriodUs);
+
+    // Two wakeups in the same frame say nothing about its start.
+    scheduler.RecordWakeUp(100200ULL, 100, true);
+    scheduler.RecordWakeUp(100700ULL, 100, false);
+    HOST_TEST_EXPECT(scheduler.FrameStartUs() == 0ULL, "frame start %llu before a frame change", (unsigned long long)scheduler.FrameStartUs());
+
+    // The frame changes between 100700us and 101500us.
+    scheduler.RecordWakeUp(101500ULL, 101, true);
+    HOST_TEST_EXPECT(scheduler.FrameStartUs() == 101100ULL, "frame start %llu, expected the middle of the window", (unsigned long long)scheduler.FrameStartUs());
+
+    // A frame change that agrees with the prediction keeps it.
+    scheduler.RecordWakeUp(102000ULL, 101, false);
+    scheduler.RecordWakeUp(102300ULL, 102, true);
+    HOST_TEST_EXPECT(scheduler.FrameStartUs() == 101100ULL, "frame start %llu moved by a consistent frame change", (unsigned long long)scheduler.FrameStartUs());
+
+    // The next frame is due at 103100us, plus the guard.
+    ULONG dueTimeUs = scheduler.CalculateNextWakeUp(102300ULL, 0ULL, true, 0, 48000);
+    HOST_TEST_EXPECT(dueTimeUs == 800 + WakeupSchedulerProbe::c_frameGuardUs, "due time %u for the next frame", dueTimeUs);
+
+    // A frame change outside of the window moves the predicted phase, one in it does not.
+    scheduler.RecordWakeUp(103050ULL, 102, false);
+    scheduler.RecordWakeUp(103250ULL, 103, true);
+    HOST_TEST_EXPECT(scheduler.FrameStartUs() == 101100ULL, "frame start %llu moved by a frame change in its window", (unsigned long long)scheduler.FrameStartUs());
+    scheduler.RecordWakeUp(104150ULL, 103, false);
+    scheduler.RecordWakeUp(104400ULL, 104, true);
+    HOST_TEST_EXPECT(scheduler.FrameStartUs() == 104275ULL, "frame start %llu, expected the middle of the window after a phase change", (unsigned long long)scheduler.FrameStartUs());
+}
+
+//
+// The USB frames start at c_framePhaseUs modulo 1ms. The IRPs complete every
+// c_irpPeriodUs at another phase with some jitter, and wake the thread up
+// as the completion routine does. Between them, the thread sleeps for the
+// due time of the scheduler plus the jitter of the timer.
+//
+static void TestSimulation(
+    ULONG maxTimerJitterUs
+)
+{
+    static const ULONGLONG c_startUs = 1000000ULL;
+    static const ULONGLONG c_durationUs = 2000000ULL;
+    static const ULONGLONG c_warmUpUs = 100000ULL;
+    static const ULONG     c_framePhaseUs = 337;
+    static const ULONG     c_completionPhaseUs = 1234;
+
+    std::mt19937         random(maxTimerJitterUs + 1);
+    WakeupSchedulerProbe scheduler;
+    scheduler.Reset(c_irpPeriodUs);
+
+    ULONGLONG now = c_startUs;
+    ULONGLONG nextCompletionUs = c_startUs + c_completionPhaseUs;
+    ULONGLONG lastCompletionUs = 0ULL;
+    ULONG     lastBusTime = 0;
+    ULONG     scheduledWakeUps = 0;
+    ULONG     missedFrames = 0;
+    ULONGLONG totalDelayUs = 0ULL;
+    ULONGLONG maxDelayUs = 0ULL;
+    bool      scheduled = false;
+
+    while (now < c_startUs + c_durationUs)
+    {
+        ULONG busTime = (ULONG)((now - c_framePhaseUs) / WakeupSchedulerProbe::c_usbFrameUs);
+        bool  useful = (busTime != lastBusTime);
+
+        if (scheduled && (now >= c_startUs + c_warmUpUs))
+        {
+            // A scheduled wakeup must see the frame that started just before it.
+            ULONGLONG frameStartUs = (ULONGLONG)busTime * WakeupSchedulerProbe::c_usbFrameUs + c_framePhaseUs;
+            ULONGLONG delayUs = now - frameStartUs;
+            ++scheduledWakeUps;
+            missedFrames += useful ? 0 : 1;
+            totalDelayUs += delayUs;
+            maxDelayUs = max(maxDelayUs, delayUs);
+        }
+
+        scheduler.RecordWakeUp(now, busTime, useful);
+        lastBusTime = busTime;
+
+        ULONG     dueTimeUs = scheduler.CalculateNextWakeUp(now, lastCompletionUs, true, 0, 48000);
+        ULONGLONG timerUs = now + dueTimeUs + ((maxTimerJitterUs != 0) ? (random() % maxTimerJitterUs) : 0);
+        if (nextCompletionUs <= timerUs)
+        {
+            now = max(now + 1, nextCompletionUs);
+            lastCompletionUs = nextCompletionUs;
+            nextCompletionUs += c_irpPeriodUs + (random() % 61) - 30;
+            scheduled = false;
+        }
+        else
+        {
+            now = timerUs;
+            scheduled = true;
+        }
+    }
+
+    ULONGLONG frameStartUs = scheduler.FrameStartUs();
+    LONG      phaseErrorUs = (LONG)((frameStartUs + WakeupSchedulerProbe::c_usbFrameUs - c_framePhaseUs) % WakeupSchedulerProbe::c_usbFrameUs);
+    if (phaseErrorUs > (LONG)WakeupSchedulerProbe::c_usbFrameUs / 2)
+    {
+        phaseErrorUs -= WakeupSchedulerProbe::c_usbFrameUs;
+    }
+    ULONG averageDelayUs = (scheduledWakeUps != 0) ? (ULONG)(totalDelayUs / scheduledWakeUps) : 0;
+
+    printf("timer jitter %3uus: %u scheduled wakeups, %u missed a frame, delay after the frame start average %uus, max %lluus, phase error %dus\n", maxTimerJitterUs, scheduledWakeUps, missedFrames, averageDelayUs, (unsigned long long)maxDelayUs, phaseErrorUs);
+
+    HOST_TEST_EXPECT(scheduledWakeUps > 1000, "%u scheduled wakeups", scheduledWakeUps);
+    HOST_TEST_EXPECT(missedFrames * 50 <= scheduledWakeUps, "jitter %u: %u of %u scheduled wakeups saw no new frame", maxTimerJitterUs, missedFrames, scheduledWakeUps);
+    HOST_TEST_EXPECT(averageDelayUs <= WakeupSchedulerProbe::c_frameGuardUs + maxTimerJitterUs / 2 + 100, "jitter %u: the wakeups are %uus after the frame start on average", maxTimerJitterUs, averageDelayUs);
+    HOST_TEST_EXPECT((phaseErrorUs >= -100) && (phaseErrorUs <= 100), "jitter %u: the predicted frame start is %dus off", maxTimerJitterUs, phaseErrorUs);
+}
+
+int main()
+{
+    TestDueTimes();
+    TestFramePhase();
+    TestSimulation(0);
+    TestSimulation(20);
+    TestSimulation(80);
+
+    return HOST_TEST_RESULT();
+}
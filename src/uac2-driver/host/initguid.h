@@ -0,0 +1,31 @@
+﻿// Copyright (c) Yamaha Corporation.
+// Licensed under the MIT License
+// ============================================================================
+// This is part of the Microsoft Low-Latency Audio driver project.
+// Further information: https://aka.ms/asio
+// ============================================================================
+
+/*++
+
+Module Name:
+
+    initguid.h
+
+Abstract:
+
+    Define DEFINE_GUID for the host build, in place of the header of the
+    Windows SDK, so that UAC_User.h can be included by StreamPlatform.h.
+
+Environment:
+
+    User mode (STREAM_PLATFORM_HOST)
+
+--*/
+
+#ifndef _HOST_INITGUID_H_
+#define _HOST_INITGUID_H_
+
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    inline constexpr GUID name = {l, w1, w2, {b1, b2, b3, b4, b5, b6, b7, b8}}
+
+#endif